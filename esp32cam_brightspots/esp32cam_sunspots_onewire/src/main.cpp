@@ -1,6 +1,7 @@
 
 #include "esp_camera.h"         // https://github.com/espressif/esp32-camera
 #include <Arduino.h>
+#include <light_link.h>
 
 #define CAMERA_MODEL_AI_THINKER // Has PSRAM
 #include "camera_pins.h"
@@ -11,8 +12,12 @@
 //#include <C:\Users\10PRO\esp\esp-idf\components\esp32-camera\target\private_include\ll_cam.h>
 //#include <C:\Users\10PRO\esp\esp-idf\components\esp32-camera\sensors\private_include\ov2640_regs.h>
 //
+LightLinkParser linkParser;
+
 void setup() {
-  Serial.begin(921600);
+  // Same UART goes to the LCD board
+  Serial.begin(LIGHT_LINK_BAUD);
+  LightLinkInit(&linkParser);
 
 
   camera_config_t config;
@@ -94,8 +99,87 @@ uint8_t bufs_idx = 0;
 uint8_t bufs_size = 0;
 
 
+// Shape of the bright blob found at the first saturated pixel, from its
+// moments, so streaks go out as ellipses instead of as whatever disc the LCD
+// would have to draw around them. The first hit in row order is the top of
+// the blob, so the window hangs down from it.
+#define BLOB_THRESHOLD 255
+#define BLOB_WINDOW 32
+#define BLOB_PAD 1 // pixels around the blob's edge
+#define BLOB_MIN_MAJOR 4 // Smaller or rounder than this and the LCD's default disc is fine
+#define BLOB_MIN_ELONGATION 1.5f
+
+// Returns false if it's close enough to round to send as a plain point
+bool BlobEllipse(const uint8_t *buf, uint16_t seedX, uint16_t seedY, uint16_t *x, uint16_t *y, uint16_t *major,
+                 uint16_t *minor, uint16_t *angle) {
+  int16_t x0 = max(0, (int16_t)seedX - BLOB_WINDOW / 2);
+  int16_t x1 = min((int16_t)width, (int16_t)(seedX + BLOB_WINDOW / 2));
+  int16_t y1 = min((int16_t)height, (int16_t)(seedY + BLOB_WINDOW));
+  uint32_t n = 0;
+  int32_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+  for (int16_t row = seedY; row < y1; row++) {
+    const uint8_t *line = &buf[row * width];
+    for (int16_t col = x0; col < x1; col++) {
+      if (line[col] >= BLOB_THRESHOLD) {
+        // Relative to the seed so the sums stay small
+        int32_t u = col - seedX;
+        int32_t v = row - seedY;
+        n++;
+        sx += u;
+        sy += v;
+        sxx += u * u;
+        syy += v * v;
+        sxy += u * v;
+      }
+    }
+  }
+  float cx = (float)sx / n;
+  float cy = (float)sy / n;
+  *x = (uint16_t)lroundf(seedX + cx);
+  *y = (uint16_t)lroundf(seedY + cy);
+
+  // Covariance -> axes. A solid ellipse has variance (semi-axis / 2)^2 along each axis.
+  float a = (float)sxx / n - cx * cx;
+  float b = (float)sxy / n - cx * cy;
+  float c = (float)syy / n - cy * cy;
+  float mid = (a + c) / 2;
+  float spread = sqrtf((a - c) * (a - c) / 4 + b * b);
+  float big = 2 * sqrtf(mid + spread) + BLOB_PAD;
+  float small = 2 * sqrtf(max(0.0f, mid - spread)) + BLOB_PAD;
+  if (big < BLOB_MIN_MAJOR || big < small * BLOB_MIN_ELONGATION) {
+    return false;
+  }
+  // 256 = half a turn, same as the LCD's struct Light
+  float theta = 0.5f * atan2f(2 * b, a - c);
+  *major = (uint16_t)ceilf(big);
+  *minor = (uint16_t)ceilf(small);
+  *angle = (uint16_t)lroundf(theta * 256 / (float)M_PI) & 0xFF;
+  return true;
+}
+
+// Answer LCD clock sync requests right away so they don't sit in the RX
+// buffer for a whole frame. See time_sync.h
+void PollSyncRequests() {
+  LightLinkMessage message;
+  char line[LIGHT_LINK_MAX_LINE_BYTES];
+  uint8_t lineLength = 0;
+
+  while (Serial.available() > 0) {
+    if (LightLinkFeed(&linkParser, Serial.read(), &message) != LINK_SYNC_REQUEST) {
+      continue;
+    }
+    uint32_t t2 = micros();
+    // Let any light lines ahead of us drain so t3 is when the reply really goes out
+    Serial.flush();
+    uint32_t t3 = micros() + LightLinkWireUs(LIGHT_LINK_SYNC_REPLY_BYTES);
+    lineLength = LightLinkFormatSyncReply(line, message.t[0], t2, t3);
+    Serial.write((const uint8_t *)line, lineLength);
+  }
+}
+
 unsigned long lastMillis = 0;
 void loop() {
+  PollSyncRequests();
   if (millis() - lastMillis < 10) {
     return;
   }
@@ -136,6 +220,10 @@ void loop() {
   uint16_t x = 0;
   uint16_t y = 0;
   uint16_t index = 0;
+  // Buffers are being continuously filled by DMA, so "now" is close enough
+  uint32_t captureUs = micros();
+  char line[LIGHT_LINK_MAX_LINE_BYTES];
+  uint8_t lineLength = 0;
 
   while (index < width * height) {
     //Serial.printf("%d\n", index);
@@ -148,10 +236,19 @@ void loop() {
 
 BreakLoop:
   if (index < width * height) {
+    uint16_t major, minor, angle;
     x = index % width;
-    y = index / height;
-    Serial.printf("%d %d;\n", x, y);
+    y = index / width;
+    if (BlobEllipse(bufs[bufs_idx], x, y, &x, &y, &major, &minor, &angle)) {
+      lineLength = LightLinkFormatEllipse(line, x, y, major, minor, angle, 255);
+    } else {
+      lineLength = LightLinkFormatLight(line, x, y);
+    }
+    Serial.write((const uint8_t *)line, lineLength);
   }
+  // Tell the LCD this frame is done so it can draw right away
+  lineLength = LightLinkFormatTimedFrameEnd(line, captureUs);
+  Serial.write((const uint8_t *)line, lineLength);
 
   
   
@@ -161,7 +258,8 @@ BreakLoop:
   bufs_idx = (bufs_idx + 1) % bufs_max_size;
 
   //Serial.printf("FPS: %d, %d\n", 1000/(millis() - lastMillis + 1), millis());
-  Serial.printf("%d\n", millis());
+  // Would be thrown away as a bad line on the LCD side
+  //Serial.printf("%d\n", millis());
   lastMillis = millis();
 
 
@@ -0,0 +1,187 @@
+/*
+  Calibration blobs from fit_radial.py --blob through the LCD's own
+  calibration.cpp: CalibrationCheck(), CalibrationApply() and a save / load
+  round trip through NVS (host_shims/Preferences.h, in memory).
+
+  Each blob has to pass the check and map every camera pixel the way the
+  lens it was fit to does. That's fit_radial.py --synthetic's: the old
+  offsets (mirrored, 110, 75) behind a radial lens with --k1. Radial is held
+  to 0.1 LCD px of it, the grid to 0.3 px (bilinear between 16 px cells, the
+  same 0.288 px dewarp_check gets at k1 -0.12), offsets to exactly the old
+  offsets. Then
+  copies of the blob with one thing wrong each have to be refused, for the
+  right reason: a flipped byte (CRC), magic, version, size, another camera's
+  sensor profile and an unknown transform (both with the CRC fixed up, so
+  it's the field that gets them refused).
+
+  Build + run:
+    g++ -O2 -std=c++11 -Ihost_shims -I../lcd_graphical_esp32_arduino_poc/include calibration_check.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/calibration.cpp ../lcd_graphical_esp32_arduino_poc/src/dewarp.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/radial.cpp -o calibration_check
+    for t in offsets grid radial; do
+      python3 fit_radial.py --synthetic -0.12 --blob $t.bin --transform $t
+    done
+    ./calibration_check --k1 -0.12 offsets.bin grid.bin radial.bin
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include <Preferences.h>
+
+#include "calibration.h"
+
+// fit_radial.py's lens and DEFAULT_H
+#define LENS_RADIUS 100.0
+#define MAX_GRID_ERROR_PX 0.3
+#define MAX_RADIAL_ERROR_PX 0.1
+
+static double k1 = 0;
+
+static void ModelPoint(double x, double y, double *lcdX, double *lcdY) {
+  double dx = x - DEWARP_CAMERA_WIDTH / 2;
+  double dy = y - DEWARP_CAMERA_HEIGHT / 2;
+  double k = 1 + k1 * (dx * dx + dy * dy) / (LENS_RADIUS * LENS_RADIUS);
+  *lcdX = -dx * k + 110 - DEWARP_CAMERA_WIDTH / 2;
+  *lcdY = dy * k + 75 + DEWARP_CAMERA_HEIGHT / 2;
+}
+
+// Worst distance from the model over every camera pixel, LCD px
+static double MappingError(const struct EyeCalibration *eye) {
+  double worst = 0;
+  for (int y = 0; y < DEWARP_CAMERA_HEIGHT; y++) {
+    for (int x = 0; x < DEWARP_CAMERA_WIDTH; x++) {
+      int32_t lx, ly;
+      double mx, my;
+      if (eye->radial != NULL) {
+        RadialToLCD(eye->radial, x, y, &lx, &ly);
+        ModelPoint(x, y, &mx, &my);
+      } else if (eye->dewarp != NULL) {
+        Dewarp(eye->dewarp, x, y, &lx, &ly);
+        ModelPoint(x, y, &mx, &my);
+      } else {
+        lx = (eye->xSign * x + eye->xOffset) * 256;
+        ly = (y + eye->yOffset) * 256;
+        mx = 110 - x;
+        my = y + 75;
+      }
+      worst = fmax(worst, hypot(lx / 256.0 - mx, ly / 256.0 - my));
+    }
+  }
+  return worst;
+}
+
+static void FixCrc(struct CalibrationBlob *blob) {
+  size_t crcStart = offsetof(struct CalibrationBlob, crc) + sizeof(blob->crc);
+  blob->crc = CalibrationCrc((const uint8_t *)blob + crcStart, sizeof(*blob) - crcStart);
+}
+
+// A copy with one thing wrong has to be refused with this reason
+static bool Refused(const char *what, const struct CalibrationBlob *good, void (*spoil)(struct CalibrationBlob *),
+                    size_t size, const char *want) {
+  static struct CalibrationBlob bad;
+  bad = *good;
+  spoil(&bad);
+  const char *got = CalibrationCheck(&bad, size);
+  bool ok = got != NULL && strcmp(got, want) == 0;
+  printf("  %-22s %-24s%s\n", what, got != NULL ? got : "accepted", ok ? "" : "  <- WRONG");
+  return ok;
+}
+
+static bool CheckBlob(const char *path) {
+  static struct CalibrationBlob blob;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    printf("%s: can't open\n", path);
+    return false;
+  }
+  size_t size = fread(&blob, 1, sizeof(blob), f);
+  bool trailing = fgetc(f) != EOF;
+  fclose(f);
+  if (trailing) {
+    printf("%s: bigger than a CalibrationBlob (%zu bytes)\n", path, sizeof(blob));
+    return false;
+  }
+
+  const char *why = CalibrationCheck(&blob, size);
+  printf("%s: %zu bytes, user \"%.*s\", %s\n", path, size, CALIBRATION_USER_CHARS, blob.user,
+         why != NULL ? why : "usable");
+  if (why != NULL) {
+    return false;
+  }
+
+  bool ok = true;
+  static const char *const transforms[] = {"offsets", "grid", "radial"};
+  struct EyeCalibration eyes[NUM_EYES];
+  struct RadialTransform radial[NUM_EYES];
+  CalibrationApply(&blob, eyes, radial);
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    double error = MappingError(&eyes[eye]);
+    uint8_t transform = blob.eyes[eye].transform;
+    bool good = transform == CALIBRATION_RADIAL ? error <= MAX_RADIAL_ERROR_PX
+              : transform == CALIBRATION_GRID   ? error <= MAX_GRID_ERROR_PX
+                                                : error == 0;
+    printf("  eye %d: %-7s contrast %3u, max %.3f px from the lens%s\n", eye, transforms[transform],
+           eyes[eye].contrast, error, good ? "" : "  <- WRONG");
+    ok &= good;
+  }
+
+  // Saved and read back the way setup() does
+  struct CalibrationBlob loaded;
+  bool roundTrip = CalibrationSave(&blob) && CalibrationLoad(&loaded) && memcmp(&loaded, &blob, sizeof(blob)) == 0;
+  printf("  NVS save / load        %s\n", roundTrip ? "same" : "DIFFERENT");
+  ok &= roundTrip;
+  std::vector<uint8_t> *stored = Preferences::HostEntry("headlight", "calib");
+  (*stored)[stored->size() / 2] ^= 0x10;
+  bool refused = !CalibrationLoad(&loaded);
+  printf("  NVS flipped byte       %s\n", refused ? "not loaded" : "LOADED");
+  ok &= refused;
+
+  ok &= Refused("flipped byte", &blob, [](struct CalibrationBlob *b) { b->eyes[1].grid.x[2][3] ^= 1; }, size,
+                "bad CRC");
+  ok &= Refused("magic", &blob, [](struct CalibrationBlob *b) { b->magic ^= 0x20; }, size, "not a calibration");
+  ok &= Refused("short", &blob, [](struct CalibrationBlob *) {}, size - 1, "not a calibration");
+  ok &= Refused("version", &blob, [](struct CalibrationBlob *b) { b->version++; }, size, "wrong version");
+  ok &= Refused("size field", &blob, [](struct CalibrationBlob *b) { b->size--; }, size, "wrong version");
+  ok &= Refused("camera width", &blob,
+                [](struct CalibrationBlob *b) {
+                  b->cameraWidth = 320;
+                  FixCrc(b);
+                },
+                size, "made for another camera");
+  ok &= Refused("grid rows", &blob,
+                [](struct CalibrationBlob *b) {
+                  b->gridRows++;
+                  FixCrc(b);
+                },
+                size, "made for another camera");
+  ok &= Refused("transform", &blob,
+                [](struct CalibrationBlob *b) {
+                  b->eyes[0].transform = CALIBRATION_RADIAL + 1;
+                  FixCrc(b);
+                },
+                size, "unknown transform");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  int blobs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--k1") && i + 1 < argc) {
+      k1 = atof(argv[++i]);
+      continue;
+    }
+    ok &= CheckBlob(argv[i]);
+    blobs++;
+  }
+  if (blobs == 0) {
+    printf("calibration_check [--k1 K1] blob...\n");
+    return 1;
+  }
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+'''
+Sends a calibration blob (fit_radial.py --blob) to the LCD over USB serial.
+It gets checked, saved to NVS and used straight away, no reflashing, see
+lcd_graphical_esp32_arduino_poc calibration.h.
+
+  python3 calibration_upload.py /dev/ttyACM0 alice.bin
+
+Needs pyserial (pip install pyserial).
+'''
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+# calibration.h
+MAGIC = 0x43424C48
+VERSION = 1
+HEADER = struct.Struct('<IHHI')
+BAUD = 921600
+
+
+def check(blob):
+    magic, version, size, crc = HEADER.unpack_from(blob)
+    if magic != MAGIC:
+        return 'not a calibration blob'
+    if version != VERSION:
+        return 'version %d, this tool sends %d' % (version, VERSION)
+    if size != len(blob):
+        return 'says %d bytes, file has %d' % (size, len(blob))
+    if zlib.crc32(blob[HEADER.size:]) & 0xFFFFFFFF != crc:
+        return 'bad CRC'
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Send a calibration blob to the LCD')
+    parser.add_argument('port')
+    parser.add_argument('blob')
+    parser.add_argument('--baud', type=int, default=BAUD)
+    parser.add_argument('--timeout', type=float, default=3.0, help='s to wait for the reply')
+    args = parser.parse_args()
+
+    blob = open(args.blob, 'rb').read()
+    problem = check(blob)
+    if problem:
+        sys.exit('%s: %s' % (args.blob, problem))
+    try:
+        import serial
+    except ImportError:
+        sys.exit('needs pyserial: pip install pyserial')
+
+    with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+        port.reset_input_buffer()
+        port.write(b'C' + struct.pack('<I', len(blob)) + blob)
+        port.flush()
+        # Everything else the LCD prints goes by too, wait for ours
+        deadline = time.time() + args.timeout
+        while time.time() < deadline:
+            line = port.readline().decode(errors='replace').strip()
+            if line.startswith('Calibration:'):
+                print(line)
+                sys.exit(0 if 'saved' in line else 1)
+    sys.exit('no reply from the LCD')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,318 @@
+/*
+  Camera -> LCD dewarp grids for the LCD firmware (lcd_graphical_esp32_arduino_poc
+  dewarp.cpp): generates them, and checks the fixed point bilinear lookup
+  against the float model they come from.
+
+  The model is the eye's calibration (mirror, scale, offsets, as in main.cpp)
+  after a radial lens correction about the middle of the camera:
+    r = distance from center / LENS_RADIUS
+    undistorted = center + (p - center) * (1 + k1 r^2 + k2 r^4)
+  k1 < 0 pulls the corners in (barrel lens), k1 > 0 pushes them out.
+
+  Every camera pixel goes through Dewarp(), RadialToLCD() (radial.cpp, the
+  r^2 tables fit_radial.py writes) and the float model, for a few lenses, and
+  the error is reported before and after rounding to LCD pixels. Then cycles
+  per point for both, against the plain offsets and the float model.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../lcd_graphical_esp32_arduino_poc/include dewarp_check.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/dewarp.cpp ../lcd_graphical_esp32_arduino_poc/src/radial.cpp \
+      -o dewarp_check
+    ./dewarp_check
+    ./dewarp_check --k1 -0.12 --emit ../lcd_graphical_esp32_arduino_poc/include/dewarp_table.h
+
+  --emit writes the grids the firmware builds with, for the given lens and
+  scale. From measured points, fit_radial.py writes them instead (and the
+  r^2 tables). The checked in ones are k1 = k2 = 0 and scale 1, the same
+  mapping as the old offsets, until the lens gets measured.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "dewarp.h"
+#include "radial.h"
+
+#define NUM_EYES 2
+static const char *const eyeNames[NUM_EYES] = {"left", "right"};
+#define LENS_CENTER_X (DEWARP_CAMERA_WIDTH / 2.0)
+#define LENS_CENTER_Y (DEWARP_CAMERA_HEIGHT / 2.0)
+#define LENS_RADIUS 100.0 // Camera pixels, center to corner
+
+struct Model {
+  int xSign;
+  double xOffset;
+  double yOffset;
+  double scale;
+  double k1;
+  double k2;
+};
+
+// Same as main.cpp's eyeCalibration
+static const struct Model eyeModels[NUM_EYES] = {
+  {-1, 110, 75, 1, 0, 0},
+  {-1, 110, 75, 1, 0, 0},
+};
+
+static void ModelPoint(const struct Model *m, double x, double y, double *lcdX, double *lcdY) {
+  double dx = x - LENS_CENTER_X;
+  double dy = y - LENS_CENTER_Y;
+  double r2 = (dx * dx + dy * dy) / (LENS_RADIUS * LENS_RADIUS);
+  double k = 1 + m->k1 * r2 + m->k2 * r2 * r2;
+  double ux = LENS_CENTER_X + dx * k;
+  double uy = LENS_CENTER_Y + dy * k;
+  *lcdX = m->xSign * ux * m->scale + m->xOffset;
+  *lcdY = uy * m->scale + m->yOffset;
+}
+
+static void BuildGrid(const struct Model *m, struct DewarpGrid *grid) {
+  for (int row = 0; row < DEWARP_ROWS; row++) {
+    for (int col = 0; col < DEWARP_COLS; col++) {
+      double x, y;
+      ModelPoint(m, col * DEWARP_CELL, row * DEWARP_CELL, &x, &y);
+      grid->x[row][col] = (int32_t)lround(x * (1 << DEWARP_FRACTION_BITS));
+      grid->y[row][col] = (int32_t)lround(y * (1 << DEWARP_FRACTION_BITS));
+    }
+  }
+}
+
+// Same table and homography fit_radial.py would write for this model
+static void BuildRadial(const struct Model *m, uint16_t *scale, struct RadialTransform *t) {
+  double half = (1 << RADIAL_R2_SHIFT) / 2.0;
+  for (int i = 0; i < RADIAL_TABLE_SIZE; i++) {
+    double r2 = ((i << RADIAL_R2_SHIFT) + half) / (LENS_RADIUS * LENS_RADIUS);
+    scale[i] = (uint16_t)lround((1 + m->k1 * r2 + m->k2 * r2 * r2) * (1 << RADIAL_SCALE_BITS));
+  }
+  t->centerX = (int16_t)LENS_CENTER_X;
+  t->centerY = (int16_t)LENS_CENTER_Y;
+  t->scale = scale;
+  // Centered in, so the offsets take the center along
+  double h[6] = {m->xSign * m->scale, 0, m->xSign * m->scale * LENS_CENTER_X + m->xOffset,
+                 0, m->scale, m->scale * LENS_CENTER_Y + m->yOffset};
+  for (int i = 0; i < 6; i++) {
+    t->h[i] = (int32_t)lround(h[i] * 65536);
+  }
+  t->h[6] = 0;
+  t->h[7] = 0;
+  t->projective = false;
+}
+
+static void EmitGrid(FILE *f, const char *name, const int32_t (*v)[DEWARP_COLS]) {
+  fprintf(f, "    // %s\n    {\n", name);
+  for (int row = 0; row < DEWARP_ROWS; row++) {
+    fprintf(f, "      {");
+    for (int col = 0; col < DEWARP_COLS; col++) {
+      fprintf(f, "%s%d", col ? ", " : "", v[row][col]);
+    }
+    fprintf(f, "},\n");
+  }
+  fprintf(f, "    },\n");
+}
+
+static int Emit(const char *path, const struct Model *models) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  fprintf(f, "#pragma once\n\n");
+  fprintf(f, "// Generated by host_tools/dewarp_check.cpp --emit, don't edit by hand.\n");
+  fprintf(f, "// Lens k1 %g, k2 %g about (%g, %g), radius %g. Scale %g.\n", models[0].k1, models[0].k2,
+          LENS_CENTER_X, LENS_CENTER_Y, LENS_RADIUS, models[0].scale);
+  fprintf(f, "// Only include from one file, it's the definition.\n\n");
+  fprintf(f, "#include \"dewarp.h\"\n#include \"eyes.h\"\n\n");
+  fprintf(f, "static const struct DewarpGrid dewarpGrids[NUM_EYES] = {\n");
+  for (int eye = 0; eye < NUM_EYES; eye++) {
+    struct DewarpGrid grid;
+    BuildGrid(&models[eye], &grid);
+    fprintf(f, "  // %s: xSign %d, xOffset %g, yOffset %g\n  {\n", eyeNames[eye], models[eye].xSign,
+            models[eye].xOffset, models[eye].yOffset);
+    EmitGrid(f, "x", grid.x);
+    EmitGrid(f, "y", grid.y);
+    fprintf(f, "  },\n");
+  }
+  fprintf(f, "};\n");
+  fclose(f);
+  printf("wrote %s\n", path);
+  return 0;
+}
+
+// Every camera pixel, plus a margin past the edges where extrapolated lights
+// can end up
+template <typename F>
+static bool Accuracy(const struct Model *m, const char *title, F transform) {
+  double maxError = 0;
+  double sumError = 0;
+  double maxEdgeError = 0;
+  uint32_t points = 0;
+  uint32_t offByOne = 0;
+  uint32_t worse = 0;
+  for (int y = -8; y < DEWARP_CAMERA_HEIGHT + 8; y++) {
+    for (int x = -8; x < DEWARP_CAMERA_WIDTH + 8; x++) {
+      double wantX, wantY;
+      int32_t gotX, gotY;
+      ModelPoint(m, x, y, &wantX, &wantY);
+      transform((int16_t)x, (int16_t)y, &gotX, &gotY);
+      double ex = gotX / 256.0 - wantX;
+      double ey = gotY / 256.0 - wantY;
+      double e = sqrt(ex * ex + ey * ey);
+      bool inside = x >= 0 && y >= 0 && x < DEWARP_CAMERA_WIDTH && y < DEWARP_CAMERA_HEIGHT;
+      if (!inside) {
+        maxEdgeError = e > maxEdgeError ? e : maxEdgeError;
+        continue;
+      }
+      maxError = e > maxError ? e : maxError;
+      sumError += e;
+      points++;
+      // What the firmware draws, against the model rounded
+      int32_t pixelX = (gotX + 128) >> 8;
+      int32_t pixelY = (gotY + 128) >> 8;
+      long roundX = lround(floor(wantX + 0.5));
+      long roundY = lround(floor(wantY + 0.5));
+      long offX = labs(pixelX - roundX);
+      long offY = labs(pixelY - roundY);
+      long off = offX > offY ? offX : offY;
+      offByOne += off == 1;
+      worse += off > 1;
+    }
+  }
+  printf("%-34s max %.3f px, mean %.3f px, 8 px past the edge max %.3f px; rounded: %5.2f%% off by one, %u worse\n",
+         title, maxError, sumError / points, maxEdgeError, 100.0 * offByOne / points, worse);
+  return worse == 0;
+}
+
+static volatile uint32_t sink;
+
+// Cycles (rdtsc, so the host's TSC) and ns per point over the whole frame
+template <typename F>
+static void Time(const char *title, F transform) {
+  const int rounds = 200;
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_RDTSC
+  uint64_t t0 = __rdtsc();
+#endif
+  uint32_t acc = 0; // Wraps, only there so the loop isn't optimized out
+  for (int r = 0; r < rounds; r++) {
+    for (int y = 0; y < DEWARP_CAMERA_HEIGHT; y++) {
+      for (int x = 0; x < DEWARP_CAMERA_WIDTH; x++) {
+        int32_t lx, ly;
+        transform((int16_t)x, (int16_t)(y ^ (r & 1)), &lx, &ly);
+        acc += (uint32_t)(lx ^ ly);
+      }
+    }
+  }
+#ifdef HAVE_RDTSC
+  uint64_t cycles = __rdtsc() - t0;
+#endif
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  sink = acc;
+  double points = (double)rounds * DEWARP_CAMERA_WIDTH * DEWARP_CAMERA_HEIGHT;
+#ifdef HAVE_RDTSC
+  printf("  %-26s %6.2f cycles/point, %6.2f ns/point\n", title, cycles / points, ns / points);
+#else
+  printf("  %-26s %6.2f ns/point\n", title, ns / points);
+#endif
+}
+
+static void Usage() {
+  printf("dewarp_check [--k1 K] [--k2 K] [--scale S] [--emit FILE]\n");
+}
+
+int main(int argc, char **argv) {
+  double k1 = 0, k2 = 0, scale = 1;
+  const char *emit = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--k1"))    k1 = atof(v);
+    else if (!strcmp(a, "--k2"))    k2 = atof(v);
+    else if (!strcmp(a, "--scale")) scale = atof(v);
+    else if (!strcmp(a, "--emit"))  emit = v;
+    else { Usage(); return 1; }
+    i++;
+  }
+
+  struct Model models[NUM_EYES];
+  for (int eye = 0; eye < NUM_EYES; eye++) {
+    models[eye] = eyeModels[eye];
+    models[eye].k1 = k1;
+    models[eye].k2 = k2;
+    models[eye].scale = scale;
+  }
+  if (emit) {
+    return Emit(emit, models);
+  }
+
+  printf("grid %dx%d points, %d camera px per cell, %u bytes per eye\n", DEWARP_COLS, DEWARP_ROWS, DEWARP_CELL,
+         (unsigned)sizeof(struct DewarpGrid));
+  printf("radial: %d entry r^2 table, %u bytes shared + %u per eye\n", RADIAL_TABLE_SIZE,
+         (unsigned)(RADIAL_TABLE_SIZE * sizeof(uint16_t)), (unsigned)sizeof(struct RadialTransform));
+  bool ok = true;
+  // Lenses it should cope with, barrel to pincushion, and the 160 -> 128 scale
+  double lenses[][3] = {
+    {k1, k2, scale}, {-0.08, 0, 1}, {-0.2, 0, 1}, {-0.3, 0.05, 1}, {0.1, 0, 1}, {-0.2, 0, 0.8},
+  };
+  static uint16_t radialScale[RADIAL_TABLE_SIZE];
+  for (const auto &lens : lenses) {
+    struct Model m = eyeModels[0];
+    m.k1 = lens[0];
+    m.k2 = lens[1];
+    m.scale = lens[2];
+    struct DewarpGrid grid;
+    struct RadialTransform radial;
+    BuildGrid(&m, &grid);
+    BuildRadial(&m, radialScale, &radial);
+    char title[64];
+    snprintf(title, sizeof(title), "grid   k1 %g k2 %g scale %g:", m.k1, m.k2, m.scale);
+    ok &= Accuracy(&m, title, [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+      Dewarp(&grid, x, y, lx, ly);
+    });
+    snprintf(title, sizeof(title), "radial k1 %g k2 %g scale %g:", m.k1, m.k2, m.scale);
+    ok &= Accuracy(&m, title, [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+      RadialToLCD(&radial, x, y, lx, ly);
+    });
+  }
+
+  struct Model m = eyeModels[0];
+  m.k1 = -0.2;
+  struct DewarpGrid grid;
+  struct RadialTransform radial;
+  BuildGrid(&m, &grid);
+  BuildRadial(&m, radialScale, &radial);
+  printf("per point, k1 -0.2:\n");
+  Time("Dewarp()", [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+    Dewarp(&grid, x, y, lx, ly);
+  });
+  Time("RadialToLCD()", [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+    RadialToLCD(&radial, x, y, lx, ly);
+  });
+  // A camera that isn't square on to the panel
+  struct RadialTransform tilted = radial;
+  tilted.h[6] = 1 << (RADIAL_PROJECTIVE_BITS - 12);
+  tilted.projective = true;
+  Time("RadialToLCD() projective", [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+    RadialToLCD(&tilted, x, y, lx, ly);
+  });
+  Time("offsets only (old)", [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+    *lx = m.xSign * x + (int32_t)m.xOffset;
+    *ly = y + (int32_t)m.yOffset;
+  });
+  Time("float model", [&](int16_t x, int16_t y, int32_t *lx, int32_t *ly) {
+    float dx = x - (float)LENS_CENTER_X;
+    float dy = y - (float)LENS_CENTER_Y;
+    float r2 = (dx * dx + dy * dy) * (float)(1 / (LENS_RADIUS * LENS_RADIUS));
+    float k = 1 + (float)m.k1 * r2;
+    *lx = (int32_t)lrintf(-(float)LENS_CENTER_X - dx * k + (float)m.xOffset);
+    *ly = (int32_t)lrintf((float)LENS_CENTER_Y + dy * k + (float)m.yOffset);
+  });
+  printf("%s\n", ok ? "ok" : "FAILED, rounded output more than a pixel off somewhere");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/*
+  Runs the drift refiner (lcd_graphical_esp32_arduino_poc drift.cpp) through
+  a drive: the glasses slowly slide (offset and a bit of scale, as if the
+  panel got further from the eye), the car stops at lights now and then with
+  a few street lamps sitting still in view, and in between everything moves.
+  The wearer nudges (one key, 1 LCD px) whenever the mask for the lamp
+  straight ahead is more than a pixel off, every half second at most.
+
+  Prints how far off the mask is in the middle of the panel (+-32 px, where
+  the wearer is looking) and over all of it at the end of every stop, how
+  many nudges it took, and what DriftTrack() + DriftStep() cost per frame
+  with a full frame of lights. Only one lamp straight ahead gets judged at a
+  time, so the edges lean on the scale picked up over several stops.
+
+  Also checks that a lamp leaving with no nudge after it moves the
+  correction: its observation drops from live weight to history weight.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../lcd_graphical_esp32_arduino_poc/include drift_sim.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/drift.cpp -o drift_sim
+    ./drift_sim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "drift.h"
+
+#define FPS 30
+#define MINUTES 20
+#define NUM_LAMPS 3
+#define STOP_EVERY_S 90
+#define STOP_FOR_S 30
+#define NUDGE_EVERY_FRAMES (FPS / 2)
+
+// Camera px -> LCD px before any drift, roughly what a fitted calibration
+// does: mirrored, the camera's 160 px across the panel's 128
+static void ToLCD(double x, double y, double *lcdX, double *lcdY) {
+  *lcdX = 124 - 0.75 * x;
+  *lcdY = 19 + 0.75 * y;
+}
+
+// How far off the glasses have slid by t (s): what the correction should be
+static void Truth(double t, double lcdX, double lcdY, double *dx, double *dy) {
+  double slide = t / (MINUTES * 60.0);
+  double scale = 0.02 * slide;
+  *dx = 4.0 * slide + scale * (lcdX - DRIFT_LCD_CENTER);
+  *dy = -6.0 * slide + scale * (lcdY - DRIFT_LCD_CENTER);
+}
+
+static void Applied(const struct DriftCorrection *c, double lcdX, double lcdY, double *dx, double *dy) {
+  int32_t x = (int32_t)lround(lcdX * 256);
+  int32_t y = (int32_t)lround(lcdY * 256);
+  int32_t x0 = x;
+  int32_t y0 = y;
+  DriftApply(c, &x, &y);
+  *dx = (x - x0) / 256.0;
+  *dy = (y - y0) / 256.0;
+}
+
+// Worst error within reach px of the middle of the panel, LCD px
+static double PanelError(const struct DriftCorrection *c, double t, int reach) {
+  double worst = 0;
+  for (int y = DRIFT_LCD_CENTER - reach; y <= DRIFT_LCD_CENTER + reach; y += 8) {
+    for (int x = DRIFT_LCD_CENTER - reach; x <= DRIFT_LCD_CENTER + reach; x += 8) {
+      double wx, wy, ax, ay;
+      Truth(t, x, y, &wx, &wy);
+      Applied(c, x, y, &ax, &ay);
+      worst = fmax(worst, hypot(wx - ax, wy - ay));
+    }
+  }
+  return worst;
+}
+
+// Two stops, one nudge each. Once the second lamp goes its observation only
+// counts as much as the first one's, so the correction has to move, with
+// nothing nudged since.
+static bool LeavingMovesCorrection() {
+  static const int16_t lampX[] = {30, 130};
+  static const int16_t lampY[] = {30, 90};
+  static const int32_t pushX[] = {3 * 256, -2 * 256};
+  struct DriftReferences refs;
+  struct Drift drift;
+  DriftReferencesInit(&refs);
+  DriftInit(&drift);
+  struct DriftCorrection nudged = drift.correction;
+  for (int s = 0; s < 2; s++) {
+    struct Light lamp;
+    memset(&lamp, 0, sizeof(lamp));
+    lamp.x1 = (uint16_t)lampX[s];
+    lamp.y1 = (uint16_t)lampY[s];
+    for (int frame = 0; frame < DRIFT_STABLE_FRAMES; frame++) {
+      DriftTrack(&refs, &lamp, 1);
+      DriftStep(&drift, &refs);
+    }
+    struct Light still[DRIFT_MAX_REFERENCES];
+    uint8_t ids[DRIFT_MAX_REFERENCES];
+    uint8_t numStill = DriftStillLights(&refs, still, ids);
+    for (uint8_t i = 0; i < numStill; i++) {
+      double x, y;
+      ToLCD(still[i].x1, still[i].y1, &x, &y);
+      still[i].x1 = (uint16_t)lround(x);
+      still[i].y1 = (uint16_t)lround(y);
+    }
+    DriftNudge(&drift, still, ids, numStill, pushX[s], 0);
+    DriftStep(&drift, &refs);
+    nudged = drift.correction;
+    // Gone
+    DriftTrack(&refs, NULL, 0);
+    DriftStep(&drift, &refs);
+  }
+  printf("lamp left, no nudge: offset x %+.2f -> %+.2f px, scale x %+.2f%% -> %+.2f%%\n", nudged.offsetX / 256.0,
+         drift.correction.offsetX / 256.0, nudged.scaleX * 100.0 / 65536, drift.correction.scaleX * 100.0 / 65536);
+  return memcmp(&nudged, &drift.correction, sizeof(nudged)) != 0;
+}
+
+int main() {
+  struct DriftReferences refs;
+  struct Drift drift;
+  DriftReferencesInit(&refs);
+  DriftInit(&drift);
+  srand(1);
+
+  struct Light lights[MAX_LIGHTS];
+  double lampX[NUM_LAMPS], lampY[NUM_LAMPS];
+  uint32_t nudges = 0;
+  uint32_t ignored = 0;
+  static uint32_t cycles[MINUTES * 60 * FPS];
+  double worstAfterFirstStop = 0;
+  const int frames = MINUTES * 60 * FPS;
+  struct DriftCorrection none = {0, 0, 0, 0};
+  printf("   t   nudges  worst px corrected / not: middle         all\n");
+  for (int frame = 0; frame < frames; frame++) {
+    double t = (double)frame / FPS;
+    bool stopped = fmod(t, STOP_EVERY_S) >= STOP_EVERY_S - STOP_FOR_S;
+    if (frame % (STOP_EVERY_S * FPS) == 0) {
+      for (int k = 0; k < NUM_LAMPS; k++) {
+        lampX[k] = 10 + rand() % 140;
+        lampY[k] = 10 + rand() % 100;
+      }
+    }
+    // A full frame: the lamps, plus everything else moving past
+    uint8_t n = 0;
+    for (int k = 0; k < NUM_LAMPS; k++) {
+      memset(&lights[n], 0, sizeof(lights[n]));
+      double drive = stopped ? 0 : 3.0 * frame;
+      lights[n].x1 = (uint16_t)((int)(lampX[k] + drive) % 160);
+      lights[n].y1 = (uint16_t)lampY[k];
+      n++;
+    }
+    while (n < MAX_LIGHTS) {
+      memset(&lights[n], 0, sizeof(lights[n]));
+      lights[n].x1 = (uint16_t)((n * 37 + frame * 5) % 160);
+      lights[n].y1 = (uint16_t)((n * 53 + frame * 3) % 120);
+      n++;
+    }
+
+#ifdef HAVE_RDTSC
+    uint64_t t0 = __rdtsc();
+#endif
+    DriftTrack(&refs, lights, n);
+    DriftStep(&drift, &refs);
+#ifdef HAVE_RDTSC
+    cycles[frame] = (uint32_t)(__rdtsc() - t0);
+#endif
+
+    // End of a stop
+    if ((frame + 1) % (STOP_EVERY_S * FPS) == 0) {
+      double corrected = PanelError(&drift.correction, t, 32);
+      printf("%5.0f s %5u                    %5.2f / %5.2f   %5.2f / %5.2f\n", t, nudges, corrected,
+             PanelError(&none, t, 32), PanelError(&drift.correction, t, 64), PanelError(&none, t, 64));
+      if (t > STOP_EVERY_S) {
+        worstAfterFirstStop = fmax(worstAfterFirstStop, corrected);
+      }
+    }
+    if (!stopped || frame % NUDGE_EVERY_FRAMES != 0) {
+      continue;
+    }
+    // The wearer looks at the lamp straight ahead, and nudges if it leaks
+    double ex = 0;
+    double ey = 0;
+    double nearest = 1e9;
+    for (int k = 0; k < NUM_LAMPS; k++) {
+      double lcdX, lcdY, wx, wy, ax, ay;
+      ToLCD(lights[k].x1, lights[k].y1, &lcdX, &lcdY);
+      double x = lround(lcdX) - DRIFT_LCD_CENTER;
+      double y = lround(lcdY) - DRIFT_LCD_CENTER;
+      if (x * x + y * y >= nearest) {
+        continue;
+      }
+      nearest = x * x + y * y;
+      Truth(t, lcdX, lcdY, &wx, &wy);
+      Applied(&drift.correction, lcdX, lcdY, &ax, &ay);
+      ex = wx - ax;
+      ey = wy - ay;
+    }
+    if (fabs(ex) <= 1 && fabs(ey) <= 1) {
+      continue;
+    }
+    int32_t dx = fabs(ex) >= fabs(ey) ? (ex > 0 ? 256 : -256) : 0;
+    int32_t dy = fabs(ex) >= fabs(ey) ? 0 : (ey > 0 ? 256 : -256);
+    // main.cpp NudgeDrift()
+    struct Light still[DRIFT_MAX_REFERENCES];
+    uint8_t ids[DRIFT_MAX_REFERENCES];
+    uint8_t numStill = DriftStillLights(&refs, still, ids);
+    if (numStill == 0) {
+      ignored++;
+      continue;
+    }
+    for (uint8_t i = 0; i < numStill; i++) {
+      double x, y;
+      ToLCD(still[i].x1, still[i].y1, &x, &y);
+      still[i].x1 = (uint16_t)lround(x);
+      still[i].y1 = (uint16_t)lround(y);
+    }
+    DriftNudge(&drift, still, ids, numStill, dx, dy);
+    nudges++;
+  }
+
+  printf("correction: offset %+.2f, %+.2f px, scale %+.2f%%, %+.2f%%\n", drift.correction.offsetX / 256.0,
+         drift.correction.offsetY / 256.0, drift.correction.scaleX * 100.0 / 65536,
+         drift.correction.scaleY * 100.0 / 65536);
+  printf("%u nudges, %u before the lamps counted as still (ignored), %u observations\n", nudges, ignored,
+         drift.observations);
+#ifdef HAVE_RDTSC
+  uint64_t total = 0;
+  for (int i = 0; i < frames; i++) {
+    total += cycles[i];
+  }
+  qsort(cycles, frames, sizeof(cycles[0]), [](const void *a, const void *b) {
+    return (int)(*(const uint32_t *)a > *(const uint32_t *)b) - (int)(*(const uint32_t *)a < *(const uint32_t *)b);
+  });
+  printf("DriftTrack() + DriftStep() with %d lights: mean %llu cycles, 99.9%% under %u\n", MAX_LIGHTS,
+         (unsigned long long)(total / frames), cycles[frames * 999 / 1000]);
+#endif
+  // The wearer lets a pixel go, and the middle's corners are a scale away
+  // from the lamp that got judged
+  bool ok = worstAfterFirstStop < 2.5;
+  if (!ok) {
+    printf("FAILED, middle more than 2.5 px off after a stop\n");
+  }
+  if (!LeavingMovesCorrection()) {
+    printf("FAILED, correction stuck after a lamp left\n");
+    ok = false;
+  }
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,405 @@
+'''
+Fits the LCD's camera -> LCD transform (lcd_graphical_esp32_arduino_poc
+radial.h) to measured points, and writes the tables the firmware builds with.
+
+The model: a radial lens correction about the middle of the camera, shared
+by both eyes since it's one lens, then a homography per eye.
+  r2 = |p - center|^2 / LENS_RADIUS^2
+  u  = (p - center) * (1 + k1 r2 + k2 r2^2)
+  lcd = H u (projective, or affine with --affine)
+It starts from the straight line solution (k = 0, linear homography) and
+refines everything together with Levenberg-Marquardt.
+
+Points are a CSV, one per line, '#' comments:
+  eye, camera_x, camera_y, lcd_x, lcd_y
+eye is left or right. An eye with no points keeps the old fixed offsets.
+
+  python3 fit_radial.py points.csv --user alice
+  python3 fit_radial.py --synthetic -0.15 --noise 0.3   # dry run, no points needed
+
+Writes radial_table.h (the r^2 tables) and dewarp_table.h (the bilinear grid
+from the same fit, see dewarp.h) into the firmware's include/, so either
+transform can be picked for that wearer. Then rebuild and flash.
+
+Or, with no reflashing, --blob writes the wearer's calibration (calibration.h)
+to a file for calibration_upload.py to send:
+  python3 fit_radial.py points.csv --user alice --blob alice.bin --transform radial --contrast 200 175
+'''
+import argparse
+import math
+import os
+import random
+import struct
+import sys
+import zlib
+
+INCLUDE = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'lcd_graphical_esp32_arduino_poc', 'include')
+EYES = ['left', 'right']
+
+# Same as radial.h / dewarp.h
+CAMERA_WIDTH = 160
+CAMERA_HEIGHT = 120
+CENTER_X = CAMERA_WIDTH // 2
+CENTER_Y = CAMERA_HEIGHT // 2
+LENS_RADIUS = 100.0
+R2_SHIFT = 4
+MARGIN = 8
+MAX_R2 = (CENTER_X + MARGIN) ** 2 + (CENTER_Y + MARGIN) ** 2
+TABLE_SIZE = (MAX_R2 >> R2_SHIFT) + 1
+SCALE_BITS = 14
+UNDISTORTED_BITS = 4
+PROJECTIVE_BITS = 24
+FRACTION_BITS = 8
+CELL = 16
+GRID_COLS = CAMERA_WIDTH // CELL + 1
+GRID_ROWS = (CAMERA_HEIGHT + CELL - 1) // CELL + 1
+
+# calibration.h
+CALIBRATION_MAGIC = 0x43424C48
+CALIBRATION_VERSION = 1
+CALIBRATION_USER_CHARS = 16
+CALIBRATION_TRANSFORMS = {'offsets': 0, 'grid': 1, 'radial': 2}
+
+# main.cpp's old fixed offsets, as a homography on centered coordinates:
+# lcd_x = -(x) + 110, lcd_y = y + 75
+DEFAULT_H = [-1.0, 0.0, 110.0 - CENTER_X, 0.0, 1.0, 75.0 + CENTER_Y, 0.0, 0.0]
+
+
+def radial_scale(k1, k2, r2):
+    r = r2 / (LENS_RADIUS * LENS_RADIUS)
+    return 1 + k1 * r + k2 * r * r
+
+
+def model_point(k1, k2, h, x, y):
+    dx = x - CENTER_X
+    dy = y - CENTER_Y
+    k = radial_scale(k1, k2, dx * dx + dy * dy)
+    ux = dx * k
+    uy = dy * k
+    w = 1 + h[6] * ux + h[7] * uy
+    return (h[0] * ux + h[1] * uy + h[2]) / w, (h[3] * ux + h[4] * uy + h[5]) / w
+
+
+def solve(a, b):
+    '''Gaussian elimination with partial pivoting, a is n x n'''
+    n = len(b)
+    m = [row[:] + [b[i]] for i, row in enumerate(a)]
+    for c in range(n):
+        p = max(range(c, n), key=lambda r: abs(m[r][c]))
+        if abs(m[p][c]) < 1e-15:
+            raise ValueError('singular, not enough (or too few distinct) points')
+        m[c], m[p] = m[p], m[c]
+        for r in range(n):
+            if r != c and m[r][c] != 0:
+                f = m[r][c] / m[c][c]
+                for k in range(c, n + 1):
+                    m[r][k] -= f * m[c][k]
+    return [m[i][n] / m[i][i] for i in range(n)]
+
+
+def linear_homography(points, affine):
+    '''Least squares with k = 0: lcd_x (1 + h6 u + h7 v) = h0 u + h1 v + h2 ...'''
+    n = 6 if affine else 8
+    ata = [[0.0] * n for _ in range(n)]
+    atb = [0.0] * n
+    for x, y, lx, ly in points:
+        u = x - CENTER_X
+        v = y - CENTER_Y
+        rows = [([u, v, 1, 0, 0, 0, -lx * u, -lx * v], lx), ([0, 0, 0, u, v, 1, -ly * u, -ly * v], ly)]
+        for row, rhs in rows:
+            row = row[:n]
+            for i in range(n):
+                atb[i] += row[i] * rhs
+                for j in range(n):
+                    ata[i][j] += row[i] * row[j]
+    h = solve(ata, atb)
+    return h + [0.0, 0.0] if affine else h
+
+
+class Fit:
+    '''Parameters: k1, k2, then 6 or 8 homography terms for each fitted eye'''
+
+    def __init__(self, points, affine, radial_terms):
+        self.points = points
+        self.eyes = [eye for eye in EYES if points[eye]]
+        self.per_eye = 6 if affine else 8
+        self.radial_terms = radial_terms
+
+    def unpack(self, p):
+        k1 = p[0] if self.radial_terms >= 1 else 0.0
+        k2 = p[1] if self.radial_terms >= 2 else 0.0
+        hs = {}
+        for i, eye in enumerate(self.eyes):
+            h = p[2 + i * self.per_eye:2 + (i + 1) * self.per_eye]
+            hs[eye] = list(h) + [0.0] * (8 - self.per_eye)
+        return k1, k2, hs
+
+    def residuals(self, p):
+        k1, k2, hs = self.unpack(p)
+        out = []
+        for eye in self.eyes:
+            h = hs[eye]
+            for x, y, lx, ly in self.points[eye]:
+                mx, my = model_point(k1, k2, h, x, y)
+                out += [mx - lx, my - ly]
+        return out
+
+    def start(self):
+        p = [0.0, 0.0]
+        for eye in self.eyes:
+            p += linear_homography(self.points[eye], self.per_eye == 6)[:self.per_eye]
+        return p
+
+    def solve(self, iterations=100):
+        p = self.start()
+        fixed = set(range(self.radial_terms, 2))
+        free = [i for i in range(len(p)) if i not in fixed]
+        r = self.residuals(p)
+        cost = sum(v * v for v in r)
+        damping = 1e-3
+        for _ in range(iterations):
+            # Numeric Jacobian, central differences
+            jac = []
+            for i in free:
+                step = 1e-6 * max(1.0, abs(p[i]))
+                up = p[:]
+                down = p[:]
+                up[i] += step
+                down[i] -= step
+                ru = self.residuals(up)
+                rd = self.residuals(down)
+                jac.append([(a - b) / (2 * step) for a, b in zip(ru, rd)])
+            n = len(free)
+            jtj = [[sum(a * b for a, b in zip(jac[i], jac[j])) for j in range(n)] for i in range(n)]
+            jtr = [sum(a * b for a, b in zip(jac[i], r)) for i in range(n)]
+            improved = False
+            while damping < 1e10:
+                a = [[jtj[i][j] + (damping * jtj[i][i] if i == j else 0) for j in range(n)] for i in range(n)]
+                try:
+                    delta = solve(a, [-v for v in jtr])
+                except ValueError:
+                    damping *= 10
+                    continue
+                trial = p[:]
+                for i, d in zip(free, delta):
+                    trial[i] += d
+                tr = self.residuals(trial)
+                trial_cost = sum(v * v for v in tr)
+                if trial_cost < cost:
+                    improved = cost - trial_cost > 1e-12 * cost
+                    p, r, cost = trial, tr, trial_cost
+                    damping = max(damping / 10, 1e-12)
+                    break
+                damping *= 10
+            if not improved:
+                break
+        return self.unpack(p)
+
+
+def read_points(path):
+    points = {eye: [] for eye in EYES}
+    for number, line in enumerate(open(path), 1):
+        line = line.split('#')[0].strip()
+        if not line:
+            continue
+        fields = [f.strip() for f in line.split(',')]
+        if len(fields) != 5 or fields[0] not in EYES:
+            sys.exit('%s:%d: want eye,camera_x,camera_y,lcd_x,lcd_y' % (path, number))
+        points[fields[0]].append(tuple(float(f) for f in fields[1:]))
+    return points
+
+
+def synthetic_points(k1, noise, seed):
+    '''The old offsets through a lens, on a 9x7 grid of targets'''
+    rng = random.Random(seed)
+    points = {eye: [] for eye in EYES}
+    for eye in EYES:
+        for j in range(7):
+            for i in range(9):
+                x = 4 + i * (CAMERA_WIDTH - 8) / 8.0
+                y = 4 + j * (CAMERA_HEIGHT - 8) / 6.0
+                lx, ly = model_point(k1, 0.0, DEFAULT_H, x, y)
+                points[eye].append((x, y, lx + rng.gauss(0, noise), ly + rng.gauss(0, noise)))
+    return points
+
+
+def scale_table(k1, k2):
+    # Middle of each step of r^2, so the lookup is never more than half a step off
+    half = (1 << R2_SHIFT) / 2.0
+    return [int(round(radial_scale(k1, k2, (i << R2_SHIFT) + half) * (1 << SCALE_BITS))) for i in range(TABLE_SIZE)]
+
+
+def fixed_homography(h):
+    return [int(round(v * (1 << 16))) for v in h[:6]] + [int(round(v * (1 << PROJECTIVE_BITS))) for v in h[6:]]
+
+
+def fixed_point(table, hq, projective, x, y):
+    '''Same integer steps as RadialToLCD() in radial.cpp, in LCD px'''
+    dx = int(x) - CENTER_X
+    dy = int(y) - CENTER_Y
+    index = min((dx * dx + dy * dy) >> R2_SHIFT, TABLE_SIZE - 1)
+    k = table[index]
+    ux = (dx * k) >> (SCALE_BITS - UNDISTORTED_BITS)
+    uy = (dy * k) >> (SCALE_BITS - UNDISTORTED_BITS)
+    lx = ((hq[0] * ux + hq[1] * uy) >> UNDISTORTED_BITS) + hq[2]
+    ly = ((hq[3] * ux + hq[4] * uy) >> UNDISTORTED_BITS) + hq[5]
+    if not projective:
+        return (lx >> (16 - FRACTION_BITS)) / 256.0, (ly >> (16 - FRACTION_BITS)) / 256.0
+    w = (1 << 16) + ((hq[6] * ux + hq[7] * uy) >> (PROJECTIVE_BITS - 16 + UNDISTORTED_BITS))
+    # C divides towards zero
+    qx = abs(lx << FRACTION_BITS) // w * (1 if lx >= 0 else -1)
+    qy = abs(ly << FRACTION_BITS) // w * (1 if ly >= 0 else -1)
+    return qx / 256.0, qy / 256.0
+
+
+def report(points, k1, k2, hs, table, fixed):
+    for eye in EYES:
+        if not points[eye]:
+            print('%-5s: no points, old offsets' % eye)
+            continue
+        h = hs[eye]
+        errors = []
+        fixed_errors = []
+        for x, y, lx, ly in points[eye]:
+            mx, my = model_point(k1, k2, h, x, y)
+            errors.append(math.hypot(mx - lx, my - ly))
+            # Lights come in whole camera pixels
+            mx, my = model_point(k1, k2, h, int(x), int(y))
+            fx, fy = fixed_point(table, fixed[eye][0], fixed[eye][1], int(x), int(y))
+            fixed_errors.append(math.hypot(fx - mx, fy - my))
+        rms = math.sqrt(sum(e * e for e in errors) / len(errors))
+        print('%-5s: %d points, fit rms %.3f px, max %.3f px; fixed point vs fit max %.3f px' %
+              (eye, len(errors), rms, max(errors), max(fixed_errors)))
+
+
+def write_radial(path, user, source, k1, k2, table, fixed):
+    with open(path, 'w') as f:
+        f.write('#pragma once\n\n')
+        f.write('// Generated by host_tools/fit_radial.py, don\'t edit by hand.\n')
+        f.write('// User: %s. From %s.\n' % (user, source))
+        f.write('// Lens k1 %.6g, k2 %.6g about (%d, %d), radius %g.\n' % (k1, k2, CENTER_X, CENTER_Y, LENS_RADIUS))
+        f.write('// Only include from one file, it\'s the definition.\n\n')
+        f.write('#include "radial.h"\n#include "eyes.h"\n\n')
+        f.write('constexpr uint16_t radialScale[RADIAL_TABLE_SIZE] = {\n')
+        for i in range(0, TABLE_SIZE, 12):
+            f.write('  ' + ', '.join(str(v) for v in table[i:i + 12]) + ',\n')
+        f.write('};\n\n')
+        f.write('constexpr struct RadialTransform radialTransforms[NUM_EYES] = {\n')
+        for eye in EYES:
+            hq, projective = fixed[eye]
+            f.write('  // %s\n' % eye)
+            f.write('  {%d, %d, radialScale, {%s}, %s},\n' % (CENTER_X, CENTER_Y, ', '.join(str(v) for v in hq),
+                                                            'true' if projective else 'false'))
+        f.write('};\n')
+    print('wrote %s' % path)
+
+
+def grid_points(k1, k2, h):
+    '''[axis][row][col] in Q8.8, DewarpGrid'''
+    grid = [[model_point(k1, k2, h, col * CELL, row * CELL) for col in range(GRID_COLS)] for row in range(GRID_ROWS)]
+    return [[[int(round(p[axis] * (1 << FRACTION_BITS))) for p in row] for row in grid] for axis in range(2)]
+
+
+def pack_blob(user, k1, k2, hs, table, fixed, transform, contrast, light_radius):
+    '''struct CalibrationBlob, see calibration.h for the layout'''
+    body = struct.pack('<HHhhBBBB', CAMERA_WIDTH, CAMERA_HEIGHT, CENTER_X, CENTER_Y, GRID_COLS, GRID_ROWS,
+                       light_radius, 0)
+    body += user.encode()[:CALIBRATION_USER_CHARS].ljust(CALIBRATION_USER_CHARS, b'\0')
+    for i, eye in enumerate(EYES):
+        h = hs[eye]
+        # The offsets only version, for CALIBRATION_OFFSETS
+        x_sign = -1 if h[0] < 0 else 1
+        x_offset = int(round(h[2] - x_sign * CENTER_X))
+        y_offset = int(round(h[5] - CENTER_Y))
+        hq, projective = fixed[eye]
+        body += struct.pack('<bBBBhh', x_sign, contrast[i], CALIBRATION_TRANSFORMS[transform], int(projective),
+                            x_offset, y_offset)
+        body += struct.pack('<8i', *hq)
+        for axis in grid_points(k1, k2, h):
+            for row in axis:
+                body += struct.pack('<%di' % GRID_COLS, *row)
+    body += struct.pack('<%dH' % TABLE_SIZE, *table)
+    size = 12 + len(body)
+    return struct.pack('<IHHI', CALIBRATION_MAGIC, CALIBRATION_VERSION, size, zlib.crc32(body) & 0xFFFFFFFF) + body
+
+
+def write_grid(path, user, source, k1, k2, hs):
+    '''Same layout as dewarp_check.cpp --emit'''
+    with open(path, 'w') as f:
+        f.write('#pragma once\n\n')
+        f.write('// Generated by host_tools/fit_radial.py, don\'t edit by hand.\n')
+        f.write('// User: %s. From %s.\n' % (user, source))
+        f.write('// Lens k1 %.6g, k2 %.6g about (%d, %d), radius %g.\n' % (k1, k2, CENTER_X, CENTER_Y, LENS_RADIUS))
+        f.write('// Only include from one file, it\'s the definition.\n\n')
+        f.write('#include "dewarp.h"\n#include "eyes.h"\n\n')
+        f.write('static const struct DewarpGrid dewarpGrids[NUM_EYES] = {\n')
+        for eye in EYES:
+            f.write('  // %s\n  {\n' % eye)
+            for axis, name in zip(grid_points(k1, k2, hs[eye]), ['x', 'y']):
+                f.write('    // %s\n    {\n' % name)
+                for row in axis:
+                    f.write('      {' + ', '.join(str(v) for v in row) + '},\n')
+                f.write('    },\n')
+            f.write('  },\n')
+        f.write('};\n')
+    print('wrote %s' % path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Fit the camera -> LCD transform and write its tables')
+    parser.add_argument('points', nargs='?', help='CSV: eye,camera_x,camera_y,lcd_x,lcd_y')
+    parser.add_argument('--user', default='default', help='Who it\'s for, goes in the header')
+    parser.add_argument('--affine', action='store_true', help='No perspective, saves the divides')
+    parser.add_argument('--radial-terms', type=int, default=2, choices=[0, 1, 2])
+    parser.add_argument('--synthetic', type=float, metavar='K1', help='Made up points through a lens with this k1')
+    parser.add_argument('--noise', type=float, default=0.0, help='px, for --synthetic')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--radial-out', default=os.path.join(INCLUDE, 'radial_table.h'))
+    parser.add_argument('--grid-out', default=os.path.join(INCLUDE, 'dewarp_table.h'))
+    parser.add_argument('--dry-run', action='store_true', help='Fit and report, write nothing')
+    parser.add_argument('--blob', help='Write a calibration blob here instead of the headers')
+    parser.add_argument('--transform', choices=sorted(CALIBRATION_TRANSFORMS), default='grid', help='For --blob')
+    parser.add_argument('--contrast', type=int, nargs=2, default=[200, 175], metavar=('LEFT', 'RIGHT'),
+                        help='For --blob')
+    parser.add_argument('--light-radius', type=int, default=4, help='For --blob, LCD px')
+    args = parser.parse_args()
+
+    if args.synthetic is not None:
+        points = synthetic_points(args.synthetic, args.noise, args.seed)
+        source = 'synthetic points, k1 %g, noise %g px' % (args.synthetic, args.noise)
+    elif args.points:
+        points = read_points(args.points)
+        source = os.path.basename(args.points)
+    else:
+        parser.error('need a points file or --synthetic')
+    if not any(points.values()):
+        sys.exit('no points')
+
+    k1, k2, hs = Fit(points, args.affine, args.radial_terms).solve()
+    for eye in EYES:
+        hs.setdefault(eye, DEFAULT_H)
+    table = scale_table(k1, k2)
+    if max(table) >= 1 << 16 or min(table) <= 0:
+        sys.exit('lens scale out of range for Q2.14, k1 %g k2 %g' % (k1, k2))
+    fixed = {}
+    for eye in EYES:
+        hq = fixed_homography(hs[eye])
+        fixed[eye] = (hq, hq[6] != 0 or hq[7] != 0)
+    print('k1 %.6g, k2 %.6g' % (k1, k2))
+    for eye in EYES:
+        print('%-5s: H %s' % (eye, ' '.join('%.6g' % v for v in hs[eye])))
+    report(points, k1, k2, hs, table, fixed)
+    if args.dry_run:
+        return
+    if args.blob:
+        blob = pack_blob(args.user, k1, k2, hs, table, fixed, args.transform, args.contrast, args.light_radius)
+        with open(args.blob, 'wb') as f:
+            f.write(blob)
+        print('wrote %s, %d bytes' % (args.blob, len(blob)))
+    else:
+        write_radial(args.radial_out, args.user, source, k1, k2, table, fixed)
+        write_grid(args.grid_out, args.user, source, k1, k2, hs)
+
+
+if __name__ == '__main__':
+    main()
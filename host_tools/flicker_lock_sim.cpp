@@ -0,0 +1,309 @@
+/*
+  Runs shared/lcd_waveform flicker_lock through a few flickering lights the
+  way lcd_basic_arduino's FlickerLock() uses it: 20 ms of photodiode reads
+  (~90 us apart on the ESP8266's ADC, noisy, 10 bit) a loop(), then the next
+  table handed over to go on the end of the one playing, then delay(1). The
+  waveform engine is mocked (tables back to back, a handed over one waiting
+  for the one playing to come round), and the glass goes dark / clear with a
+  time constant of LCD_TAU_US.
+
+  Per light: how long it took to lock, how much of its light got blocked,
+  how much of the time the glass was clear (what everything else gets
+  through), and how far the windows start from where they should, FLICKER_LEAD_US
+  before each on edge. Against that, sixtyHertz played free running (the
+  hand written way, right for 120 Hz lamps give or take, phase by luck) and
+  fullBlock (everything blocked, nothing seen).
+
+  Starts micros() 3 s short of wrapping.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../shared/lcd_waveform -I../lcd_basic_arduino/lcd_basic_arduino/include \
+      flicker_lock_sim.cpp ../shared/lcd_waveform/flicker_lock.cpp -o flicker_lock_sim
+    ./flicker_lock_sim
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "flicker_lock.h"
+#include "waveforms.h"
+
+#define SECONDS 20
+#define SETTLE_S 2 // Counted from here on
+#define STEP_US 5
+#define ADC_US 90
+#define ADC_JITTER_US 10
+#define ADC_NOISE 4.0 // Counts rms
+#define AMBIENT 150 // Counts
+#define SWING 300 // Counts, source fully on
+#define SAMPLE_MS 20 // lcd_basic_arduino FLICKER_SAMPLE_MS
+#define LOOP_GAP_US 1100 // delay(1) and the rest of loop()
+#define LCD_TAU_US 150 // Guess, dark and clear alike
+#define START_US 7 // waveform.cpp, WAVE_LEAD_US + MIN_TICKS
+
+enum Shape { PWM, AC_LED, AC_LAMP, STEADY };
+
+struct Source {
+  const char *name;
+  enum Shape shape;
+  double hz; // Of the flicker
+  double duty; // PWM on fraction
+  double wander; // Frequency swings +-this fraction, over 7 s
+};
+
+static const struct Source sources[] = {
+  {"PWM taillight 200 Hz 20%", PWM, 200, 0.20, 0},
+  {"PWM taillight 480 Hz 35%", PWM, 480, 0.35, 0},
+  {"PWM 150 Hz 10%, +-2% wander", PWM, 150, 0.10, 0.02},
+  {"LED street lamp 120 Hz", AC_LED, 120, 0, 0.001},
+  {"sodium lamp 100 Hz", AC_LAMP, 100, 0, 0.001},
+  {"steady headlight", STEADY, 0, 0, 0},
+};
+
+// 0..1 at cycle fraction f
+static double Brightness(const struct Source *s, double f) {
+  switch (s->shape) {
+  case PWM:
+    return f < s->duty ? 1 : 0;
+  case AC_LED: {
+    // Rectified mains straight into a string of LEDs: only lit near the peaks
+    double v = fabs(sin(M_PI * f));
+    return v > 0.6 ? (v - 0.6) / 0.4 : 0;
+  }
+  case AC_LAMP:
+    return 0.4 + 0.6 * sin(M_PI * f) * sin(M_PI * f);
+  default:
+    return 1;
+  }
+}
+
+// Where the source is most of the way from its lowest to its highest on
+// the way up, same as the edge detector's middle
+static double RiseFraction(const struct Source *s) {
+  switch (s->shape) {
+  case AC_LED:
+    return asin(0.8) / M_PI;
+  case AC_LAMP:
+    return 0.25;
+  default:
+    return 0;
+  }
+}
+
+// Mocked waveform engine: only what's dark and when tables start
+struct Engine {
+  bool playing;
+  std::vector<struct WavePhase> table;
+  uint32_t start; // Of the current time round
+  uint32_t period;
+  bool pending;
+  std::vector<struct WavePhase> next;
+};
+
+static void Play(struct Engine *e, const struct WavePhase *phases, uint8_t n, uint32_t now) {
+  if (!e->playing) {
+    e->table.assign(phases, phases + n);
+    e->start = now;
+    e->period = WavePeriodUs(phases, n);
+    e->playing = true;
+    e->pending = false;
+  } else {
+    e->next.assign(phases, phases + n);
+    e->pending = true;
+  }
+}
+
+static void Advance(struct Engine *e, uint32_t now) {
+  while (e->playing && (int32_t)(now - (e->start + e->period)) >= 0) {
+    e->start += e->period;
+    if (e->pending) {
+      e->table = e->next;
+      e->period = WavePeriodUs(e->table.data(), (uint8_t)e->table.size());
+      e->pending = false;
+    }
+  }
+}
+
+static bool Dark(const struct Engine *e, uint32_t now) {
+  if (!e->playing) {
+    return false;
+  }
+  uint32_t into = now - e->start;
+  for (const struct WavePhase &p : e->table) {
+    if (into < p.us) {
+      return p.backplanes != p.segments;
+    }
+    into -= p.us;
+  }
+  return false;
+}
+
+struct Result {
+  double lockMs; // -1 never
+  double blocked; // Of the source's light, past SETTLE_S
+  double clear; // Of the time
+  double windowRmsUs; // Going dark to the nearest ideal window start
+  double windowMaxUs;
+  int unlocks;
+};
+
+enum Mode { LOCKED, FREE_SIXTY };
+
+static struct Result Run(const struct Source *s, enum Mode mode, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0, ADC_NOISE);
+  std::uniform_int_distribution<int> jitter(-ADC_JITTER_US, ADC_JITTER_US);
+  std::uniform_real_distribution<double> startPhase(0, 1);
+
+  struct FlickerPll pll;
+  FlickerPllInit(&pll);
+  struct Engine engine = {};
+  uint32_t tableUs = 0; // main.cpp's flicker_table_us
+
+  const uint32_t t0 = 0xFFFFFFFFu - 3000000u;
+  uint32_t now = t0;
+  double cycle = startPhase(rng); // Source's, in cycles
+  double opacity = 0;
+  uint32_t burstEnd = now + SAMPLE_MS * 1000;
+  uint32_t nextSample = now;
+  uint32_t resumeAt = now; // Sampling again from here
+  bool sampling = true;
+  bool wasLocked = false;
+  struct Result r = {-1, 0, 0, 0, 0, 0};
+  double light = 0, passed = 0, clearUs = 0, countedUs = 0;
+  std::vector<double> idealStarts; // Ideal window starts, source cycle times
+  std::vector<double> darkStarts; // Settled
+  bool wasDark = false;
+  const double decay = 1 - exp(-(double)STEP_US / LCD_TAU_US);
+
+  if (mode == FREE_SIXTY) {
+    Play(&engine, sixtyHertz, WAVE_COUNT(sixtyHertz), now);
+  }
+
+  for (uint32_t step = 0; step < (uint32_t)SECONDS * 1000000 / STEP_US; step++, now += STEP_US) {
+    double elapsedS = (double)step * STEP_US / 1e6;
+    double hz = s->hz * (1 + s->wander * sin(2 * M_PI * elapsedS / 7));
+    double before = cycle;
+    cycle += hz * STEP_US / 1e6;
+    double f = cycle - floor(cycle);
+    double b = Brightness(s, f);
+    if (s->shape != STEADY) {
+      // An ideal window start went by this step
+      double rise = RiseFraction(s) - (double)FLICKER_LEAD_US * hz / 1e6;
+      if (floor(before - rise) != floor(cycle - rise)) {
+        idealStarts.push_back(elapsedS * 1e6);
+      }
+    }
+
+    if (mode == LOCKED) {
+      if (sampling && (int32_t)(now - nextSample) >= 0) {
+        double level = AMBIENT + SWING * b + noise(rng);
+        level = level < 0 ? 0 : level > 1023 ? 1023 : level;
+        FlickerPllSample(&pll, now, (int32_t)level);
+        nextSample = now + ADC_US + jitter(rng);
+      }
+      if (pll.locked && !wasLocked && r.lockMs < 0) {
+        r.lockMs = elapsedS * 1000;
+      }
+      if (!pll.locked && wasLocked) {
+        r.unlocks++;
+      }
+      wasLocked = pll.locked;
+
+      if (sampling && (int32_t)(now - burstEnd) >= 0) {
+        // The rest of FlickerLock()
+        sampling = false;
+        resumeAt = now + LOOP_GAP_US;
+        if (!pll.locked) {
+          engine.playing = false;
+          tableUs = 0;
+        } else if (tableUs == 0) {
+          struct WavePhase phases[FLICKER_PHASES];
+          uint8_t n = FlickerPhases(&pll, now, phases);
+          engine.playing = false;
+          // First edge a few us after WavePlay()
+          Play(&engine, phases, n, now + START_US);
+          tableUs = WavePeriodUs(phases, n);
+        } else if (!engine.pending) {
+          struct WavePhase phases[FLICKER_PHASES];
+          uint8_t n = FlickerPhases(&pll, engine.start + tableUs, phases);
+          if (!WaveBalanced(phases, n, 1, 1)) {
+            printf("unbalanced table\n");
+          }
+          Play(&engine, phases, n, now);
+          tableUs = WavePeriodUs(phases, n);
+        }
+      }
+      if (!sampling && (int32_t)(now - resumeAt) >= 0) {
+        sampling = true;
+        burstEnd = now + SAMPLE_MS * 1000;
+        nextSample = now;
+      }
+    }
+
+    Advance(&engine, now);
+    bool dark = Dark(&engine, now);
+    if (dark && !wasDark && elapsedS >= SETTLE_S) {
+      darkStarts.push_back(elapsedS * 1e6);
+    }
+    wasDark = dark;
+    double target = dark ? 1 : 0;
+    opacity += (target - opacity) * decay;
+    if (elapsedS >= SETTLE_S) {
+      light += b;
+      passed += b * (1 - opacity);
+      clearUs += 1 - opacity;
+      countedUs += 1;
+    }
+  }
+  r.blocked = light > 0 ? 1 - passed / light : 0;
+  r.clear = clearUs / countedUs;
+
+  // Going dark against the ideal window starts
+  double sum = 0;
+  int count = 0;
+  size_t j = 0;
+  for (double t : darkStarts) {
+    if (idealStarts.empty()) {
+      break;
+    }
+    while (j + 1 < idealStarts.size() && fabs(idealStarts[j + 1] - t) <= fabs(idealStarts[j] - t)) {
+      j++;
+    }
+    double error = t - idealStarts[j];
+    sum += error * error;
+    r.windowMaxUs = fmax(r.windowMaxUs, fabs(error));
+    count++;
+  }
+  r.windowRmsUs = count ? sqrt(sum / count) : 0;
+  return r;
+}
+
+int main() {
+  printf("%ds a light, counted from %ds. Blocked: of its light. Clear: of the time.\n", SECONDS, SETTLE_S);
+  printf("%-29s %21s %29s  %s\n", "", "locked", "window start error", "sixtyHertz free running");
+  printf("%-29s %8s %6s %6s %8s %8s %8s %12s %6s\n", "", "after", "blocked", "clear", "rms", "max", "unlocks",
+         "blocked", "clear");
+  bool ok = true;
+  for (const struct Source &s : sources) {
+    struct Result locked = Run(&s, LOCKED, 1);
+    struct Result free = Run(&s, FREE_SIXTY, 1);
+    if (locked.lockMs < 0) {
+      printf("%-29s %8s %6.1f%% %5.1f%% %8s %8s %8d %11.1f%% %5.1f%%\n", s.name, "never", 100 * locked.blocked,
+             100 * locked.clear, "-", "-", locked.unlocks, 100 * free.blocked, 100 * free.clear);
+    } else {
+      printf("%-29s %6.0fms %6.1f%% %5.1f%% %6.0fus %6.0fus %8d %11.1f%% %5.1f%%\n", s.name, locked.lockMs,
+             100 * locked.blocked, 100 * locked.clear, locked.windowRmsUs, locked.windowMaxUs, locked.unlocks,
+             100 * free.blocked, 100 * free.clear);
+    }
+    // Flickering ones should lock, line up and beat sixtyHertz, a steady one never lock. A lamp
+    // that never goes off can't be blocked much without losing the view too.
+    ok &= s.shape == STEADY ? locked.lockMs < 0
+                            : locked.lockMs >= 0 && locked.windowRmsUs < 150 && locked.blocked > free.blocked + 0.1;
+  }
+  printf("fullBlock: 100%% blocked, 0%% clear\n");
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
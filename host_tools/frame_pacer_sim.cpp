@@ -0,0 +1,140 @@
+/*
+  lcd_graphical_esp32_arduino_poc's FramePacer (frame_pacer.h) against a
+  simulated camera, stepped the way loop() polls it: FramePacerDue() every
+  --step-us, FramePacerCameraFrame() when a frame's last line comes in.
+
+  Camera frames arrive every 1e6 / --camera-fps us, give or take --uart-us
+  of UART / scan noise. Prints the same numbers as the firmware's "Pacing:"
+  line once a second, plus how far each draw lands from just after a camera
+  frame (FRAME_ALIGN_MARGIN_US), and when that settled to within --lock-us.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../lcd_graphical_esp32_arduino_poc/include frame_pacer_sim.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/frame_pacer.cpp -o frame_pacer_sim
+    ./frame_pacer_sim --camera-fps 20
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <random>
+
+#include "frame_pacer.h"
+
+struct Options {
+  double cameraFps = 20;
+  double nominalMs = 1000 / 30; // main.cpp's MILLIS_PER_DRAW, whole ms
+  double stepUs = 100;
+  double uartUs = 200; // Arrival noise, +-
+  double lockUs = 500;
+  double seconds = 10;
+  int mode = FRAME_PACE_CAMERA;
+  uint32_t seed = 1;
+};
+
+static void Usage() {
+  printf("frame_pacer_sim [--camera-fps F] [--nominal-ms MS] [--step-us US] [--uart-us US]\n"
+         "                [--lock-us US] [--seconds S] [--fixed] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    if (!strcmp(a, "--fixed")) {
+      o.mode = FRAME_PACE_FIXED;
+      continue;
+    }
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--camera-fps"))  o.cameraFps = atof(v);
+    else if (!strcmp(a, "--nominal-ms"))  o.nominalMs = atof(v);
+    else if (!strcmp(a, "--step-us"))     o.stepUs = atof(v);
+    else if (!strcmp(a, "--uart-us"))     o.uartUs = atof(v);
+    else if (!strcmp(a, "--lock-us"))     o.lockUs = atof(v);
+    else if (!strcmp(a, "--seconds"))     o.seconds = atof(v);
+    else if (!strcmp(a, "--seed"))        o.seed = atoi(v);
+    else { Usage(); return 1; }
+    i++;
+  }
+
+  std::mt19937 rng(o.seed);
+  std::uniform_real_distribution<double> noise(-o.uartUs, o.uartUs);
+  const double cameraUs = 1e6 / o.cameraFps;
+
+  FramePacer pacer;
+  FramePacerInit(&pacer, (uint32_t)(o.nominalMs * 1000), (uint8_t)o.mode);
+
+  // Camera's first frame lands somewhere odd against the LCD's grid
+  double nextFrameUs = cameraUs * 0.37;
+  double frameUs = nextFrameUs + noise(rng);
+  uint32_t lastArrival = 0;
+  bool haveArrival = false;
+  double nextReportUs = 1e6;
+  double lockedAtUs = -1;
+  double sumLand = 0, sumLandSquared = 0;
+  uint32_t landed = 0;
+
+  printf("camera %.1f fps, nominal %.0f ms, %s, %.0f us steps\n", o.cameraFps, o.nominalMs,
+         o.mode == FRAME_PACE_CAMERA ? "FRAME_PACE_CAMERA" : "FRAME_PACE_FIXED", o.stepUs);
+  printf("%6s %8s %8s %8s %8s %8s %8s %10s\n", "time s", "draws", "min us", "max us", "mean us", "jitter",
+         "phase", "camera us");
+
+  for (double t = 0; t < o.seconds * 1e6; t += o.stepUs) {
+    uint32_t now = (uint32_t)t;
+    if (t >= frameUs) {
+      FramePacerCameraFrame(&pacer, now);
+      lastArrival = now;
+      haveArrival = true;
+      nextFrameUs += cameraUs;
+      frameUs = nextFrameUs + noise(rng);
+    }
+    if (FramePacerDue(&pacer, now) && haveArrival) {
+      // Only the draws that should be right after a frame
+      int32_t land = (int32_t)(now - lastArrival) - FRAME_ALIGN_MARGIN_US;
+      if ((uint32_t)abs(land) < pacer.periodUs / 2) {
+        if (lockedAtUs < 0 && (uint32_t)abs(land) <= o.lockUs) {
+          lockedAtUs = t;
+        } else if ((uint32_t)abs(land) > o.lockUs) {
+          lockedAtUs = -1;
+        }
+        if (t >= o.seconds * 1e6 / 2) {
+          sumLand += land;
+          sumLandSquared += (double)land * land;
+          landed++;
+        }
+      }
+    }
+    if (t >= nextReportUs) {
+      nextReportUs += 1e6;
+      FramePacerStats stats;
+      FramePacerTakeStats(&pacer, &stats);
+      printf("%6.0f %8u %8u %8u %8u %8u %8d %10u\n", t / 1e6, stats.frames, stats.minIntervalUs,
+             stats.maxIntervalUs, stats.meanIntervalUs, stats.jitterUs, stats.phaseUs, stats.cameraPeriodUs);
+    }
+  }
+
+  printf("\ndraw period %u us\n", pacer.periodUs);
+  if (pacer.periodUs < pacer.nominalUs) {
+    printf("FAILED, drawing faster than nominal\n");
+    return 1;
+  }
+  if (o.mode == FRAME_PACE_CAMERA && pacer.perFrame == 0) {
+    printf("camera faster than nominal, drawing at nominal without lining up\n");
+    return 0;
+  }
+  if (o.mode == FRAME_PACE_CAMERA) {
+    if (lockedAtUs < 0) {
+      printf("never settled within %.0f us of just after a frame\n", o.lockUs);
+      return 1;
+    }
+    printf("settled within %.0f us of just after a frame after %.2f s\n", o.lockUs, lockedAtUs / 1e6);
+  }
+  if (landed > 0) {
+    double mean = sumLand / landed;
+    printf("second half: draws after a frame land %.0f us +-%.0f us rms from the margin\n", mean,
+           sqrt(sumLandSquared / landed - mean * mean));
+  }
+  return 0;
+}
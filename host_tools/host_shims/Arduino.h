@@ -0,0 +1,35 @@
+#pragma once
+
+// Just enough Arduino for the LCD's render path to build on the host, see
+// render_regress.cpp. Not a general purpose Arduino emulation.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#define IRAM_ATTR
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+using std::min;
+using std::max;
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+
+class HostSerial {
+  public:
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  void println(const char *s = "");
+};
+
+extern HostSerial Serial;
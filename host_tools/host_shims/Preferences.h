@@ -0,0 +1,49 @@
+#pragma once
+
+// ESP32 Preferences (NVS) kept in memory, enough for calibration.cpp's
+// load and save on the host, see calibration_check.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences {
+  public:
+  bool begin(const char *name, bool readOnly = false) {
+    space = name;
+    this->readOnly = readOnly;
+    return true;
+  }
+  void end() {}
+  size_t getBytes(const char *key, void *buf, size_t maxLen) {
+    std::map<std::string, std::vector<uint8_t>>::const_iterator it = Store().find(space + "/" + key);
+    if (it == Store().end() || it->second.size() > maxLen) {
+      return 0;
+    }
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+  size_t putBytes(const char *key, const void *value, size_t len) {
+    if (readOnly) {
+      return 0;
+    }
+    Store()[space + "/" + key].assign((const uint8_t *)value, (const uint8_t *)value + len);
+    return len;
+  }
+
+  // Host only: what's in flash, to mess with
+  static std::vector<uint8_t> *HostEntry(const char *name, const char *key) {
+    return &Store()[std::string(name) + "/" + key];
+  }
+
+  private:
+  static std::map<std::string, std::vector<uint8_t>> &Store() {
+    static std::map<std::string, std::vector<uint8_t>> store;
+    return store;
+  }
+  std::string space;
+  bool readOnly = false;
+};
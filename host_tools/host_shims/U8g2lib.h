@@ -0,0 +1,71 @@
+#pragma once
+
+// u8g2 as far as the LCD firmware uses it with an ST7571 128x128 in full
+// buffer mode. Commands and data go out through the byte callback the
+// firmware gives it, the same way the real library's would, so
+// display_dma.cpp's callback gets exercised too. See host_shims.cpp
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#define U8X8_PIN_NONE 255
+enum { U8X8_PIN_SPI_CLOCK, U8X8_PIN_SPI_DATA, U8X8_PIN_CS, U8X8_PIN_DC, U8X8_PIN_RESET, U8X8_PIN_CNT };
+enum {
+  U8X8_MSG_BYTE_INIT = 20,
+  U8X8_MSG_BYTE_SET_DC,
+  U8X8_MSG_BYTE_START_TRANSFER,
+  U8X8_MSG_BYTE_SEND,
+  U8X8_MSG_BYTE_END_TRANSFER,
+};
+
+struct u8x8_struct;
+typedef struct u8x8_struct u8x8_t;
+typedef uint8_t (*u8x8_msg_cb)(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+struct u8x8_struct {
+  uint8_t pins[U8X8_PIN_CNT];
+  uint8_t x_offset;
+  u8x8_msg_cb byte_cb;
+};
+
+#define U8G2_HOST_WIDTH 128
+#define U8G2_HOST_PAGES 16
+
+struct u8g2_t {
+  u8x8_t u8x8;
+  uint8_t buffer[U8G2_HOST_WIDTH * U8G2_HOST_PAGES];
+};
+
+struct u8g2_cb_t {
+  int unused;
+};
+extern const u8g2_cb_t *U8G2_R0;
+
+uint8_t u8x8_gpio_and_delay_arduino(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+void u8g2_Setup_st7571_128x128_f(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb,
+                                 u8x8_msg_cb gpio_and_delay_cb);
+void u8x8_SetPin_4Wire_SW_SPI(u8x8_t *u8x8, uint8_t clock, uint8_t data, uint8_t cs, uint8_t dc, uint8_t reset);
+
+class U8G2 {
+  protected:
+  u8g2_t u8g2;
+
+  public:
+  U8G2() {}
+  u8x8_t *getU8x8() { return &u8g2.u8x8; }
+  u8g2_t *getU8g2() { return &u8g2; }
+  uint8_t *getBufferPtr() { return u8g2.buffer; }
+
+  void begin();
+  void setPowerSave(uint8_t on);
+  void setContrast(uint8_t value);
+  void clearDisplay();
+  void clearBuffer();
+  void sendBuffer();
+  void updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
+  void firstPage();
+  uint8_t nextPage();
+  void drawPixel(int16_t x, int16_t y);
+  void drawBox(int16_t x, int16_t y, int16_t w, int16_t h);
+  void drawDisc(int16_t x, int16_t y, int16_t r);
+};
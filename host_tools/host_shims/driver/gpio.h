@@ -0,0 +1,12 @@
+#pragma once
+
+// ESP-IDF GPIO, levels only. See host_shims.cpp
+
+#include <stdint.h>
+#include "../esp_err.h"
+
+typedef enum { GPIO_NUM_NC = -1, GPIO_NUM_MAX = 40 } gpio_num_t; // ESP32 has 40, so every pin is in range
+typedef enum { GPIO_MODE_INPUT = 1, GPIO_MODE_OUTPUT = 2 } gpio_mode_t;
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode);
@@ -0,0 +1,340 @@
+#include <stdarg.h>
+#include <chrono>
+#include "Arduino.h"
+#include "U8g2lib.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "host_shims.h"
+
+// ---- Arduino ----
+
+HostSerial Serial;
+static const u8g2_cb_t rotation0 = {0};
+const u8g2_cb_t *U8G2_R0 = &rotation0;
+static const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                              started).count();
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+// Nothing on the host is waiting on real time
+void delay(unsigned long) {}
+void delayMicroseconds(unsigned int) {}
+
+int HostSerial::printf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+void HostSerial::println(const char *s) {
+  puts(s);
+}
+
+// ---- Pins and panels ----
+
+struct HostPanel {
+  struct St7571 *emulator;
+  uint8_t cs;
+  uint8_t dc;
+  uint8_t reset;
+};
+
+static struct HostPanel panels[HOST_MAX_PANELS];
+static uint8_t numPanels = 0;
+static uint8_t levels[256];
+static bool levelsSet = false;
+static uint32_t overheadNs = HOST_TRANSACTION_OVERHEAD_NS;
+static struct HostBusStats bus;
+
+static void SetLevel(uint8_t pin, uint8_t level) {
+  if (!levelsSet) {
+    // Everything idles high, CS included
+    memset(levels, 1, sizeof(levels));
+    levelsSet = true;
+  }
+  bool falling = levels[pin] && !level;
+  levels[pin] = level ? 1 : 0;
+  for (uint8_t i = 0; falling && i < numPanels; i++) {
+    if (panels[i].reset == pin) {
+      St7571Reset(panels[i].emulator);
+    }
+  }
+}
+
+static uint8_t GetLevel(uint8_t pin) {
+  return levelsSet ? levels[pin] : 1;
+}
+
+void HostAttachPanel(struct St7571 *emulator, uint8_t cs, uint8_t dc, uint8_t reset) {
+  if (numPanels < HOST_MAX_PANELS) {
+    panels[numPanels].emulator = emulator;
+    panels[numPanels].cs = cs;
+    panels[numPanels].dc = dc;
+    panels[numPanels].reset = reset;
+    numPanels++;
+  }
+}
+
+void HostSetTransactionOverhead(uint32_t ns) {
+  overheadNs = ns;
+}
+
+const struct HostBusStats *HostBus() {
+  return &bus;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  SetLevel(pin, level);
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+  SetLevel((uint8_t)pin, (uint8_t)level);
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t, gpio_mode_t) {
+  return ESP_OK;
+}
+
+// ---- SPI ----
+
+struct spi_device_t {
+  spi_device_interface_config_t config;
+  uint32_t pending; // Queued, result not collected yet
+};
+
+static struct spi_device_t device;
+
+uint32_t HostSpiHz() {
+  return device.config.clock_speed_hz;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t, const spi_bus_config_t *, int) {
+  return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle) {
+  device.config = *config;
+  device.pending = 0;
+  *handle = &device;
+  return ESP_OK;
+}
+
+// Everything goes out as soon as it's queued. Timing is modelled, not real.
+static void Transmit(spi_device_handle_t handle, spi_transaction_t *t) {
+  if (handle->config.pre_cb) {
+    handle->config.pre_cb(t);
+  }
+  const uint8_t *bytes = (t->flags & SPI_TRANS_USE_TXDATA) ? t->tx_data : (const uint8_t *)t->tx_buffer;
+  uint32_t n = t->length / 8;
+  uint32_t byteNs = (uint32_t)(8000000000ULL / (handle->config.clock_speed_hz ? handle->config.clock_speed_hz : 1));
+  uint8_t selected = 0;
+  bus.transactions++;
+  for (uint8_t i = 0; i < numPanels; i++) {
+    if (GetLevel(panels[i].cs) == 0) {
+      St7571Write(panels[i].emulator, GetLevel(panels[i].dc) != 0, bytes, n, byteNs, overheadNs);
+      selected++;
+    }
+  }
+  if (selected == 0) {
+    bus.unselected++;
+  } else if (selected > 1) {
+    bus.collisions++;
+  }
+  if (handle->config.post_cb) {
+    handle->config.post_cb(t);
+  }
+  for (uint8_t i = 0; i < numPanels; i++) {
+    if (GetLevel(panels[i].cs) == 0) {
+      bus.leftSelected++;
+      break;
+    }
+  }
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *t, uint32_t) {
+  Transmit(handle, t);
+  handle->pending++;
+  return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **t, uint32_t) {
+  if (handle->pending == 0) {
+    return ESP_ERR_TIMEOUT;
+  }
+  handle->pending--;
+  *t = NULL;
+  return ESP_OK;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *t) {
+  Transmit(handle, t);
+  return ESP_OK;
+}
+
+// ---- u8g2 ----
+
+// Modelled on u8g2's u8x8_d_st7571.c 128x128 init, check it against the
+// library version in platformio.ini if the two ever disagree
+static const uint8_t initSequence[] = {
+  0xAE,       // Display off
+  0x38, 0xB8, // Mode set
+  0x48, 0x80, // Duty 1/128
+  0xA0,       // ADC normal
+  0xC8,       // SHL reverse
+  0x44, 0x00, // COM0
+  0x40, 0x00, // Start line
+  0xAB,       // Oscillator on
+  0x27,       // Regulator resistor ratio
+  0x81, 0x1F, // Contrast
+  0x54,       // Bias 1/9
+  0x2C, 0x2E, 0x2F, // Power control, booster/regulator/follower on in steps
+  0x7B, 0x11, 0x00, // Extension 3: black and white mode
+  0xA6,       // Not inverted
+  0xA4,       // Normal display (not all on)
+};
+
+uint8_t u8x8_gpio_and_delay_arduino(u8x8_t *, uint8_t, uint8_t, void *) {
+  return 1;
+}
+
+void u8g2_Setup_st7571_128x128_f(u8g2_t *u8g2, const u8g2_cb_t *, u8x8_msg_cb byte_cb,
+                                 u8x8_msg_cb) {
+  memset(u8g2, 0, sizeof(*u8g2));
+  u8g2->u8x8.byte_cb = byte_cb;
+  for (uint8_t i = 0; i < U8X8_PIN_CNT; i++) {
+    u8g2->u8x8.pins[i] = U8X8_PIN_NONE;
+  }
+}
+
+void u8x8_SetPin_4Wire_SW_SPI(u8x8_t *u8x8, uint8_t clock, uint8_t data, uint8_t cs, uint8_t dc, uint8_t reset) {
+  u8x8->pins[U8X8_PIN_SPI_CLOCK] = clock;
+  u8x8->pins[U8X8_PIN_SPI_DATA] = data;
+  u8x8->pins[U8X8_PIN_CS] = cs;
+  u8x8->pins[U8X8_PIN_DC] = dc;
+  u8x8->pins[U8X8_PIN_RESET] = reset;
+}
+
+// Like u8x8_cad_001: one send per command byte, data in one go
+static void SendCommands(u8x8_t *u8x8, const uint8_t *commands, uint16_t n) {
+  u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_START_TRANSFER, 0, NULL);
+  u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_SET_DC, 0, NULL);
+  for (uint16_t i = 0; i < n; i++) {
+    u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_SEND, 1, (void *)&commands[i]);
+  }
+  u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_END_TRANSFER, 0, NULL);
+}
+
+void U8G2::begin() {
+  u8x8_t *u8x8 = getU8x8();
+  u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_INIT, 0, NULL);
+  if (u8x8->pins[U8X8_PIN_RESET] != U8X8_PIN_NONE) {
+    digitalWrite(u8x8->pins[U8X8_PIN_RESET], HIGH);
+    digitalWrite(u8x8->pins[U8X8_PIN_RESET], LOW);
+    digitalWrite(u8x8->pins[U8X8_PIN_RESET], HIGH);
+  }
+  SendCommands(u8x8, initSequence, sizeof(initSequence));
+  clearDisplay();
+  setPowerSave(0);
+}
+
+void U8G2::setPowerSave(uint8_t on) {
+  uint8_t command = on ? 0xAE : 0xAF;
+  SendCommands(getU8x8(), &command, 1);
+}
+
+void U8G2::setContrast(uint8_t value) {
+  uint8_t commands[] = {0x81, (uint8_t)(value >> 2)};
+  SendCommands(getU8x8(), commands, sizeof(commands));
+}
+
+void U8G2::clearBuffer() {
+  memset(u8g2.buffer, 0, sizeof(u8g2.buffer));
+}
+
+void U8G2::clearDisplay() {
+  clearBuffer();
+  sendBuffer();
+}
+
+void U8G2::sendBuffer() {
+  updateDisplayArea(0, 0, U8G2_HOST_WIDTH / 8, U8G2_HOST_PAGES);
+}
+
+// Same commands as u8g2's st7571 tile drawing: column, page, then the bytes
+void U8G2::updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th) {
+  u8x8_t *u8x8 = getU8x8();
+  for (uint8_t page = ty; page < ty + th && page < U8G2_HOST_PAGES; page++) {
+    uint8_t x = tx * 8 + u8x8->x_offset;
+    uint8_t commands[] = {(uint8_t)(0x10 | (x >> 4)), (uint8_t)(x & 0x0F), (uint8_t)(0xB0 | page)};
+    SendCommands(u8x8, commands, sizeof(commands));
+    u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_START_TRANSFER, 0, NULL);
+    u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_SET_DC, 1, NULL);
+    u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_SEND, tw * 8, &u8g2.buffer[page * U8G2_HOST_WIDTH + tx * 8]);
+    u8x8->byte_cb(u8x8, U8X8_MSG_BYTE_END_TRANSFER, 0, NULL);
+  }
+}
+
+void U8G2::firstPage() {
+  clearBuffer();
+}
+
+uint8_t U8G2::nextPage() {
+  sendBuffer();
+  return 0;
+}
+
+void U8G2::drawPixel(int16_t x, int16_t y) {
+  if (x >= 0 && x < U8G2_HOST_WIDTH && y >= 0 && y < U8G2_HOST_PAGES * 8) {
+    u8g2.buffer[(y >> 3) * U8G2_HOST_WIDTH + x] |= 1 << (y & 7);
+  }
+}
+
+void U8G2::drawBox(int16_t x, int16_t y, int16_t w, int16_t h) {
+  for (int16_t j = y; j < y + h; j++) {
+    for (int16_t i = x; i < x + w; i++) {
+      drawPixel(i, j);
+    }
+  }
+}
+
+// u8g2's midpoint disc, pixel for pixel
+void U8G2::drawDisc(int16_t x0, int16_t y0, int16_t r) {
+  int16_t f = 1 - r;
+  int16_t ddFx = 1;
+  int16_t ddFy = -2 * r;
+  int16_t x = 0;
+  int16_t y = r;
+  for (;;) {
+    for (int16_t i = -y; i <= y; i++) {
+      drawPixel(x0 + x, y0 + i);
+      drawPixel(x0 - x, y0 + i);
+    }
+    for (int16_t i = -x; i <= x; i++) {
+      drawPixel(x0 + y, y0 + i);
+      drawPixel(x0 - y, y0 + i);
+    }
+    if (x >= y) {
+      break;
+    }
+    if (f >= 0) {
+      y--;
+      ddFy += 2;
+      f += ddFy;
+    }
+    x++;
+    ddFx += 2;
+    f += ddFx;
+  }
+}
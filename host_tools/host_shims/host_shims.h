@@ -0,0 +1,25 @@
+#pragma once
+
+// Wiring for the host shims: which emulated ST7571 sits on which pins, and
+// how long a transaction takes on the modelled bus.
+
+#include <stdint.h>
+#include "../st7571_emulator.h"
+
+#define HOST_MAX_PANELS 4
+// CS/DC switching in the pre/post-transfer callbacks plus the driver queueing the
+// next descriptor. A guess until it's measured on the board with a scope.
+#define HOST_TRANSACTION_OVERHEAD_NS 2000
+
+struct HostBusStats {
+  uint32_t transactions;
+  uint32_t unselected; // Went out with no CS low
+  uint32_t collisions; // More than one CS low at once
+  uint32_t leftSelected; // A CS still low once it's done
+};
+
+void HostAttachPanel(struct St7571 *emulator, uint8_t cs, uint8_t dc, uint8_t reset);
+void HostSetTransactionOverhead(uint32_t ns);
+// Pins set up by spi_bus_add_device(), 0 before that
+uint32_t HostSpiHz();
+const struct HostBusStats *HostBus();
@@ -0,0 +1,254 @@
+/*
+  Camera -> LCD serial link on the host, no boards needed.
+
+  Runs the real sender (LightLinkFormat*) and receiver (LightLinkFeed) from
+  shared/light_link through a simulated UART: bytes take 10 bit times each at
+  the chosen baud, the LCD's RX buffer overflows if it's busy drawing, and
+  bytes can be dropped, bit flipped or replaced by bursts of garbage.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../shared/light_link link_loopback.cpp -o link_loopback
+    ./link_loopback --lights 4 --fps 0 --flip 1e-4 --burst 1e-5
+
+  --fps 0 means the camera sends as fast as the link lets it, which gives the
+  maximum sustained light updates per second for those settings.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "light_link.h"
+
+struct Options {
+  uint32_t baud = LIGHT_LINK_BAUD;
+  uint16_t lightsPerFrame = 4;
+  double fps = 30;            // 0 = as fast as the link allows
+  double seconds = 10;
+  double dropRate = 0;        // per byte
+  double flipRate = 0;        // per byte, flips one random bit
+  double burstRate = 0;       // per byte, starts a burst of garbage
+  uint16_t burstLength = 16;  // bytes
+  double drawUs = 0;          // LCD doesn't read the UART while drawing
+  uint32_t rxBufferBytes = 256; // Arduino-ESP32 HardwareSerial default
+  uint32_t seed = 1;
+};
+
+struct WireByte {
+  char c;
+  double arriveUs;
+  uint32_t frame;
+  bool faulted; // Touched by fault injection
+};
+
+struct SentLight {
+  uint16_t x;
+  uint16_t y;
+};
+
+static double Percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t i = (size_t)(p / 100.0 * (v.size() - 1) + 0.5);
+  return v[i];
+}
+
+static void PrintDistribution(const char *name, const std::vector<double> &v) {
+  if (v.empty()) {
+    printf("%-20s (none)\n", name);
+    return;
+  }
+  double sum = 0;
+  for (double d : v) sum += d;
+  printf("%-20s n=%zu mean=%.1f p50=%.1f p90=%.1f p99=%.1f max=%.1f us\n", name, v.size(),
+         sum / v.size(), Percentile(v, 50), Percentile(v, 90), Percentile(v, 99),
+         Percentile(v, 100));
+}
+
+static void Usage() {
+  printf("link_loopback [--baud N] [--lights N] [--fps F] [--seconds S]\n"
+         "              [--drop P] [--flip P] [--burst P] [--burst-len N]\n"
+         "              [--draw-us US] [--rx-buffer N] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--baud"))      o.baud = atoi(v);
+    else if (!strcmp(a, "--lights"))    o.lightsPerFrame = atoi(v);
+    else if (!strcmp(a, "--fps"))       o.fps = atof(v);
+    else if (!strcmp(a, "--seconds"))   o.seconds = atof(v);
+    else if (!strcmp(a, "--drop"))      o.dropRate = atof(v);
+    else if (!strcmp(a, "--flip"))      o.flipRate = atof(v);
+    else if (!strcmp(a, "--burst"))     o.burstRate = atof(v);
+    else if (!strcmp(a, "--burst-len")) o.burstLength = atoi(v);
+    else if (!strcmp(a, "--draw-us"))   o.drawUs = atof(v);
+    else if (!strcmp(a, "--rx-buffer")) o.rxBufferBytes = atoi(v);
+    else if (!strcmp(a, "--seed"))      o.seed = atoi(v);
+    else { Usage(); return 1; }
+    i++;
+  }
+
+  std::mt19937 rng(o.seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::uniform_int_distribution<int> coord(0, 159);
+  const double byteUs = 10.0 * 1e6 / o.baud; // 8N1
+
+  // ---- Camera side: build the byte stream as it comes off the wire ----
+  std::vector<WireByte> wire;
+  std::vector<std::vector<SentLight>> sentFrames;
+  std::vector<double> frameCaptureUs;
+  std::vector<double> faultUs;
+  double txFreeUs = 0;
+  double nextCaptureUs = 0;
+  uint16_t burstLeft = 0;
+  char line[LIGHT_LINK_LINE_BYTES];
+
+  while (nextCaptureUs < o.seconds * 1e6) {
+    // Camera grabs the latest frame once it's done writing the previous one
+    double captureUs = std::max(nextCaptureUs, txFreeUs);
+    uint32_t frame = sentFrames.size();
+    sentFrames.push_back(std::vector<SentLight>());
+    frameCaptureUs.push_back(captureUs);
+    txFreeUs = captureUs;
+
+    for (uint16_t l = 0; l <= o.lightsPerFrame; l++) {
+      uint8_t n;
+      if (l < o.lightsPerFrame) {
+        SentLight s = {(uint16_t)coord(rng), (uint16_t)coord(rng)};
+        sentFrames[frame].push_back(s);
+        n = LightLinkFormatLight(line, s.x, s.y);
+      } else {
+        n = LightLinkFormatFrameEnd(line);
+      }
+      for (uint8_t b = 0; b < n; b++) {
+        txFreeUs += byteUs;
+        WireByte w = {line[b], txFreeUs, frame, false};
+        if (burstLeft == 0 && o.burstRate > 0 && uniform(rng) < o.burstRate) {
+          burstLeft = o.burstLength;
+          faultUs.push_back(txFreeUs);
+        }
+        if (burstLeft > 0) {
+          burstLeft--;
+          w.c = (char)(rng() & 0xFF);
+          w.faulted = true;
+        } else if (o.dropRate > 0 && uniform(rng) < o.dropRate) {
+          faultUs.push_back(txFreeUs);
+          continue;
+        } else if (o.flipRate > 0 && uniform(rng) < o.flipRate) {
+          w.c ^= (char)(1 << (rng() % 8));
+          w.faulted = true;
+          faultUs.push_back(txFreeUs);
+        }
+        wire.push_back(w);
+      }
+    }
+    nextCaptureUs = (o.fps > 0) ? captureUs + 1e6 / o.fps : txFreeUs;
+  }
+
+  // ---- LCD side: RX buffer + parser, busy for drawUs after each frame ----
+  LightLinkParser parser;
+  LightLinkInit(&parser);
+  std::deque<WireByte> rx;
+  double busyUntilUs = 0;
+  double nowUs = 0;
+  size_t next = 0;
+  size_t faultIdx = 0;
+  uint32_t rxOverflowBytes = 0;
+  uint32_t lightsOk = 0;
+  uint32_t lightsWrong = 0; // Passed validation but not what was sent
+  uint32_t framesDrawn = 0;
+  uint32_t frameLights = 0;
+  bool lineFaulted = false;
+  uint32_t lineFrame = 0;
+  std::vector<double> latencyUs;
+  std::vector<double> recoveryUs;
+  std::vector<bool> frameSeen(sentFrames.size(), false);
+  std::vector<uint16_t> frameMatched(sentFrames.size(), 0);
+
+  while (next < wire.size() || !rx.empty()) {
+    // Bytes land in the RX buffer whether or not the LCD is looking
+    double readAtUs = std::max(nowUs, busyUntilUs);
+    while (next < wire.size() && wire[next].arriveUs <= readAtUs) {
+      if (rx.size() >= o.rxBufferBytes) {
+        rxOverflowBytes++;
+      } else {
+        rx.push_back(wire[next]);
+      }
+      next++;
+    }
+    if (rx.empty()) {
+      nowUs = wire[next].arriveUs;
+      continue;
+    }
+    nowUs = readAtUs;
+
+    WireByte w = rx.front();
+    rx.pop_front();
+    lineFaulted = lineFaulted || w.faulted;
+    lineFrame = w.frame;
+
+    LightLinkMessage m;
+    LightLinkEvent e = LightLinkFeed(&parser, w.c, &m);
+    if (e == LINK_NONE) {
+      continue;
+    }
+    if (e == LINK_LIGHT) {
+      bool match = false;
+      std::vector<SentLight> &sent = sentFrames[lineFrame];
+      for (size_t i = 0; i < sent.size(); i++) {
+        if (sent[i].x == m.x && sent[i].y == m.y) match = true;
+      }
+      if (!match) {
+        lightsWrong++;
+      } else {
+        lightsOk++;
+        frameMatched[lineFrame]++;
+      }
+      // First clean light that started after a fault = recovered
+      double lineStartUs = w.arriveUs - LIGHT_LINK_LINE_BYTES * byteUs;
+      while (match && !lineFaulted && faultIdx < faultUs.size() && faultUs[faultIdx] < lineStartUs) {
+        recoveryUs.push_back(nowUs - faultUs[faultIdx]);
+        faultIdx++;
+      }
+      frameLights++;
+    }
+    if (e == LINK_FRAME_END && frameLights > 0) {
+      if (!frameSeen[lineFrame] && frameMatched[lineFrame] == sentFrames[lineFrame].size()) {
+        latencyUs.push_back(nowUs + o.drawUs - frameCaptureUs[lineFrame]);
+      }
+      frameSeen[lineFrame] = true;
+      framesDrawn++;
+      frameLights = 0;
+      busyUntilUs = nowUs + o.drawUs;
+    }
+    lineFaulted = false;
+  }
+
+  uint32_t lightsSent = 0;
+  for (size_t f = 0; f < sentFrames.size(); f++) lightsSent += sentFrames[f].size();
+  double seconds = std::max(nowUs, txFreeUs) / 1e6;
+
+  printf("baud=%u lights/frame=%u fps=%s%.1f draw=%.0fus rx-buffer=%u\n", o.baud,
+         o.lightsPerFrame, o.fps > 0 ? "" : "max ", (double)sentFrames.size() / seconds,
+         o.drawUs, o.rxBufferBytes);
+  printf("faults injected       %zu (drop=%g flip=%g burst=%g x%u)\n", faultUs.size(),
+         o.dropRate, o.flipRate, o.burstRate, o.burstLength);
+  printf("lights sent           %u\n", lightsSent);
+  printf("lights delivered      %u (%.2f%%)\n", lightsOk, 100.0 * lightsOk / std::max(1u, lightsSent));
+  printf("lights wrong          %u (passed validation, didn't match)\n", lightsWrong);
+  printf("bad lines dropped     %u\n", parser.badLines);
+  printf("rx overflow bytes     %u\n", rxOverflowBytes);
+  printf("frames drawn          %u\n", framesDrawn);
+  printf("light updates/s       %.0f\n", lightsOk / seconds);
+  PrintDistribution("latency", latencyUs);
+  PrintDistribution("recovery", recoveryUs);
+  return 0;
+}
@@ -0,0 +1,420 @@
+/*
+  Checks the LCD's disc rasterizer (lcd_graphical_esp32_arduino_poc
+  mask_raster.cpp) pixel for pixel against u8g2's drawDisc, and times it.
+
+  The reference below is u8g2's u8g2_draw_disc() midpoint walk, drawing its
+  vlines one pixel at a time into a page-major buffer like the ST7571's.
+  Every radius up to --max-radius is drawn at positions all over the panel
+  and past every edge.
+
+  Also times a whole frame of 15 lights in 1-bit against the 2 bit gray mode
+  (gray_raster.cpp), which has to fit in the same frame time.
+
+  Ellipses and polygons (shape_raster.cpp): random convex polygons against a
+  brute force pixel-center-inside test, ellipses checked to cover every pixel
+  inside the real ellipse, then how much less they block than the disc that
+  would have to cover them, and how fast they draw.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../lcd_graphical_esp32_arduino_poc/include mask_raster_check.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/mask_raster.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/gray_raster.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/shape_raster.cpp -o mask_raster_check
+    ./mask_raster_check --max-radius 40 --pbm discs.pbm --pgm gray.pgm
+
+  --pbm / --pgm write one frame of assorted discs, to eyeball.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "mask_raster.h"
+#include "gray_raster.h"
+#include "shape_raster.h"
+
+#define BUFFER_BYTES (MASK_WIDTH * MASK_PAGES)
+
+static void SetPixel(uint8_t *buffer, int x, int y) {
+  if (x < 0 || x >= MASK_WIDTH || y < 0 || y >= MASK_PAGES * 8) {
+    return;
+  }
+  buffer[(y / 8) * MASK_WIDTH + x] |= 1 << (y & 7);
+}
+
+static void VLine(uint8_t *buffer, int x, int y, int length) {
+  for (int i = 0; i < length; i++) {
+    SetPixel(buffer, x, y + i);
+  }
+}
+
+static void ReferenceSection(uint8_t *buffer, int x, int y, int x0, int y0) {
+  VLine(buffer, x0 + x, y0 - y, y + 1);
+  VLine(buffer, x0 + y, y0 - x, x + 1);
+  VLine(buffer, x0 - x, y0 - y, y + 1);
+  VLine(buffer, x0 - y, y0 - x, x + 1);
+  VLine(buffer, x0 + x, y0, y + 1);
+  VLine(buffer, x0 + y, y0, x + 1);
+  VLine(buffer, x0 - x, y0, y + 1);
+  VLine(buffer, x0 - y, y0, x + 1);
+}
+
+static void ReferenceDisc(uint8_t *buffer, int x0, int y0, int rad) {
+  int f = 1 - rad;
+  int ddFx = 1;
+  int ddFy = -2 * rad;
+  int x = 0;
+  int y = rad;
+  ReferenceSection(buffer, x, y, x0, y0);
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddFy += 2;
+      f += ddFy;
+    }
+    x++;
+    ddFx += 2;
+    f += ddFx;
+    ReferenceSection(buffer, x, y, x0, y0);
+  }
+}
+
+static void WritePbm(const char *path, const uint8_t *buffer) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return;
+  }
+  fprintf(f, "P1\n%d %d\n", MASK_WIDTH, MASK_PAGES * 8);
+  for (int y = 0; y < MASK_PAGES * 8; y++) {
+    for (int x = 0; x < MASK_WIDTH; x++) {
+      fputc(buffer[(y / 8) * MASK_WIDTH + x] & (1 << (y & 7)) ? '1' : '0', f);
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+}
+
+static void WritePgm(const char *path, const uint8_t *buffer) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return;
+  }
+  fprintf(f, "P2\n%d %d\n3\n", GRAY_WIDTH, GRAY_PAGES * 8);
+  for (int y = 0; y < GRAY_PAGES * 8; y++) {
+    for (int x = 0; x < GRAY_WIDTH; x++) {
+      const uint8_t *column = &buffer[(y / 8) * GRAY_PAGE_BYTES + x * 2];
+      int bit = 1 << (y & 7);
+      int level = (column[GRAY_PLANE_MSB] & bit ? 2 : 0) | (column[GRAY_PLANE_LSB] & bit ? 1 : 0);
+      fprintf(f, "%d ", 3 - level); // PGM is 0 = black
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+}
+
+static void SceneLight(int i, int16_t *x, int16_t *y, uint8_t *r) {
+  *x = 8 + (i * 29) % 112;
+  *y = 8 + (i * 47) % 112;
+  *r = 1 + (i * 7) % 20;
+}
+
+static bool GetPixel(const uint8_t *buffer, int x, int y) {
+  return buffer[(y / 8) * MASK_WIDTH + x] & (1 << (y & 7));
+}
+
+static int CountPixels(const uint8_t *buffer) {
+  int n = 0;
+  for (int i = 0; i < BUFFER_BYTES; i++) {
+    n += __builtin_popcount(buffer[i]);
+  }
+  return n;
+}
+
+// Pixel centers inside or on the edge of a convex polygon, either winding
+static void ReferencePolygon(uint8_t *buffer, int x0, int y0, const int8_t *vx, const int8_t *vy, int n) {
+  for (int y = 0; y < MASK_PAGES * 8; y++) {
+    for (int x = 0; x < MASK_WIDTH; x++) {
+      bool anyPositive = false;
+      bool anyNegative = false;
+      for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        long cross = (long)(vx[j] - vx[i]) * (y - y0 - vy[i]) - (long)(vy[j] - vy[i]) * (x - x0 - vx[i]);
+        anyPositive |= cross > 0;
+        anyNegative |= cross < 0;
+      }
+      if (!(anyPositive && anyNegative)) {
+        SetPixel(buffer, x, y);
+      }
+    }
+  }
+}
+
+static bool Convex(const int8_t *vx, const int8_t *vy, int n) {
+  int sign = 0;
+  for (int i = 0; i < n; i++) {
+    int j = (i + 1) % n;
+    int k = (i + 2) % n;
+    long cross = (long)(vx[j] - vx[i]) * (vy[k] - vy[j]) - (long)(vy[j] - vy[i]) * (vx[k] - vx[j]);
+    int s = cross > 0 ? 1 : cross < 0 ? -1 : 0;
+    if (s == 0 || (sign != 0 && s != sign)) {
+      return false;
+    }
+    sign = s;
+  }
+  return true;
+}
+
+// 0 at the center, 1 on the edge of the real (unpadded) ellipse
+static double EllipseValue(int x, int y, int x0, int y0, int major, int minor, int angle) {
+  double t = angle * M_PI / 256;
+  double dx = x - x0;
+  double dy = y - y0;
+  double u = dx * cos(t) + dy * sin(t);
+  double v = -dx * sin(t) + dy * cos(t);
+  return (u * u) / ((double)major * major) + (v * v) / ((double)minor * minor);
+}
+
+// Returns how many were wrong
+static uint32_t CheckShapes(uint8_t *got, uint8_t *want) {
+  std::mt19937 rng(1);
+  uint32_t checked = 0;
+  uint32_t wrong = 0;
+  int8_t vx[SHAPE_MAX_VERTICES];
+  int8_t vy[SHAPE_MAX_VERTICES];
+  while (checked < 20000) {
+    int n = 3 + rng() % 4;
+    double radius = 1 + rng() % 60;
+    double angles[SHAPE_MAX_VERTICES];
+    for (int i = 0; i < n; i++) {
+      angles[i] = (rng() % 3600) * M_PI / 1800;
+    }
+    std::sort(angles, angles + n);
+    for (int i = 0; i < n; i++) {
+      vx[i] = (int8_t)lround(radius * cos(angles[i]));
+      vy[i] = (int8_t)lround(radius * sin(angles[i]) * (0.2 + (rng() % 9) / 10.0));
+    }
+    if (rng() & 1) {
+      std::reverse(vx, vx + n);
+      std::reverse(vy, vy + n);
+    }
+    if (!Convex(vx, vy, n)) {
+      continue;
+    }
+    int x = -40 + rng() % 208;
+    int y = -40 + rng() % 208;
+    memset(got, 0, BUFFER_BYTES);
+    memset(want, 0, BUFFER_BYTES);
+    ShapeDrawPolygon(got, SHAPE_MONO, x, y, vx, vy, n);
+    ReferencePolygon(want, x, y, vx, vy, n);
+    checked++;
+    if (memcmp(got, want, BUFFER_BYTES) != 0) {
+      if (wrong < 10) {
+        printf("mismatch: %d-gon at (%d, %d)\n", n, x, y);
+      }
+      wrong++;
+    }
+  }
+  printf("%u polygons checked, %u differ from brute force\n", checked, wrong);
+
+  uint32_t ellipses = 0;
+  uint32_t uncovered = 0;
+  for (int major = 1; major <= 60; major += 3) {
+    for (int minor = 1; minor <= major; minor += 2) {
+      for (int angle = 0; angle < 256; angle += 7) {
+        int x = 20 + (major * 7 + angle) % 90;
+        int y = 20 + (minor * 13 + angle) % 90;
+        memset(got, 0, BUFFER_BYTES);
+        ShapeDrawEllipse(got, SHAPE_MONO, x, y, major, minor, angle);
+        ellipses++;
+        for (int py = 0; py < MASK_PAGES * 8; py++) {
+          for (int px = 0; px < MASK_WIDTH; px++) {
+            if (!GetPixel(got, px, py) && EllipseValue(px, py, x, y, major, minor, angle) < 1.0 - 1e-3) {
+              uncovered++;
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("%u ellipses checked, %u pixels inside them left clear\n", ellipses, uncovered);
+  return wrong + uncovered;
+}
+
+// Blocked pixels against the covering disc, averaged over angles
+static void ShapeArea() {
+  static uint8_t buffer[BUFFER_BYTES];
+  static const int shapes[][2] = {{6, 6}, {6, 3}, {12, 12}, {12, 6}, {12, 3}, {24, 8}, {24, 4}, {40, 6}};
+  for (unsigned s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+    int major = shapes[s][0];
+    int minor = shapes[s][1];
+    memset(buffer, 0, sizeof(buffer));
+    MaskDrawDisc(buffer, 64, 64, major);
+    int disc = CountPixels(buffer);
+    long ellipse = 0;
+    for (int angle = 0; angle < 256; angle++) {
+      memset(buffer, 0, sizeof(buffer));
+      ShapeDrawEllipse(buffer, SHAPE_MONO, 64, 64, major, minor, angle);
+      ellipse += CountPixels(buffer);
+    }
+    double mean = ellipse / 256.0;
+    printf("ellipse %2dx%-2d: %6.0f px blocked (ideal %6.0f), covering disc %5d px, %3.0f%% less\n", major, minor,
+           mean, M_PI * major * minor, disc, 100.0 * (1 - mean / disc));
+  }
+}
+
+static void ShapeSpeed(uint8_t *got) {
+  static const int shapes[][2] = {{4, 2}, {12, 12}, {12, 3}, {24, 6}};
+  const uint32_t count = 1000000;
+  for (unsigned s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+    double ms[2];
+    for (int which = 0; which < 2; which++) {
+      memset(got, 0, BUFFER_BYTES);
+      auto start = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < count; i++) {
+        if (which == 0) {
+          ShapeDrawEllipse(got, SHAPE_MONO, (i * 29) % 128, (i * 47) % 128, shapes[s][0], shapes[s][1], i);
+        } else {
+          MaskDrawDisc(got, (i * 29) % 128, (i * 47) % 128, shapes[s][0]);
+        }
+      }
+      ms[which] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    printf("ellipse %2dx%-2d: %8.0f/ms, covering disc %8.0f/ms (host)\n", shapes[s][0], shapes[s][1],
+           count / ms[0], count / ms[1]);
+  }
+  static const int8_t hx[] = {-10, -4, 8, 10, 4, -8};
+  static const int8_t hy[] = {-2, -6, -4, 2, 6, 4};
+  memset(got, 0, BUFFER_BYTES);
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < count; i++) {
+    ShapeDrawPolygon(got, SHAPE_MONO, (i * 29) % 128, (i * 47) % 128, hx, hy, 6);
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("hexagon 20x12: %8.0f/ms (host)\n", count / ms);
+}
+
+static void Usage() {
+  printf("mask_raster_check [--max-radius R] [--pbm FILE] [--pgm FILE]\n");
+}
+
+int main(int argc, char **argv) {
+  int maxRadius = 40;
+  const char *pbm = NULL;
+  const char *pgm = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--max-radius")) maxRadius = atoi(v);
+    else if (!strcmp(a, "--pbm"))        pbm = v;
+    else if (!strcmp(a, "--pgm"))        pgm = v;
+    else { Usage(); return 1; }
+    i++;
+  }
+  if (maxRadius > 255) {
+    maxRadius = 255;
+  }
+
+  MaskRasterInit();
+  GrayRasterInit();
+  ShapeRasterInit();
+  static uint8_t got[BUFFER_BYTES];
+  static uint8_t want[BUFFER_BYTES];
+  uint32_t checked = 0;
+  uint32_t wrong = 0;
+
+  for (int r = 0; r <= maxRadius; r++) {
+    for (int y = -r - 2; y < MASK_PAGES * 8 + r + 2; y += 3) {
+      for (int x = -r - 2; x < MASK_WIDTH + r + 2; x += 5) {
+        memset(got, 0, sizeof(got));
+        memset(want, 0, sizeof(want));
+        MaskDrawDisc(got, x, y, r);
+        ReferenceDisc(want, x, y, r);
+        checked++;
+        if (memcmp(got, want, sizeof(got)) != 0) {
+          if (wrong < 10) {
+            printf("mismatch: r=%d at (%d, %d)\n", r, x, y);
+          }
+          wrong++;
+        }
+      }
+    }
+  }
+  printf("%u discs checked, %u differ from u8g2\n", checked, wrong);
+  uint32_t shapesWrong = CheckShapes(got, want);
+  ShapeArea();
+
+  static uint8_t gray[GRAY_PAGES * GRAY_PAGE_BYTES];
+  int16_t lx, ly;
+  uint8_t lr;
+  if (pbm) {
+    memset(got, 0, sizeof(got));
+    for (int i = 0; i < 15; i++) {
+      SceneLight(i, &lx, &ly, &lr);
+      MaskDrawDisc(got, lx, ly, lr);
+    }
+    WritePbm(pbm, got);
+  }
+  if (pgm) {
+    memset(gray, 0, sizeof(gray));
+    for (int i = 0; i < 15; i++) {
+      SceneLight(i, &lx, &ly, &lr);
+      GrayDrawLight(gray, lx, ly, lr);
+    }
+    WritePgm(pgm, gray);
+  }
+
+  // Whole frames as RenderLights() does them, clear included. Small lights
+  // like the camera usually sends.
+  const uint32_t frames = 20000;
+  double frameUs[2];
+  for (int which = 0; which < 2; which++) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frames; f++) {
+      if (which == 0) {
+        memset(got, 0, sizeof(got));
+      } else {
+        memset(gray, 0, sizeof(gray));
+      }
+      for (int i = 0; i < 15; i++) {
+        SceneLight(i + f, &lx, &ly, &lr);
+        lr = 2 + lr % 6;
+        if (which == 0) {
+          MaskDrawDisc(got, lx, ly, lr);
+        } else {
+          GrayDrawLight(gray, lx, ly, lr);
+        }
+      }
+    }
+    frameUs[which] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+  }
+  printf("15 light frame: 1-bit %.2f us, gray %.2f us (host)\n", frameUs[0], frameUs[1]);
+
+  static const int radii[] = {4, 12, 24};
+  const uint32_t discs = 1000000;
+  for (unsigned r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+    double ms[2];
+    for (int which = 0; which < 2; which++) {
+      memset(got, 0, sizeof(got));
+      auto start = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < discs; i++) {
+        if (which == 0) {
+          MaskDrawDisc(got, (i * 29) % 128, (i * 47) % 128, radii[r]);
+        } else {
+          ReferenceDisc(got, (i * 29) % 128, (i * 47) % 128, radii[r]);
+        }
+      }
+      ms[which] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    printf("r=%2d: %8.0f discs/ms, reference %8.0f discs/ms (host, not the ESP32)\n", radii[r],
+           discs / ms[0], discs / ms[1]);
+  }
+  ShapeSpeed(got);
+  return wrong == 0 && shapesWrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+/*
+  Checks the LCD's fixed point parallax projection (lcd_graphical_esp32_arduino_poc
+  parallax.cpp) against a float model that does the geometry the long way:
+  a ray out of the camera through the pixel, the source on it at the given
+  distance, the line from there to the eye, and where that crosses the panel.
+
+  Every camera pixel, for sources from 30 cm to 65 m, and for the eye moved
+  around a few mm like glasses sitting differently. Both the assumed distance
+  path (ParallaxSetDistance() + ParallaxPoint()) and per light distances
+  through ParallaxProject(). Then how far the blocked spot moves with distance
+  (what a flat offset gets wrong), and cycles for a batch of lights.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../lcd_graphical_esp32_arduino_poc/include parallax_check.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/parallax.cpp -o parallax_check
+    ./parallax_check
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "parallax.h"
+
+#define CAMERA_WIDTH 160
+#define CAMERA_HEIGHT 120
+#define BATCH 64
+
+// Same as main.cpp's right eye (EYES_PARALLAX)
+static const struct ParallaxGeometry rightEye = {
+  /* eye=*/ {32000, 0, 0},
+  /* camera=*/ {0, -5000, 20000},
+  /* lcdCenter=*/ {32000, 0, 15000},
+  /* lcdPitch=*/ 280,
+  /* lcdXSign=*/ -1,
+  /* focalQ4=*/ 140 * 16,
+  /* principalXQ4=*/ 80 * 16,
+  /* principalYQ4=*/ 60 * 16,
+  /* distanceMm=*/ 20000,
+};
+
+// The long way round, in mm
+static void ModelPoint(const struct ParallaxGeometry *g, double u, double v, double distanceMm, double *lcdX,
+                       double *lcdY) {
+  double eye[3], camera[3], lcd[3];
+  for (int i = 0; i < 3; i++) {
+    eye[i] = g->eye[i] / 1000.0;
+    camera[i] = g->camera[i] / 1000.0;
+    lcd[i] = g->lcdCenter[i] / 1000.0;
+  }
+  double f = g->focalQ4 / 16.0;
+  double ray[3] = {(u - g->principalXQ4 / 16.0) / f, (v - g->principalYQ4 / 16.0) / f, 1};
+  double source[3];
+  for (int i = 0; i < 3; i++) {
+    source[i] = camera[i] + ray[i] * distanceMm;
+  }
+  // Eye to source, where it crosses z = lcd[2]
+  double t = (lcd[2] - eye[2]) / (source[2] - eye[2]);
+  double x = eye[0] + t * (source[0] - eye[0]);
+  double y = eye[1] + t * (source[1] - eye[1]);
+  double pitch = g->lcdPitch / 1000.0;
+  *lcdX = PARALLAX_LCD_CENTER + g->lcdXSign * (x - lcd[0]) / pitch;
+  *lcdY = PARALLAX_LCD_CENTER + (y - lcd[1]) / pitch;
+}
+
+struct Errors {
+  double max;
+  double sum;
+  uint32_t points;
+};
+
+static void Add(struct Errors *e, double wantX, double wantY, int32_t gotX, int32_t gotY) {
+  double d = hypot(gotX / 256.0 - wantX, gotY / 256.0 - wantY);
+  e->max = d > e->max ? d : e->max;
+  e->sum += d;
+  e->points++;
+}
+
+static bool Accuracy(const struct ParallaxGeometry *g, const char *title) {
+  static const uint16_t distances[] = {300, 1000, 3000, 20000, 65000};
+  struct Errors assumed = {0, 0, 0};
+  struct Errors perLight = {0, 0, 0};
+  struct Parallax p;
+  ParallaxInit(&p, g);
+  int16_t xs[CAMERA_WIDTH], ys[CAMERA_WIDTH];
+  uint16_t ds[CAMERA_WIDTH];
+  int32_t lx[CAMERA_WIDTH], ly[CAMERA_WIDTH];
+  for (uint16_t distance : distances) {
+    ParallaxSetDistance(&p, distance);
+    for (int v = 0; v < CAMERA_HEIGHT; v++) {
+      for (int u = 0; u < CAMERA_WIDTH; u++) {
+        double wantX, wantY;
+        int32_t gotX, gotY;
+        ModelPoint(g, u, v, distance, &wantX, &wantY);
+        ParallaxPoint(&p, u, v, &gotX, &gotY);
+        Add(&assumed, wantX, wantY, gotX, gotY);
+      }
+    }
+  }
+  // Every light at its own distance, the assumed one left at the default
+  ParallaxSetDistance(&p, g->distanceMm);
+  for (int v = 0; v < CAMERA_HEIGHT; v++) {
+    for (int u = 0; u < CAMERA_WIDTH; u++) {
+      xs[u] = u;
+      ys[u] = v;
+      ds[u] = distances[(u + v) % 5];
+    }
+    ParallaxProject(&p, xs, ys, ds, CAMERA_WIDTH, lx, ly);
+    for (int u = 0; u < CAMERA_WIDTH; u++) {
+      double wantX, wantY;
+      ModelPoint(g, u, v, ds[u], &wantX, &wantY);
+      Add(&perLight, wantX, wantY, lx[u], ly[u]);
+    }
+  }
+  printf("%-24s assumed distance max %.3f px, mean %.3f px; per light max %.3f px, mean %.3f px\n", title,
+         assumed.max, assumed.sum / assumed.points, perLight.max, perLight.sum / perLight.points);
+  return assumed.max < 0.5 && perLight.max < 0.5;
+}
+
+// How far the spot for the middle and a corner of the camera moves between
+// a source this far and one at 65 m
+static void Shift(const struct ParallaxGeometry *g) {
+  static const uint16_t distances[] = {300, 1000, 3000, 10000};
+  printf("spot moves vs a source at 65 m (LCD px, middle / corner of the camera):\n");
+  for (uint16_t distance : distances) {
+    double fx, fy, nx, ny, cfx, cfy, cnx, cny;
+    ModelPoint(g, 80, 60, 65000, &fx, &fy);
+    ModelPoint(g, 80, 60, distance, &nx, &ny);
+    ModelPoint(g, 0, 0, 65000, &cfx, &cfy);
+    ModelPoint(g, 0, 0, distance, &cnx, &cny);
+    printf("  %5.1f m: %5.2f / %5.2f\n", distance / 1000.0, hypot(nx - fx, ny - fy), hypot(cnx - cfx, cny - cfy));
+  }
+}
+
+static volatile int32_t sink;
+
+static void Time(const char *title, const struct Parallax *p, const uint16_t *distances) {
+  int16_t xs[BATCH], ys[BATCH];
+  int32_t lx[BATCH], ly[BATCH];
+  for (int i = 0; i < BATCH; i++) {
+    xs[i] = (i * 37) % CAMERA_WIDTH;
+    ys[i] = (i * 53) % CAMERA_HEIGHT;
+  }
+  const int rounds = 100000;
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_RDTSC
+  uint64_t t0 = __rdtsc();
+#endif
+  int32_t acc = 0;
+  for (int r = 0; r < rounds; r++) {
+    xs[r & (BATCH - 1)] ^= 1;
+    ParallaxProject(p, xs, ys, distances, BATCH, lx, ly);
+    acc += lx[r & (BATCH - 1)] ^ ly[(r * 7) & (BATCH - 1)];
+  }
+#ifdef HAVE_RDTSC
+  uint64_t cycles = __rdtsc() - t0;
+#endif
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  sink = acc;
+#ifdef HAVE_RDTSC
+  printf("  %-22s %7.0f cycles/batch of %d (%5.2f per light), %6.0f ns/batch\n", title, (double)cycles / rounds, BATCH,
+         (double)cycles / rounds / BATCH, ns / rounds);
+#else
+  printf("  %-22s %6.0f ns/batch of %d\n", title, ns / rounds, BATCH);
+#endif
+}
+
+int main() {
+  bool ok = true;
+  ok &= Accuracy(&rightEye, "as designed:");
+  // Glasses sitting differently: the eye moves, everything else with the frame
+  static const int32_t moves[][3] = {
+    {3000, 0, 0}, {-3000, 0, 0}, {0, 3000, 0}, {0, -3000, 0}, {0, 0, 5000}, {0, 0, -5000},
+  };
+  for (const auto &move : moves) {
+    struct ParallaxGeometry g = rightEye;
+    char title[64];
+    for (int i = 0; i < 3; i++) {
+      g.eye[i] += move[i];
+    }
+    snprintf(title, sizeof(title), "eye %+d %+d %+d mm:", move[0] / 1000, move[1] / 1000, move[2] / 1000);
+    ok &= Accuracy(&g, title);
+  }
+  Shift(&rightEye);
+
+  struct Parallax p;
+  ParallaxInit(&p, &rightEye);
+  uint16_t distances[BATCH];
+  for (int i = 0; i < BATCH; i++) {
+    distances[i] = 500 + i * 700;
+  }
+  printf("batch of %d lights:\n", BATCH);
+  Time("assumed distance", &p, NULL);
+  Time("distance per light", &p, distances);
+  printf("%s\n", ok ? "ok" : "FAILED, over half a pixel off somewhere");
+  return ok ? 0 : 1;
+}
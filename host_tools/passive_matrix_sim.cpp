@@ -0,0 +1,307 @@
+/*
+  RMS voltage on every pixel of a passive-matrix panel, and the on/off
+  contrast that leaves, against the multiplex ratio. This is the README's
+  contrast problem, worked out for whole panels instead of the 4x4 grid
+  lcd_segment_testing drives.
+
+  Alt-Pleshko driving: one row per group selected at a time at Vs, the
+  others at 0. A column is at -Vd where the pixel on the selected row should
+  be on and +Vd where it should be off, so on pixels see Vs + Vd and off ones
+  Vs - Vd while selected, and +-Vd the rest of the frame. Vs / Vd = sqrt(mux)
+  is the best ratio there is (--bias overrides it, as 1/a bias: Vs = (a - 1) Vd).
+  Polarity flips every frame, which doesn't change RMS, so one frame is enough.
+
+  Parallel row groups: the panel's rows are split into --groups groups, each
+  with its own column lines (chip-on-glass drivers top and bottom and so on),
+  all scanning at once. Rows per group is the multiplex ratio.
+
+  Done like that, every pixel's RMS only depends on itself and the pattern
+  wouldn't matter. Real panels have resistive row electrodes, which get
+  pulled towards the average of the columns crossing them (shadowing,
+  horizontal crosstalk), so --shadow of that is added every slot. Rows
+  with lots of pixels on come out different from rows with few, which is
+  why the whole panel gets simulated, slot by slot. Rows get split across
+  --threads.
+
+  Contrast is the worst on pixel over the worst off pixel, then means. Volts
+  are for Vs + Vd = --vop.
+
+  Build + run:
+    g++ -O2 -std=c++11 -pthread passive_matrix_sim.cpp -o passive_matrix_sim
+    ./passive_matrix_sim
+    ./passive_matrix_sim --rows 480 --cols 640 --groups 1,2,4,8 --pattern random
+    ./passive_matrix_sim --rows 64 --cols 64 --groups 2 --dump rms.csv
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct Options {
+  int rows = 0; // 0 = sweep 4, 8, ... maxRows
+  int maxRows = 512;
+  int cols = 256;
+  std::vector<int> groups = {1, 2, 4, 8};
+  const char *pattern = "headlights";
+  double shadow = 0.02; // Of the column average a row gets pulled towards
+  double bias = 0; // 1/a, 0 = best for the multiplex ratio
+  double vop = 5;
+  int threads = 0; // 0 = all of them
+  const char *dump = NULL;
+  uint32_t seed = 1;
+};
+
+struct Panel {
+  int rows;
+  int cols;
+  std::vector<uint8_t> on; // rows x cols
+};
+
+static bool MakePattern(const char *name, int rows, int cols, uint32_t seed, struct Panel *p) {
+  p->rows = rows;
+  p->cols = cols;
+  p->on.assign((size_t)rows * cols, 0);
+  std::mt19937 rng(seed);
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++) {
+      uint8_t v;
+      if (!strcmp(name, "headlights")) {
+        // What the glasses draw: a few blobs, mostly clear
+        static const double blobs[][3] = {{0.3, 0.45, 0.08}, {0.62, 0.5, 0.06}, {0.8, 0.3, 0.03}};
+        v = 0;
+        for (const auto &b : blobs) {
+          double dx = (double)c / cols - b[0];
+          double dy = ((double)r / rows - b[1]) * rows / cols;
+          v |= dx * dx + dy * dy < b[2] * b[2];
+        }
+      } else if (!strcmp(name, "checker")) {
+        v = (r + c) & 1;
+      } else if (!strcmp(name, "random")) {
+        v = rng() % 4 == 0;
+      } else if (!strcmp(name, "all")) {
+        v = 1;
+      } else {
+        return false;
+      }
+      p->on[(size_t)r * cols + c] = v;
+    }
+  }
+  return true;
+}
+
+struct Drive {
+  int groups;
+  int mux; // Rows per group
+  double vs;
+  double vd;
+};
+
+static struct Drive MakeDrive(const struct Options &o, int rows, int groups) {
+  struct Drive d;
+  d.groups = groups;
+  d.mux = rows / groups;
+  double ratio = o.bias > 0 ? o.bias - 1 : sqrt((double)d.mux);
+  d.vd = o.vop / (ratio + 1);
+  d.vs = o.vop - d.vd;
+  return d;
+}
+
+// Best case for the multiplex ratio, no crosstalk
+static double IdealContrast(int mux) {
+  double s = sqrt((double)mux);
+  return sqrt((s + 1) / (s - 1));
+}
+
+struct Stats {
+  double onMin = 1e9;
+  double onSum = 0;
+  int onCount = 0;
+  double offMax = 0;
+  double offSum = 0;
+  int offCount = 0;
+
+  void Add(const Stats &o) {
+    onMin = std::min(onMin, o.onMin);
+    onSum += o.onSum;
+    onCount += o.onCount;
+    offMax = std::max(offMax, o.offMax);
+    offSum += o.offSum;
+    offCount += o.offCount;
+  }
+};
+
+// Column voltages for every slot of every group, and the average a row in
+// that group gets pulled towards. Same for every row, so worked out once.
+struct Columns {
+  std::vector<float> v; // groups x mux x cols
+  std::vector<double> mean; // groups x mux
+};
+
+static void MakeColumns(const struct Panel &p, const struct Drive &d, struct Columns *cols) {
+  cols->v.resize((size_t)d.groups * d.mux * p.cols);
+  cols->mean.resize((size_t)d.groups * d.mux);
+  for (int g = 0; g < d.groups; g++) {
+    for (int slot = 0; slot < d.mux; slot++) {
+      int selected = g * d.mux + slot;
+      float *v = &cols->v[((size_t)g * d.mux + slot) * p.cols];
+      double sum = 0;
+      for (int c = 0; c < p.cols; c++) {
+        v[c] = p.on[(size_t)selected * p.cols + c] ? -d.vd : d.vd;
+        sum += v[c];
+      }
+      cols->mean[(size_t)g * d.mux + slot] = sum / p.cols;
+    }
+  }
+}
+
+// Rows [first, last), RMS of every pixel into rms (rows x cols)
+static void SimulateRows(const struct Panel &p, const struct Drive &d, const struct Columns &cols, double shadow,
+                         int first, int last, float *rms, struct Stats *stats) {
+  std::vector<double> squared(p.cols);
+  for (int r = first; r < last; r++) {
+    int g = r / d.mux;
+    std::fill(squared.begin(), squared.end(), 0.0);
+    for (int slot = 0; slot < d.mux; slot++) {
+      double row = g * d.mux + slot == r ? d.vs : 0;
+      row += shadow * (cols.mean[(size_t)g * d.mux + slot] - row);
+      const float *v = &cols.v[((size_t)g * d.mux + slot) * p.cols];
+      for (int c = 0; c < p.cols; c++) {
+        double across = row - v[c];
+        squared[c] += across * across;
+      }
+    }
+    for (int c = 0; c < p.cols; c++) {
+      double v = sqrt(squared[c] / d.mux);
+      rms[(size_t)r * p.cols + c] = (float)v;
+      if (p.on[(size_t)r * p.cols + c]) {
+        stats->onMin = std::min(stats->onMin, v);
+        stats->onSum += v;
+        stats->onCount++;
+      } else {
+        stats->offMax = std::max(stats->offMax, v);
+        stats->offSum += v;
+        stats->offCount++;
+      }
+    }
+  }
+}
+
+static struct Stats Simulate(const struct Panel &p, const struct Drive &d, double shadow, int threads,
+                             std::vector<float> *rms) {
+  struct Columns cols;
+  MakeColumns(p, d, &cols);
+  rms->resize((size_t)p.rows * p.cols);
+  threads = std::max(1, std::min(threads, p.rows));
+  std::vector<struct Stats> partial(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    int first = p.rows * t / threads;
+    int last = p.rows * (t + 1) / threads;
+    workers.emplace_back(SimulateRows, std::cref(p), std::cref(d), std::cref(cols), shadow, first, last, rms->data(),
+                         &partial[t]);
+  }
+  struct Stats all;
+  for (int t = 0; t < threads; t++) {
+    workers[t].join();
+    all.Add(partial[t]);
+  }
+  return all;
+}
+
+static void Usage() {
+  printf("passive_matrix_sim [--rows N | --max-rows N] [--cols M] [--groups 1,2,4] [--pattern P]\n"
+         "                   [--shadow F] [--bias A] [--vop V] [--threads T] [--dump FILE.csv] [--seed N]\n"
+         "  patterns: headlights checker random all\n");
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--rows"))     o.rows = atoi(v);
+    else if (!strcmp(a, "--max-rows")) o.maxRows = atoi(v);
+    else if (!strcmp(a, "--cols"))     o.cols = atoi(v);
+    else if (!strcmp(a, "--pattern"))  o.pattern = v;
+    else if (!strcmp(a, "--shadow"))   o.shadow = atof(v);
+    else if (!strcmp(a, "--bias"))     o.bias = atof(v);
+    else if (!strcmp(a, "--vop"))      o.vop = atof(v);
+    else if (!strcmp(a, "--threads"))  o.threads = atoi(v);
+    else if (!strcmp(a, "--dump"))     o.dump = v;
+    else if (!strcmp(a, "--seed"))     o.seed = atoi(v);
+    else if (!strcmp(a, "--groups")) {
+      o.groups.clear();
+      for (const char *s = v; *s; s = strchr(s, ',') ? strchr(s, ',') + 1 : s + strlen(s)) {
+        o.groups.push_back(atoi(s));
+      }
+    }
+    else { Usage(); return 1; }
+    i++;
+  }
+  if (o.threads <= 0) {
+    o.threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::vector<int> sizes;
+  if (o.rows > 0) {
+    sizes.push_back(o.rows);
+  } else {
+    for (int rows = 4; rows <= o.maxRows; rows *= 2) {
+      sizes.push_back(rows);
+    }
+  }
+
+  FILE *dump = NULL;
+  if (o.dump != NULL && (dump = fopen(o.dump, "w")) == NULL) {
+    printf("can't write %s\n", o.dump);
+    return 1;
+  }
+  printf("%s pattern, %d columns, shadow %.3f, %d threads, Vs + Vd = %.1f V\n", o.pattern, o.cols, o.shadow,
+         o.threads, o.vop);
+  printf(" rows groups  mux  Vs/Vd   on V min/mean  off V max/mean   contrast worst  mean  ideal\n");
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t pixelSlots = 0;
+  for (int rows : sizes) {
+    struct Panel panel;
+    if (!MakePattern(o.pattern, rows, o.cols, o.seed, &panel)) {
+      Usage();
+      return 1;
+    }
+    for (int groups : o.groups) {
+      if (groups <= 0 || rows % groups != 0 || rows / groups < 2) {
+        continue;
+      }
+      struct Drive d = MakeDrive(o, rows, groups);
+      std::vector<float> rms;
+      struct Stats s = Simulate(panel, d, o.shadow, o.threads, &rms);
+      pixelSlots += (uint64_t)rows * o.cols * d.mux;
+      double onMean = s.onCount ? s.onSum / s.onCount : 0;
+      double offMean = s.offCount ? s.offSum / s.offCount : 0;
+      printf("%5d %6d %4d %6.2f  %6.3f %6.3f   %6.3f %6.3f          %6.3f %6.3f %6.3f\n", rows, groups, d.mux,
+             d.vs / d.vd, s.onCount ? s.onMin : 0, onMean, s.offMax, offMean,
+             s.onCount && s.offMax > 0 ? s.onMin / s.offMax : 0, offMean > 0 ? onMean / offMean : 0,
+             IdealContrast(d.mux));
+      if (dump != NULL) {
+        fprintf(dump, "# %d rows, %d groups, %s, V rms per pixel\n", rows, groups, o.pattern);
+        for (int r = 0; r < rows; r++) {
+          for (int c = 0; c < o.cols; c++) {
+            fprintf(dump, c ? ",%.4f" : "%.4f", rms[(size_t)r * o.cols + c]);
+          }
+          fprintf(dump, "\n");
+        }
+      }
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  printf("%.2f s, %.0f M pixel-slots/s\n", seconds, pixelSlots / seconds / 1e6);
+  if (dump != NULL) {
+    fclose(dump);
+  }
+  return 0;
+}
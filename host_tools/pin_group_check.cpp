@@ -0,0 +1,235 @@
+/*
+  Setting all of lcd_segment_testing's drive lines for a phase, the old way
+  (a digitalWrite() per pin, like the ESP8266 core's: a call, a check for a
+  PWM / tone on the pin, then GPOS or GPOC or GP16O) against pin_group.h's
+  masks (shared/lcd_waveform): one GPOS, one GPOC, and GP16O for D0.
+
+  The registers are mocked. Each write stamps the host cycle counter on the
+  pins it changes, so skew is the spread of those stamps over the pins that
+  changed in one update (of the updates changing more than one): host cycles, and register writes, between the first
+  edge and the last. The writes are what carries over to the chip; each one
+  there is an APB store, and each digitalWrite() a good deal more than that.
+  Cycles per update are timed separately with stamping off.
+
+  Also checks the masks against the pins one at a time, for every
+  combination of lines.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../shared/lcd_waveform -I../lcd_segment_testing/include pin_group_check.cpp \
+      -o pin_group_check
+    ./pin_group_check
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "pin_group.h"
+#include "segment_tests.h"
+
+// D1 mini
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+static inline uint64_t Now() {
+#ifdef HAVE_RDTSC
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// The mocked GPIO block
+static uint32_t level; // Bit per GPIO, 16 included
+static uint64_t changedAt[17];
+static uint32_t changed;
+static uint32_t writes;
+static uint32_t writeAt[17]; // Which write of the update changed it
+static bool stamping;
+
+static void Changed(uint32_t mask) {
+  if (!stamping) {
+    return;
+  }
+  uint64_t t = Now();
+  writes++;
+  for (int pin = 0; pin <= 16; pin++) {
+    if (mask & (1UL << pin)) {
+      changedAt[pin] = t;
+      writeAt[pin] = writes;
+    }
+  }
+  changed |= mask;
+}
+
+struct SetRegister {
+  void operator=(uint32_t mask) {
+    uint32_t now = level | (mask & 0xFFFF);
+    Changed(now ^ level);
+    level = now;
+  }
+};
+struct ClearRegister {
+  void operator=(uint32_t mask) {
+    uint32_t now = level & ~(mask & 0xFFFF);
+    Changed(now ^ level);
+    level = now;
+  }
+};
+struct Gpio16Register {
+  void operator=(uint32_t v) {
+    uint32_t now = (level & 0xFFFF) | ((v & 1) << 16);
+    Changed(now ^ level);
+    level = now;
+  }
+};
+static SetRegister GPOS;
+static ClearRegister GPOC;
+static Gpio16Register GP16O;
+
+// Core's digitalWrite(): stopWaveform() / _stopPWM() look the pin up first
+static volatile uint32_t waveformEnabled = 0;
+__attribute__((noinline)) static void digitalWrite(uint8_t pin, uint8_t val) {
+  if (waveformEnabled & (1UL << pin)) {
+    waveformEnabled &= ~(1UL << pin);
+  }
+  if (pin < 16) {
+    if (val) {
+      GPOS = 1UL << pin;
+    } else {
+      GPOC = 1UL << pin;
+    }
+  } else if (pin == 16) {
+    GP16O = val;
+  }
+}
+
+static constexpr uint8_t backplanePins[] = {D0, D1, D2, D3};
+static constexpr uint8_t segmentPins[] = {D5, D6, D7, D8};
+static constexpr struct PinGroup backplanes = PIN_GROUP(backplanePins);
+static constexpr struct PinGroup segments = PIN_GROUP(segmentPins);
+static const uint32_t allMask = backplanes.all | segments.all;
+
+static void Old(const struct WavePhase *p) {
+  for (int i = 0; i < SEGMENT_TEST_BACKPLANES; i++) {
+    digitalWrite(backplanePins[i], (p->backplanes >> i) & 1);
+  }
+  for (int i = 0; i < SEGMENT_TEST_SEGMENTS; i++) {
+    digitalWrite(segmentPins[i], (p->segments >> i) & 1);
+  }
+}
+
+// What waveform.cpp's interrupt does, masks from the tables
+static void New(const struct WavePhase *p) {
+  uint32_t set = PinGroupMask(&backplanes, p->backplanes) | PinGroupMask(&segments, p->segments);
+  GPOS = set;
+  GPOC = allMask & ~set;
+  GP16O = (p->backplanes & backplanes.bit16) || (p->segments & segments.bit16);
+}
+
+// Pins one at a time against the masks, every combination of lines
+static bool MasksMatch() {
+  bool ok = true;
+  for (uint32_t b = 0; b < 16; b++) {
+    for (uint32_t s = 0; s < 16; s++) {
+      struct WavePhase p = {(uint8_t)b, (uint8_t)s, 0, 0};
+      level = 0x5A5A5;
+      Old(&p);
+      uint32_t want = level;
+      level = 0xA5A5A;
+      New(&p);
+      ok &= (level & (allMask | 1UL << 16)) == (want & (allMask | 1UL << 16));
+    }
+  }
+  return ok;
+}
+
+struct Result {
+  double cycles; // Per update
+  uint64_t skewMedian; // First edge to last of those that changed
+  uint64_t skew99; // Preemption on the host shows up past this
+  double skewWrites; // Mean
+};
+
+static struct Result Run(void (*update)(const struct WavePhase *)) {
+  // Every phase of every crossing's table, in order
+  const int rounds = 20000;
+  struct Result r = {0, 0, 0, 0};
+  std::vector<uint64_t> skews;
+  stamping = false;
+  uint64_t t0 = Now();
+  for (int round = 0; round < rounds; round++) {
+    for (int t = 0; t < SEGMENT_TEST_BACKPLANES * SEGMENT_TEST_SEGMENTS; t++) {
+      for (int i = 0; i < SEGMENT_TEST_PHASES; i++) {
+        update(&segmentTests[t / SEGMENT_TEST_SEGMENTS][t % SEGMENT_TEST_SEGMENTS][i]);
+      }
+    }
+  }
+  const int updates = SEGMENT_TEST_BACKPLANES * SEGMENT_TEST_SEGMENTS * SEGMENT_TEST_PHASES;
+  r.cycles = (double)(Now() - t0) / rounds / updates;
+
+  stamping = true;
+  uint64_t writeSum = 0;
+  int counted = 0;
+  for (int round = 0; round < rounds / 10; round++) {
+    for (int t = 0; t < SEGMENT_TEST_BACKPLANES * SEGMENT_TEST_SEGMENTS; t++) {
+      for (int i = 0; i < SEGMENT_TEST_PHASES; i++) {
+        changed = 0;
+        writes = 0;
+        update(&segmentTests[t / SEGMENT_TEST_SEGMENTS][t % SEGMENT_TEST_SEGMENTS][i]);
+        if (__builtin_popcount(changed) < 2) {
+          continue; // No skew to have
+        }
+        uint64_t first = UINT64_MAX, last = 0;
+        uint32_t firstWrite = UINT32_MAX, lastWrite = 0;
+        for (int pin = 0; pin <= 16; pin++) {
+          if (changed & (1UL << pin)) {
+            first = changedAt[pin] < first ? changedAt[pin] : first;
+            last = changedAt[pin] > last ? changedAt[pin] : last;
+            firstWrite = writeAt[pin] < firstWrite ? writeAt[pin] : firstWrite;
+            lastWrite = writeAt[pin] > lastWrite ? writeAt[pin] : lastWrite;
+          }
+        }
+        skews.push_back(last - first);
+        writeSum += lastWrite - firstWrite;
+        counted++;
+      }
+    }
+  }
+  std::sort(skews.begin(), skews.end());
+  r.skewMedian = skews[skews.size() / 2];
+  r.skew99 = skews[skews.size() * 99 / 100];
+  r.skewWrites = (double)writeSum / counted;
+  return r;
+}
+
+int main() {
+  bool ok = MasksMatch();
+  printf("masks %s the pins one at a time\n", ok ? "match" : "DON'T match");
+  struct Result old = Run(Old);
+  struct Result now = Run(New);
+#ifdef HAVE_RDTSC
+  const char *unit = "cycles";
+#else
+  const char *unit = "ns";
+#endif
+  printf("segment_tests.h phases, 8 lines, host %s on the mock:\n", unit);
+  printf("                  per update   skew median / 99%%   writes first edge to last\n");
+  printf("  digitalWrite()  %10.1f   %11llu / %4llu   %5.2f\n", old.cycles, (unsigned long long)old.skewMedian,
+         (unsigned long long)old.skew99, old.skewWrites);
+  printf("  pin group       %10.1f   %11llu / %4llu   %5.2f\n", now.cycles, (unsigned long long)now.skewMedian,
+         (unsigned long long)now.skew99, now.skewWrites);
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
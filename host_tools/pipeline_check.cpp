@@ -0,0 +1,205 @@
+/*
+  Checks the compile time transform stacks (lcd_graphical_esp32_arduino_poc
+  transform_pipeline.h) against the hand written camera -> LCD mapping they
+  replaced in eyes.cpp, for every camera pixel and both eyes, plus a longer
+  mirror / scale / offset / clamp stack against the same thing spelled out.
+  They have to match exactly.
+
+  Then cycles per light: the old way (which transform, decided for every
+  light) against Batch() with it decided once.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../lcd_graphical_esp32_arduino_poc/include pipeline_check.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/dewarp.cpp ../lcd_graphical_esp32_arduino_poc/src/radial.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/parallax.cpp -o pipeline_check
+    ./pipeline_check
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "eyes.h"
+#include "transform_pipeline.h"
+#include "dewarp_table.h"
+#include "radial_table.h"
+
+#define CAMERA_WIDTH 160
+#define CAMERA_HEIGHT 120
+#define BATCH 64
+
+// Same as main.cpp (EYES_PARALLAX)
+static const struct ParallaxGeometry geometry[NUM_EYES] = {
+  {{-32000, 0, 0}, {0, -5000, 20000}, {-32000, 0, 15000}, 280, -1, 140 * 16, 80 * 16, 60 * 16, 20000},
+  {{32000, 0, 0}, {0, -5000, 20000}, {32000, 0, 15000}, 280, -1, 140 * 16, 80 * 16, 60 * 16, 20000},
+};
+static struct Parallax parallax[NUM_EYES];
+
+// eyes.cpp CameraToLCD() before the pipelines
+static inline void OldCameraToLCD(const struct EyeCalibration *cal, int16_t x, int16_t y, uint16_t *lcdX,
+                                  uint16_t *lcdY) {
+  int32_t xTemp;
+  int32_t yTemp;
+  if (cal->parallax != NULL || cal->radial != NULL || cal->dewarp != NULL) {
+    if (cal->parallax != NULL) {
+      ParallaxPoint(cal->parallax, x, y, &xTemp, &yTemp);
+    } else if (cal->radial != NULL) {
+      RadialToLCD(cal->radial, x, y, &xTemp, &yTemp);
+    } else {
+      Dewarp(cal->dewarp, x, y, &xTemp, &yTemp);
+    }
+    xTemp = (xTemp + (1 << (DEWARP_FRACTION_BITS - 1))) >> DEWARP_FRACTION_BITS;
+    yTemp = (yTemp + (1 << (DEWARP_FRACTION_BITS - 1))) >> DEWARP_FRACTION_BITS;
+  } else {
+    xTemp = cal->xSign * x + cal->xOffset;
+    yTemp = y + cal->yOffset;
+  }
+  *lcdX = (uint16_t)xTemp;
+  *lcdY = (uint16_t)yTemp;
+}
+
+// eyes.cpp CameraToLCD() now
+static const struct DriftCorrection noDrift = {0, 0, 0, 0};
+static void NewCameraToLCD(const struct EyeCalibration *cal, const int16_t *x, const int16_t *y, uint8_t count,
+                           int16_t *lcdX, int16_t *lcdY) {
+  DriftStage drift(cal->drift != NULL ? cal->drift : &noDrift);
+  if (cal->parallax != NULL) {
+    Pipeline<ParallaxStage, DriftStage>(ParallaxStage(cal->parallax), drift).Batch(x, y, count, lcdX, lcdY);
+  } else if (cal->radial != NULL) {
+    Pipeline<RadialStage, DriftStage>(RadialStage(cal->radial), drift).Batch(x, y, count, lcdX, lcdY);
+  } else if (cal->dewarp != NULL) {
+    Pipeline<DewarpStage, DriftStage>(DewarpStage(cal->dewarp), drift).Batch(x, y, count, lcdX, lcdY);
+  } else if (cal->xSign < 0) {
+    Pipeline<MirrorStage, OffsetStage, DriftStage>(MirrorStage(), OffsetStage(cal->xOffset, cal->yOffset), drift)
+        .Batch(x, y, count, lcdX, lcdY);
+  } else {
+    Pipeline<OffsetStage, DriftStage>(OffsetStage(cal->xOffset, cal->yOffset), drift).Batch(x, y, count, lcdX, lcdY);
+  }
+}
+
+static struct EyeCalibration Way(int eye, int way) {
+  struct EyeCalibration cal = {-1, 110, 75, 200, NULL, NULL, NULL, NULL};
+  switch (way) {
+    case 0: cal.dewarp = &dewarpGrids[eye]; break;
+    case 1: cal.radial = &radialTransforms[eye]; break;
+    case 2: cal.parallax = &parallax[eye]; break;
+    case 4: cal.xSign = 1; break;
+  }
+  return cal;
+}
+static const char *const wayNames[] = {"dewarp grid", "radial", "parallax", "mirror + offset", "offset"};
+#define NUM_WAYS 5
+
+static bool Matches() {
+  bool ok = true;
+  int16_t xs[CAMERA_WIDTH], ys[CAMERA_WIDTH], lx[CAMERA_WIDTH], ly[CAMERA_WIDTH];
+  for (int way = 0; way < NUM_WAYS; way++) {
+    uint32_t wrong = 0;
+    for (int eye = 0; eye < NUM_EYES; eye++) {
+      struct EyeCalibration cal = Way(eye, way);
+      for (int v = 0; v < CAMERA_HEIGHT; v++) {
+        for (int u = 0; u < CAMERA_WIDTH; u++) {
+          xs[u] = u;
+          ys[u] = v;
+        }
+        NewCameraToLCD(&cal, xs, ys, CAMERA_WIDTH, lx, ly);
+        for (int u = 0; u < CAMERA_WIDTH; u++) {
+          uint16_t wantX, wantY;
+          OldCameraToLCD(&cal, u, v, &wantX, &wantY);
+          wrong += (uint16_t)lx[u] != wantX || (uint16_t)ly[u] != wantY;
+        }
+      }
+    }
+    printf("%-26s %s", wayNames[way], wrong ? "" : "same\n");
+    if (wrong) {
+      printf("%u points differ\n", wrong);
+      ok = false;
+    }
+  }
+
+  // Something no prototype has yet, against the arithmetic spelled out
+  Pipeline<MirrorStage, ScaleStage, OffsetStage, ClampStage> stack(MirrorStage(), ScaleStage(300, 200),
+                                                                   OffsetStage(140, -10), ClampStage(-1, 128));
+  uint32_t wrong = 0;
+  for (int v = 0; v < CAMERA_HEIGHT; v++) {
+    for (int u = 0; u < CAMERA_WIDTH; u++) {
+      int32_t gotX, gotY;
+      stack.Point(u, v, &gotX, &gotY);
+      int32_t x = ((-(u << 8)) * 300 >> 8) + (140 << 8);
+      int32_t y = ((v << 8) * 200 >> 8) - (10 << 8);
+      x = x < -256 ? -256 : (x > 128 * 256 ? 128 * 256 : x);
+      y = y < -256 ? -256 : (y > 128 * 256 ? 128 * 256 : y);
+      wrong += gotX != x || gotY != y;
+    }
+  }
+  printf("%-26s %s", "mirror/scale/offset/clamp", wrong ? "" : "same\n");
+  if (wrong) {
+    printf("%u points differ\n", wrong);
+    ok = false;
+  }
+  return ok;
+}
+
+static volatile int32_t sink;
+
+static void Time(int way) {
+  struct EyeCalibration cal = Way(EYE_RIGHT, way);
+  int16_t xs[BATCH], ys[BATCH], lx[BATCH], ly[BATCH];
+  uint16_t ox[BATCH], oy[BATCH];
+  for (int i = 0; i < BATCH; i++) {
+    xs[i] = (i * 37) % CAMERA_WIDTH;
+    ys[i] = (i * 53) % CAMERA_HEIGHT;
+  }
+  const int rounds = 100000;
+  double perLight[2];
+  for (int which = 0; which < 2; which++) {
+    int32_t acc = 0;
+#ifdef HAVE_RDTSC
+    uint64_t t0 = __rdtsc();
+#else
+    auto t0 = std::chrono::steady_clock::now();
+#endif
+    for (int r = 0; r < rounds; r++) {
+      xs[r & (BATCH - 1)] ^= 1;
+      if (which == 0) {
+        for (int i = 0; i < BATCH; i++) {
+          OldCameraToLCD(&cal, xs[i], ys[i], &ox[i], &oy[i]);
+        }
+        acc += ox[r & (BATCH - 1)] ^ oy[(r * 7) & (BATCH - 1)];
+      } else {
+        NewCameraToLCD(&cal, xs, ys, BATCH, lx, ly);
+        acc += lx[r & (BATCH - 1)] ^ ly[(r * 7) & (BATCH - 1)];
+      }
+    }
+#ifdef HAVE_RDTSC
+    perLight[which] = (double)(__rdtsc() - t0) / rounds / BATCH;
+#else
+    perLight[which] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds /
+                      BATCH;
+#endif
+    sink = acc;
+  }
+#ifdef HAVE_RDTSC
+  printf("  %-18s %6.2f -> %6.2f cycles/light\n", wayNames[way], perLight[0], perLight[1]);
+#else
+  printf("  %-18s %6.2f -> %6.2f ns/light\n", wayNames[way], perLight[0], perLight[1]);
+#endif
+}
+
+int main() {
+  for (int eye = 0; eye < NUM_EYES; eye++) {
+    ParallaxInit(&parallax[eye], &geometry[eye]);
+  }
+  bool ok = Matches();
+  printf("per light, decided per light -> Batch():\n");
+  for (int way = 0; way < NUM_WAYS; way++) {
+    Time(way);
+  }
+  printf("%s\n", ok ? "ok" : "FAILED, pipelines don't match");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+/*
+  What the LCD firmware would put on the glass, without the hardware.
+
+  Builds the real render path (render.cpp, display_dma.cpp and the
+  rasterizers) against host_shims/, so every SPI transaction display_dma.cpp
+  queues lands in an emulated ST7571 (st7571_emulator.h) for whichever eye's
+  CS is low. Both eyes are wired like main.cpp, set up like main.cpp's setup(),
+  then fed a scripted scene of moving discs, ellipses and polygons.
+
+  After every flush each panel's emulated display RAM has to match the frame
+  the renderer thinks is on the glass, pixel for pixel. Frames are also hashed
+  so a rendering change can be checked against a recorded run, and the bytes
+  and modelled bus time are totalled per frame and per kind of command.
+
+  Build + run:
+    g++ -O2 -std=c++11 -Ihost_shims -I../lcd_graphical_esp32_arduino_poc/include render_regress.cpp \
+      host_shims/host_shims.cpp ../lcd_graphical_esp32_arduino_poc/src/render.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/display_dma.cpp ../lcd_graphical_esp32_arduino_poc/src/mask_raster.cpp \
+      ../lcd_graphical_esp32_arduino_poc/src/gray_raster.cpp ../lcd_graphical_esp32_arduino_poc/src/shape_raster.cpp \
+      -o render_regress
+    ./render_regress --check render_regress.golden
+
+  Add -DRENDER_GRAY for the 4 gray level path (its hashes won't match the
+  mono golden file, record its own). -DRENDER_FRC dithers the dimmer lights,
+  and between camera frames steps the pattern as often as main.cpp would.
+  Every step's glass is checked the same way, each pixel has to be on for as
+  many steps of a cycle as its most opaque light says, and the bus time per
+  step gives the refresh rate the SPI path can keep up. --record writes a new golden file after
+  an intended change, --pgm-dir dumps every frame of both eyes.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+#include "host_shims/host_shims.h"
+#include "render.h"
+#include "display_dma.h"
+
+#define NUM_EYES 2
+#define EYE_LEFT 0
+#define EYE_RIGHT 1
+static const char *const eyeNames[NUM_EYES] = {"left", "right"};
+// Same as main.cpp's eyeCalibration
+static const uint8_t eyeContrast[NUM_EYES] = {200, 175};
+#define SCENE_MAX_LIGHTS 8
+
+#ifdef RENDER_GRAY
+#define MODE_NAME "gray"
+#elif defined(RENDER_FRC)
+#define MODE_NAME "frc"
+// Camera frames at 30 Hz, one dither step every FRC_REFRESH_US in between
+#define DITHER_STEPS_PER_FRAME (1000000 / 30 / FRC_REFRESH_US)
+#else
+#define MODE_NAME "mono"
+#endif
+
+// Pins as in main.cpp. Reset is one wire to both panels.
+#define PIN_RESET 2
+U8G2_ST7571_128X128_F_DMA displayRight(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 1, /* dc=*/ 3, /* reset=*/ U8X8_PIN_NONE);
+U8G2_ST7571_128X128_F_DMA displayLeft(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 4, /* dc=*/ 3, /* reset=*/ PIN_RESET);
+U8G2 *displays[NUM_EYES] = {&displayLeft, &displayRight};
+static struct St7571 emulators[NUM_EYES];
+static struct Renderer renderers[NUM_EYES];
+
+struct Options {
+  uint32_t frames = 300;
+  const char *record = NULL;
+  const char *check = NULL;
+  const char *pgmDir = NULL;
+  uint32_t overheadNs = HOST_TRANSACTION_OVERHEAD_NS;
+};
+
+// Deterministic, every shape, lights coming and going, and every 50 frames
+// it holds still for 10 so the nothing-changed path gets a turn
+static uint8_t SceneLights(uint32_t frame, uint8_t eye, struct Light *lights) {
+  uint32_t t = frame % 50 < 10 ? frame - frame % 50 : frame;
+  uint8_t n = 3 + (t / 40) % 6;
+  for (uint8_t i = 0; i < n; i++) {
+    struct Light *l = &lights[i];
+    memset(l, 0, sizeof(*l));
+    int16_t x = 6 + (i * 37 + t * (1 + i % 3)) % 116;
+    int16_t y = 6 + (i * 53 + t * (1 + i % 2) / 2) % 116;
+    l->x1 = eye == EYE_LEFT ? 127 - x : x;
+    l->y1 = y;
+    // Only FRC builds draw these any differently
+    l->brightness = i % 4 == 0 ? 255 : (uint8_t)(i * 70);
+    switch (i % 3) {
+      case 0:
+        l->shape = LIGHT_DISC;
+        l->radius = 3 + i % 5;
+        break;
+      case 1:
+        l->shape = LIGHT_ELLIPSE;
+        l->radius = 10 + i % 4;
+        l->minor = 2 + i % 3;
+        l->angle = (uint8_t)(t * 3 + i * 40);
+        break;
+      default:
+        l->shape = LIGHT_POLYGON;
+        l->numVertices = 4;
+        l->vx[0] = -8, l->vy[0] = 0;
+        l->vx[1] = 0, l->vy[1] = -3;
+        l->vx[2] = 8, l->vy[2] = 0;
+        l->vx[3] = 0, l->vy[3] = 3 + i % 3;
+        l->radius = 8;
+        break;
+    }
+  }
+  return n;
+}
+
+static uint8_t FrameLevel(const uint8_t *frame, uint8_t x, uint8_t y) {
+  uint8_t bit = 1 << (y & 7);
+#ifdef RENDER_GRAY
+  const uint8_t *column = &frame[(y >> 3) * GRAY_PAGE_BYTES + x * 2];
+  return (column[GRAY_PLANE_MSB] & bit ? 2 : 0) | (column[GRAY_PLANE_LSB] & bit ? 1 : 0);
+#else
+  return frame[(y >> 3) * LCD_PAGE_BYTES + x] & bit ? 3 : 0;
+#endif
+}
+
+static uint32_t Mismatches(const struct St7571 *e, const uint8_t *frame) {
+  uint32_t wrong = 0;
+  for (uint8_t y = 0; y < ST7571_PAGES * 8; y++) {
+    for (uint8_t x = 0; x < ST7571_COLUMNS; x++) {
+      wrong += St7571Pixel(e, x, y) != FrameLevel(frame, x, y);
+    }
+  }
+  return wrong;
+}
+
+// FNV-1a over the glass
+static uint32_t Hash(const struct St7571 *e) {
+  uint32_t h = 2166136261u;
+  for (uint8_t y = 0; y < ST7571_PAGES * 8; y++) {
+    for (uint8_t x = 0; x < ST7571_COLUMNS; x++) {
+      h = (h ^ St7571Pixel(e, x, y)) * 16777619u;
+    }
+  }
+  return h;
+}
+
+#ifdef RENDER_FRC
+// How many steps of a whole cycle each pixel should be on: the most opaque
+// light over it, same levels as render.cpp
+static void ExpectedOnSteps(const struct Light *lights, uint8_t n, uint8_t *steps) {
+  static uint8_t layer[LCD_PAGES * LCD_PAGE_BYTES];
+  memset(steps, 0, ST7571_COLUMNS * ST7571_PAGES * 8);
+  for (uint8_t i = 0; i < n; i++) {
+    uint8_t level = 1 + lights[i].brightness * (FRC_LEVELS - 1) / 255;
+    memset(layer, 0, sizeof(layer));
+    ShapeDrawLight(layer, SHAPE_MONO, &lights[i]);
+    for (uint8_t y = 0; y < ST7571_PAGES * 8; y++) {
+      for (uint8_t x = 0; x < ST7571_COLUMNS; x++) {
+        uint8_t *s = &steps[y * ST7571_COLUMNS + x];
+        if ((layer[(y >> 3) * LCD_PAGE_BYTES + x] & (1 << (y & 7))) && level > *s) {
+          *s = level;
+        }
+      }
+    }
+  }
+}
+#endif
+
+static void WritePgm(const char *dir, uint32_t frame, uint8_t eye, const struct St7571 *e) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/frame_%04u_%s.pgm", dir, frame, eyeNames[eye]);
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return;
+  }
+  fprintf(f, "P2\n%d %d\n3\n", ST7571_COLUMNS, ST7571_PAGES * 8);
+  for (uint8_t y = 0; y < ST7571_PAGES * 8; y++) {
+    for (uint8_t x = 0; x < ST7571_COLUMNS; x++) {
+      fprintf(f, "%d ", 3 - St7571Pixel(e, x, y)); // PGM is 0 = black
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+}
+
+static void PrintKinds(const char *title, const struct St7571Stats *s, uint32_t frames) {
+  printf("%s\n", title);
+  printf("  %-9s %9s %9s %12s\n", "kind", "count", "bytes", "bus us");
+  for (uint8_t k = 0; k < ST7571_KINDS; k++) {
+    if (s->bytes[k] == 0) {
+      continue;
+    }
+    printf("  %-9s %9.1f %9.1f %12.1f\n", st7571KindNames[k], (double)s->count[k] / frames,
+           (double)s->bytes[k] / frames, s->busNs[k] / 1000.0 / frames);
+  }
+  printf("  %-9s %9s %9.1f %12.1f  (%u transactions)\n", "total", "", (double)St7571Bytes(s) / frames,
+         St7571BusNs(s) / 1000.0 / frames, s->transactions / frames);
+}
+
+static void AddStats(struct St7571Stats *into, const struct St7571Stats *s) {
+  into->transactions += s->transactions;
+  into->overrun += s->overrun;
+  for (uint8_t k = 0; k < ST7571_KINDS; k++) {
+    into->count[k] += s->count[k];
+    into->bytes[k] += s->bytes[k];
+    into->busNs[k] += s->busNs[k];
+  }
+}
+
+static void Usage() {
+  printf("render_regress [--frames N] [--record FILE] [--check FILE] [--pgm-dir DIR] [--overhead-ns NS]\n");
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--frames"))      o.frames = atoi(v);
+    else if (!strcmp(a, "--record"))      o.record = v;
+    else if (!strcmp(a, "--check"))       o.check = v;
+    else if (!strcmp(a, "--pgm-dir"))     o.pgmDir = v;
+    else if (!strcmp(a, "--overhead-ns")) o.overheadNs = atoi(v);
+    else { Usage(); return 1; }
+    i++;
+  }
+
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    St7571Init(&emulators[eye]);
+  }
+  HostAttachPanel(&emulators[EYE_LEFT], 4, 3, PIN_RESET);
+  HostAttachPanel(&emulators[EYE_RIGHT], 1, 3, PIN_RESET);
+  HostSetTransactionOverhead(o.overheadNs);
+
+  // setup(), same order as main.cpp
+  int failures = 0;
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    U8G2 *display = displays[eye];
+    display->begin();
+    display->setContrast(eyeContrast[eye]);
+    display->clearDisplay();
+    display->firstPage();
+    do {
+      display->drawDisc(20, 120, 4);
+    } while (display->nextPage());
+  }
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    RenderInit(&renderers[eye], displays[eye]);
+  }
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    struct St7571 *e = &emulators[eye];
+    struct St7571Stats setup;
+    St7571TakeFrame(e, &setup);
+    bool gray = false;
+#ifdef RENDER_GRAY
+    gray = true;
+#endif
+    bool ok = e->displayOn && e->contrast == eyeContrast[eye] >> 2 && e->gray == gray && !e->allOn && !e->inverse;
+    printf("%-5s setup: %s, display %s, contrast %u, %s, %u resets, %u bytes, %.0f us on the bus%s\n", eyeNames[eye],
+           ok ? "ok" : "WRONG", e->displayOn ? "on" : "off", e->contrast, e->gray ? "gray" : "mono", e->resets,
+           St7571Bytes(&setup), St7571BusNs(&setup) / 1000.0, setup.count[ST7571_KIND_UNKNOWN] ? ", unknown commands" : "");
+    failures += !ok;
+  }
+
+  FILE *record = o.record ? fopen(o.record, "w") : NULL;
+  FILE *check = o.check ? fopen(o.check, "r") : NULL;
+  if ((o.record && !record) || (o.check && !check)) {
+    perror(o.record && !record ? o.record : o.check);
+    return 1;
+  }
+  if (record) {
+    fprintf(record, "mode %s\n", MODE_NAME);
+  }
+  if (check) {
+    char mode[16];
+    if (fscanf(check, "mode %15s\n", mode) != 1 || strcmp(mode, MODE_NAME) != 0) {
+      printf("%s isn't a %s recording\n", o.check, MODE_NAME);
+      return 1;
+    }
+  }
+
+  struct St7571Stats total;
+  memset(&total, 0, sizeof(total));
+  std::vector<double> frameUs;
+  uint32_t maxBytes = 0;
+  uint32_t wrongFrames = 0;
+  uint32_t changedHashes = 0;
+  struct Light lights[NUM_EYES][SCENE_MAX_LIGHTS];
+  uint8_t numLights[NUM_EYES];
+  struct RenderStats stats;
+#ifdef RENDER_FRC
+  std::vector<double> stepUs;
+  uint32_t wrongSteps = 0;
+  uint32_t wrongDuty = 0;
+  static uint8_t onSteps[NUM_EYES][ST7571_PAGES * 8 * ST7571_COLUMNS];
+  static uint8_t expected[ST7571_PAGES * 8 * ST7571_COLUMNS];
+#endif
+
+  for (uint32_t f = 0; f < o.frames; f++) {
+    struct Renderer *drawn[NUM_EYES];
+    for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+      numLights[eye] = SceneLights(f, eye, lights[eye]);
+      RenderCompose(&renderers[eye], lights[eye], numLights[eye], &stats);
+      drawn[eye] = &renderers[eye];
+    }
+    RenderFlush(drawn, NUM_EYES);
+    DisplayDmaWait();
+
+    uint64_t busNs = 0;
+    uint32_t bytes = 0;
+    for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+      struct St7571 *e = &emulators[eye];
+      struct Renderer *r = &renderers[eye];
+      struct St7571Stats s;
+      St7571TakeFrame(e, &s);
+      AddStats(&total, &s);
+      busNs += St7571BusNs(&s);
+      bytes += St7571Bytes(&s);
+
+      uint32_t wrong = Mismatches(e, r->frames[r->back ^ 1]);
+      if (wrong > 0) {
+        if (wrongFrames < 10) {
+          printf("frame %u %s: %u pixels on the glass aren't what the renderer sent\n", f, eyeNames[eye], wrong);
+        }
+        wrongFrames++;
+      }
+      uint32_t hash = Hash(e);
+      if (record) {
+        fprintf(record, "%u %s %08x\n", f, eyeNames[eye], hash);
+      }
+      if (check) {
+        uint32_t wantFrame, wantHash;
+        char wantEye[8];
+        if (fscanf(check, "%u %7s %x\n", &wantFrame, wantEye, &wantHash) != 3 || wantFrame != f ||
+            strcmp(wantEye, eyeNames[eye]) != 0) {
+          printf("%s ran out at frame %u\n", o.check, f);
+          return 1;
+        }
+        if (wantHash != hash) {
+          if (changedHashes < 10) {
+            printf("frame %u %s: differs from %s\n", f, eyeNames[eye], o.check);
+          }
+          changedHashes++;
+        }
+      }
+      if (o.pgmDir) {
+        WritePgm(o.pgmDir, f, eye, e);
+      }
+    }
+    frameUs.push_back(busNs / 1000.0);
+    maxBytes = bytes > maxBytes ? bytes : maxBytes;
+
+#ifdef RENDER_FRC
+    memset(onSteps, 0, sizeof(onSteps));
+    for (uint32_t step = 0; step < DITHER_STEPS_PER_FRAME; step++) {
+      uint8_t numDrawn = 0;
+      for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+        if (RenderDitherStep(&renderers[eye], &stats)) {
+          drawn[numDrawn++] = &renderers[eye];
+        }
+      }
+      RenderFlush(drawn, numDrawn);
+      DisplayDmaWait();
+      uint64_t stepNs = 0;
+      for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+        struct St7571 *e = &emulators[eye];
+        struct Renderer *r = &renderers[eye];
+        struct St7571Stats s;
+        St7571TakeFrame(e, &s);
+        stepNs += St7571BusNs(&s);
+        if (Mismatches(e, r->frames[r->back ^ 1]) > 0) {
+          if (wrongSteps < 10) {
+            printf("frame %u step %u %s: glass isn't what the renderer sent\n", f, step, eyeNames[eye]);
+          }
+          wrongSteps++;
+        }
+        // The last whole cycle of the frame
+        if (step + FRC_PHASES >= DITHER_STEPS_PER_FRAME) {
+          for (uint8_t y = 0; y < ST7571_PAGES * 8; y++) {
+            for (uint8_t x = 0; x < ST7571_COLUMNS; x++) {
+              onSteps[eye][y * ST7571_COLUMNS + x] += St7571Pixel(e, x, y) != 0;
+            }
+          }
+        }
+      }
+      stepUs.push_back(stepNs / 1000.0);
+    }
+    for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+      ExpectedOnSteps(lights[eye], numLights[eye], expected);
+      uint32_t wrong = 0;
+      for (uint32_t i = 0; i < sizeof(expected); i++) {
+        wrong += onSteps[eye][i] != expected[i];
+      }
+      if (wrong > 0) {
+        if (wrongDuty < 10) {
+          printf("frame %u %s: %u pixels not on for the right share of the cycle\n", f, eyeNames[eye], wrong);
+        }
+        wrongDuty++;
+      }
+    }
+#endif
+  }
+
+  double meanUs = 0;
+  double maxUs = 0;
+  for (double us : frameUs) {
+    meanUs += us / frameUs.size();
+    maxUs = us > maxUs ? us : maxUs;
+  }
+  printf("%u frames (%s, both eyes, SPI %lu Hz, %u ns per transaction)\n", o.frames, MODE_NAME,
+         (unsigned long)HostSpiHz(), o.overheadNs);
+  printf("bus per frame: mean %.1f us, max %.1f us, max %u bytes\n", meanUs, maxUs, maxBytes);
+  PrintKinds("per frame, both eyes:", &total, o.frames);
+  const struct HostBusStats *bus = HostBus();
+  printf("bus: %u transactions, %u with no panel selected, %u with both, %u leaving one selected, "
+         "%u bytes past the last column\n",
+         bus->transactions, bus->unselected, bus->collisions, bus->leftSelected, total.overrun);
+  printf("glass matches renderer: %s (%u frames wrong)\n", wrongFrames == 0 ? "yes" : "NO", wrongFrames);
+#ifdef RENDER_FRC
+  double stepMeanUs = 0;
+  double stepMaxUs = 0;
+  for (double us : stepUs) {
+    stepMeanUs += us / stepUs.size();
+    stepMaxUs = us > stepMaxUs ? us : stepMaxUs;
+  }
+  printf("dither: %u steps every %u us, bus per step mean %.1f us, max %.1f us -> %.0f Hz sustained, %.0f Hz worst\n",
+         (unsigned)stepUs.size(), FRC_REFRESH_US, stepMeanUs, stepMaxUs, 1e6 / stepMeanUs, 1e6 / stepMaxUs);
+  printf("dither glass matches renderer: %s (%u steps wrong), duty right: %s (%u frames wrong)\n",
+         wrongSteps == 0 ? "yes" : "NO", wrongSteps, wrongDuty == 0 ? "yes" : "NO", wrongDuty);
+  failures += wrongSteps + wrongDuty;
+#endif
+  if (check) {
+    printf("against %s: %u frames differ\n", o.check, changedHashes);
+  }
+  if (record) {
+    fclose(record);
+  }
+  failures += wrongFrames + changedHashes + bus->collisions + bus->unselected + bus->leftSelected + total.overrun;
+  return failures == 0 ? 0 : 1;
+}
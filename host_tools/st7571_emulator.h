@@ -0,0 +1,288 @@
+#pragma once
+
+// ST7571 on the host: decodes the command/data byte stream the LCD firmware
+// sends over SPI into display RAM plus the controller state (page/column
+// address, contrast, display on/off, mono or 4 gray level mode...), and counts
+// bytes and bus time per kind of command.
+//
+// Only what the firmware actually uses is modelled. Display RAM is kept in
+// RAM coordinates (ADC/SHL/start line are recorded, not applied), since u8g2
+// sets those up so RAM coordinates are panel coordinates for U8G2_R0.
+//
+// Used by render_regress.cpp through host_shims/, which routes ESP-IDF SPI
+// transactions here by whichever panel's CS is low.
+
+#include <stdint.h>
+#include <string.h>
+
+#define ST7571_COLUMNS 128
+#define ST7571_PAGES 16
+// Gray mode takes 2 bytes per column. Same order the firmware assumes, see
+// GRAY_PLANE_LSB in gray_raster.h
+#define ST7571_GRAY_FIRST_BYTE_LSB 1
+
+// Commands, ST7565 style. Ones with an argument take the next byte too.
+#define ST7571_COLUMN_LOW 0x00    // 0x00-0x0F
+#define ST7571_COLUMN_HIGH 0x10   // 0x10-0x17
+#define ST7571_PAGE_ADDRESS 0xB0  // 0xB0-0xBF
+#define ST7571_START_LINE 0x40    // + arg
+#define ST7571_COM0 0x44          // + arg
+#define ST7571_DUTY 0x48          // + arg
+#define ST7571_N_LINE 0x4C        // + arg
+#define ST7571_MODE_SET 0x38      // + arg
+#define ST7571_CONTRAST 0x81      // + arg, 0-63
+#define ST7571_ADC 0xA0           // 0xA0/0xA1
+#define ST7571_ALL_ON 0xA4        // 0xA4/0xA5
+#define ST7571_INVERSE 0xA6       // 0xA6/0xA7
+#define ST7571_DISPLAY_OFF 0xAE
+#define ST7571_DISPLAY_ON 0xAF
+#define ST7571_OSCILLATOR_ON 0xAB
+#define ST7571_SHL 0xC0           // 0xC0/0xC8
+#define ST7571_RESET 0xE2
+#define ST7571_NOP 0xE3
+#define ST7571_EXTENSION_3 0x7B   // then 0x10 gray / 0x11 mono, 0x00 leaves
+#define ST7571_EXT3_GRAY 0x10
+#define ST7571_EXT3_MONO 0x11
+#define ST7571_EXT3_EXIT 0x00
+
+enum St7571Kind {
+  ST7571_KIND_ADDRESS,  // Page and column
+  ST7571_KIND_CONTRAST,
+  ST7571_KIND_MODE,     // Mono / gray
+  ST7571_KIND_DISPLAY,  // On/off, inverse, all on
+  ST7571_KIND_SETUP,    // Everything else it knows, mostly from init
+  ST7571_KIND_UNKNOWN,
+  ST7571_KIND_DATA,
+  ST7571_KINDS
+};
+
+static const char *const st7571KindNames[ST7571_KINDS] = {"address", "contrast", "mode", "display", "setup",
+                                                            "unknown", "data"};
+
+struct St7571Stats {
+  uint32_t transactions;
+  uint32_t count[ST7571_KINDS]; // Commands (an argument doesn't count again), data bytes
+  uint32_t bytes[ST7571_KINDS];
+  uint64_t busNs[ST7571_KINDS];
+  uint32_t overrun; // Data bytes past the last column, dropped
+};
+
+struct St7571 {
+  uint8_t ram[ST7571_PAGES][ST7571_COLUMNS][2]; // [1] only used in gray mode
+  uint8_t page;
+  uint8_t column;
+  uint8_t columnByte; // Which byte of a gray column comes next
+  uint8_t pendingCommand; // Waiting for its argument, 0 if none
+  bool extension3;
+  bool gray;
+  bool displayOn;
+  bool allOn;
+  bool inverse;
+  bool adc;
+  bool shl;
+  uint8_t startLine;
+  uint8_t contrast;
+  uint32_t resets;
+  struct St7571Stats frame; // Since St7571TakeFrame()
+  struct St7571Stats total;
+};
+
+// Power on or the reset pin. Display RAM isn't cleared on the real thing either.
+static inline void St7571Reset(struct St7571 *e) {
+  e->page = 0;
+  e->column = 0;
+  e->columnByte = 0;
+  e->pendingCommand = 0;
+  e->extension3 = false;
+  e->gray = false;
+  e->displayOn = false;
+  e->allOn = false;
+  e->inverse = false;
+  e->adc = false;
+  e->shl = false;
+  e->startLine = 0;
+  e->contrast = 0;
+  e->resets++;
+}
+
+static inline void St7571Init(struct St7571 *e) {
+  memset(e, 0, sizeof(*e));
+  St7571Reset(e);
+  e->resets = 0;
+}
+
+static inline void St7571Count(struct St7571 *e, enum St7571Kind kind, bool first, uint64_t ns) {
+  if (first) {
+    e->frame.count[kind]++;
+    e->total.count[kind]++;
+  }
+  e->frame.bytes[kind]++;
+  e->total.bytes[kind]++;
+  e->frame.busNs[kind] += ns;
+  e->total.busNs[kind] += ns;
+}
+
+static inline enum St7571Kind St7571Command(struct St7571 *e, uint8_t c) {
+  if (e->pendingCommand != 0) {
+    uint8_t command = e->pendingCommand;
+    e->pendingCommand = 0;
+    if (command == ST7571_CONTRAST) {
+      e->contrast = c & 0x3F;
+      return ST7571_KIND_CONTRAST;
+    }
+    if (command == ST7571_START_LINE) {
+      e->startLine = c & 0x7F;
+    }
+    return ST7571_KIND_SETUP;
+  }
+  if (e->extension3) {
+    if (c == ST7571_EXT3_EXIT) {
+      e->extension3 = false;
+    } else if (c == ST7571_EXT3_GRAY || c == ST7571_EXT3_MONO) {
+      e->gray = c == ST7571_EXT3_GRAY;
+    } else {
+      return ST7571_KIND_UNKNOWN;
+    }
+    return ST7571_KIND_MODE;
+  }
+  if (c <= 0x0F) {
+    e->column = (e->column & 0xF0) | c;
+    e->columnByte = 0;
+    return ST7571_KIND_ADDRESS;
+  }
+  if (c <= 0x17) {
+    e->column = (e->column & 0x0F) | ((c & 0x07) << 4);
+    e->columnByte = 0;
+    return ST7571_KIND_ADDRESS;
+  }
+  if ((c & 0xF0) == ST7571_PAGE_ADDRESS) {
+    e->page = c & 0x0F;
+    return ST7571_KIND_ADDRESS;
+  }
+  switch (c) {
+    case ST7571_START_LINE:
+    case ST7571_COM0:
+    case ST7571_DUTY:
+    case ST7571_N_LINE:
+    case ST7571_MODE_SET:
+      e->pendingCommand = c;
+      return ST7571_KIND_SETUP;
+    case ST7571_CONTRAST:
+      e->pendingCommand = c;
+      return ST7571_KIND_CONTRAST;
+    case ST7571_EXTENSION_3:
+      e->extension3 = true;
+      return ST7571_KIND_MODE;
+    case ST7571_DISPLAY_OFF:
+    case ST7571_DISPLAY_ON:
+      e->displayOn = c == ST7571_DISPLAY_ON;
+      return ST7571_KIND_DISPLAY;
+    case ST7571_ALL_ON:
+    case ST7571_ALL_ON + 1:
+      e->allOn = c & 1;
+      return ST7571_KIND_DISPLAY;
+    case ST7571_INVERSE:
+    case ST7571_INVERSE + 1:
+      e->inverse = c & 1;
+      return ST7571_KIND_DISPLAY;
+    case ST7571_ADC:
+    case ST7571_ADC + 1:
+      e->adc = c & 1;
+      return ST7571_KIND_SETUP;
+    case ST7571_SHL:
+    case ST7571_SHL + 8:
+      e->shl = (c & 8) != 0;
+      return ST7571_KIND_SETUP;
+    case ST7571_RESET:
+      St7571Reset(e);
+      return ST7571_KIND_SETUP;
+    case ST7571_OSCILLATOR_ON:
+    case ST7571_NOP:
+      return ST7571_KIND_SETUP;
+    default:
+      break;
+  }
+  // Regulator ratio, power control, bias
+  if ((c >= 0x20 && c <= 0x2F) || (c >= 0x50 && c <= 0x57)) {
+    return ST7571_KIND_SETUP;
+  }
+  return ST7571_KIND_UNKNOWN;
+}
+
+static inline void St7571Data(struct St7571 *e, uint8_t d) {
+  if (e->column >= ST7571_COLUMNS) {
+    e->frame.overrun++;
+    e->total.overrun++;
+    return;
+  }
+  if (!e->gray) {
+    e->ram[e->page][e->column++][0] = d;
+    return;
+  }
+  uint8_t plane = (e->columnByte == 0) == ST7571_GRAY_FIRST_BYTE_LSB ? 0 : 1;
+  e->ram[e->page][e->column][plane] = d;
+  if (++e->columnByte == 2) {
+    e->columnByte = 0;
+    e->column++;
+  }
+}
+
+// One SPI transaction with CS low. The transaction's fixed cost is charged to
+// its first byte, then every byte costs byteNs.
+static inline void St7571Write(struct St7571 *e, bool dc, const uint8_t *bytes, uint32_t n, uint32_t byteNs,
+                               uint32_t overheadNs) {
+  e->frame.transactions++;
+  e->total.transactions++;
+  for (uint32_t i = 0; i < n; i++) {
+    uint64_t ns = byteNs + (i == 0 ? overheadNs : 0);
+    if (dc) {
+      St7571Data(e, bytes[i]);
+      St7571Count(e, ST7571_KIND_DATA, true, ns);
+    } else {
+      bool argument = e->pendingCommand != 0;
+      St7571Count(e, St7571Command(e, bytes[i]), !argument, ns);
+    }
+  }
+}
+
+// 0 = clear .. 3 = darkest, as it'd show on the glass. Mono pixels are 0 or 3.
+static inline uint8_t St7571Pixel(const struct St7571 *e, uint8_t x, uint8_t y) {
+  if (!e->displayOn) {
+    return 0;
+  }
+  uint8_t level;
+  if (e->allOn) {
+    level = 3;
+  } else {
+    const uint8_t *column = e->ram[y >> 3][x];
+    uint8_t bit = 1 << (y & 7);
+    if (e->gray) {
+      level = (column[1] & bit ? 2 : 0) | (column[0] & bit ? 1 : 0);
+    } else {
+      level = column[0] & bit ? 3 : 0;
+    }
+  }
+  return e->inverse ? 3 - level : level;
+}
+
+static inline uint64_t St7571BusNs(const struct St7571Stats *s) {
+  uint64_t ns = 0;
+  for (uint8_t k = 0; k < ST7571_KINDS; k++) {
+    ns += s->busNs[k];
+  }
+  return ns;
+}
+
+static inline uint32_t St7571Bytes(const struct St7571Stats *s) {
+  uint32_t bytes = 0;
+  for (uint8_t k = 0; k < ST7571_KINDS; k++) {
+    bytes += s->bytes[k];
+  }
+  return bytes;
+}
+
+// Hands back what was sent since the last call
+static inline void St7571TakeFrame(struct St7571 *e, struct St7571Stats *stats) {
+  *stats = e->frame;
+  memset(&e->frame, 0, sizeof(e->frame));
+}
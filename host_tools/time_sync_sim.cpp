@@ -0,0 +1,145 @@
+/*
+  Camera/LCD clock sync (shared/light_link/time_sync.h) against simulated
+  crystals that drift apart, with the same message stamping the firmware does.
+
+  Each board's micros() runs at its own rate (--lcd-ppm, --cam-ppm) from its
+  own boot time. The LCD asks every --period-ms. Replies can sit in the LCD's
+  RX buffer while it's drawing (--draw-ms, with probability --busy), and the
+  camera only polls between scans (--cam-poll-us).
+
+  Every 10 ms the estimate is checked against the true LCD time of a camera
+  timestamp, which is what the LCD uses to age frames.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../shared/light_link time_sync_sim.cpp -o time_sync_sim
+    ./time_sync_sim --lcd-ppm 40 --cam-ppm -30 --seconds 120
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "light_link.h"
+#include "time_sync.h"
+
+struct Options {
+  double lcdPpm = 20;
+  double camPpm = -20;
+  double camBootOffsetUs = 1234567; // Camera booted this much earlier
+  double periodMs = 250;
+  double drawMs = 100;
+  double busy = 0.5;       // Fraction of time the LCD is in the middle of a draw
+  double camPollUs = 3000;
+  double seconds = 60;
+  uint32_t seed = 1;
+};
+
+struct Clock {
+  double ppm;
+  double bootUs;
+  uint32_t At(double trueUs) const {
+    double t = (trueUs + bootUs) * (1 + ppm * 1e-6);
+    return (uint32_t)(uint64_t)fmod(t, 4294967296.0);
+  }
+};
+
+static void Usage() {
+  printf("time_sync_sim [--lcd-ppm P] [--cam-ppm P] [--cam-offset-us US] [--period-ms MS]\n"
+         "              [--draw-ms MS] [--busy F] [--cam-poll-us US] [--seconds S] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!v) { Usage(); return 1; }
+    if      (!strcmp(a, "--lcd-ppm"))       o.lcdPpm = atof(v);
+    else if (!strcmp(a, "--cam-ppm"))       o.camPpm = atof(v);
+    else if (!strcmp(a, "--cam-offset-us")) o.camBootOffsetUs = atof(v);
+    else if (!strcmp(a, "--period-ms"))     o.periodMs = atof(v);
+    else if (!strcmp(a, "--draw-ms"))       o.drawMs = atof(v);
+    else if (!strcmp(a, "--busy"))          o.busy = atof(v);
+    else if (!strcmp(a, "--cam-poll-us"))   o.camPollUs = atof(v);
+    else if (!strcmp(a, "--seconds"))       o.seconds = atof(v);
+    else if (!strcmp(a, "--seed"))          o.seed = atoi(v);
+    else { Usage(); return 1; }
+    i++;
+  }
+
+  std::mt19937 rng(o.seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  Clock lcd = {o.lcdPpm, 0};
+  Clock cam = {o.camPpm, o.camBootOffsetUs};
+  const double requestUs = LightLinkWireUs(2 + LIGHT_LINK_HEX_CHARS);
+  const double replyUs = LightLinkWireUs(LIGHT_LINK_SYNC_REPLY_BYTES);
+  // Remote runs faster than local by this much
+  const double trueDriftPpb = ((1 + o.camPpm * 1e-6) / (1 + o.lcdPpm * 1e-6) - 1) * 1e9;
+
+  TimeSync ts;
+  TimeSyncInit(&ts);
+  std::vector<double> errors;
+  uint32_t outsideBound = 0;
+  uint32_t samples = 0;
+  double nextRequestUs = 0;
+  double nextCheckUs = 0;
+  double nextPrintUs = 5e6;
+
+  printf("true drift %.0f ppb, LCD asks every %.0f ms, LCD busy %.0f%% (%.0f ms draws)\n",
+         trueDriftPpb, o.periodMs, o.busy * 100, o.drawMs);
+  printf("%8s %12s %12s %12s\n", "time s", "error us", "reported us", "drift ppb");
+
+  for (double nowUs = 0; nowUs < o.seconds * 1e6; nowUs += 1000) {
+    if (nowUs >= nextRequestUs) {
+      nextRequestUs += o.periodMs * 1000;
+      // Same stamping as the firmware: t1 when the request's last byte leaves,
+      // t3 when the reply's last byte leaves
+      double sendUs = nowUs;
+      uint32_t t1 = lcd.At(sendUs) + (uint32_t)requestUs;
+      double camSeesUs = sendUs + requestUs + uniform(rng) * o.camPollUs;
+      uint32_t t2 = cam.At(camSeesUs);
+      double flushUs = camSeesUs + uniform(rng) * 150;
+      uint32_t t3 = cam.At(flushUs) + (uint32_t)replyUs;
+      double arriveUs = flushUs + replyUs;
+      double readUs = arriveUs + uniform(rng) * 500;
+      if (uniform(rng) < o.busy) {
+        readUs += uniform(rng) * o.drawMs * 1000;
+      }
+      uint32_t t4 = lcd.At(readUs);
+      TimeSyncAddSample(&ts, t1, t2, t3, t4);
+      samples++;
+    }
+
+    if (ts.valid && nowUs >= nextCheckUs) {
+      nextCheckUs += 10000;
+      uint32_t capture = cam.At(nowUs);
+      int32_t error = (int32_t)(TimeSyncRemoteToLocal(&ts, capture) - lcd.At(nowUs));
+      if (nowUs > 5e6) {
+        errors.push_back(fabs((double)error));
+        if ((uint32_t)abs(error) > 2 * TimeSyncErrorUs(&ts)) {
+          outsideBound++;
+        }
+      }
+      if (nowUs >= nextPrintUs) {
+        nextPrintUs += 5e6;
+        printf("%8.0f %12d %12u %12d\n", nowUs / 1e6, error, TimeSyncErrorUs(&ts), ts.driftPpb);
+      }
+    }
+  }
+
+  std::sort(errors.begin(), errors.end());
+  if (errors.empty()) {
+    printf("never synced\n");
+    return 1;
+  }
+  printf("\n%u sync exchanges, %zu checks after 5 s warmup\n", samples, errors.size());
+  printf("|error| p50=%.0f p90=%.0f p99=%.0f max=%.0f us\n", errors[errors.size() / 2],
+         errors[errors.size() * 9 / 10], errors[errors.size() * 99 / 100], errors.back());
+  printf("more than 2x reported error %.1f%%\n", 100.0 * outsideBound / errors.size());
+  printf("drift estimate %d ppb (true %.0f ppb)\n", ts.driftPpb, trueDriftPpb);
+  return 0;
+}
@@ -0,0 +1,152 @@
+'''
+Turns trace lines from the LCD (lcd_graphical_esp32_arduino_poc trace.h)
+into a timeline. Everything else in the capture is ignored, so the normal
+Serial output can be mixed in.
+
+Capture with anything that logs the serial port to a file, send a 'T' to dump
+the whole ring buffer, then:
+  python3 trace_decode.py capture.txt
+  python3 trace_decode.py capture.txt --chrome trace.json   # open in ui.perfetto.dev
+
+Event names come from the TraceId enum in trace.h, so they stay in step.
+'''
+import argparse
+import json
+import os
+import re
+import sys
+
+DEFAULT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              '..', 'lcd_graphical_esp32_arduino_poc', 'include', 'trace.h')
+LINE = re.compile(r'~([0-9a-f]{8})([0-9a-f]{4})([0-9a-f]{8})([0-9a-f]{8})\s*$')
+# Shown as a span from START to END
+SPANS = {'TRACE_DRAW_START': ('TRACE_DRAW_END', 'draw')}
+
+
+def read_names(header):
+    names = {}
+    text = open(header).read()
+    body = re.search(r'enum\s+TraceId\s*\{(.*?)\}', text, re.S).group(1)
+    value = 0
+    for line in body.split('\n'):
+        m = re.match(r'\s*(TRACE_\w+)\s*(?:=\s*(\d+))?\s*,', line)
+        if m:
+            if m.group(2):
+                value = int(m.group(2))
+            names[value] = m.group(1)
+            value += 1
+    return names
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def read_events(lines, names):
+    events = []
+    last = None
+    wraps = 0
+    for line in lines:
+        m = LINE.search(line)
+        if not m:
+            continue
+        us = int(m.group(1), 16)
+        # micros() wraps every ~71 minutes
+        if last is not None and us < last and last - us > (1 << 31):
+            wraps += 1
+        last = us
+        event_id = int(m.group(2), 16)
+        events.append({
+            'us': us + (wraps << 32),
+            'name': names.get(event_id, 'TRACE_%d' % event_id),
+            'a': signed(int(m.group(3), 16)),
+            'b': signed(int(m.group(4), 16)),
+        })
+    # Background and dumped events can interleave slightly out of order
+    events.sort(key=lambda e: e['us'])
+    return events
+
+
+def print_timeline(events):
+    start = events[0]['us']
+    previous = start
+    print('%12s %10s  %-22s %10s %10s' % ('ms', '+us', 'event', 'a', 'b'))
+    for e in events:
+        print('%12.3f %10d  %-22s %10d %10d' % ((e['us'] - start) / 1000.0, e['us'] - previous,
+                                                e['name'], e['a'], e['b']))
+        previous = e['us']
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def print_summary(events):
+    counts = {}
+    for e in events:
+        counts[e['name']] = counts.get(e['name'], 0) + 1
+    print()
+    for name in sorted(counts):
+        print('%-22s %8d' % (name, counts[name]))
+
+    for start_name, (end_name, label) in SPANS.items():
+        durations = []
+        gaps = []
+        open_ = None
+        last_start = None
+        for e in events:
+            if e['name'] == start_name:
+                open_ = e['us']
+                if last_start is not None:
+                    gaps.append(e['us'] - last_start)
+                last_start = e['us']
+            elif e['name'] == end_name and open_ is not None:
+                durations.append(e['us'] - open_)
+                open_ = None
+        if durations:
+            print('%s: %d, took p50 %d us p90 %d us max %d us' % (label, len(durations), percentile(durations, 0.5),
+                                                              percentile(durations, 0.9), max(durations)))
+        if gaps:
+            print('%s every: p10 %d us p50 %d us p90 %d us' % (label, percentile(gaps, 0.1), percentile(gaps, 0.5),
+                                                             percentile(gaps, 0.9)))
+
+
+def write_chrome(events, path):
+    out = []
+    for e in events:
+        args = {'a': e['a'], 'b': e['b']}
+        if e['name'] in SPANS:
+            out.append({'name': SPANS[e['name']][1], 'ph': 'B', 'ts': e['us'], 'pid': 1, 'tid': 1, 'args': args})
+        elif any(e['name'] == end for end, _ in SPANS.values()):
+            out.append({'name': [label for end, label in SPANS.values() if end == e['name']][0], 'ph': 'E',
+                        'ts': e['us'], 'pid': 1, 'tid': 1, 'args': args})
+        else:
+            out.append({'name': e['name'], 'ph': 'i', 's': 't', 'ts': e['us'], 'pid': 1, 'tid': 1, 'args': args})
+    json.dump({'traceEvents': out}, open(path, 'w'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', nargs='?', help='serial log, stdin if left out')
+    parser.add_argument('--header', default=DEFAULT_HEADER, help='trace.h to read event names from')
+    parser.add_argument('--chrome', help='also write Chrome/Perfetto trace JSON here')
+    parser.add_argument('--summary', action='store_true', help='counts and draw times only, no timeline')
+    args = parser.parse_args()
+
+    names = read_names(args.header)
+    lines = open(args.capture) if args.capture else sys.stdin
+    events = read_events(lines, names)
+    if not events:
+        print('no trace lines found')
+        return 1
+    if not args.summary:
+        print_timeline(events)
+    print_summary(events)
+    if args.chrome:
+        write_chrome(events, args.chrome)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,182 @@
+/*
+  Per crossing RMS and DC of the LCD waveform tables (shared/lcd_waveform):
+  the fixed ones in lcd_basic_arduino's waveforms.h and lcd_segment_testing's
+  segment_tests.h, Fade at every step it takes, and Fade the way it used to be
+  (second half lcd_duty_cycle_max - duty) for comparison. Volts at a 3.3 V
+  supply, lines at 0, the supply, or floating at half of it.
+
+  Then a few framebuffers on the 4x4 test panel: shown the old way, lighting
+  one crossing at a time (segment_tests.h) round all the ones that are on,
+  against multiplex.h with one row group and with two. Contrast is the
+  dimmest on crossing over the brightest off one, frame rate is how often
+  the whole framebuffer gets shown. With two groups, crossings between one
+  group's backplanes and the other's segments aren't pixels, they'd be
+  separate glass, so they're left out (and their worst printed).
+
+  The compile time check already says whether DC is exactly zero, this is
+  how much RMS each crossing gets, how far the off ones are from the on ones,
+  and how much DC the old fade had.
+
+  Build + run:
+    g++ -O2 -std=c++11 -I../shared/lcd_waveform -I../lcd_basic_arduino/lcd_basic_arduino/include \
+      -I../lcd_segment_testing/include waveform_rms.cpp ../shared/lcd_waveform/multiplex.cpp -o waveform_rms
+    ./waveform_rms
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+#include "waveforms.h"
+#include "segment_tests.h"
+#include "multiplex.h"
+
+#define SUPPLY_V 3.3
+#define FADE_HALF_US 8000 // lcd_basic_arduino LCD_DELAY_MS_MAX
+#define FADE_DUTY_MIN 1 // lcd_duty_cycle's range there
+#define FADE_DUTY_MAX 40
+
+static double Rms(const struct WavePhase *phases, uint8_t count, uint8_t b, uint8_t s) {
+  return SUPPLY_V / 2 * sqrt((double)WaveSquared(phases, count, b, s) / WavePeriodUs(phases, count));
+}
+
+static double Dc(const struct WavePhase *phases, uint8_t count, uint8_t b, uint8_t s) {
+  return SUPPLY_V / 2 * (double)WaveDc(phases, count, b, s) / WavePeriodUs(phases, count);
+}
+
+// Worst |DC| over all crossings, and prints RMS / DC for each
+static double Report(const char *name, const struct WavePhase *phases, uint8_t count, uint8_t numBackplanes,
+                     uint8_t numSegments) {
+  printf("%-22s %6.2f ms ", name, WavePeriodUs(phases, count) / 1000.0);
+  double worst = 0;
+  for (uint8_t b = 0; b < numBackplanes; b++) {
+    if (b > 0) {
+      printf("\n%-32s", "");
+    }
+    for (uint8_t s = 0; s < numSegments; s++) {
+      double dc = Dc(phases, count, b, s);
+      printf(" %5.3f V rms %+6.1f mV", Rms(phases, count, b, s), dc * 1000);
+      worst = fmax(worst, fabs(dc));
+    }
+  }
+  printf("\n");
+  return worst;
+}
+
+// lcd_basic_arduino Fade() before the tables: inverted half was max - duty
+static uint8_t OldFadeWave(struct WavePhase *phases, uint16_t duty) {
+  uint32_t highUs = (uint32_t)FADE_PWM_US * duty / FADE_PWM_RANGE;
+  uint32_t invertedUs = (uint32_t)FADE_PWM_US * (FADE_DUTY_MAX - duty) / FADE_PWM_RANGE;
+  uint8_t n = FadeHalf(phases, 0, highUs, FADE_HALF_US);
+  return n + FadeHalf(phases + n, 1, invertedUs, FADE_HALF_US);
+}
+
+struct Framebuffer {
+  const char *name;
+  uint8_t rows[SEGMENT_TEST_BACKPLANES];
+};
+
+static const struct Framebuffer framebuffers[] = {
+  {"one pixel", {0x0, 0x2, 0x0, 0x0}},
+  {"diagonal", {0x1, 0x2, 0x4, 0x8}},
+  {"2x2 block", {0x3, 0x3, 0x0, 0x0}},
+  {"checker", {0x5, 0xA, 0x5, 0xA}},
+};
+
+// Contrast of a table showing fb, over the crossings that are pixels.
+// Anything off it bounds (stray) goes in worstStray.
+static double Contrast(const struct WavePhase *phases, uint8_t count, const uint8_t *fb, uint8_t groups,
+                       double *worstStray, double *worstDc) {
+  double onMin = 1e9;
+  double offMax = 0;
+  int rows = SEGMENT_TEST_BACKPLANES / groups;
+  int columns = SEGMENT_TEST_SEGMENTS / groups;
+  for (int b = 0; b < SEGMENT_TEST_BACKPLANES; b++) {
+    for (int s = 0; s < SEGMENT_TEST_SEGMENTS; s++) {
+      double rms = Rms(phases, count, b, s);
+      *worstDc = fmax(*worstDc, fabs(Dc(phases, count, b, s)));
+      if (b / rows != s / columns) {
+        *worstStray = fmax(*worstStray, rms);
+      } else if (fb[b] & (1 << s)) {
+        onMin = fmin(onMin, rms);
+      } else {
+        offMax = fmax(offMax, rms);
+      }
+    }
+  }
+  return offMax > 0 ? onMin / offMax : 0;
+}
+
+// Framebuffers, the old way against multiplex.h. Worst DC anywhere.
+static double CompareFramebuffers() {
+  printf("\n4x4 panel, %d us slots: contrast / full frames a second\n", LCD_CHARGE_TIME_US);
+  printf("%-12s %19s %19s %19s\n", "", "one at a time", "1 group", "2 groups");
+  double worstDc = 0;
+  double worstStray = 0;
+  for (const struct Framebuffer &fb : framebuffers) {
+    // The old way: a crossing's whole superframe each, round the ones on
+    std::vector<struct WavePhase> sweep;
+    for (int b = 0; b < SEGMENT_TEST_BACKPLANES; b++) {
+      for (int s = 0; s < SEGMENT_TEST_SEGMENTS; s++) {
+        if (fb.rows[b] & (1 << s)) {
+          sweep.insert(sweep.end(), segmentTests[b][s], segmentTests[b][s] + SEGMENT_TEST_PHASES);
+        }
+      }
+    }
+    double ignored = 0;
+    printf("%-12s %10.2fx %5.1f Hz", fb.name,
+           Contrast(sweep.data(), (uint8_t)sweep.size(), fb.rows, 1, &ignored, &worstDc),
+           1e6 / WavePeriodUs(sweep.data(), (uint8_t)sweep.size()));
+    for (uint8_t groups = 1; groups <= 2; groups++) {
+      struct MultiplexLayout layout = {SEGMENT_TEST_BACKPLANES, SEGMENT_TEST_SEGMENTS, groups, LCD_CHARGE_TIME_US};
+      struct WavePhase phases[WAVE_MAX_PHASES];
+      uint8_t n = MultiplexPhases(&layout, fb.rows, phases);
+      printf(" %10.2fx %5u Hz", Contrast(phases, n, fb.rows, groups, &worstStray, &worstDc),
+             MultiplexFrameHz(&layout));
+    }
+    printf("\n");
+  }
+  printf("crossings between groups on this glass: up to %.3f V rms\n", worstStray);
+  return worstDc;
+}
+
+int main() {
+  printf("%-22s %9s  per crossing, backplane rows x segment columns\n", "", "period");
+  double worst = 0;
+  worst = fmax(worst, Report("fullBlock", fullBlock, WAVE_COUNT(fullBlock), 1, 1));
+  worst = fmax(worst, Report("sixtyHertz", sixtyHertz, WAVE_COUNT(sixtyHertz), 1, 1));
+  worst = fmax(worst, Report("ledBadgeBlink", ledBadgeBlink, WAVE_COUNT(ledBadgeBlink), 1, 1));
+  // Which one's lit doesn't matter for the numbers, only where it is
+  worst = fmax(worst, Report("segmentTests[1][2]", segmentTests[1][2], SEGMENT_TEST_PHASES, SEGMENT_TEST_BACKPLANES,
+                             SEGMENT_TEST_SEGMENTS));
+  for (int b = 0; b < SEGMENT_TEST_BACKPLANES; b++) {
+    for (int s = 0; s < SEGMENT_TEST_SEGMENTS; s++) {
+      worst = fmax(worst, fabs(Dc(segmentTests[b][s], SEGMENT_TEST_PHASES, b, s)));
+    }
+  }
+
+  printf("\nFade, duty: now rms / dc, before rms / dc\n");
+  struct WavePhase phases[WAVE_MAX_PHASES];
+  double oldWorst = 0;
+  for (uint16_t duty = FADE_DUTY_MIN; duty <= FADE_DUTY_MAX; duty++) {
+    uint8_t n = FadeWave(phases, duty, FADE_HALF_US);
+    double rms = Rms(phases, n, 0, 0);
+    double dc = Dc(phases, n, 0, 0);
+    worst = fmax(worst, fabs(dc));
+    if (!WaveBalanced(phases, n, 1, 1) || n > WAVE_MAX_PHASES) {
+      worst = fmax(worst, 1);
+    }
+    n = OldFadeWave(phases, duty);
+    double oldDc = Dc(phases, n, 0, 0);
+    oldWorst = fmax(oldWorst, fabs(oldDc));
+    if (duty % 5 == 0 || duty == FADE_DUTY_MIN) {
+      printf("  %2u: %5.3f V %+6.1f mV    %5.3f V %+6.1f mV\n", duty, rms, dc * 1000, Rms(phases, n, 0, 0),
+             oldDc * 1000);
+    }
+  }
+  printf("worst DC now %.1f mV, old fade %.1f mV\n", worst * 1000, oldWorst * 1000);
+  worst = fmax(worst, CompareFramebuffers());
+  bool ok = worst == 0;
+  printf("%s\n", ok ? "ok" : "FAILED, DC left on a crossing");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// What main.cpp's actions play, one backplane line and one segment line and
+// nothing floating, so each phase is {backplane, segment, us, 0}. The fixed
+// ones are checked at compile time, the ones built while running by
+// WavePlay() (and all of them by host_tools/waveform_rms).
+
+#include "waveform_table.h"
+
+#define MIN_LCD_US_SWITCH (1000000/(121)/2)
+#define LCD_FRAME_US (2 * MIN_LCD_US_SWITCH) // ~60 Hz
+#define BADGE_PERIOD_US (1000000/50)
+#define BADGE_BLINK_US 1000
+
+// Basic setup, 100% duty cycle
+static constexpr struct WavePhase fullBlock[] = {
+  {0, 1, MIN_LCD_US_SWITCH, 0},
+  {1, 0, MIN_LCD_US_SWITCH, 0},
+};
+WAVE_CHECK(fullBlock, 1, 1, LCD_FRAME_US);
+
+// Try to dim at the same time as 60Hz lighting. 50% duty cycle
+static constexpr struct WavePhase sixtyHertz[] = {
+  {1, 1, MIN_LCD_US_SWITCH, 0},
+  {1, 0, MIN_LCD_US_SWITCH, 0},
+  {0, 0, MIN_LCD_US_SWITCH, 0},
+  {0, 1, MIN_LCD_US_SWITCH, 0},
+};
+WAVE_CHECK(sixtyHertz, 1, 1, 2 * LCD_FRAME_US);
+
+// Try to dim at the same time as AEMBOT badge
+static constexpr struct WavePhase ledBadgeBlink[] = {
+  {1, 1, BADGE_PERIOD_US, 0},
+  {1, 0, BADGE_BLINK_US, 0},
+  {0, 0, BADGE_PERIOD_US, 0},
+  {0, 1, BADGE_BLINK_US, 0},
+};
+WAVE_CHECK(ledBadgeBlink, 1, 1, 2 * (BADGE_PERIOD_US + BADGE_BLINK_US));
+
+// 100% on at some other frequency, fullBlock with halfUs
+static inline uint8_t SquareWave(struct WavePhase *phases, uint32_t halfUs) {
+  phases[0] = {0, 1, halfUs, 0};
+  phases[1] = {1, 0, halfUs, 0};
+  return 2;
+}
+
+// analogWrite() needs timer1 too, so Fade's segment PWM is phases as well.
+// Same 1 kHz and range it had, but lined up with the backplane now.
+#define FADE_PWM_US 1000
+#define FADE_PWM_RANGE 255
+
+// Segment PWM for half a frame, backplane held
+static inline uint8_t FadeHalf(struct WavePhase *phases, uint8_t backplane, uint32_t highUs, uint32_t halfUs) {
+  uint8_t n = 0;
+  for (uint32_t t = 0; t < halfUs; t += FADE_PWM_US) {
+    if (highUs > 0) {
+      phases[n++] = {backplane, 1, highUs, 0};
+    }
+    if (highUs < FADE_PWM_US) {
+      phases[n++] = {backplane, 0, FADE_PWM_US - highUs, 0};
+    }
+  }
+  return n;
+}
+
+// Segment high for duty with the backplane low, then inverted to add up to
+// 0 DC: low for duty with it high. Two phases a ms, 32 for 8 ms halves. The
+// second half used to be lcd_duty_cycle_max - duty, which isn't the
+// inverse and left DC on at every step of the fade.
+static inline uint8_t FadeWave(struct WavePhase *phases, uint16_t duty, uint32_t halfUs) {
+  uint32_t highUs = (uint32_t)FADE_PWM_US * duty / FADE_PWM_RANGE;
+  uint8_t n = FadeHalf(phases, 0, highUs, halfUs);
+  return n + FadeHalf(phases + n, 1, FADE_PWM_US - highUs, halfUs);
+}
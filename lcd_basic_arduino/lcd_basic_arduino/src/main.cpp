@@ -24,12 +24,21 @@
   https://www.arduino.cc/en/Tutorial/BuiltInExamples/Blink
 */
 #include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "waveform.h"
+#include "waveforms.h"
+#include "flicker_lock.h"
 
 
 const int BUTTON_LOW = D4;
 const int BUTTON_SENSE = D3;
 const int LCD_BACKPLANE = D5;
 const int LCD_SEGMENT = D6;
+const int FLICKER_SENSE = A0; // Photodiode from 3.3V, 100k from A0 to ground, looking where the lights are
+static constexpr uint8_t backplane_pins[] = {LCD_BACKPLANE};
+static constexpr uint8_t segment_pins[] = {LCD_SEGMENT};
+static constexpr struct PinGroup backplane_lines = PIN_GROUP(backplane_pins);
+static constexpr struct PinGroup segment_lines = PIN_GROUP(segment_pins);
 const int LCD_DELAY_MS_MAX = 1000/60/2; // 60FPS, switched twice
 const int LCD_CHARGE_TIME_MS = 1;
 const int CAMERA_DELAY_US = 1; // 30FPS
@@ -44,8 +53,18 @@ uint16_t lcd_duty_cycle_min = 0;
 uint16_t lcd_duty_cycle_max = 40;
 
 const unsigned long DEBOUNCE_MS = 250;
+const unsigned long STATS_MS = 5000;
+#define BUSY_WAIT_EDGES 240 // ~1 s of FullBlock() the old way, to compare against
+#define FLICKER_SAMPLE_MS 20 // FlickerLock() reads the photodiode flat out this long each loop()
+struct FlickerPll flicker;
+uint32_t flicker_table_us = 0; // Period of FlickerLock()'s table playing, 0 if it's not
 
 
+void PrintWaveStats(const char *name, const struct WaveStats *stats) {
+  Serial.printf("%s: %u edges, late mean %u ns max %u ns, period error rms %u ns max %u ns, %u overruns\n", name,
+                stats->edges, stats->meanLateNs, stats->maxLateNs, stats->periodRmsNs, stats->periodMaxNs,
+                stats->overruns);
+}
 
 // the setup function runs once when you press reset or power the board
 void setup() {
@@ -56,33 +75,37 @@ void setup() {
   pinMode(BUTTON_SENSE, INPUT_PULLUP);
 
   Serial.begin(115200);
+  // Radio's not used, and its interrupts only get in the waveform's way
+  WiFi.mode(WIFI_OFF);
+  WiFi.forceSleepBegin();
+
+  // How the busy wait did, before the timer takes the pins
+  struct WaveStats stats;
+  WaveBusyWaitStats(LCD_BACKPLANE, LCD_SEGMENT, MIN_LCD_US_SWITCH, BUSY_WAIT_EDGES, &stats);
+  PrintWaveStats("Busy wait", &stats);
+  WaveBegin(&backplane_lines, &segment_lines);
+  FlickerPllInit(&flicker);
 }
 
-#define MIN_LCD_US_SWITCH (1000000/(121)/2)
 uint32_t lcd_on_time_us = 0;
 uint32_t lcd_on_time_us_increment = 100;
 
-void FullBlock() {
-    // Basic setup, 100% duty cycle
-
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(MIN_LCD_US_SWITCH);
+// The actions hand the waveform engine a table of phases whenever it
+// changes, it plays them from timer1 until the next one. The tables are in
+// waveforms.h.
 
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(MIN_LCD_US_SWITCH);
+void FullBlock() {
+  WavePlay(fullBlock, WAVE_COUNT(fullBlock));
 }
 
 void Fade() {
   // Fading in/out, works well, I think!
-  digitalWrite(LCD_BACKPLANE, LOW);
-  analogWrite(LCD_SEGMENT, lcd_duty_cycle);
-  delay(LCD_DELAY_MS_MAX);
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  // Write inverted to add up to 0 DC
-  analogWrite(LCD_SEGMENT, lcd_duty_cycle_max-lcd_duty_cycle);
-  delay(LCD_DELAY_MS_MAX);
+  struct WavePhase phases[WAVE_MAX_PHASES];
+  uint8_t n = FadeWave(phases, lcd_duty_cycle, LCD_DELAY_MS_MAX * 1000);
+  // Only takes a new one once the last has started, so this steps once a frame
+  if (!WavePlay(phases, n)) {
+    return;
+  }
   lcd_duty_cycle += lcd_duty_cycle_diff;
   if (lcd_duty_cycle > (lcd_duty_cycle_max - abs(lcd_duty_cycle_diff)) || lcd_duty_cycle < (lcd_duty_cycle_min + abs(lcd_duty_cycle_diff))) {
     lcd_duty_cycle_diff *= -1;
@@ -93,6 +116,7 @@ void Fade() {
 
 unsigned long delay_us = 0;
 
+unsigned long delay_us_min = 10; // Any shorter and it's all interrupt
 unsigned long delay_us_step = 1;
 unsigned long delay_us_max = 500;
 unsigned long cycle_time_ms = 5000;
@@ -104,14 +128,9 @@ unsigned long millis_step_ms = 12;
 unsigned long millis_current_step = 0;
 */
 void FreqSweep() {
-  delay_us = map(millis() % cycle_time_ms, 0, cycle_time_ms, 0, delay_us_max);
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(delay_us);
-
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(delay_us);
+  delay_us = map(millis() % cycle_time_ms, 0, cycle_time_ms, delay_us_min, delay_us_max);
+  struct WavePhase phases[2];
+  WavePlay(phases, SquareWave(phases, delay_us));
 }
 
 // 100% on, but alternate between two frequencies
@@ -119,13 +138,8 @@ unsigned long delay_us_array[2] = {200, 500};
 unsigned long millis_alternate_step_ms = 10;
 unsigned long millis_current_step = 0;
 void FreqAlternate() {
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(delay_us);
-
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(delay_us);
+  struct WavePhase phases[2];
+  WavePlay(phases, SquareWave(phases, delay_us));
 
   if (millis() / millis_alternate_step_ms > millis_current_step) {
     delay_us = delay_us_array[(millis_current_step % 2)];
@@ -135,48 +149,64 @@ void FreqAlternate() {
 }
 
 void Off() {
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, LOW);
+  WaveStop();
 }
 
 void SixtyHertz() {
-  // Try to dim at the same time as 60Hz lighting. 50% duty cycle
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(MIN_LCD_US_SWITCH);
-
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(MIN_LCD_US_SWITCH);
-
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(MIN_LCD_US_SWITCH);
-
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(MIN_LCD_US_SWITCH);
+  WavePlay(sixtyHertz, WAVE_COUNT(sixtyHertz));
 }
 
 
-const int BADGE_PERIOD_US = 1000000/50;
 void LEDBadgeBlink() {
-  // Try to dim at the same time as AEMBOT badge
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(BADGE_PERIOD_US);
+  WavePlay(ledBadgeBlink, WAVE_COUNT(ledBadgeBlink));
+}
 
-  digitalWrite(LCD_BACKPLANE, HIGH);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(1000);
+// Like the two above, but for whatever's flickering in front of the
+// photodiode, locked onto it (see flicker_lock.h). Clear until then.
+void FlickerLock() {
+  unsigned long start = millis();
+  while (millis() - start < FLICKER_SAMPLE_MS) {
+    uint32_t before = micros();
+    int level = analogRead(FLICKER_SENSE);
+    // Stamped halfway through the read
+    FlickerPllSample(&flicker, before + (micros() - before) / 2, level);
+  }
+  if (!flicker.locked) {
+    WaveStop();
+    flicker_table_us = 0;
+    return;
+  }
 
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, LOW);
-  delayMicroseconds(BADGE_PERIOD_US);
+  struct WavePhase phases[FLICKER_PHASES];
+  if (flicker_table_us == 0) {
+    // Starting over, from now. WaveCycleStartUs() says when it really did
+    // for the next one.
+    WaveStop();
+    uint8_t n = FlickerPhases(&flicker, micros(), phases);
+    WavePlay(phases, n);
+    flicker_table_us = WavePeriodUs(phases, n);
+    return;
+  }
+  // Otherwise the next one goes on the end of the one playing
+  uint32_t cycle_start;
+  if (!WaveCycleStartUs(&cycle_start)) {
+    return;
+  }
+  uint8_t n = FlickerPhases(&flicker, cycle_start + flicker_table_us, phases);
+  if (WavePlay(phases, n)) {
+    flicker_table_us = WavePeriodUs(phases, n);
+  }
+}
 
-  digitalWrite(LCD_BACKPLANE, LOW);
-  digitalWrite(LCD_SEGMENT, HIGH);
-  delayMicroseconds(1000);
+void PrintFlicker() {
+  if (!flicker.locked) {
+    Serial.printf("Flicker: not locked\n");
+    return;
+  }
+  uint32_t period = FlickerPeriodUs(&flicker);
+  uint32_t dark = FlickerDarkUs(&flicker);
+  Serial.printf("Flicker: %.2f Hz, on %u us, dark %u us, %u%% clear, last edge %+d us off\n",
+                256e6 / flicker.periodQ8, flicker.onUs, dark, 100 * (period - dark) / period, flicker.errorUs);
 }
 
 
@@ -185,13 +215,14 @@ typedef void(*Action)();    // Action is the typename for a pointer
                             // no parameters.
 
 //Action   actions[] = {&FullBlock, &Fade, &Off, &SixtyHertz, &LEDBadgeBlink};        // An array of Action objects.
-Action   actions[] = {&FreqSweep, &FreqAlternate, &FullBlock, &Fade, &Off};
+Action   actions[] = {&FreqSweep, &FreqAlternate, &FullBlock, &Fade, &Off, &FlickerLock};
 
 
 
 int action_idx = 0;
 unsigned long last_debounce_time = 0;
 bool button_reset = false;
+unsigned long last_stats_time = 0;
 
 void loop() {
   if (((millis() - DEBOUNCE_MS) < last_debounce_time)) {
@@ -204,10 +235,22 @@ void loop() {
     action_idx = (action_idx + 1) % (sizeof(actions)/sizeof(actions[0]));
     last_debounce_time = millis();
     button_reset = false;
+    flicker_table_us = 0; // Whatever's playing isn't FlickerLock()'s
   }
 
   actions[action_idx]();
 
+  if (millis() - last_stats_time >= STATS_MS) {
+    struct WaveStats stats;
+    WaveTakeStats(&stats);
+    PrintWaveStats("Timer", &stats);
+    if (actions[action_idx] == &FlickerLock) {
+      PrintFlicker();
+    }
+    last_stats_time = millis();
+  }
+  // Nothing to do until the next action update, the edges happen without us
+  delay(1);
 
 
 
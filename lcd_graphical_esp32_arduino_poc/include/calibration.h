@@ -0,0 +1,71 @@
+#pragma once
+
+// Per-wearer calibration, kept in NVS so recalibrating doesn't mean
+// reflashing. It's one versioned binary blob: the eyes' transform tables,
+// contrast, light radius, and the sensor profile the tables were made for.
+// setup() reads it once into RAM and the tables get used right there, the
+// EyeCalibration pointers just point into it. No parsing, every field is
+// already where and how the code wants it.
+//
+// Without a valid blob the compiled in tables (dewarp_table.h,
+// radial_table.h) get used in place from flash, same as before.
+//
+// host_tools/fit_radial.py --blob writes one, host_tools/calibration_upload.py
+// sends it over USB serial ('C', see main.cpp). Layout is little endian with
+// every field naturally aligned, the asserts in calibration.cpp pin it down
+// and fit_radial.py packs the same thing. Any change to it (or to the grid or
+// table sizes) needs CALIBRATION_VERSION bumped.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "eyes.h"
+
+#define CALIBRATION_MAGIC 0x43424C48 // "HLBC"
+#define CALIBRATION_VERSION 1
+#define CALIBRATION_USER_CHARS 16
+
+// Which transform an eye uses
+#define CALIBRATION_OFFSETS 0
+#define CALIBRATION_GRID 1
+#define CALIBRATION_RADIAL 2
+
+struct CalibrationEye {
+  int8_t xSign;
+  uint8_t contrast;
+  uint8_t transform;
+  uint8_t radialProjective;
+  int16_t xOffset; // For CALIBRATION_OFFSETS
+  int16_t yOffset;
+  int32_t radialH[8]; // RadialTransform.h
+  struct DewarpGrid grid;
+};
+
+struct CalibrationBlob {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size; // Of the whole blob
+  uint32_t crc; // CRC-32 (same as zlib's) of everything after this
+  // Sensor profile: the camera the tables were made for. Has to match this
+  // build's or the tables would be read wrong.
+  uint16_t cameraWidth;
+  uint16_t cameraHeight;
+  int16_t lensCenterX;
+  int16_t lensCenterY;
+  uint8_t gridCols;
+  uint8_t gridRows;
+  uint8_t lightRadius; // Drawn for lights that come without one
+  uint8_t reserved;
+  char user[CALIBRATION_USER_CHARS]; // Who it's for, not always 0 terminated
+  struct CalibrationEye eyes[NUM_EYES];
+  uint16_t radialScale[RADIAL_TABLE_SIZE]; // Shared by both eyes, one lens
+};
+
+uint32_t CalibrationCrc(const uint8_t *data, size_t size);
+// NULL if it's usable, else why not
+const char *CalibrationCheck(const struct CalibrationBlob *blob, size_t size);
+// One read from NVS. False if there's none or it isn't usable.
+bool CalibrationLoad(struct CalibrationBlob *blob);
+bool CalibrationSave(const struct CalibrationBlob *blob);
+// Points eyes (and radial, which needs somewhere to live) into blob, so it
+// has to stay around as long as they're used
+void CalibrationApply(const struct CalibrationBlob *blob, struct EyeCalibration *eyes, struct RadialTransform *radial);
@@ -0,0 +1,32 @@
+#pragma once
+
+// Camera pixels -> LCD pixels through a coarse grid of control points, so
+// the lens (and whatever else the calibration finds) doesn't need any math at
+// run time. Each point says where that camera pixel lands on the LCD, in Q8.8.
+// A light is bilinearly interpolated from the 4 points around it: the cell is
+// a power of 2 camera pixels, so finding it and the weights is shifts and
+// masks. No float, no sqrt, no divide.
+//
+// Grids live in flash, see dewarp_table.h. They're generated, and checked
+// against the float model they come from, by host_tools/dewarp_check.cpp
+
+#include <stdint.h>
+
+#define DEWARP_CELL_SHIFT 4 // 16 camera pixels per cell
+#define DEWARP_CELL (1 << DEWARP_CELL_SHIFT)
+// Camera is QQVGA, 160x120. One more point than cells each way.
+#define DEWARP_CAMERA_WIDTH 160
+#define DEWARP_CAMERA_HEIGHT 120
+#define DEWARP_COLS (DEWARP_CAMERA_WIDTH / DEWARP_CELL + 1)
+#define DEWARP_ROWS ((DEWARP_CAMERA_HEIGHT + DEWARP_CELL - 1) / DEWARP_CELL + 1)
+#define DEWARP_FRACTION_BITS 8 // Q8.8
+
+struct DewarpGrid {
+  // LCD pixels, Q8.8. 32 bits since off the panel is fine and can be past +-128.
+  int32_t x[DEWARP_ROWS][DEWARP_COLS];
+  int32_t y[DEWARP_ROWS][DEWARP_COLS];
+};
+
+// (x, y) in camera pixels, out in LCD pixels Q8.8. Outside the grid the edge
+// cells carry on in a straight line.
+void Dewarp(const struct DewarpGrid *grid, int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY);
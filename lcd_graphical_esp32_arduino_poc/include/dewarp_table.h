@@ -0,0 +1,66 @@
+#pragma once
+
+// Generated by host_tools/fit_radial.py, don't edit by hand.
+// User: default. From synthetic points, k1 0, noise 0 px.
+// Lens k1 0, k2 0 about (80, 60), radius 100.
+// Only include from one file, it's the definition.
+
+#include "dewarp.h"
+#include "eyes.h"
+
+static const struct DewarpGrid dewarpGrids[NUM_EYES] = {
+  // left
+  {
+    // x
+    {
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+    },
+    // y
+    {
+      {19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200},
+      {23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296},
+      {27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392},
+      {31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488},
+      {35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584},
+      {39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680},
+      {43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776},
+      {47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872},
+      {51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968},
+    },
+  },
+  // right
+  {
+    // x
+    {
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+      {28160, 24064, 19968, 15872, 11776, 7680, 3584, -512, -4608, -8704, -12800},
+    },
+    // y
+    {
+      {19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200, 19200},
+      {23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296, 23296},
+      {27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392, 27392},
+      {31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488, 31488},
+      {35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584, 35584},
+      {39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680, 39680},
+      {43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776, 43776},
+      {47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872, 47872},
+      {51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968, 51968},
+    },
+  },
+};
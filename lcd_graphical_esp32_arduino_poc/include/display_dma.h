@@ -0,0 +1,55 @@
+#pragma once
+
+// ST7571s over the ESP32-S2's hardware SPI with DMA instead of u8g2 bit-banging
+// the pins. u8g2 still owns a frame buffer per panel and all the drawing
+// calls, and its own commands (init, contrast, clearDisplay...) go out through
+// u8x8_byte_esp32_spi_dma below. Frames are pushed with DisplayDmaFlushPages(),
+// which queues the pages and returns right away, so the next frame can be
+// drawn (into another buffer) while this one is still going out.
+//
+// Up to DISPLAY_MAX_PANELS panels (one per eye) share one bus: clock, data
+// and DC are common, each has its own CS. CS is switched from the transfer
+// callback rather than by the SPI peripheral, so everything goes through one
+// queue and pages for the two eyes can be interleaved.
+
+#include <U8g2lib.h>
+
+#define DISPLAY_SPI_HZ 10000000 // ST7571 serial clock is good to 20MHz, leave some margin for the wires
+#define DISPLAY_PAGES 16
+#define DISPLAY_PAGE_BYTES 128
+#define DISPLAY_GRAY_PAGE_BYTES 256 // 2 bytes per column in 4 gray level mode
+#define DISPLAY_MAX_PANELS 2
+
+uint8_t u8x8_byte_esp32_spi_dma(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+// Returns the panel number for the Flush calls
+uint8_t DisplayDmaAttach(u8x8_t *u8x8);
+
+// Same wiring as the _4W_SW_SPI constructor, the pins get routed to the SPI
+// peripheral through the GPIO matrix. Every panel needs the same clock and
+// data pins. Give all but the first reset = U8X8_PIN_NONE if they share the
+// reset line, otherwise begin() on the second one resets the first.
+class U8G2_ST7571_128X128_F_DMA : public U8G2 {
+  public: U8G2_ST7571_128X128_F_DMA(const u8g2_cb_t *rotation, uint8_t clock, uint8_t data, uint8_t cs, uint8_t dc, uint8_t reset = U8X8_PIN_NONE) : U8G2() {
+    u8g2_Setup_st7571_128x128_f(&u8g2, rotation, u8x8_byte_esp32_spi_dma, u8x8_gpio_and_delay_arduino);
+    u8x8_SetPin_4Wire_SW_SPI(getU8x8(), clock, data, cs, dc, reset);
+    panel = DisplayDmaAttach(getU8x8());
+  }
+  uint8_t panel;
+};
+
+// Queues the pages set in pageMask (bit n = page n) from buffer, which is
+// sent as is, so leave it alone until the next flush or DisplayDmaWait().
+// Needs to be in internal RAM and 4 byte aligned. Waits for the previous
+// flush first if it's still going.
+void DisplayDmaFlushPages(uint8_t panel, const uint8_t *buffer, uint16_t pageMask);
+// Same for several panels at once, alternating page by page so they all
+// finish at about the same time
+void DisplayDmaFlushPanels(const uint8_t *panels, const uint8_t *const *buffers, const uint16_t *pageMasks,
+                           uint8_t numPanels);
+// Blocks until everything queued has gone out
+void DisplayDmaWait();
+bool DisplayDmaBusy();
+// Switches an ST7571 between 1 and 2 bits per pixel. Pages passed to the
+// flush calls are DISPLAY_GRAY_PAGE_BYTES long after this. u8g2 knows
+// nothing about it, so don't draw through u8g2 while it's on.
+void DisplayDmaSetGray(uint8_t panel, bool gray);
@@ -0,0 +1,117 @@
+#pragma once
+
+// Glasses slide around on the face while they're worn, and whatever the
+// calibration was goes stale. This keeps a small correction on top of it per
+// eye: an offset plus a scale about the panel center on each axis, fit by
+// least squares to where the mask should have been for lights that sat still
+// a while, like street lamps while stopped at a light.
+//
+// The forward camera can't see the eye, so it can't tell the glasses slid on
+// its own: a far away lamp stays put in the camera either way. The wearer
+// says which way the mask is off (w/a/s/d over serial, see main.cpp), and
+// the still lights are what that gets pinned to. Moving ones are ignored, a
+// nudge with nothing still around does nothing.
+//
+// A nudge is about the still light nearest the middle of the panel, the one
+// straight ahead: with several around there's no telling which one the
+// wearer means otherwise, and a nudge that moves them all can't tell an
+// offset from a scale.
+//
+// Each still light has one live observation that every nudge replaces, and
+// counts for a lot so a nudge moves the mask right away. Once the light goes
+// (the car moves on) its last observation goes into the history, which is
+// slowly forgotten. The history is what the scale comes from: lamps in
+// different places at different stops.
+//
+// Bounded per frame: DriftTrack() is DRIFT_MAX_REFERENCES compares per light,
+// DriftStep() folds in at most DRIFT_MAX_REFERENCES observations and solves a
+// 2x2 per axis. The correction the transform reads only changes at the end of
+// DriftStep(), which runs between frames.
+
+#include <stdint.h>
+#include "lights.h"
+
+#define DRIFT_MAX_REFERENCES 4 // Still light candidates tracked at once
+#define DRIFT_STILL_PX 2 // Camera px. Further than this from where it was first seen and it moved.
+#define DRIFT_STABLE_FRAMES 60 // Still this long before nudges count, ~2 s at 30 fps
+#define DRIFT_WEIGHT 256 // Of one observation in the history, fixed point so forgetting has room
+#define DRIFT_LIVE_WEIGHT (16 * DRIFT_WEIGHT) // Of a still light's live one
+#define DRIFT_FORGET_FRAMES 256 // History weighs 1/32 less every this many frames, half life ~3 min
+#define DRIFT_FORGET_SHIFT 5
+#define DRIFT_RIDGE_PX 24 // Scale stays put until observations spread wider than about this
+#define DRIFT_MAX_OFFSET 24 // LCD px
+#define DRIFT_MAX_SCALE_Q16 (65536 / 8) // +-12.5%
+#define DRIFT_LCD_CENTER 64 // LCD px, what the scale is about
+
+struct DriftReference {
+  int16_t x; // Camera px, where it was first seen
+  int16_t y;
+  uint16_t frames; // Seen in a row, stops counting at DRIFT_STABLE_FRAMES
+  uint8_t id;
+};
+
+// One set for both eyes, it's the camera that sees them
+struct DriftReferences {
+  struct DriftReference references[DRIFT_MAX_REFERENCES];
+  uint8_t count;
+  uint8_t nextId;
+};
+
+// lcd += offset + scale * (lcd - center), after the calibration's transform
+struct DriftCorrection {
+  int32_t offsetX; // LCD px Q8.8
+  int32_t offsetY;
+  int32_t scaleX; // Q16, 0 = unchanged
+  int32_t scaleY;
+};
+
+struct DriftObservation {
+  bool used;
+  uint8_t id; // Of the reference it's about
+  int16_t lcdX; // LCD px where it gets drawn without the correction
+  int16_t lcdY;
+  int32_t wantX; // Correction wanted there, LCD px Q8.8
+  int32_t wantY;
+};
+
+// Weighted sums for least squares of want = offset + slope * (lcd - center)
+struct DriftAxis {
+  int64_t weight;
+  int64_t r;
+  int64_t r2;
+  int64_t want;
+  int64_t rWant;
+};
+
+struct Drift {
+  struct DriftAxis x; // History
+  struct DriftAxis y;
+  struct DriftObservation live[DRIFT_MAX_REFERENCES];
+  uint16_t frames; // Since the history was last forgotten a bit
+  bool changed; // Needs solving again
+  uint32_t nudges;
+  uint32_t observations; // Gone into the history
+  struct DriftCorrection correction; // What the transform reads
+};
+
+void DriftReferencesInit(struct DriftReferences *r);
+// Once per camera frame
+void DriftTrack(struct DriftReferences *r, const struct Light *lights, uint8_t numLights);
+// The ones that have been still long enough, as lights at their camera
+// position, plus their ids. Both need room for DRIFT_MAX_REFERENCES.
+uint8_t DriftStillLights(const struct DriftReferences *r, struct Light *out, uint8_t *ids);
+
+// Back to no correction
+void DriftInit(struct Drift *d);
+// The mask around the still light nearest straight ahead, out of these (LCD
+// px, drawn without the correction), should move by dx, dy (LCD px Q8.8)
+// from where it is now
+void DriftNudge(struct Drift *d, const struct Light *lcdLights, const uint8_t *ids, uint8_t count, int32_t dx,
+                int32_t dy);
+// Between frames, after DriftTrack(). True if the correction changed.
+bool DriftStep(struct Drift *d, const struct DriftReferences *r);
+// The correction at an LCD position, Q8.8 in and out
+static inline void DriftApply(const struct DriftCorrection *c, int32_t *x, int32_t *y) {
+  *x += c->offsetX + ((c->scaleX * (*x - (DRIFT_LCD_CENTER << 8))) >> 16);
+  *y += c->offsetY + ((c->scaleY * (*y - (DRIFT_LCD_CENTER << 8))) >> 16);
+}
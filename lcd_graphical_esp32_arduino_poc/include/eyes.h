@@ -0,0 +1,43 @@
+#pragma once
+
+// Both eyes from one board. Each eye has its own panel (same SPI bus, own
+// CS), its own contrast and its own camera -> LCD calibration, and both get
+// drawn from the same camera frame at the same time.
+
+#include <stdint.h>
+#include "lights.h"
+#include "dewarp.h"
+#include "radial.h"
+#include "parallax.h"
+#include "drift.h"
+
+#define NUM_EYES 2
+// From the viewer's perspective
+#define EYE_LEFT 0
+#define EYE_RIGHT 1
+#define EYES_LEFT (1 << EYE_LEFT)
+#define EYES_RIGHT (1 << EYE_RIGHT)
+#define EYES_BOTH (EYES_LEFT | EYES_RIGHT)
+
+struct EyeCalibration {
+  int8_t xSign; // -1 to mirror
+  int16_t xOffset; // LCD pixels, after mirroring
+  int16_t yOffset;
+  uint8_t contrast; // Trade off "off" transparency with "on" darkness
+  // Either replaces the offsets above when set, see dewarp.h and radial.h.
+  // xSign still says whether shapes get mirrored.
+  const struct DewarpGrid *dewarp;
+  const struct RadialTransform *radial; // Wins if both are set
+  // Follows the light to the eye instead, see parallax.h. Wins over both.
+  const struct Parallax *parallax;
+  // On top of whichever of the above, NULL for none. See drift.h.
+  const struct DriftCorrection *drift;
+};
+
+// Camera pixels -> LCD pixels for every eye in eyeMask, in one pass over the
+// lights. out[eye] needs room for numLights.
+void TransformLights(const struct EyeCalibration *calibration, uint8_t eyeMask, const struct Light *in,
+                     uint8_t numLights, struct Light *const *out);
+// Prints cycles per light through TransformLights(): grid, radial, parallax,
+// offsets only
+void EyesBenchmark(const struct EyeCalibration *calibration);
@@ -0,0 +1,65 @@
+#pragma once
+
+// Decides when the LCD draws. It used to draw whenever the UART went quiet,
+// so the frame rate wobbled with the serial traffic. Now draws happen on a
+// fixed period, each one from the newest complete camera frame.
+//
+// FRAME_PACE_CAMERA also slides the schedule to land just after camera frames
+// arrive (every Nth draw if the LCD runs faster than the camera), so what's
+// drawn is as fresh as it gets and its age doesn't wander around. It never
+// draws faster than the nominal period: a camera faster than that is just
+// drawn from at nominal, nothing lined up. See host_tools/frame_pacer_sim.
+
+#include <stdint.h>
+
+#define FRAME_PACE_FIXED 0
+#define FRAME_PACE_CAMERA 1
+#define FRAME_ALIGN_MARGIN_US 1000 // After a camera frame's last line
+#define FRAME_ALIGN_GAIN_SHIFT 3 // Fix 1/8 of the phase error per camera frame
+#define FRAME_CAMERA_OUTLIERS 4 // Odd gaps in a row before believing the camera changed rate
+#define FRAME_PER_FRAME_SHIFT 4 // One more draw per camera frame needs 1/16 of nominal to spare
+
+struct FramePacerStats {
+  uint32_t frames;
+  uint32_t skipped; // Draws missed because the loop was busy too long
+  uint32_t minIntervalUs;
+  uint32_t maxIntervalUs;
+  uint32_t meanIntervalUs;
+  uint32_t jitterUs; // RMS of (interval - period)
+  uint32_t cameraPeriodUs; // 0 if no frames seen
+  int32_t phaseUs; // FRAME_PACE_CAMERA: mean of where draws land vs where we want them
+};
+
+struct FramePacer {
+  uint8_t mode;
+  uint32_t nominalUs;
+  uint32_t periodUs; // Tweaked to a whole fraction of the camera's in FRAME_PACE_CAMERA, never under nominalUs
+  uint32_t perFrame; // Draws per camera frame, FRAME_PACE_CAMERA, 0 if not lined up
+  uint32_t nextUs;
+  uint32_t lastDrawUs;
+  bool started;
+  bool drawn;
+
+  uint32_t lastArrivalUs;
+  bool haveArrival;
+  uint32_t cameraPeriodUs; // Smoothed
+  uint8_t outliers; // In a row, enough of them and the camera really changed rate
+
+  // Since the last FramePacerTakeStats()
+  uint32_t frames;
+  uint32_t skipped;
+  uint32_t intervals;
+  uint32_t minIntervalUs;
+  uint32_t maxIntervalUs;
+  uint64_t sumIntervalUs;
+  uint64_t sumSquaredErrorUs;
+  int64_t sumPhaseUs;
+  uint32_t phases;
+};
+
+void FramePacerInit(struct FramePacer *p, uint32_t periodUs, uint8_t mode);
+// True when it's time to draw
+bool FramePacerDue(struct FramePacer *p, uint32_t nowUs);
+// A whole camera frame just came in
+void FramePacerCameraFrame(struct FramePacer *p, uint32_t arrivalUs);
+void FramePacerTakeStats(struct FramePacer *p, struct FramePacerStats *stats);
@@ -0,0 +1,30 @@
+#pragma once
+
+// Soft edged blocking discs for the ST7571's 4 gray level mode. Each light is
+// a solid core (the same size as the 1-bit disc) with a two step penumbra
+// around it, so the edge of the blocked area isn't a hard line in your view.
+//
+// Buffer is laid out the way the ST7571 wants it in gray mode, so there's no
+// packing step before a flush: byte [page * 256 + x * 2 + plane] holds 8
+// vertical pixels of one bit plane, lowest bit on top. Overlapping lights keep
+// the darker level, which works on whole bytes of both planes at once.
+//
+// Distances come from a table of sqrt(d^2) in quarter pixels, no float sqrt.
+
+#include <stdint.h>
+
+#define GRAY_WIDTH 128
+#define GRAY_PAGES 16
+#define GRAY_PAGE_BYTES 256
+// Which byte of a column pair is which. Swap if light and dark gray come out
+// backwards on the glass.
+#define GRAY_PLANE_LSB 0
+#define GRAY_PLANE_MSB 1
+#define GRAY_LEVEL_CORE 3 // Darkest
+#define GRAY_FEATHER 4 // pixels of penumbra outside the core, half at level 2 and half at 1
+// Core + feather past this (merged lights) get a hard edged core only
+#define GRAY_MAX_DISTANCE 63
+
+void GrayRasterInit();
+// Clipped to the panel, (x, y) can be off the edge
+void GrayDrawLight(uint8_t *buffer, int16_t x, int16_t y, uint8_t radius);
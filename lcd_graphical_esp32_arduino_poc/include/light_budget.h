@@ -0,0 +1,32 @@
+#pragma once
+
+// Keeps the number of lights we draw bounded, however many the camera sends.
+// A city street can have dozens of lamps in view, and every light is another
+// disc to rasterize (and a bigger frame to push over SPI).
+//
+// 0. Lights that are nowhere on the panel are dropped.
+// 1. Lights whose discs overlap or nearly touch (within LIGHT_MERGE_GAP) are
+//    merged into one disc covering all of them. Candidates come from a coarse
+//    grid so we don't compare every pair.
+// 2. What's left is ranked by brightness * area, and only the top `budget`
+//    are kept.
+
+#include <stdint.h>
+#include "lights.h"
+
+#define LIGHT_MERGE_GAP 2 // pixels between disc edges that still counts as touching
+#define LIGHT_GRID_CELL_SHIFT 4 // 16x16 pixel cells
+#define LIGHT_GRID_CELLS_X 8 // 128 / 16
+#define LIGHT_GRID_CELLS_Y 8
+#define LIGHT_GRID_CELL_CAPACITY 8
+#define LIGHT_MERGE_PASSES 3 // Merged discs grow and can touch new ones
+
+struct LightBudgetStats {
+  uint8_t in;
+  uint8_t merged; // Lights absorbed into another one
+  uint8_t dropped; // Over budget after merging
+  uint8_t offPanel; // Nowhere on the panel, dropped first
+};
+
+// Reduces lights[] in place and returns the new count (<= budget)
+uint8_t ReduceLights(struct Light *lights, uint8_t numLights, uint8_t budget, struct LightBudgetStats *stats);
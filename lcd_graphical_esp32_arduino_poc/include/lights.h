@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// What gets blocked around (x1, y1). Streaks and reflections off wet roads
+// are long and thin, and a disc big enough to cover them darkens way more of
+// the view than the light itself.
+#define LIGHT_DISC 0
+#define LIGHT_ELLIPSE 1
+#define LIGHT_POLYGON 2
+#define LIGHT_POLYGON_MAX_VERTICES 6
+
+#define MAX_LIGHTS 64 // Received per frame, extras are dropped
+
+// denoted in LCD pixels (corrected values). Left of / above the panel x1 / y1
+// hold a negative int16_t, so read them through (int16_t).
+struct Light
+{
+  uint16_t x1;
+  uint16_t y1;
+  uint8_t radius; // Disc radius, or the covering circle of the other shapes (what merging goes by)
+  uint8_t brightness; // 0-255, 255 if the camera didn't say
+  uint8_t shape; // LIGHT_DISC etc
+  // LIGHT_ELLIPSE: radius is the semi-major axis
+  uint8_t minor; // Semi-minor axis
+  uint8_t angle; // Major axis from +x towards +y (down), 256 = half a turn
+  // LIGHT_POLYGON: convex, either winding, offsets from (x1, y1)
+  uint8_t numVertices;
+  int8_t vx[LIGHT_POLYGON_MAX_VERTICES];
+  int8_t vy[LIGHT_POLYGON_MAX_VERTICES];
+};
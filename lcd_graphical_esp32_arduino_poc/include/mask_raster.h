@@ -0,0 +1,23 @@
+#pragma once
+
+// Draws the blocking discs straight into u8g2's frame buffer instead of
+// going through drawDisc(), which sets pixels through a generic vline routine.
+//
+// The ST7571 buffer is page-major: byte [page * 128 + x] holds rows
+// page*8 .. page*8+7 of column x, lowest bit on top. So a disc is a run of
+// columns, each one a vertical span. For small radii the spans are
+// precomputed as 32-bit column masks (a sprite per radius), and a blit is one
+// shift per column plus up to 4 byte ORs. Bigger discs fill spans directly.
+//
+// Pixels come out identical to u8g2's drawDisc, see host_tools/mask_raster_check.cpp
+
+#include <stdint.h>
+
+#define MASK_WIDTH 128
+#define MASK_PAGES 16
+// Diameter + 7 bits of page offset has to fit in 32 bits
+#define MASK_SPRITE_MAX_RADIUS 12
+
+void MaskRasterInit();
+// Clipped to the panel, (x, y) can be off the edge
+void MaskDrawDisc(uint8_t *buffer, int16_t x, int16_t y, uint8_t radius);
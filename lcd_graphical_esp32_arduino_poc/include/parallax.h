@@ -0,0 +1,79 @@
+#pragma once
+
+// Camera pixels -> LCD pixels by actually following the light: each light is
+// a ray out of the camera, the source sits on it at some distance, and what
+// gets blocked is where the line from the source to the eye crosses the LCD.
+// So unlike a flat offset it gets nearby sources right, and moving the eye
+// (glasses sitting differently) is just a new eye position.
+//
+// Glasses frame, in um: x to the wearer's right, y down, z straight ahead.
+// The camera looks down z, the panel is square on to it. Camera pixels are
+// taken as pinhole ones, so lens correction goes first.
+//
+// Working it through for a source at distance Z ahead of the camera, with
+// A = lcdZ - eyeZ, B = cameraZ - eyeZ + Z, du = camera px from the principal
+// point, f = focal length in camera px:
+//   lcdX = eyeX + A (cameraX - eyeX) / B + (A / f) (Z / B) du
+// Everything but du only depends on Z. With one assumed distance for all
+// lights (ParallaxSetDistance()) it's one multiply per axis per light. A
+// distance per light costs two 32-bit divides on top.
+//
+// host_tools/parallax_check.cpp checks it against the float ray model.
+
+#include <stdint.h>
+
+#define PARALLAX_LCD_CENTER 64 // LCD px, the middle of the panel
+#define PARALLAX_W_BITS 14 // Z / B
+
+struct ParallaxGeometry {
+  int32_t eye[3]; // um, the pupil
+  int32_t camera[3]; // um, the camera's pinhole
+  int32_t lcdCenter[3]; // um, the middle of the panel
+  int32_t lcdPitch; // um per LCD px
+  int8_t lcdXSign; // -1 if LCD x runs to the wearer's left
+  int32_t focalQ4; // Camera px, Q4
+  int32_t principalXQ4; // Camera px, Q4
+  int32_t principalYQ4;
+  uint16_t distanceMm; // Assumed source distance, from the camera along z
+};
+
+struct Parallax {
+  int8_t xSign;
+  int32_t principalXQ4;
+  int32_t principalYQ4;
+  int32_t cameraEyeZ; // um, B - Z
+  int32_t baseX; // LCD px Q8, eye relative to the panel center
+  int32_t baseY;
+  int32_t offsetNumX; // LCD px Q8 * um, over B for the camera to eye offset
+  int32_t offsetNumY;
+  int32_t slopeInfinity; // LCD px per camera px Q16, for a source infinitely far
+  // For the assumed distance, see ParallaxSetDistance()
+  uint16_t distanceMm;
+  int32_t offsetX; // LCD px Q8, incl. base
+  int32_t offsetY;
+  int32_t slope; // LCD px per camera px Q16
+};
+
+// Once per geometry change, not the hot path
+void ParallaxInit(struct Parallax *p, const struct ParallaxGeometry *g);
+void ParallaxSetDistance(struct Parallax *p, uint16_t distanceMm);
+// Camera px Q8.8 -> LCD px Q8.8 for the given distance terms, inline so
+// transform_pipeline.h can have it mid stack
+static inline void ParallaxProjectQ8(const struct Parallax *p, int32_t offsetX, int32_t offsetY, int32_t slope,
+                                     int32_t x, int32_t y, int32_t *lcdX, int32_t *lcdY) {
+  // Relative to the principal point, Q4
+  int32_t du = (x >> 4) - p->principalXQ4;
+  int32_t dv = (y >> 4) - p->principalYQ4;
+  // Q16 * Q4 -> Q8
+  int32_t lx = offsetX + ((slope * du) >> 12);
+  int32_t ly = offsetY + ((slope * dv) >> 12);
+  *lcdX = (PARALLAX_LCD_CENTER << 8) + (p->xSign < 0 ? -lx : lx);
+  *lcdY = (PARALLAX_LCD_CENTER << 8) + ly;
+}
+
+// One light at the assumed distance, out in LCD px Q8.8 like Dewarp()
+void ParallaxPoint(const struct Parallax *p, int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY);
+// All lights in one go. distanceMm can be NULL for the assumed distance, a 0
+// in it means the assumed distance too.
+void ParallaxProject(const struct Parallax *p, const int16_t *x, const int16_t *y, const uint16_t *distanceMm,
+                     uint8_t count, int32_t *lcdX, int32_t *lcdY);
@@ -0,0 +1,41 @@
+#pragma once
+
+// Camera pixels -> LCD pixels as a radial lens correction then a homography,
+// the other way to do what dewarp.h does. The lens part only depends on r^2,
+// so there's no sqrt: r^2 indexes a table of how much to stretch that
+// radius, and that's one multiply per axis. The homography takes it from the
+// undistorted camera to the LCD (mirror, scale, rotation, offsets and the
+// panel not being square on to the camera).
+//
+// Fitted from measured points by host_tools/fit_radial.py, which writes the
+// tables into radial_table.h. host_tools/dewarp_check.cpp checks it and
+// times it against the grid.
+
+#include <stdint.h>
+#include "dewarp.h"
+
+#define RADIAL_R2_SHIFT 4 // Table step, 16 camera px^2
+// Center to corner of the frame, plus a margin for lights extrapolated off
+// the edge. Further out uses the last entry.
+#define RADIAL_MARGIN 8
+#define RADIAL_MAX_R2 ((DEWARP_CAMERA_WIDTH / 2 + RADIAL_MARGIN) * (DEWARP_CAMERA_WIDTH / 2 + RADIAL_MARGIN) + \
+                       (DEWARP_CAMERA_HEIGHT / 2 + RADIAL_MARGIN) * (DEWARP_CAMERA_HEIGHT / 2 + RADIAL_MARGIN))
+#define RADIAL_TABLE_SIZE ((RADIAL_MAX_R2 >> RADIAL_R2_SHIFT) + 1)
+#define RADIAL_SCALE_BITS 14 // Q2.14, so up to 4x
+#define RADIAL_UNDISTORTED_BITS 4 // Camera px between the two steps, Q4
+#define RADIAL_PROJECTIVE_BITS 24 // h[6], h[7]
+
+struct RadialTransform {
+  int16_t centerX; // Camera px, the lens center
+  int16_t centerY;
+  const uint16_t *scale; // [r^2 >> RADIAL_R2_SHIFT], Q2.14
+  // On the undistorted camera position relative to the center, (ux, uy):
+  //   lcdX = (h0 ux + h1 uy + h2) / w, lcdY = (h3 ux + h4 uy + h5) / w
+  //   w = 1 + h6 ux + h7 uy
+  // h0..h5 in Q16 (LCD px), h6 and h7 in Q24.
+  int32_t h[8];
+  bool projective; // h6 and h7 aren't 0, costs a divide per axis
+};
+
+// (x, y) in camera pixels, out in LCD pixels Q8.8 like Dewarp()
+void RadialToLCD(const struct RadialTransform *t, int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY);
@@ -0,0 +1,85 @@
+#pragma once
+
+// Draws the blocking shapes into a back frame and only sends the 8-row pages
+// that are different from the front frame, which is what's on the glass. Pushing
+// the whole 128x128 panel every frame is most of the draw time, and most
+// frames only a light or two moved a few pixels.
+//
+// One Renderer per panel. With two eyes, compose both and then flush them
+// together so their pages go out interleaved.
+
+#include <U8g2lib.h>
+#include "lights.h"
+#include "gray_raster.h"
+#include "shape_raster.h"
+
+#define LCD_PAGES 16 // 8 rows each
+#define LCD_PAGE_BYTES 128 // One byte = 8 vertical pixels
+
+// Hardware SPI + DMA, see display_dma.h. Comment out to go back to u8g2
+// bit-banging the pins.
+#define DISPLAY_DMA
+
+// 2 bits per pixel with soft edged discs, see gray_raster.h. Needs DISPLAY_DMA
+// since u8g2 only does 1 bit.
+//#define RENDER_GRAY
+
+// 1-bit only: lights below full brightness get a dither pattern that moves on
+// every refresh (frame rate control), so they block partly instead of fully.
+// The pattern has to keep moving between camera frames, see RenderDitherStep().
+//#define RENDER_FRC
+#define FRC_LEVELS 4 // Opacity steps, 2x2 ordered dither. The top one is solid.
+#define FRC_PHASES 4
+#define FRC_REFRESH_US 4167 // 240 Hz, so every pixel's on/off cycle repeats at 60 Hz
+
+// Uncomment to print update and flush times for 1, 4 and 15 moving lights at startup
+//#define RENDER_BENCHMARK
+
+#ifdef RENDER_GRAY
+// Already in the order the LCD takes it in gray mode
+#define RENDER_PAGE_BYTES GRAY_PAGE_BYTES
+#define RENDER_SHAPE_LAYOUT SHAPE_GRAY
+#else
+#define RENDER_PAGE_BYTES LCD_PAGE_BYTES
+#define RENDER_SHAPE_LAYOUT SHAPE_MONO
+#endif
+
+struct Renderer {
+  U8G2 *display;
+  uint8_t panel; // DISPLAY_DMA panel number
+  // Back frame gets drawn while the front one is (or is going) on the glass,
+  // then they swap. With DISPLAY_DMA the front one is sent straight from here.
+  uint8_t frames[2][LCD_PAGES * RENDER_PAGE_BYTES] __attribute__((aligned(4)));
+  uint8_t back;
+  bool frontValid; // Front matches the glass
+  bool composed; // Back has a new frame waiting for RenderFlush()
+  uint16_t dirty; // Its pages that differ from the front
+  struct Light lastLights[MAX_LIGHTS];
+  uint8_t numLastLights;
+  uint8_t ditherPhase;
+  bool dithered; // Last composed frame has lights drawn with a dither pattern
+};
+
+struct RenderStats {
+  uint8_t pagesSent;
+  uint32_t drawUs;  // Clearing + drawing into the buffer
+  uint32_t flushUs; // Sending pages to the LCD. With DISPLAY_DMA just queueing them,
+                    // the transfer finishes in the background
+};
+
+void RenderInit(struct Renderer *r, U8G2 *display);
+// Call after drawing something outside of RenderLights(), the glass no
+// longer matches what we think is on it
+void RenderInvalidate(struct Renderer *r);
+// Draws into the back frame and works out which pages changed, sends nothing
+void RenderCompose(struct Renderer *r, const struct Light *lights, uint8_t numLights, struct RenderStats *stats);
+// Sends whatever RenderCompose() left in each and swaps their frames.
+// Returns the us it took (just queueing with DISPLAY_DMA).
+uint32_t RenderFlush(struct Renderer *const *renderers, uint8_t count);
+// Next step of the dither pattern for the lights last composed, for
+// RenderFlush() to send. Returns false without composing if nothing on this
+// panel is dithered. Does nothing without RENDER_FRC.
+bool RenderDitherStep(struct Renderer *r, struct RenderStats *stats);
+// Compose + flush for one panel
+void RenderLights(struct Renderer *r, const struct Light *lights, uint8_t numLights, struct RenderStats *stats);
+void RenderBenchmark(struct Renderer *r);
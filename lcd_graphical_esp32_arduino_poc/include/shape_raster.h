@@ -0,0 +1,38 @@
+#pragma once
+
+// Rotated ellipses and convex polygons, for lights that aren't round (see
+// lights.h). Same idea as mask_raster.h: the buffer is page-major, so the
+// fill walks columns, not rows. Every edge is stepped across the columns it
+// spans with an integer quotient + remainder (no float, no division per
+// column), which gives the exact top and bottom pixel center inside the shape
+// in each column. Then each column is one vertical span.
+//
+// Ellipses are drawn as the 16-gon around them, so they never come out
+// smaller than the light. Vertices are kept in 1/16 pixels.
+//
+// Checked against a brute force point-in-polygon test, and measured against
+// the covering discs, in host_tools/mask_raster_check.cpp
+
+#include <stdint.h>
+#include "lights.h"
+
+#define SHAPE_WIDTH 128
+#define SHAPE_PAGES 16
+#define SHAPE_SUBPIXEL_SHIFT 4
+#define SHAPE_ELLIPSE_VERTICES 16
+#define SHAPE_MAX_VERTICES SHAPE_ELLIPSE_VERTICES
+
+// Buffer layouts
+#define SHAPE_MONO 0 // mask_raster.h
+#define SHAPE_GRAY 1 // gray_raster.h, drawn at GRAY_LEVEL_CORE with no feather
+
+void ShapeRasterInit();
+// Clipped to the panel, (x, y) can be off the edge
+void ShapeDrawEllipse(uint8_t *buffer, uint8_t layout, int16_t x, int16_t y, uint8_t major, uint8_t minor,
+                      uint8_t angle);
+void ShapeDrawPolygon(uint8_t *buffer, uint8_t layout, int16_t x, int16_t y, const int8_t *vx, const int8_t *vy,
+                      uint8_t numVertices);
+// Whatever shape the light is, discs go to mask_raster / gray_raster
+void ShapeDrawLight(uint8_t *buffer, uint8_t layout, const struct Light *light);
+// Smallest radius around (x1, y1) that covers a LIGHT_POLYGON
+uint8_t ShapeCoverRadius(const struct Light *light);
@@ -0,0 +1,59 @@
+#pragma once
+
+// Timestamped trace points for the draw and parse paths, instead of
+// Serial.printf, whose formatting was a big part of the times it printed.
+//
+// TRACE(id, a, b) stores {micros(), id, a, b} into a RAM ring buffer and
+// that's it. TRACE_POLL() in loop() sends a few buffered events at a time
+// over Serial, TRACE_DUMP() all of them (main.cpp does it on a 'T'). They go out as "~" + hex
+// lines so they can sit between the normal text output;
+// host_tools/trace_decode.py turns a capture into a timeline.
+//
+// Comment out TRACE_ENABLED and every trace point compiles to nothing, the
+// arguments aren't even evaluated, so don't put anything with side effects in
+// them.
+
+#include <stdint.h>
+
+#define TRACE_ENABLED
+#define TRACE_EVENTS 1024 // Power of 2
+#define TRACE_DRAIN_PER_POLL 4 // Background, so loop() doesn't stall on Serial
+
+// Keep in order, trace_decode.py reads the names from here
+enum TraceId {
+  TRACE_LOST,          // a = events overwritten before they were sent
+  TRACE_LIGHT_RX,      // a, b = camera x, y
+  TRACE_LIGHT_OVERFLOW, // a = lights that didn't fit so far
+  TRACE_BAD_LINE,      // a = bad lines so far
+  TRACE_SYNC_SAMPLE,   // a = round trip us, b = offset us
+  TRACE_FRAME_COMMIT,  // a = lights, b = 1 if it has a capture time
+  TRACE_DRAW_START,    // a = lights after extrapolation, b = eyes drawn
+  TRACE_BUDGET,        // a = merged, b = over budget
+  TRACE_DRAW_END,      // a = pages sent, b = rasterize us, both eyes
+  TRACE_FLUSH,         // a = pages sent, b = flush us, both eyes
+};
+
+struct TraceEvent {
+  uint32_t stamp; // Which write filled this slot + 1, 0 while one is in progress
+  uint32_t us;
+  uint16_t id;
+  int32_t a;
+  int32_t b;
+};
+
+#ifdef TRACE_ENABLED
+#define TRACE(id, a, b) TraceWrite((id), (int32_t)(a), (int32_t)(b))
+#define TRACE_POLL() TracePoll()
+#define TRACE_DUMP() TraceDump()
+#else
+#define TRACE(id, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0) // Not evaluated, but still used
+#define TRACE_POLL() do { } while (0)
+#define TRACE_DUMP() do { } while (0)
+#endif
+
+// Safe from an ISR too, writers only share an atomic counter
+void TraceWrite(uint16_t id, int32_t a, int32_t b);
+// Sends up to maxEvents, returns how many went
+uint16_t TraceDrain(uint16_t maxEvents);
+void TracePoll();
+void TraceDump();
@@ -0,0 +1,160 @@
+#pragma once
+
+// Camera -> LCD as a stack of stages, put together at compile time. Each
+// prototype's stack is just a type, e.g. mirror then offset:
+//
+//   Pipeline<MirrorStage, OffsetStage> p(MirrorStage(), OffsetStage(110, 75));
+//   p.Point(x, y, &lcdX, &lcdY);
+//
+// and it all inlines into one function, no virtuals or function pointers.
+// The LUT stages still call Dewarp() / RadialToLCD() directly since those
+// live in their own .cpp.
+//
+// Coordinates are Q8.8 the whole way through, camera px going in and LCD px
+// coming out (same as Dewarp()). A stage is anything with
+//   void Apply(int32_t &x, int32_t &y) const
+// The LUT stages look up whole camera pixels, so they go first.
+//
+// Batch() does all lights in one loop over plain x / y arrays instead of
+// Light structs, see TransformLights().
+
+#include <stdint.h>
+#include "dewarp.h"
+#include "radial.h"
+#include "parallax.h"
+#include "drift.h"
+
+#define PIPELINE_FRACTION_BITS DEWARP_FRACTION_BITS
+#define PIPELINE_ONE (1 << PIPELINE_FRACTION_BITS) // Multiplied rather than shifted, offsets can be negative
+#define PIPELINE_INLINE inline __attribute__((always_inline))
+
+// x -> -x. Put an OffsetStage after it to land back on the panel.
+struct MirrorStage {
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    (void)y;
+    x = -x;
+  }
+};
+
+struct OffsetStage {
+  int32_t x; // Q8.8
+  int32_t y;
+  OffsetStage(int16_t xPixels, int16_t yPixels)
+      : x((int32_t)xPixels * PIPELINE_ONE), y((int32_t)yPixels * PIPELINE_ONE) {}
+  PIPELINE_INLINE void Apply(int32_t &px, int32_t &py) const {
+    px += x;
+    py += y;
+  }
+};
+
+// About the origin, so usually before an OffsetStage
+struct ScaleStage {
+  int32_t x; // Q8, 256 = 1
+  int32_t y;
+  ScaleStage(int32_t xQ8, int32_t yQ8) : x(xQ8), y(yQ8) {}
+  PIPELINE_INLINE void Apply(int32_t &px, int32_t &py) const {
+    px = (px * x) >> 8;
+    py = (py * y) >> 8;
+  }
+};
+
+// Whole camera pixels through the grid, see dewarp.h
+struct DewarpStage {
+  const struct DewarpGrid *grid;
+  explicit DewarpStage(const struct DewarpGrid *g) : grid(g) {}
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    Dewarp(grid, (int16_t)(x >> PIPELINE_FRACTION_BITS), (int16_t)(y >> PIPELINE_FRACTION_BITS), &x, &y);
+  }
+};
+
+// Whole camera pixels through the r^2 tables + homography, see radial.h
+struct RadialStage {
+  const struct RadialTransform *transform;
+  explicit RadialStage(const struct RadialTransform *t) : transform(t) {}
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    RadialToLCD(transform, (int16_t)(x >> PIPELINE_FRACTION_BITS), (int16_t)(y >> PIPELINE_FRACTION_BITS), &x, &y);
+  }
+};
+
+// Pinhole camera px -> LCD px at the assumed distance, see parallax.h. Takes
+// the fractions, so it can follow a stage that undoes the lens.
+struct ParallaxStage {
+  const struct Parallax *parallax;
+  explicit ParallaxStage(const struct Parallax *p) : parallax(p) {}
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    ParallaxProjectQ8(parallax, parallax->offsetX, parallax->offsetY, parallax->slope, x, y, &x, &y);
+  }
+};
+
+// What the glasses sliding around has put off, see drift.h. Goes after the
+// stages that land on the LCD.
+struct DriftStage {
+  const struct DriftCorrection *correction;
+  explicit DriftStage(const struct DriftCorrection *c) : correction(c) {}
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    DriftApply(correction, &x, &y);
+  }
+};
+
+// Keeps both axes within [lowest, highest] px. Only for stacks that want it: left
+// alone, off panel comes out negative and the rasterizers clip it.
+struct ClampStage {
+  int32_t lowest; // Q8.8
+  int32_t highest;
+  ClampStage(int16_t lowestPixels, int16_t highestPixels)
+      : lowest((int32_t)lowestPixels * PIPELINE_ONE),
+        highest((int32_t)highestPixels * PIPELINE_ONE) {}
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    x = x < lowest ? lowest : (x > highest ? highest : x);
+    y = y < lowest ? lowest : (y > highest ? highest : y);
+  }
+};
+
+// The stages one after another, first to last
+template <typename... Stages>
+struct PipelineStages;
+
+template <>
+struct PipelineStages<> {
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    (void)x;
+    (void)y;
+  }
+};
+
+template <typename First, typename... Rest>
+struct PipelineStages<First, Rest...> {
+  First first;
+  PipelineStages<Rest...> rest;
+  PipelineStages(const First &f, const Rest &...r) : first(f), rest(r...) {}
+  PIPELINE_INLINE void Apply(int32_t &x, int32_t &y) const {
+    first.Apply(x, y);
+    rest.Apply(x, y);
+  }
+};
+
+template <typename... Stages>
+struct Pipeline {
+  PipelineStages<Stages...> stages;
+  Pipeline(const Stages &...s) : stages(s...) {}
+
+  // Camera px -> LCD px Q8.8
+  PIPELINE_INLINE void Point(int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY) const {
+    int32_t px = (int32_t)x * PIPELINE_ONE;
+    int32_t py = (int32_t)y * PIPELINE_ONE;
+    stages.Apply(px, py);
+    *lcdX = px;
+    *lcdY = py;
+  }
+
+  // Every light in one loop, out to the nearest LCD px. Off the panel ends up
+  // negative, same as CameraToLCD().
+  void Batch(const int16_t *x, const int16_t *y, uint8_t count, int16_t *lcdX, int16_t *lcdY) const {
+    for (uint8_t i = 0; i < count; i++) {
+      int32_t px, py;
+      Point(x[i], y[i], &px, &py);
+      lcdX[i] = (int16_t)((px + (1 << (PIPELINE_FRACTION_BITS - 1))) >> PIPELINE_FRACTION_BITS);
+      lcdY[i] = (int16_t)((py + (1 << (PIPELINE_FRACTION_BITS - 1))) >> PIPELINE_FRACTION_BITS);
+    }
+  }
+};
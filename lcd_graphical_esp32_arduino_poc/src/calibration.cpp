@@ -0,0 +1,95 @@
+#include <Preferences.h>
+#include <string.h>
+#include "calibration.h"
+
+#define NVS_NAMESPACE "headlight"
+#define NVS_KEY "calib"
+
+// The layout fit_radial.py packs, see calibration.h
+static_assert(sizeof(struct DewarpGrid) == 2 * DEWARP_ROWS * DEWARP_COLS * 4, "grid layout");
+static_assert(offsetof(struct CalibrationEye, radialH) == 8, "eye layout");
+static_assert(offsetof(struct CalibrationEye, grid) == 40, "eye layout");
+static_assert(sizeof(struct CalibrationEye) == 40 + sizeof(struct DewarpGrid), "eye layout");
+static_assert(offsetof(struct CalibrationBlob, cameraWidth) == 12, "blob layout");
+static_assert(offsetof(struct CalibrationBlob, user) == 24, "blob layout");
+static_assert(offsetof(struct CalibrationBlob, eyes) == 40, "blob layout");
+static_assert(offsetof(struct CalibrationBlob, radialScale) == 40 + NUM_EYES * sizeof(struct CalibrationEye),
+              "blob layout");
+static_assert(sizeof(struct CalibrationBlob) <= UINT16_MAX, "size field");
+
+// Bit at a time, it's a few KB once at boot
+uint32_t CalibrationCrc(const uint8_t *data, size_t size) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+const char *CalibrationCheck(const struct CalibrationBlob *blob, size_t size) {
+  if (size != sizeof(*blob) || blob->magic != CALIBRATION_MAGIC) {
+    return "not a calibration";
+  }
+  if (blob->version != CALIBRATION_VERSION || blob->size != sizeof(*blob)) {
+    return "wrong version";
+  }
+  size_t crcStart = offsetof(struct CalibrationBlob, crc) + sizeof(blob->crc);
+  if (CalibrationCrc((const uint8_t *)blob + crcStart, sizeof(*blob) - crcStart) != blob->crc) {
+    return "bad CRC";
+  }
+  if (blob->cameraWidth != DEWARP_CAMERA_WIDTH || blob->cameraHeight != DEWARP_CAMERA_HEIGHT ||
+      blob->gridCols != DEWARP_COLS || blob->gridRows != DEWARP_ROWS) {
+    return "made for another camera";
+  }
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    if (blob->eyes[eye].transform > CALIBRATION_RADIAL) {
+      return "unknown transform";
+    }
+  }
+  return NULL;
+}
+
+bool CalibrationLoad(struct CalibrationBlob *blob) {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, /* readOnly=*/ true)) {
+    return false;
+  }
+  size_t size = prefs.getBytes(NVS_KEY, blob, sizeof(*blob));
+  prefs.end();
+  return CalibrationCheck(blob, size) == NULL;
+}
+
+bool CalibrationSave(const struct CalibrationBlob *blob) {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, /* readOnly=*/ false)) {
+    return false;
+  }
+  size_t size = prefs.putBytes(NVS_KEY, blob, sizeof(*blob));
+  prefs.end();
+  return size == sizeof(*blob);
+}
+
+void CalibrationApply(const struct CalibrationBlob *blob, struct EyeCalibration *eyes, struct RadialTransform *radial) {
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    const struct CalibrationEye *from = &blob->eyes[eye];
+    struct EyeCalibration *to = &eyes[eye];
+    to->xSign = from->xSign;
+    to->xOffset = from->xOffset;
+    to->yOffset = from->yOffset;
+    to->contrast = from->contrast;
+    to->dewarp = from->transform == CALIBRATION_GRID ? &from->grid : NULL;
+    to->radial = NULL;
+    to->parallax = NULL;
+    if (from->transform == CALIBRATION_RADIAL) {
+      radial[eye].centerX = blob->lensCenterX;
+      radial[eye].centerY = blob->lensCenterY;
+      radial[eye].scale = blob->radialScale;
+      memcpy(radial[eye].h, from->radialH, sizeof(radial[eye].h));
+      radial[eye].projective = from->radialProjective != 0;
+      to->radial = &radial[eye];
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#include "dewarp.h"
+
+#define ONE (1 << DEWARP_FRACTION_BITS)
+
+// Cell to use and how far into it, in 1/256 of a cell. Clamped to the edge
+// cells, so the weight goes below 0 or past 256 off the grid.
+static inline void Locate(int16_t v, int16_t lastCell, int16_t *cell, int32_t *weight) {
+  int16_t c = v >> DEWARP_CELL_SHIFT; // Floors for negative too
+  if (c < 0) {
+    c = 0;
+  } else if (c > lastCell) {
+    c = lastCell;
+  }
+  *cell = c;
+  *weight = ((int32_t)(v - (c << DEWARP_CELL_SHIFT)) * ONE) >> DEWARP_CELL_SHIFT;
+}
+
+// Q8.8 values with a Q8 weight. Differences of two points times 256 still
+// fit easily, so no 64 bit.
+static inline int32_t Lerp(int32_t a, int32_t b, int32_t w) {
+  return a + (((b - a) * w) >> DEWARP_FRACTION_BITS);
+}
+
+void Dewarp(const struct DewarpGrid *grid, int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY) {
+  int16_t col, row;
+  int32_t wx, wy;
+  Locate(x, DEWARP_COLS - 2, &col, &wx);
+  Locate(y, DEWARP_ROWS - 2, &row, &wy);
+  const int32_t *x0 = &grid->x[row][col];
+  const int32_t *x1 = &grid->x[row + 1][col];
+  const int32_t *y0 = &grid->y[row][col];
+  const int32_t *y1 = &grid->y[row + 1][col];
+  *lcdX = Lerp(Lerp(x0[0], x0[1], wx), Lerp(x1[0], x1[1], wx), wy);
+  *lcdY = Lerp(Lerp(y0[0], y0[1], wx), Lerp(y1[0], y1[1], wx), wy);
+}
@@ -0,0 +1,219 @@
+#include <Arduino.h>
+#include <string.h>
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+#include "display_dma.h"
+
+// ST7565-style addressing, same as u8g2's st7571 driver
+#define CMD_PAGE_ADDRESS 0xB0
+#define CMD_COLUMN_HIGH 0x10
+#define CMD_COLUMN_LOW 0x00
+// Display mode lives in extension command set 3
+#define CMD_EXTENSION_3 0x7B
+#define CMD_MODE_GRAY 0x10
+#define CMD_MODE_MONO 0x11
+#define CMD_EXTENSION_EXIT 0x00
+
+// What the pins need to be for one transaction, passed in its user field
+struct Target {
+  uint8_t panel;
+  uint8_t dcLevel;
+};
+
+struct Panel {
+  u8x8_t *u8x8;
+  gpio_num_t cs;
+  gpio_num_t dc;
+  uint8_t dcLevel; // For u8x8 sends
+  uint8_t xOffset;
+  uint16_t pageBytes;
+  struct Target targets[2]; // Command, data
+};
+
+static struct Panel panels[DISPLAY_MAX_PANELS];
+static uint8_t numPanels = 0;
+static spi_device_handle_t device = NULL;
+
+// Command + data per page per panel
+#define MAX_TRANSACTIONS (DISPLAY_PAGES * 2 * DISPLAY_MAX_PANELS)
+static spi_transaction_t transactions[MAX_TRANSACTIONS];
+static uint8_t numQueued = 0;
+
+// Run in the SPI ISR right before and after each transaction, so a panel
+// is only ever selected while its own bytes are going out
+static void IRAM_ATTR PreTransfer(spi_transaction_t *t) {
+  const struct Target *target = (const struct Target *)t->user;
+  gpio_set_level(panels[target->panel].dc, target->dcLevel);
+  gpio_set_level(panels[target->panel].cs, 0);
+}
+
+static void IRAM_ATTR PostTransfer(spi_transaction_t *t) {
+  const struct Target *target = (const struct Target *)t->user;
+  gpio_set_level(panels[target->panel].cs, 1);
+}
+
+uint8_t DisplayDmaAttach(u8x8_t *u8x8) {
+  if (numPanels >= DISPLAY_MAX_PANELS) {
+    return DISPLAY_MAX_PANELS - 1;
+  }
+  // Pins aren't set yet when the constructor calls this, they're read in Init
+  panels[numPanels].u8x8 = u8x8;
+  return numPanels++;
+}
+
+static struct Panel *FindPanel(u8x8_t *u8x8) {
+  for (uint8_t i = 0; i < numPanels; i++) {
+    if (panels[i].u8x8 == u8x8) {
+      return &panels[i];
+    }
+  }
+  return &panels[0];
+}
+
+static void DisplayDmaInit(u8x8_t *u8x8) {
+  struct Panel *panel = FindPanel(u8x8);
+  uint8_t index = panel - panels;
+  panel->cs = (gpio_num_t)u8x8->pins[U8X8_PIN_CS];
+  panel->dc = (gpio_num_t)u8x8->pins[U8X8_PIN_DC];
+  panel->xOffset = u8x8->x_offset;
+  panel->pageBytes = DISPLAY_PAGE_BYTES;
+  panel->targets[0].panel = index;
+  panel->targets[0].dcLevel = 0;
+  panel->targets[1].panel = index;
+  panel->targets[1].dcLevel = 1;
+  gpio_set_direction(panel->cs, GPIO_MODE_OUTPUT);
+  gpio_set_level(panel->cs, 1);
+  gpio_set_direction(panel->dc, GPIO_MODE_OUTPUT);
+
+  if (device != NULL) {
+    // Bus is already up from the first panel
+    return;
+  }
+  spi_bus_config_t bus;
+  memset(&bus, 0, sizeof(bus));
+  bus.sclk_io_num = u8x8->pins[U8X8_PIN_SPI_CLOCK];
+  bus.mosi_io_num = u8x8->pins[U8X8_PIN_SPI_DATA];
+  bus.miso_io_num = -1;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  bus.max_transfer_sz = DISPLAY_GRAY_PAGE_BYTES;
+  ESP_ERROR_CHECK(spi_bus_initialize(SPI2_HOST, &bus, SPI_DMA_CH_AUTO));
+
+  spi_device_interface_config_t dev;
+  memset(&dev, 0, sizeof(dev));
+  dev.clock_speed_hz = DISPLAY_SPI_HZ;
+  dev.mode = 0;
+  dev.spics_io_num = -1; // Done in PreTransfer / PostTransfer
+  dev.queue_size = MAX_TRANSACTIONS;
+  dev.pre_cb = PreTransfer;
+  dev.post_cb = PostTransfer;
+  ESP_ERROR_CHECK(spi_bus_add_device(SPI2_HOST, &dev, &device));
+}
+
+void DisplayDmaWait() {
+  spi_transaction_t *done;
+  while (numQueued > 0) {
+    spi_device_get_trans_result(device, &done, portMAX_DELAY);
+    numQueued--;
+  }
+}
+
+bool DisplayDmaBusy() {
+  spi_transaction_t *done;
+  // Collect whatever has finished without blocking
+  while (numQueued > 0 && spi_device_get_trans_result(device, &done, 0) == ESP_OK) {
+    numQueued--;
+  }
+  return numQueued > 0;
+}
+
+static uint8_t AddPage(uint8_t n, uint8_t panelIndex, const uint8_t *buffer, uint8_t page) {
+  struct Panel *panel = &panels[panelIndex];
+
+  // 3 command bytes fit in the transaction itself, no DMA buffer needed
+  spi_transaction_t *command = &transactions[n++];
+  memset(command, 0, sizeof(*command));
+  command->flags = SPI_TRANS_USE_TXDATA;
+  command->length = 3 * 8;
+  command->tx_data[0] = CMD_COLUMN_HIGH | (panel->xOffset >> 4);
+  command->tx_data[1] = CMD_COLUMN_LOW | (panel->xOffset & 0x0F);
+  command->tx_data[2] = CMD_PAGE_ADDRESS | page;
+  command->user = &panel->targets[0];
+
+  spi_transaction_t *data = &transactions[n++];
+  memset(data, 0, sizeof(*data));
+  data->length = panel->pageBytes * 8;
+  data->tx_buffer = &buffer[page * panel->pageBytes];
+  data->user = &panel->targets[1];
+  return n;
+}
+
+void DisplayDmaFlushPanels(const uint8_t *panelList, const uint8_t *const *buffers, const uint16_t *pageMasks,
+                           uint8_t count) {
+  DisplayDmaWait();
+
+  uint8_t n = 0;
+  for (uint8_t page = 0; page < DISPLAY_PAGES; page++) {
+    for (uint8_t i = 0; i < count; i++) {
+      if (pageMasks[i] & (1 << page)) {
+        n = AddPage(n, panelList[i], buffers[i], page);
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    spi_device_queue_trans(device, &transactions[i], portMAX_DELAY);
+    numQueued++;
+  }
+}
+
+void DisplayDmaFlushPages(uint8_t panel, const uint8_t *buffer, uint16_t pageMask) {
+  DisplayDmaFlushPanels(&panel, &buffer, &pageMask, 1);
+}
+
+void DisplayDmaSetGray(uint8_t panelIndex, bool gray) {
+  struct Panel *panel = &panels[panelIndex];
+  DisplayDmaWait();
+  spi_transaction_t t;
+  memset(&t, 0, sizeof(t));
+  t.flags = SPI_TRANS_USE_TXDATA;
+  t.length = 3 * 8;
+  t.tx_data[0] = CMD_EXTENSION_3;
+  t.tx_data[1] = gray ? CMD_MODE_GRAY : CMD_MODE_MONO;
+  t.tx_data[2] = CMD_EXTENSION_EXIT;
+  t.user = &panel->targets[0];
+  spi_device_polling_transmit(device, &t);
+  panel->pageBytes = gray ? DISPLAY_GRAY_PAGE_BYTES : DISPLAY_PAGE_BYTES;
+}
+
+// u8x8 byte interface, for everything u8g2 sends itself. Not the hot path,
+// so it just does blocking polled transfers.
+uint8_t u8x8_byte_esp32_spi_dma(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr) {
+  struct Panel *panel;
+  spi_transaction_t t;
+  switch (msg) {
+    case U8X8_MSG_BYTE_INIT:
+      DisplayDmaInit(u8x8);
+      break;
+    case U8X8_MSG_BYTE_SET_DC:
+      FindPanel(u8x8)->dcLevel = arg_int;
+      break;
+    case U8X8_MSG_BYTE_START_TRANSFER:
+      // Polled transfers can't go while queued ones are pending
+      DisplayDmaWait();
+      break;
+    case U8X8_MSG_BYTE_SEND:
+      panel = FindPanel(u8x8);
+      memset(&t, 0, sizeof(t));
+      t.length = arg_int * 8;
+      t.tx_buffer = arg_ptr;
+      t.user = &panel->targets[panel->dcLevel ? 1 : 0];
+      spi_device_polling_transmit(device, &t);
+      break;
+    case U8X8_MSG_BYTE_END_TRANSFER:
+      break;
+    default:
+      return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+#include "drift.h"
+
+void DriftReferencesInit(struct DriftReferences *r) {
+  memset(r, 0, sizeof(*r));
+}
+
+static inline bool Near(const struct DriftReference *ref, const struct Light *light) {
+  return abs((int16_t)light->x1 - ref->x) <= DRIFT_STILL_PX && abs((int16_t)light->y1 - ref->y) <= DRIFT_STILL_PX;
+}
+
+void DriftTrack(struct DriftReferences *r, const struct Light *lights, uint8_t numLights) {
+  // Keep the ones still sitting where they were, drop the rest
+  for (uint8_t k = 0; k < r->count;) {
+    struct DriftReference *ref = &r->references[k];
+    bool seen = false;
+    for (uint8_t i = 0; i < numLights && !seen; i++) {
+      seen = Near(ref, &lights[i]);
+    }
+    if (!seen) {
+      *ref = r->references[--r->count];
+      continue;
+    }
+    if (ref->frames < DRIFT_STABLE_FRAMES) {
+      ref->frames++;
+    }
+    k++;
+  }
+  // New candidates while there's room
+  for (uint8_t i = 0; i < numLights && r->count < DRIFT_MAX_REFERENCES; i++) {
+    bool known = false;
+    for (uint8_t k = 0; k < r->count && !known; k++) {
+      known = Near(&r->references[k], &lights[i]);
+    }
+    if (!known) {
+      struct DriftReference *ref = &r->references[r->count++];
+      ref->x = (int16_t)lights[i].x1;
+      ref->y = (int16_t)lights[i].y1;
+      ref->frames = 1;
+      ref->id = r->nextId++;
+    }
+  }
+}
+
+uint8_t DriftStillLights(const struct DriftReferences *r, struct Light *out, uint8_t *ids) {
+  uint8_t n = 0;
+  for (uint8_t k = 0; k < r->count; k++) {
+    if (r->references[k].frames < DRIFT_STABLE_FRAMES) {
+      continue;
+    }
+    memset(&out[n], 0, sizeof(out[n]));
+    out[n].x1 = (uint16_t)r->references[k].x;
+    out[n].y1 = (uint16_t)r->references[k].y;
+    ids[n] = r->references[k].id;
+    n++;
+  }
+  return n;
+}
+
+void DriftInit(struct Drift *d) {
+  memset(d, 0, sizeof(*d));
+}
+
+void DriftNudge(struct Drift *d, const struct Light *lcdLights, const uint8_t *ids, uint8_t count, int32_t dx,
+                int32_t dy) {
+  // About the one nearest straight ahead, with several still there's no
+  // telling which one the wearer means otherwise
+  uint8_t best = count;
+  int32_t bestDistance = INT32_MAX;
+  for (uint8_t i = 0; i < count; i++) {
+    int32_t x = (int16_t)lcdLights[i].x1 - DRIFT_LCD_CENTER;
+    int32_t y = (int16_t)lcdLights[i].y1 - DRIFT_LCD_CENTER;
+    if (x * x + y * y < bestDistance) {
+      bestDistance = x * x + y * y;
+      best = i;
+    }
+  }
+  if (best == count) {
+    return;
+  }
+  // Its live observation, or a free one. There's one per reference.
+  struct DriftObservation *o = NULL;
+  for (uint8_t k = 0; k < DRIFT_MAX_REFERENCES; k++) {
+    if (d->live[k].used && d->live[k].id == ids[best]) {
+      o = &d->live[k];
+      break;
+    }
+    if (!d->live[k].used && o == NULL) {
+      o = &d->live[k];
+    }
+  }
+  if (o == NULL) {
+    return;
+  }
+  o->used = true;
+  o->id = ids[best];
+  o->lcdX = (int16_t)lcdLights[best].x1;
+  o->lcdY = (int16_t)lcdLights[best].y1;
+  // What it's corrected by now, plus the nudge
+  int32_t x = (int32_t)o->lcdX * 256;
+  int32_t y = (int32_t)o->lcdY * 256;
+  DriftApply(&d->correction, &x, &y);
+  o->wantX = x - (int32_t)o->lcdX * 256 + dx;
+  o->wantY = y - (int32_t)o->lcdY * 256 + dy;
+  d->nudges++;
+  d->changed = true;
+}
+
+static void Add(struct DriftAxis *a, int16_t lcd, int32_t want, int64_t weight) {
+  int64_t r = lcd - DRIFT_LCD_CENTER;
+  a->weight += weight;
+  a->r += weight * r;
+  a->r2 += weight * r * r;
+  a->want += weight * want;
+  a->rWant += weight * r * want;
+}
+
+static void Forget(struct DriftAxis *a) {
+  a->weight -= a->weight >> DRIFT_FORGET_SHIFT;
+  a->r -= a->r >> DRIFT_FORGET_SHIFT;
+  a->r2 -= a->r2 >> DRIFT_FORGET_SHIFT;
+  a->want -= a->want >> DRIFT_FORGET_SHIFT;
+  a->rWant -= a->rWant >> DRIFT_FORGET_SHIFT;
+}
+
+static inline int32_t Clamp(int64_t v, int32_t limit) {
+  return (int32_t)(v < -limit ? -limit : (v > limit ? limit : v));
+}
+
+// Offset and scale for one axis, from the sums. The ridge keeps the slope at
+// 0 while everything's been seen in one spot, which is then just the mean.
+static void Solve(const struct DriftAxis *a, int32_t *offset, int32_t *scale) {
+  int64_t r2 = a->r2 + a->weight * DRIFT_RIDGE_PX * DRIFT_RIDGE_PX;
+  int64_t det = a->weight * r2 - a->r * a->r;
+  if (a->weight == 0 || det <= 0) {
+    return;
+  }
+  *offset = Clamp((r2 * a->want - a->r * a->rWant) / det, DRIFT_MAX_OFFSET << 8);
+  // Q8 per px -> Q16
+  *scale = Clamp((a->weight * a->rWant - a->r * a->want) * 256 / det, DRIFT_MAX_SCALE_Q16);
+}
+
+bool DriftStep(struct Drift *d, const struct DriftReferences *r) {
+  if (++d->frames >= DRIFT_FORGET_FRAMES) {
+    d->frames = 0;
+    Forget(&d->x);
+    Forget(&d->y);
+    d->changed = true;
+  }
+  // Lights that went away leave their last observation behind
+  for (uint8_t k = 0; k < DRIFT_MAX_REFERENCES; k++) {
+    struct DriftObservation *o = &d->live[k];
+    if (!o->used) {
+      continue;
+    }
+    bool still = false;
+    for (uint8_t j = 0; j < r->count && !still; j++) {
+      still = r->references[j].id == o->id;
+    }
+    if (!still) {
+      Add(&d->x, o->lcdX, o->wantX, DRIFT_WEIGHT);
+      Add(&d->y, o->lcdY, o->wantY, DRIFT_WEIGHT);
+      o->used = false;
+      d->observations++;
+      // Counts for less in the history than live
+      d->changed = true;
+    }
+  }
+  if (!d->changed) {
+    return false;
+  }
+  d->changed = false;
+
+  // History plus what's live, worked out on the side, then swapped in whole
+  struct DriftAxis x = d->x;
+  struct DriftAxis y = d->y;
+  for (uint8_t k = 0; k < DRIFT_MAX_REFERENCES; k++) {
+    const struct DriftObservation *o = &d->live[k];
+    if (o->used) {
+      Add(&x, o->lcdX, o->wantX, DRIFT_LIVE_WEIGHT);
+      Add(&y, o->lcdY, o->wantY, DRIFT_LIVE_WEIGHT);
+    }
+  }
+  struct DriftCorrection next = d->correction;
+  Solve(&x, &next.offsetX, &next.scaleX);
+  Solve(&y, &next.offsetY, &next.scaleY);
+  d->correction = next;
+  return true;
+}
@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include "eyes.h"
+#include "transform_pipeline.h"
+
+// Lens dewarp and the rest of the calibration come precomputed, as a grid of
+// control points (dewarp.h) or r^2 tables + homography (radial.h). Without
+// either it's just mirror + offset. Parallax (parallax.h) instead works it
+// out from where the eye, camera and panel are.
+//
+// Each is its own stack of stages (transform_pipeline.h), picked once per eye
+// rather than per light, with the drift correction (drift.h) last. Another
+// prototype's stack goes in here too.
+typedef Pipeline<DewarpStage, DriftStage> DewarpPipeline;
+typedef Pipeline<RadialStage, DriftStage> RadialPipeline;
+typedef Pipeline<ParallaxStage, DriftStage> ParallaxPipeline;
+typedef Pipeline<MirrorStage, OffsetStage, DriftStage> MirroredPipeline;
+typedef Pipeline<OffsetStage, DriftStage> OffsetPipeline;
+
+static const struct DriftCorrection noDrift = {0, 0, 0, 0};
+
+// Off the panel ends up negative, which the rasterizers clip
+static void CameraToLCD(const struct EyeCalibration *cal, const int16_t *x, const int16_t *y, uint8_t count,
+                        int16_t *lcdX, int16_t *lcdY) {
+  DriftStage drift(cal->drift != NULL ? cal->drift : &noDrift);
+  if (cal->parallax != NULL) {
+    ParallaxPipeline(ParallaxStage(cal->parallax), drift).Batch(x, y, count, lcdX, lcdY);
+  } else if (cal->radial != NULL) {
+    RadialPipeline(RadialStage(cal->radial), drift).Batch(x, y, count, lcdX, lcdY);
+  } else if (cal->dewarp != NULL) {
+    DewarpPipeline(DewarpStage(cal->dewarp), drift).Batch(x, y, count, lcdX, lcdY);
+  } else if (cal->xSign < 0) {
+    MirroredPipeline(MirrorStage(), OffsetStage(cal->xOffset, cal->yOffset), drift).Batch(x, y, count, lcdX, lcdY);
+  } else {
+    OffsetPipeline(OffsetStage(cal->xOffset, cal->yOffset), drift).Batch(x, y, count, lcdX, lcdY);
+  }
+}
+
+void TransformLights(const struct EyeCalibration *calibration, uint8_t eyeMask, const struct Light *in,
+                     uint8_t numLights, struct Light *const *out) {
+  // Positions pulled out once for every eye
+  static int16_t cameraX[UINT8_MAX];
+  static int16_t cameraY[UINT8_MAX];
+  static int16_t lcdX[UINT8_MAX];
+  static int16_t lcdY[UINT8_MAX];
+  for (uint8_t i = 0; i < numLights; i++) {
+    cameraX[i] = (int16_t)in[i].x1;
+    cameraY[i] = (int16_t)in[i].y1;
+  }
+
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    if (!(eyeMask & (1 << eye))) {
+      continue;
+    }
+    const struct EyeCalibration *cal = &calibration[eye];
+    CameraToLCD(cal, cameraX, cameraY, numLights, lcdX, lcdY);
+    for (uint8_t i = 0; i < numLights; i++) {
+      const struct Light *light = &in[i];
+      struct Light *o = &out[eye][i];
+      *o = *light;
+      // Negative stays negative read back through (int16_t), see lights.h
+      o->x1 = (uint16_t)lcdX[i];
+      o->y1 = (uint16_t)lcdY[i];
+      if (cal->xSign < 0) {
+        // Mirrored shapes lean the other way
+        o->angle = (uint8_t)-light->angle;
+        for (uint8_t k = 0; k < light->numVertices && k < LIGHT_POLYGON_MAX_VERTICES; k++) {
+          o->vx[k] = -light->vx[k];
+        }
+      }
+    }
+  }
+}
+
+void EyesBenchmark(const struct EyeCalibration *calibration) {
+  static const uint8_t count = 64;
+  static const uint8_t rounds = 20;
+  struct Light in[count];
+  static struct Light out[NUM_EYES][count];
+  struct Light *outs[NUM_EYES] = {out[EYE_LEFT], out[EYE_RIGHT]};
+  for (uint8_t i = 0; i < count; i++) {
+    memset(&in[i], 0, sizeof(in[i]));
+    in[i].x1 = (i * 37) % DEWARP_CAMERA_WIDTH;
+    in[i].y1 = (i * 53) % DEWARP_CAMERA_HEIGHT;
+    in[i].radius = 4;
+    in[i].brightness = 255;
+  }
+  // Same calibration four ways, whichever tables it has
+  static const char *const names[] = {"dewarp grid", "radial", "parallax", "offsets only"};
+  struct EyeCalibration ways[4][NUM_EYES];
+  for (uint8_t w = 0; w < 4; w++) {
+    memcpy(ways[w], calibration, sizeof(ways[w]));
+    for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+      ways[w][eye].dewarp = w == 0 ? calibration[eye].dewarp : NULL;
+      ways[w][eye].radial = w == 1 ? calibration[eye].radial : NULL;
+      ways[w][eye].parallax = w == 2 ? calibration[eye].parallax : NULL;
+    }
+  }
+
+  for (uint8_t w = 0; w < 4; w++) {
+    if ((w == 0 && ways[w][EYE_RIGHT].dewarp == NULL) || (w == 1 && ways[w][EYE_RIGHT].radial == NULL) ||
+        (w == 2 && ways[w][EYE_RIGHT].parallax == NULL)) {
+      continue;
+    }
+    // One eye, so it's per point
+    uint32_t start = ESP.getCycleCount();
+    for (uint8_t r = 0; r < rounds; r++) {
+      TransformLights(ways[w], EYES_RIGHT, in, count, outs);
+    }
+    uint32_t cycles = ESP.getCycleCount() - start;
+    Serial.printf("Transform %s: %lu cycles/light (%lu MHz)\n", names[w], (unsigned long)(cycles / (rounds * count)),
+                  (unsigned long)ESP.getCpuFreqMHz());
+  }
+}
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "frame_pacer.h"
+
+static uint32_t Sqrt(uint32_t v) {
+  uint32_t r = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > v) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (v >= r + bit) {
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return r;
+}
+
+static void ResetStats(struct FramePacer *p) {
+  p->frames = 0;
+  p->skipped = 0;
+  p->intervals = 0;
+  p->minIntervalUs = UINT32_MAX;
+  p->maxIntervalUs = 0;
+  p->sumIntervalUs = 0;
+  p->sumSquaredErrorUs = 0;
+  p->sumPhaseUs = 0;
+  p->phases = 0;
+}
+
+void FramePacerInit(struct FramePacer *p, uint32_t periodUs, uint8_t mode) {
+  memset(p, 0, sizeof(*p));
+  p->mode = mode;
+  p->nominalUs = periodUs;
+  p->periodUs = periodUs;
+  ResetStats(p);
+}
+
+bool FramePacerDue(struct FramePacer *p, uint32_t nowUs) {
+  if (!p->started) {
+    p->started = true;
+    p->nextUs = nowUs;
+  }
+  if ((int32_t)(nowUs - p->nextUs) < 0) {
+    return false;
+  }
+
+  if (p->drawn) {
+    uint32_t interval = nowUs - p->lastDrawUs;
+    int32_t error = (int32_t)(interval - p->periodUs);
+    p->minIntervalUs = interval < p->minIntervalUs ? interval : p->minIntervalUs;
+    p->maxIntervalUs = interval > p->maxIntervalUs ? interval : p->maxIntervalUs;
+    p->sumIntervalUs += interval;
+    p->sumSquaredErrorUs += (int64_t)error * error;
+    p->intervals++;
+  }
+  p->drawn = true;
+  p->lastDrawUs = nowUs;
+  p->frames++;
+
+  // Keep the grid, don't drift by however late we were
+  p->nextUs += p->periodUs;
+  if ((int32_t)(nowUs - p->nextUs) >= 0) {
+    // Fell a whole period or more behind, don't try to catch up with a burst
+    uint32_t behind = (nowUs - p->nextUs) / p->periodUs + 1;
+    p->skipped += behind;
+    p->nextUs += behind * p->periodUs;
+  }
+  return true;
+}
+
+void FramePacerCameraFrame(struct FramePacer *p, uint32_t arrivalUs) {
+  if (p->haveArrival) {
+    uint32_t gap = arrivalUs - p->lastArrivalUs;
+    // Way off means a dropped frame or lines that got stuck behind a draw
+    if (gap > p->cameraPeriodUs / 2 && gap < p->cameraPeriodUs * 2) {
+      p->cameraPeriodUs += (int32_t)(gap - p->cameraPeriodUs) / (1 << FRAME_ALIGN_GAIN_SHIFT);
+      p->outliers = 0;
+    } else if (p->cameraPeriodUs == 0 || ++p->outliers >= FRAME_CAMERA_OUTLIERS) {
+      p->cameraPeriodUs = gap;
+      p->outliers = 0;
+    }
+  }
+  p->lastArrivalUs = arrivalUs;
+  p->haveArrival = true;
+
+  if (p->mode != FRAME_PACE_CAMERA || !p->started || p->cameraPeriodUs == 0) {
+    return;
+  }
+
+  // Most whole draws per camera frame that aren't faster than nominal. Going
+  // up one needs 1/16 of nominal to spare, a camera right at a multiple
+  // would flip it every frame.
+  uint32_t most = p->cameraPeriodUs / p->nominalUs;
+  if (most == 0) {
+    // Camera's faster, draw at nominal from whatever's newest
+    p->perFrame = 0;
+    p->periodUs = p->nominalUs;
+    return;
+  }
+  uint32_t perFrame = p->perFrame;
+  if (perFrame == 0 || perFrame > most ||
+      p->cameraPeriodUs / (p->nominalUs + (p->nominalUs >> FRAME_PER_FRAME_SHIFT)) > perFrame) {
+    perFrame = most;
+  }
+  p->perFrame = perFrame;
+  p->periodUs = p->cameraPeriodUs / perFrame;
+
+  // How far the nearest draw is from just after this frame, -period/2..period/2
+  int32_t period = (int32_t)p->periodUs;
+  int32_t error = (int32_t)(p->nextUs - (arrivalUs + FRAME_ALIGN_MARGIN_US)) % period;
+  if (error > period / 2) {
+    error -= period;
+  } else if (error < -period / 2) {
+    error += period;
+  }
+  p->sumPhaseUs += error;
+  p->phases++;
+  p->nextUs -= error / (1 << FRAME_ALIGN_GAIN_SHIFT);
+}
+
+void FramePacerTakeStats(struct FramePacer *p, struct FramePacerStats *stats) {
+  stats->frames = p->frames;
+  stats->skipped = p->skipped;
+  stats->minIntervalUs = p->intervals > 0 ? p->minIntervalUs : 0;
+  stats->maxIntervalUs = p->maxIntervalUs;
+  stats->meanIntervalUs = p->intervals > 0 ? (uint32_t)(p->sumIntervalUs / p->intervals) : 0;
+  stats->jitterUs = 0;
+  if (p->intervals > 0) {
+    uint64_t meanSquare = p->sumSquaredErrorUs / p->intervals;
+    stats->jitterUs = Sqrt(meanSquare > UINT32_MAX ? UINT32_MAX : (uint32_t)meanSquare);
+  }
+  stats->cameraPeriodUs = p->cameraPeriodUs;
+  stats->phaseUs = p->phases > 0 ? (int32_t)(p->sumPhaseUs / p->phases) : 0;
+  ResetStats(p);
+}
@@ -0,0 +1,117 @@
+#include <string.h>
+#include "gray_raster.h"
+
+#define DISTANCE_LUT_SIZE ((GRAY_MAX_DISTANCE + 1) * (GRAY_MAX_DISTANCE + 1))
+
+// floor(4 * sqrt(d^2)), indexed by d^2
+static uint8_t quarterDistance[DISTANCE_LUT_SIZE];
+
+void GrayRasterInit() {
+  uint16_t q = 0;
+  for (uint16_t d2 = 0; d2 < DISTANCE_LUT_SIZE; d2++) {
+    while ((uint32_t)(q + 1) * (q + 1) <= 16UL * d2) {
+      q++;
+    }
+    quarterDistance[d2] = (uint8_t)q;
+  }
+}
+
+// Biggest dy for each dx = 0..reach that's still within limit quarter
+// pixels of the center, -1 if none. Walks down from the previous column so
+// it's one pass, not a search per column.
+static void HalfHeights(int16_t reach, uint8_t limit, int16_t *h) {
+  int16_t dy = reach;
+  for (int16_t dx = 0; dx <= reach; dx++) {
+    while (dy >= 0) {
+      uint16_t d2 = dx * dx + dy * dy;
+      if (d2 < DISTANCE_LUT_SIZE && quarterDistance[d2] <= limit) {
+        break;
+      }
+      dy--;
+    }
+    h[dx] = dy;
+  }
+}
+
+// Same, for merged lights too big for the table. Core only.
+static void CoreHalfHeights(int16_t radius, int16_t *h) {
+  // (r + 1/2)^2 rounded down
+  int32_t limit = (int32_t)radius * radius + radius;
+  int16_t dy = radius;
+  for (int16_t dx = 0; dx <= radius; dx++) {
+    while (dy >= 0 && (int32_t)dx * dx + (int32_t)dy * dy > limit) {
+      dy--;
+    }
+    h[dx] = dy;
+  }
+}
+
+// Rows y - half .. y + half that fall in the page starting at pageTop
+static uint8_t SpanByte(int16_t y, int16_t half, int16_t pageTop) {
+  if (half < 0) {
+    return 0;
+  }
+  int16_t lo = y - half - pageTop;
+  int16_t hi = y + half - pageTop;
+  if (lo > 7 || hi < 0) {
+    return 0;
+  }
+  if (lo < 0) {
+    lo = 0;
+  }
+  if (hi > 7) {
+    hi = 7;
+  }
+  return (uint8_t)((0xFF << lo) & (0xFF >> (7 - hi)));
+}
+
+// Keeps the darker of two 2-bit levels, 8 pixels at a time
+static void Combine(uint8_t *column, uint8_t msb, uint8_t lsb) {
+  uint8_t oldMsb = column[GRAY_PLANE_MSB];
+  uint8_t oldLsb = column[GRAY_PLANE_LSB];
+  // Where only one side has the MSB set its LSB wins, otherwise either
+  column[GRAY_PLANE_LSB] = (oldLsb & (oldMsb | ~msb)) | (lsb & (msb | ~oldMsb));
+  column[GRAY_PLANE_MSB] = oldMsb | msb;
+}
+
+void GrayDrawLight(uint8_t *buffer, int16_t x, int16_t y, uint8_t radius) {
+  // Each level is a disc, so every column is three nested vertical spans
+  int16_t core[256];
+  int16_t dark[256]; // Level 2 and up
+  int16_t any[256]; // Level 1 and up
+  int16_t reach = radius + GRAY_FEATHER;
+
+  if (reach <= GRAY_MAX_DISTANCE) {
+    // Core ends half a pixel out like the 1-bit disc, then two bands of
+    // GRAY_FEATHER / 2 pixels each
+    HalfHeights(reach, 4 * radius + 2, core);
+    HalfHeights(reach, 4 * radius + 2 + 2 * GRAY_FEATHER, dark);
+    HalfHeights(reach, 4 * radius + 2 + 4 * GRAY_FEATHER, any);
+  } else {
+    reach = radius;
+    CoreHalfHeights(radius, core);
+    memcpy(dark, core, sizeof(core[0]) * (reach + 1));
+    memcpy(any, core, sizeof(core[0]) * (reach + 1));
+  }
+
+  int16_t x0 = x - reach < 0 ? 0 : x - reach;
+  int16_t x1 = x + reach >= GRAY_WIDTH ? GRAY_WIDTH - 1 : x + reach;
+  int16_t y0 = y - reach < 0 ? 0 : y - reach;
+  int16_t y1 = y + reach >= GRAY_PAGES * 8 ? GRAY_PAGES * 8 - 1 : y + reach;
+
+  for (int16_t page = y0 >> 3; page <= (y1 >> 3); page++) {
+    uint8_t *bufferPage = &buffer[page * GRAY_PAGE_BYTES];
+    for (int16_t c = x0; c <= x1; c++) {
+      int16_t dx = c < x ? x - c : c - x;
+      uint8_t coreByte = SpanByte(y, core[dx], page * 8);
+      uint8_t darkByte = SpanByte(y, dark[dx], page * 8);
+      uint8_t anyByte = SpanByte(y, any[dx], page * 8);
+      // Levels 2 and 3 have the MSB set, 1 and 3 the LSB
+      uint8_t msb = darkByte;
+      uint8_t lsb = (anyByte & ~darkByte) | coreByte;
+      if ((msb | lsb) != 0) {
+        Combine(&bufferPage[c * 2], msb, lsb);
+      }
+    }
+  }
+}
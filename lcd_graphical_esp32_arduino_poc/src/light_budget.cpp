@@ -0,0 +1,177 @@
+#include <string.h>
+#include "light_budget.h"
+
+// Rounded up, so covering discs never come out too small. Only runs when
+// two lights merge, not per pixel.
+static uint16_t SqrtCeil(uint32_t v) {
+  uint32_t r = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > v) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (v >= r + bit) {
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint16_t)(v > 0 ? r + 1 : r);
+}
+
+static bool Touching(const struct Light *a, const struct Light *b) {
+  int32_t dx = (int16_t)a->x1 - (int16_t)b->x1;
+  int32_t dy = (int16_t)a->y1 - (int16_t)b->y1;
+  int32_t reach = a->radius + b->radius + LIGHT_MERGE_GAP;
+  return dx * dx + dy * dy <= reach * reach;
+}
+
+// Grows `into` to the smallest disc covering both. Ellipses and polygons go
+// by their covering circle, so whatever comes out is a disc.
+static void Cover(struct Light *into, const struct Light *other) {
+  into->shape = LIGHT_DISC;
+  int32_t dx = (int16_t)other->x1 - (int16_t)into->x1;
+  int32_t dy = (int16_t)other->y1 - (int16_t)into->y1;
+  int32_t d = SqrtCeil(dx * dx + dy * dy);
+
+  if (into->brightness < other->brightness) {
+    into->brightness = other->brightness;
+  }
+  if (d + other->radius <= into->radius) {
+    return; // Already inside
+  }
+  if (d + into->radius <= other->radius) {
+    into->x1 = other->x1;
+    into->y1 = other->y1;
+    into->radius = other->radius;
+    return;
+  }
+  int32_t r = (d + into->radius + other->radius + 1) / 2;
+  // Slide the center towards `other` by (r - into radius)
+  int32_t shift = r - into->radius;
+  into->x1 = (uint16_t)((int16_t)into->x1 + (dx * shift + (dx >= 0 ? d / 2 : -d / 2)) / d);
+  into->y1 = (uint16_t)((int16_t)into->y1 + (dy * shift + (dy >= 0 ? d / 2 : -d / 2)) / d);
+  // Rounding the center can cost up to a pixel
+  into->radius = (uint8_t)(r + 1 > 255 ? 255 : r + 1);
+}
+
+static uint8_t CellIndex(int32_t v, uint8_t numCells) {
+  if (v < 0) {
+    return 0;
+  }
+  v >>= LIGHT_GRID_CELL_SHIFT;
+  return (uint8_t)(v >= numCells ? numCells - 1 : v);
+}
+
+// One pass over the grid. Returns the number of lights absorbed.
+static uint8_t MergePass(struct Light *lights, uint8_t numLights, bool *alive) {
+  static uint8_t cellCount[LIGHT_GRID_CELLS_Y][LIGHT_GRID_CELLS_X];
+  static uint8_t cells[LIGHT_GRID_CELLS_Y][LIGHT_GRID_CELLS_X][LIGHT_GRID_CELL_CAPACITY];
+  const int32_t pad = (LIGHT_MERGE_GAP + 1) / 2;
+  uint8_t merged = 0;
+  bool overflow = false;
+
+  memset(cellCount, 0, sizeof(cellCount));
+
+  for (uint8_t i = 0; i < numLights; i++) {
+    if (!alive[i]) {
+      continue;
+    }
+    int32_t reach = lights[i].radius + pad;
+    uint8_t cx0 = CellIndex((int16_t)lights[i].x1 - reach, LIGHT_GRID_CELLS_X);
+    uint8_t cx1 = CellIndex((int16_t)lights[i].x1 + reach, LIGHT_GRID_CELLS_X);
+    uint8_t cy0 = CellIndex((int16_t)lights[i].y1 - reach, LIGHT_GRID_CELLS_Y);
+    uint8_t cy1 = CellIndex((int16_t)lights[i].y1 + reach, LIGHT_GRID_CELLS_Y);
+
+    for (uint8_t cy = cy0; cy <= cy1; cy++) {
+      for (uint8_t cx = cx0; cx <= cx1; cx++) {
+        for (uint8_t k = 0; k < cellCount[cy][cx]; k++) {
+          uint8_t j = cells[cy][cx][k];
+          if (alive[j] && Touching(&lights[i], &lights[j])) {
+            Cover(&lights[i], &lights[j]);
+            alive[j] = false;
+            merged++;
+          }
+        }
+        if (cellCount[cy][cx] < LIGHT_GRID_CELL_CAPACITY) {
+          cells[cy][cx][cellCount[cy][cx]++] = i;
+        } else {
+          overflow = true;
+        }
+      }
+    }
+  }
+
+  if (overflow) {
+    // Everything piled into a few cells, just check every pair
+    for (uint8_t i = 0; i < numLights; i++) {
+      for (uint8_t j = i + 1; alive[i] && j < numLights; j++) {
+        if (alive[j] && Touching(&lights[i], &lights[j])) {
+          Cover(&lights[i], &lights[j]);
+          alive[j] = false;
+          merged++;
+        }
+      }
+    }
+  }
+  return merged;
+}
+
+// Left of / above the panel is negative, see lights.h
+static bool OnPanel(const struct Light *l) {
+  const int16_t size = LIGHT_GRID_CELLS_X << LIGHT_GRID_CELL_SHIFT;
+  int16_t x = (int16_t)l->x1;
+  int16_t y = (int16_t)l->y1;
+  return x + l->radius >= 0 && x - l->radius < size && y + l->radius >= 0 && y - l->radius < size;
+}
+
+static uint32_t Priority(const struct Light *l) {
+  return (uint32_t)l->brightness * l->radius * l->radius;
+}
+
+uint8_t ReduceLights(struct Light *lights, uint8_t numLights, uint8_t budget, struct LightBudgetStats *stats) {
+  bool alive[256];
+  uint8_t n = 0;
+
+  stats->in = numLights;
+  stats->merged = 0;
+  stats->dropped = 0;
+  stats->offPanel = 0;
+
+  // Nothing to draw, and they'd still take a slot in the budget
+  for (uint8_t i = 0; i < numLights; i++) {
+    alive[i] = OnPanel(&lights[i]);
+    stats->offPanel += !alive[i];
+  }
+  for (uint8_t pass = 0; pass < LIGHT_MERGE_PASSES; pass++) {
+    uint8_t merged = MergePass(lights, numLights, alive);
+    stats->merged += merged;
+    if (merged == 0) {
+      break;
+    }
+  }
+
+  // Compact and insertion sort by priority, highest first. n is small.
+  for (uint8_t i = 0; i < numLights; i++) {
+    if (!alive[i]) {
+      continue;
+    }
+    struct Light l = lights[i];
+    uint32_t p = Priority(&l);
+    uint8_t j = n;
+    while (j > 0 && Priority(&lights[j - 1]) < p) {
+      lights[j] = lights[j - 1];
+      j--;
+    }
+    lights[j] = l;
+    n++;
+  }
+
+  if (n > budget) {
+    stats->dropped = n - budget;
+    n = budget;
+  }
+  return n;
+}
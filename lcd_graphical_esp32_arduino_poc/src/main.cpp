@@ -4,6 +4,22 @@
 #include <math.h>
 #include <stdio.h>
 #include <HardwareSerial.h>
+#include <light_link.h>
+#include <time_sync.h>
+#include "lights.h"
+#include "light_budget.h"
+#include "render.h"
+#include "shape_raster.h"
+#include "frame_pacer.h"
+#include "trace.h"
+#include "eyes.h"
+#include "dewarp_table.h"
+#include "radial_table.h"
+#include "calibration.h"
+#include "drift.h"
+#ifdef DISPLAY_DMA
+#include "display_dma.h"
+#endif
 
 #define max(a,b)             \
 ({                           \
@@ -20,38 +36,91 @@
 })
 
 /* Constructor */
-U8G2_ST7571_128X128_1_4W_SW_SPI u8g2(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 1, /* dc=*/ 3, /* reset=*/ 2);
+// Full frame buffer so only the pages that changed need to be sent, see render.h
+// One panel per eye on the same clock, data, DC and reset lines, each with its
+// own CS. Only the one setup() begins first pulses reset (left), else the
+// second begin() would wipe the first panel.
+#ifdef DISPLAY_DMA
+U8G2_ST7571_128X128_F_DMA displayRight(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 1, /* dc=*/ 3, /* reset=*/ U8X8_PIN_NONE);
+U8G2_ST7571_128X128_F_DMA displayLeft(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 4, /* dc=*/ 3, /* reset=*/ 2);
+#else
+U8G2_ST7571_128X128_F_4W_SW_SPI displayRight(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 1, /* dc=*/ 3, /* reset=*/ U8X8_PIN_NONE);
+U8G2_ST7571_128X128_F_4W_SW_SPI displayLeft(U8G2_R0, /* clock=*/ 12, /* data=*/ 13, /* cs=*/ 4, /* dc=*/ 3, /* reset=*/ 2);
+#endif
+U8G2 *displays[NUM_EYES] = {&displayLeft, &displayRight};
+struct Renderer renderers[NUM_EYES];
+
+// Which panels get drawn, switch over USB serial with L / R / B
+#define EYES_DEFAULT EYES_BOTH
+uint8_t eyeMask = EYES_DEFAULT;
+
+// Both come out of host_tools/fit_radial.py for the wearer. Uncomment to use
+// the r^2 tables instead of the bilinear grid.
+//#define EYES_RADIAL
+// Or work it out from where the eyes, camera and panels are, see parallax.h.
+// Doesn't undo the lens, so only for a camera without much distortion.
+//#define EYES_PARALLAX
+#if defined(EYES_PARALLAX)
+#define EYE_TRANSFORM(eye) /* dewarp=*/ NULL, /* radial=*/ NULL, /* parallax=*/ &parallax[eye]
+#elif defined(EYES_RADIAL)
+#define EYE_TRANSFORM(eye) /* dewarp=*/ NULL, /* radial=*/ &radialTransforms[eye], /* parallax=*/ NULL
+#else
+#define EYE_TRANSFORM(eye) /* dewarp=*/ &dewarpGrids[eye], /* radial=*/ NULL, /* parallax=*/ NULL
+#endif
 
-// Right side from viewers perspective
-#define LCD_RIGHT
+// um, glasses frame (parallax.h): camera on the bridge a bit above the eyes,
+// panels 15 mm in front of them. Rough numbers off the prototype, measure!
+#define EYE_SPACING_UM 64000
+#define PARALLAX_DISTANCE_MM 20000 // Headlights a few car lengths away
+struct ParallaxGeometry parallaxGeometry[NUM_EYES] = {
+  {/* eye=*/ {-EYE_SPACING_UM / 2, 0, 0}, /* camera=*/ {0, -5000, 20000},
+   /* lcdCenter=*/ {-EYE_SPACING_UM / 2, 0, 15000}, /* lcdPitch=*/ 280, /* lcdXSign=*/ -1,
+   /* focalQ4=*/ 140 * 16, /* principalXQ4=*/ 80 * 16, /* principalYQ4=*/ 60 * 16, PARALLAX_DISTANCE_MM},
+  {/* eye=*/ {EYE_SPACING_UM / 2, 0, 0}, /* camera=*/ {0, -5000, 20000},
+   /* lcdCenter=*/ {EYE_SPACING_UM / 2, 0, 15000}, /* lcdPitch=*/ 280, /* lcdXSign=*/ -1,
+   /* focalQ4=*/ 140 * 16, /* principalXQ4=*/ 80 * 16, /* principalYQ4=*/ 60 * 16, PARALLAX_DISTANCE_MM},
+};
+struct Parallax parallax[NUM_EYES];
 
+struct EyeCalibration eyeCalibration[NUM_EYES] = {
+  // Left: not measured yet, mirror of the right for now
+  {/* xSign=*/ -1, /* xOffset=*/ 110, /* yOffset=*/ 75, /* contrast=*/ 200, EYE_TRANSFORM(EYE_LEFT)},
+  // Right: 175 is good enough for straight on
+  {/* xSign=*/ -1, /* xOffset=*/ 110, /* yOffset=*/ 75, /* contrast=*/ 175, EYE_TRANSFORM(EYE_RIGHT)},
+};
 
-// TODO: Test with lower voltage? Probably can't with this...
 
-// Normally we'd take in an angle and do some math, but for fun let's
-// see how far off just a scale + offset will be
+// TODO: Test with lower voltage? Probably can't with this...
 
-// Expected data from camera is: "10 20 \n 50 50 \n"
-// 10 = x offset in pixels from top left of first light
-// 20 = y offset in pixels from top left of first light
-// 50 = x ... 2nd light
-// 50 = y ... 2nd light
+// Expected data from camera is: "010 020 \n050 050 \n\n"
+// 010 = x offset in pixels from top left of first light
+// 020 = y offset in pixels from top left of first light
+// 050 = x ... 2nd light
+// 050 = y ... 2nd light
+// Empty line = end of camera frame. See light_link.h
 #define MILLIS_PER_DRAW (1000/30)
-#define LIGHT_RADIUS 4 // pixels
-const char ExpectedStringChars[] = "000 000 ";
-#define STR_BUFFER_LENGTH (sizeof(ExpectedStringChars) + 1)
+// FRAME_PACE_FIXED or FRAME_PACE_CAMERA, see frame_pacer.h
+#define FRAME_PACE_MODE FRAME_PACE_CAMERA
+#define LIGHT_RADIUS 4 // pixels, unless the calibration says otherwise
+uint8_t lightRadius = LIGHT_RADIUS;
+
+// Loaded from NVS at boot (or sent over serial) and used in place, see
+// calibration.h. Not loaded = the compiled in tables above.
+struct CalibrationBlob calibrationBlob;
+struct RadialTransform calibrationRadial[NUM_EYES];
+bool calibrationLoaded = false;
+
+// The glasses sliding around while worn, corrected from w/a/s/d nudges
+// against lights that sat still, see drift.h. Not saved, it's per wear.
+#define DRIFT_NUDGE (1 << 8) // LCD px Q8.8 per key
+struct DriftReferences driftReferences;
+struct Drift drift[NUM_EYES];
 
 uint8_t numLights = 0;
-#define MAX_LIGHTS 15
-
-// denoted in LCD pixels (corrected values)
-struct Light
-{
-  uint16_t x1;
-  uint16_t y1;
-  uint8_t radius;
-};
+#define LIGHT_DRAW_BUDGET 15 // Drawn per frame after merging, see light_budget.h
+uint32_t lightsOverflowed = 0;
 
+// Being received, in camera pixels
 struct Light lights[MAX_LIGHTS];
 
 // FIXME to be camera actual resolution
@@ -64,171 +133,494 @@ static const uint16_t scale = cam_height/lcd_height; // Very rough (integer) gue
 
 
 HardwareSerial Serial_UART(0);
-
-void CameraToLCD(uint16_t *x, uint16_t *y)
-{
-  // Invert x too
-  uint32_t xTemp = (-(*x) + 110);
-  uint32_t yTemp = (*y + 75);
-/*
-  // Transform x,y to x',y' via scale and rotation...
-  // Won't be this simple probably
-  int32_t xTemp2 = (xTemp*COS_ANGLE - yTemp*SIN_ANGLE)/scale;
-  int32_t yTemp2 = (xTemp*SIN_ANGLE + yTemp*COS_ANGLE)/scale;
-  xTemp = xTemp2;
-  yTemp = yTemp2;
-  */
-
-/*
-  Trying to do fast dewarping...
-    * Transform to (r,theta) space with a center.
-      * Center determination could be with 4 corner points
-      * Warping on (r) should be independent of theta, so just need to gather dewarping points on one radial and compute dewarping for r and not theta.
-      * Could just do a few piecewise linear interpolations, or maybe add spline
-      * Pre-compute a 2D lookup table in x and y (based on (r,theta)) and then do linear interpolation in between the points in x and y. That'll work
-      * Or if you need to compute real r, can do r^2 only and not sqrt. Or look up efficient hypot like these: https://stackoverflow.com/questions/3506404/fast-hypotenuse-algorithm-for-embedded-processor
- 
-*/
-
-
-  *x = (uint16_t)xTemp;
-  *y = (uint16_t)yTemp;
-}
+LightLinkParser linkParser;
+
+// Camera and LCD each have their own micros(), see time_sync.h
+#define SYNC_PERIOD_MS 250
+#define SYNC_REPORT_MS 1000
+TimeSync timeSync;
+unsigned long lastSyncRequestMillis = 0;
+unsigned long lastSyncReportMillis = 0;
+
+// When the camera captured the frame being received, in LCD micros()
+uint32_t frameCaptureUs = 0;
+bool frameHasCaptureTime = false;
+bool sawFrameEnd = false; // Camera sends them, so a quiet line isn't the end of a frame
+
+FramePacer pacer;
+#define PACING_REPORT_MS 1000
+
+// Newest complete camera frame. Every draw starts from this until the next
+// one comes in.
+struct Light committedLights[MAX_LIGHTS];
+int16_t committedDx[MAX_LIGHTS]; // Moved since the frame before, 0 if we can't tell
+int16_t committedDy[MAX_LIGHTS];
+uint8_t numCommittedLights = 0;
+uint32_t committedCaptureUs = 0;
+int32_t committedFrameUs = 0; // Between captures of this frame and the one before, 0 if unknown
+bool committedIsNew = false;
+
+// Positions as measured (before extrapolation) for the last committed frame
+#define MAX_EXTRAPOLATE_US 100000 // Don't guess further ahead than this
+#define MATCH_DISTANCE 16 // Camera pixels. Closest light last frame within this is the same light
+struct Light prevLights[MAX_LIGHTS];
+uint8_t numPrevLights = 0;
+uint32_t prevCaptureUs = 0;
+unsigned long lastPacingReportMillis = 0;
+
+#ifdef RENDER_FRC
+// Dithered lights need the pattern moved on every refresh, not just when a
+// camera frame comes in. Skipped if the bus is still busy with the last one.
+uint32_t lastDitherUs = 0;
+uint32_t dithers = 0;
+uint32_t ditherSkipped = 0;
+#endif
 
 void setup() {
   // put your setup code here, to run once:
-  u8g2.begin();
-#ifdef LCD_RIGHT
-    u8g2.setContrast(175); // good enough for straight on. Trade off "off" transparency with "on" darkness
-#else
-    u8g2.setContrast(200);
-#endif
-  u8g2.clearDisplay();
-  u8g2.firstPage();
-  do {
-#ifdef LCD_RIGHT
-    u8g2.drawDisc(20,120,LIGHT_RADIUS);
-#else
-    u8g2.drawBox(20,85,20,20);
-#endif
-
-  } while ( u8g2.nextPage() );
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    ParallaxInit(&parallax[eye], &parallaxGeometry[eye]);
+  }
+  DriftReferencesInit(&driftReferences);
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    DriftInit(&drift[eye]);
+    eyeCalibration[eye].drift = &drift[eye].correction;
+  }
+  calibrationLoaded = CalibrationLoad(&calibrationBlob);
+  if (calibrationLoaded) {
+    CalibrationApply(&calibrationBlob, eyeCalibration, calibrationRadial);
+    lightRadius = calibrationBlob.lightRadius;
+  }
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    U8G2 *display = displays[eye];
+    display->begin();
+    display->setContrast(eyeCalibration[eye].contrast);
+    display->clearDisplay();
+    display->firstPage();
+    do {
+      if (eye == EYE_RIGHT) {
+        display->drawDisc(20,120,lightRadius);
+      } else {
+        display->drawBox(20,85,20,20);
+      }
+    } while ( display->nextPage() );
+  }
 
   Serial.begin(921600);
   Serial.setTimeout(100); //ms
   Serial.println("Startup");
+  if (calibrationLoaded) {
+    Serial.printf("Calibration: %.*s\n", CALIBRATION_USER_CHARS, calibrationBlob.user);
+  } else {
+    Serial.println("Calibration: built in");
+  }
 
-  Serial_UART.begin(921600);
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    RenderInit(&renderers[eye], displays[eye]);
+  }
+#ifdef RENDER_BENCHMARK
+  RenderBenchmark(&renderers[EYE_RIGHT]);
+  // All the transforms, whichever one is in use
+  struct EyeCalibration benchmarkCalibration[NUM_EYES];
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    benchmarkCalibration[eye] = eyeCalibration[eye];
+    benchmarkCalibration[eye].dewarp = &dewarpGrids[eye];
+    benchmarkCalibration[eye].radial = &radialTransforms[eye];
+    benchmarkCalibration[eye].parallax = &parallax[eye];
+  }
+  EyesBenchmark(benchmarkCalibration);
+#endif
+
+  LightLinkInit(&linkParser);
+  TimeSyncInit(&timeSync);
+  FramePacerInit(&pacer, MILLIS_PER_DRAW * 1000UL, FRAME_PACE_MODE);
+  Serial_UART.begin(LIGHT_LINK_BAUD);
   delay(500);
-  //u8g2.clear();
+  //displayRight.clear();
   delay(500);
 }
 
-unsigned long timeStartDraw = 0;
-void drawLightsOnDisplay() {
-  // Currently 100ms to draw...seems too much. Weird!
-  uint16_t i = 0;
-  uint16_t j = 0;
-  timeStartDraw = millis();
-
-  u8g2.clearBuffer();
-  Serial.printf("Clear buf: %d\n", millis() - timeStartDraw);
-  u8g2.firstPage();
-  Serial.printf("First page: %d\n", millis() - timeStartDraw);
-
-  // Draw on LCD
-  do {
-    for (i = 0; i < numLights; i++) {
-      // A bit hacky, but I need rotated squares for now
-      u8g2.drawDisc(lights[i].x1, lights[i].y1, lights[i].radius);
+// A whole camera frame came in. Work out how far each light moved since the
+// previous one, and make it what gets drawn from now on.
+void CommitFrame() {
+  FramePacerCameraFrame(&pacer, micros());
+  TRACE(TRACE_FRAME_COMMIT, numLights, frameHasCaptureTime);
+
+  int32_t frameUs = (int32_t)(frameCaptureUs - prevCaptureUs);
+  bool matching = frameHasCaptureTime && numPrevLights > 0 && frameUs > 0;
+  for (uint8_t i = 0; i < numLights; i++) {
+    int16_t bestDistance = MATCH_DISTANCE + 1;
+    int16_t dx = 0;
+    int16_t dy = 0;
+    for (uint8_t j = 0; matching && j < numPrevLights; j++) {
+      int16_t jx = (int16_t)lights[i].x1 - (int16_t)prevLights[j].x1;
+      int16_t jy = (int16_t)lights[i].y1 - (int16_t)prevLights[j].y1;
+      int16_t distance = abs(jx) + abs(jy);
+      if (distance < bestDistance) {
+        bestDistance = distance;
+        dx = jx;
+        dy = jy;
+      }
     }
-  } while ( u8g2.nextPage() );
-  Serial.printf("Last page: %d\n", millis() - timeStartDraw);
+    committedDx[i] = bestDistance <= MATCH_DISTANCE ? dx : 0;
+    committedDy[i] = bestDistance <= MATCH_DISTANCE ? dy : 0;
+  }
+  // Between frames, so a draw never sees half a drift update
+  DriftTrack(&driftReferences, lights, numLights);
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    DriftStep(&drift[eye], &driftReferences);
+  }
+  memcpy(committedLights, lights, sizeof(lights[0]) * numLights);
+  numCommittedLights = numLights;
+  committedCaptureUs = frameCaptureUs;
+  committedFrameUs = matching ? frameUs : 0;
+  committedIsNew = true;
+
+  if (frameHasCaptureTime) {
+    memcpy(prevLights, lights, sizeof(lights[0]) * numLights);
+    numPrevLights = numLights;
+    prevCaptureUs = frameCaptureUs;
+  } else {
+    numPrevLights = 0;
+  }
+  frameHasCaptureTime = false;
   numLights = 0;
 }
 
-
-char lightSerial[STR_BUFFER_LENGTH];
-uint8_t lightSerialIndex = 0;
-
-void ResetString() {
-  lightSerialIndex = 0;
-  memset(lightSerial, 0, STR_BUFFER_LENGTH);
+// Light positions are from when the camera took the picture, which is a
+// while ago by the time they get drawn. Push them forward to drawUs using how
+// far each light moved between the last two frames.
+uint8_t ExtrapolateLights(uint32_t drawUs, struct Light *out) {
+  memcpy(out, committedLights, sizeof(out[0]) * numCommittedLights);
+
+  int32_t aheadUs = (int32_t)(drawUs - committedCaptureUs);
+  if (committedFrameUs > 0 && aheadUs > 0 && aheadUs < MAX_EXTRAPOLATE_US) {
+    for (uint8_t i = 0; i < numCommittedLights; i++) {
+      out[i].x1 = max(0, (int32_t)out[i].x1 + (int32_t)committedDx[i] * aheadUs / committedFrameUs);
+      out[i].y1 = max(0, (int32_t)out[i].y1 + (int32_t)committedDy[i] * aheadUs / committedFrameUs);
+    }
+  }
+  return numCommittedLights;
 }
 
-uint8_t i = 0;
-void loop() {
+void SendSyncRequest() {
+  char line[LIGHT_LINK_MAX_LINE_BYTES];
+  // Stamp when the last byte leaves, the camera stamps when it has the whole line
+  uint8_t length = LightLinkFormatSyncRequest(line, micros() + LightLinkWireUs(2 + LIGHT_LINK_HEX_CHARS));
+  Serial_UART.write((const uint8_t *)line, length);
+}
 
-  char * token;
-  uint16_t numBytesToRead = Serial_UART.available();
-  //Serial.printf("ToRead: %d, Index: %d\n", numBytesToRead, lightSerialIndex);
+void ReportSync() {
+  if (!timeSync.valid) {
+    Serial.println("Sync: waiting for camera");
+    return;
+  }
+  Serial.printf("Sync: offset %ld us +-%lu, drift %ld ppb, last frame age %ld us\n",
+                (long)TimeSyncOffsetAt(&timeSync, micros()), (unsigned long)TimeSyncErrorUs(&timeSync),
+                (long)timeSync.driftPpb, (long)(micros() - prevCaptureUs));
+}
 
-  if (numBytesToRead == 0) {
-    if (numLights > 0) {
-      //Serial.println("Drawing");
+void ReportPacing() {
+  struct FramePacerStats stats;
+  FramePacerTakeStats(&pacer, &stats);
+  Serial.printf("Pacing: %lu frames, interval %lu..%lu us (mean %lu), jitter %lu us rms, %lu skipped",
+                (unsigned long)stats.frames, (unsigned long)stats.minIntervalUs, (unsigned long)stats.maxIntervalUs,
+                (unsigned long)stats.meanIntervalUs, (unsigned long)stats.jitterUs, (unsigned long)stats.skipped);
+  if (FRAME_PACE_MODE == FRAME_PACE_CAMERA) {
+    Serial.printf(", camera every %lu us, phase %ld us", (unsigned long)stats.cameraPeriodUs, (long)stats.phaseUs);
+  }
+#ifdef RENDER_FRC
+  Serial.printf(", dither %lu refreshes, %lu skipped", (unsigned long)dithers, (unsigned long)ditherSkipped);
+  dithers = 0;
+  ditherSkipped = 0;
+#endif
+  Serial.println();
+}
 
+void drawLightsOnDisplay() {
+  struct RenderStats renderStats;
+  struct Light cameraLights[MAX_LIGHTS];
+  static struct Light eyeLights[NUM_EYES][MAX_LIGHTS];
+  struct Light *eyeOut[NUM_EYES] = {eyeLights[EYE_LEFT], eyeLights[EYE_RIGHT]};
+  struct Renderer *drawn[NUM_EYES];
+  uint8_t numDrawn = 0;
+  uint32_t drawUs = 0;
+  uint8_t pages = 0;
+
+  uint8_t numCameraLights = ExtrapolateLights(micros(), cameraLights);
+  TRACE(TRACE_DRAW_START, numCameraLights, eyeMask);
+  TransformLights(eyeCalibration, eyeMask, cameraLights, numCameraLights, eyeOut);
+
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    if (!(eyeMask & (1 << eye))) {
+      continue;
+    }
+    struct LightBudgetStats budgetStats;
+    uint8_t n = ReduceLights(eyeLights[eye], numCameraLights, LIGHT_DRAW_BUDGET, &budgetStats);
+    if (committedIsNew && (budgetStats.merged > 0 || budgetStats.dropped > 0)) {
+      TRACE(TRACE_BUDGET, budgetStats.merged, budgetStats.dropped);
+    }
+    RenderCompose(&renderers[eye], eyeLights[eye], n, &renderStats);
+    drawUs += renderStats.drawUs;
+    pages += renderStats.pagesSent;
+    drawn[numDrawn++] = &renderers[eye];
+  }
+  committedIsNew = false;
+  TRACE(TRACE_DRAW_END, pages, drawUs);
 
-      drawLightsOnDisplay();
-      //numLights = 0;
+  // Both eyes' pages go out together, see render.h
+  uint32_t flushUs = RenderFlush(drawn, numDrawn);
+  if (pages > 0) {
+    TRACE(TRACE_FLUSH, pages, flushUs);
+  }
+}
 
+#ifdef RENDER_FRC
+void DitherLights() {
+  struct RenderStats renderStats;
+  struct Renderer *drawn[NUM_EYES];
+  uint8_t numDrawn = 0;
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    if ((eyeMask & (1 << eye)) && RenderDitherStep(&renderers[eye], &renderStats)) {
+      drawn[numDrawn++] = &renderers[eye];
+    }
+  }
+  if (numDrawn > 0) {
+    RenderFlush(drawn, numDrawn);
+    dithers++;
+  }
+}
+#endif
 
+// Turning an eye off leaves it clear, not frozen on the last frame
+void SetEyes(uint8_t mask) {
+  struct RenderStats renderStats;
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    if ((eyeMask & (1 << eye)) && !(mask & (1 << eye))) {
+      RenderLights(&renderers[eye], NULL, 0, &renderStats);
+    }
+  }
+  eyeMask = mask;
+  Serial.printf("Eyes: %s%s\n", mask & EYES_LEFT ? "left " : "", mask & EYES_RIGHT ? "right" : "");
+}
 
+// 'C' then the size (4 bytes, little endian) then the blob, from
+// host_tools/calibration_upload.py. Saved, then used straight away.
+void ReceiveCalibration() {
+  static struct CalibrationBlob incoming;
+  uint32_t size = 0;
+  if (Serial.readBytes((char *)&size, sizeof(size)) != sizeof(size) || size != sizeof(incoming)) {
+    Serial.printf("Calibration: rejected, %lu bytes, want %u\n", (unsigned long)size, (unsigned)sizeof(incoming));
+    while (Serial.read() >= 0) {
+      // Drop the rest
     }
     return;
   }
+  size_t got = Serial.readBytes((char *)&incoming, sizeof(incoming));
+  const char *problem = CalibrationCheck(&incoming, got);
+  if (problem != NULL) {
+    Serial.printf("Calibration: rejected, %s\n", problem);
+    return;
+  }
+  if (!CalibrationSave(&incoming)) {
+    Serial.println("Calibration: rejected, NVS write failed");
+    return;
+  }
+  calibrationBlob = incoming;
+  calibrationLoaded = true;
+  CalibrationApply(&calibrationBlob, eyeCalibration, calibrationRadial);
+  lightRadius = calibrationBlob.lightRadius;
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    displays[eye]->setContrast(eyeCalibration[eye].contrast);
+  }
+  Serial.printf("Calibration: saved, %.*s\n", CALIBRATION_USER_CHARS, calibrationBlob.user);
+}
 
-  // TODO: Turn into an event instead of loop? (sleep in between)
-
-  while (1) {
-    if (lightSerialIndex >= STR_BUFFER_LENGTH) {
-      // Probably garbage when first plugging in. Let's reset the string
-      Serial.printf("lightSerialIndex >= %d\n", STR_BUFFER_LENGTH);
-      ResetString();
-      return;
+// The mask around the lights that have sat still should move by dx, dy LCD
+// px on the eyes being drawn (L / R / B picks which)
+void NudgeDrift(int32_t dx, int32_t dy) {
+  struct Light still[DRIFT_MAX_REFERENCES];
+  uint8_t ids[DRIFT_MAX_REFERENCES];
+  uint8_t n = DriftStillLights(&driftReferences, still, ids);
+  if (n == 0) {
+    Serial.println("Drift: nothing still to go by");
+    return;
+  }
+  // Where they get drawn without the correction
+  struct EyeCalibration uncorrected[NUM_EYES];
+  struct Light lcd[NUM_EYES][DRIFT_MAX_REFERENCES];
+  struct Light *lcdOut[NUM_EYES] = {lcd[EYE_LEFT], lcd[EYE_RIGHT]};
+  memcpy(uncorrected, eyeCalibration, sizeof(uncorrected));
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    uncorrected[eye].drift = NULL;
+  }
+  TransformLights(uncorrected, eyeMask, still, n, lcdOut);
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    if (eyeMask & (1 << eye)) {
+      DriftNudge(&drift[eye], lcd[eye], ids, n, dx, dy);
     }
+  }
+}
 
-    if (Serial_UART.peek() == '\n') {
-      // Consume newline but don't use it
-      Serial_UART.read();
+void ReportDrift() {
+  for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+    const struct DriftCorrection *c = &drift[eye].correction;
+    Serial.printf("Drift: %s offset %+.2f, %+.2f px, scale %+.1f%%, %+.1f%%, %lu nudges, %lu observations\n",
+                  eye == EYE_LEFT ? "left" : "right", c->offsetX / 256.0f, c->offsetY / 256.0f,
+                  c->scaleX * 100.0f / 65536, c->scaleY * 100.0f / 65536, (unsigned long)drift[eye].nudges,
+                  (unsigned long)drift[eye].observations);
+  }
+}
+
+// Single letters over USB serial
+void PollCommands() {
+  if (Serial.available() == 0) {
+    return;
+  }
+  switch (Serial.read()) {
+    case 'T':
+      TRACE_DUMP();
+      break;
+    case 'L':
+      SetEyes(EYES_LEFT);
+      break;
+    case 'R':
+      SetEyes(EYES_RIGHT);
+      break;
+    case 'B':
+      SetEyes(EYES_BOTH);
+      break;
+    case 'C':
+      ReceiveCalibration();
+      break;
+    // Drift nudges, LCD axes
+    case 'w':
+      NudgeDrift(0, -DRIFT_NUDGE);
+      break;
+    case 'a':
+      NudgeDrift(-DRIFT_NUDGE, 0);
+      break;
+    case 's':
+      NudgeDrift(0, DRIFT_NUDGE);
+      break;
+    case 'd':
+      NudgeDrift(DRIFT_NUDGE, 0);
+      break;
+    case 'D':
+      ReportDrift();
       break;
+    case 'Z':
+      for (uint8_t eye = 0; eye < NUM_EYES; eye++) {
+        DriftInit(&drift[eye]);
+      }
+      Serial.println("Drift: cleared");
+      break;
+    default:
+      break;
+  }
+}
+
+void AddLight(const LightLinkMessage *message) {
+  if (numLights >= MAX_LIGHTS) {
+    lightsOverflowed++;
+    TRACE(TRACE_LIGHT_OVERFLOW, lightsOverflowed, 0);
+    return;
+  }
+  lights[numLights].x1 = message->x;
+  lights[numLights].y1 = message->y;
+  // Older camera firmware only sends the position
+  lights[numLights].radius = message->radius > 0 ? min(message->radius, 255) : lightRadius;
+  lights[numLights].brightness = message->radius > 0 ? min(message->brightness, 255) : 255;
+  lights[numLights].shape = LIGHT_DISC;
+  lights[numLights].numVertices = 0;
+  if (message->shape == LIGHT_LINK_ELLIPSE) {
+    lights[numLights].shape = LIGHT_ELLIPSE;
+    lights[numLights].minor = min(message->minor, (uint16_t)lights[numLights].radius);
+    lights[numLights].angle = (uint8_t)message->angle;
+  } else if (message->shape == LIGHT_LINK_POLYGON) {
+    lights[numLights].shape = LIGHT_POLYGON;
+    lights[numLights].numVertices = min(message->numVertices, (uint8_t)LIGHT_POLYGON_MAX_VERTICES);
+    for (uint8_t k = 0; k < lights[numLights].numVertices; k++) {
+      // Room to mirror without overflowing, see TransformLights()
+      lights[numLights].vx[k] = (int8_t)constrain(message->vx[k], -127, 127);
+      lights[numLights].vy[k] = (int8_t)constrain(message->vy[k], -127, 127);
     }
+    // Don't trust it to cover the vertices, merging goes by it
+    lights[numLights].radius = max(lights[numLights].radius, ShapeCoverRadius(&lights[numLights]));
+  }
+  TRACE(TRACE_LIGHT_RX, lights[numLights].x1, lights[numLights].y1);
+  numLights++;
+}
 
-    Serial_UART.read(&lightSerial[lightSerialIndex], 1);
-    lightSerialIndex++;
-    numBytesToRead--;
+void loop() {
+  LightLinkMessage message;
+  uint16_t numBytesToRead = Serial_UART.available();
 
-    if (numBytesToRead == 0) {
-      return;
+  if (millis() - lastSyncRequestMillis >= SYNC_PERIOD_MS) {
+    lastSyncRequestMillis = millis();
+    SendSyncRequest();
+  }
+  if (millis() - lastSyncReportMillis >= SYNC_REPORT_MS) {
+    lastSyncReportMillis = millis();
+    ReportSync();
+  }
+  if (millis() - lastPacingReportMillis >= PACING_REPORT_MS) {
+    lastPacingReportMillis = millis();
+    ReportPacing();
+  }
+  if (FramePacerDue(&pacer, micros())) {
+    drawLightsOnDisplay();
+  }
+#ifdef RENDER_FRC
+  if (micros() - lastDitherUs >= FRC_REFRESH_US) {
+    lastDitherUs = micros();
+    if (DisplayDmaBusy()) {
+      ditherSkipped++;
+    } else {
+      DitherLights();
     }
   }
-  // Now we have line previously terminated by a newline character
+#endif
+  TRACE_POLL();
+  PollCommands();
+  //Serial.printf("ToRead: %d\n", numBytesToRead);
 
-  // Validate string matches expected string chars
-  for (i = 0; i < sizeof(ExpectedStringChars); i++) {
-    if ((ExpectedStringChars[i] == '0' && (lightSerial[i] > '9' || lightSerial[i] < '0')) ||
-        (ExpectedStringChars[i] == ' ' && lightSerial[i] != ' ')) {
-      ResetString();
-      return;
+  if (numBytesToRead == 0) {
+    // Older camera firmware doesn't send frame ends, so until one shows up the frame is done when the line goes quiet
+    if (!sawFrameEnd && numLights > 0) {
+      CommitFrame();
     }
+    return;
   }
 
-  Serial.println("Parsing string");
-
-  // So now we have a valid line. Let's parse it!
-  // Add null just in case
-  lightSerial[STR_BUFFER_LENGTH-1] = '\0';
-  //Serial.printf("lightSerial: %s\n", lightSerial);
-
-  // Only process one "light" and return through the loop
-  token = strtok(lightSerial, " ");
-  lights[numLights].x1 = atoi(token);
-  token = strtok(NULL, " ");
-  lights[numLights].y1 = atoi(token);
-  lights[numLights].radius = LIGHT_RADIUS;
-  Serial.printf("Light: %d %d -> ", lights[numLights].x1, lights[numLights].y1 );
-  CameraToLCD(&lights[numLights].x1, &lights[numLights].y1);
-  Serial.printf("%d %d\n", lights[numLights].x1, lights[numLights].y1 );
-  numLights++;
+  // TODO: Turn into an event instead of loop? (sleep in between)
 
-  ResetString();
-}
\ No newline at end of file
+  while (numBytesToRead > 0) {
+    numBytesToRead--;
+    switch (LightLinkFeed(&linkParser, Serial_UART.read(), &message)) {
+      case LINK_LIGHT:
+        AddLight(&message);
+        break;
+      case LINK_SYNC_REPLY:
+        TimeSyncAddSample(&timeSync, message.t[0], message.t[1], message.t[2], micros());
+        TRACE(TRACE_SYNC_SAMPLE, micros() - message.t[0] - (message.t[2] - message.t[1]),
+              TimeSyncOffsetAt(&timeSync, micros()));
+        break;
+      case LINK_FRAME_END:
+        sawFrameEnd = true;
+        if (message.hasTime && timeSync.valid) {
+          frameCaptureUs = TimeSyncRemoteToLocal(&timeSync, message.t[0]);
+          frameHasCaptureTime = true;
+        }
+        // Even with no lights, so the last ones get cleared off on the next draw
+        CommitFrame();
+        break;
+      case LINK_BAD_LINE:
+        // Probably garbage when first plugging in
+        TRACE(TRACE_BAD_LINE, linkParser.badLines, 0);
+        break;
+      default:
+        break;
+    }
+  }
+}
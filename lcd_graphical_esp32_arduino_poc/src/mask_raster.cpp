@@ -0,0 +1,111 @@
+#include <string.h>
+#include "mask_raster.h"
+
+// [radius][dx] column masks, bit 0 = the sprite's top row (y - radius)
+static uint32_t sprites[MASK_SPRITE_MAX_RADIUS + 1][MASK_SPRITE_MAX_RADIUS + 1];
+
+// Half height of the column dx away from the center, for dx = 0..radius.
+// Same midpoint walk as u8g2's drawDisc so we cover the same pixels.
+static void DiscHalfHeights(uint8_t radius, uint8_t *h) {
+  int16_t f = 1 - radius;
+  int16_t ddFx = 1;
+  int16_t ddFy = -2 * radius;
+  uint8_t x = 0;
+  uint8_t y = radius;
+
+  memset(h, 0, radius + 1);
+  for (;;) {
+    // u8g2 draws vlines at +-x of height y and at +-y of height x
+    if (h[x] < y) {
+      h[x] = y;
+    }
+    if (h[y] < x) {
+      h[y] = x;
+    }
+    if (x >= y) {
+      break;
+    }
+    if (f >= 0) {
+      y--;
+      ddFy += 2;
+      f += ddFy;
+    }
+    x++;
+    ddFx += 2;
+    f += ddFx;
+  }
+}
+
+void MaskRasterInit() {
+  uint8_t h[MASK_SPRITE_MAX_RADIUS + 1];
+  for (uint8_t r = 0; r <= MASK_SPRITE_MAX_RADIUS; r++) {
+    DiscHalfHeights(r, h);
+    for (uint8_t dx = 0; dx <= r; dx++) {
+      sprites[r][dx] = ((1UL << (2 * h[dx] + 1)) - 1) << (r - h[dx]);
+    }
+  }
+}
+
+static void BlitSprite(uint8_t *buffer, int16_t x, int16_t y, uint8_t radius) {
+  const uint32_t *columns = sprites[radius];
+  int16_t top = y - radius;
+  uint8_t shift = top & 7;
+  int16_t firstPage = (top - shift) / 8; // Rounds down for negative too
+  int16_t x0 = x - radius < 0 ? 0 : x - radius;
+  int16_t x1 = x + radius >= MASK_WIDTH ? MASK_WIDTH - 1 : x + radius;
+
+  for (int16_t c = x0; c <= x1; c++) {
+    uint32_t word = columns[c < x ? x - c : c - x] << shift;
+    uint8_t *column = &buffer[c];
+    for (int16_t page = firstPage; word != 0; page++, word >>= 8) {
+      if ((uint8_t)word != 0 && page >= 0 && page < MASK_PAGES) {
+        column[page * MASK_WIDTH] |= (uint8_t)word;
+      }
+    }
+  }
+}
+
+static void FillColumn(uint8_t *buffer, int16_t c, int16_t y0, int16_t y1) {
+  if (y0 < 0) {
+    y0 = 0;
+  }
+  if (y1 >= MASK_PAGES * 8) {
+    y1 = MASK_PAGES * 8 - 1;
+  }
+  if (y0 > y1) {
+    return;
+  }
+  uint8_t *column = &buffer[c];
+  int16_t p0 = y0 >> 3;
+  int16_t p1 = y1 >> 3;
+  uint8_t first = 0xFF << (y0 & 7);
+  uint8_t last = 0xFF >> (7 - (y1 & 7));
+  if (p0 == p1) {
+    column[p0 * MASK_WIDTH] |= first & last;
+    return;
+  }
+  column[p0 * MASK_WIDTH] |= first;
+  for (int16_t p = p0 + 1; p < p1; p++) {
+    column[p * MASK_WIDTH] = 0xFF;
+  }
+  column[p1 * MASK_WIDTH] |= last;
+}
+
+void MaskDrawDisc(uint8_t *buffer, int16_t x, int16_t y, uint8_t radius) {
+  if (radius <= MASK_SPRITE_MAX_RADIUS) {
+    BlitSprite(buffer, x, y, radius);
+    return;
+  }
+
+  // Merged lights can get big, not worth a sprite each
+  uint8_t h[256];
+  DiscHalfHeights(radius, h);
+  for (int16_t dx = -radius; dx <= radius; dx++) {
+    int16_t c = x + dx;
+    if (c < 0 || c >= MASK_WIDTH) {
+      continue;
+    }
+    uint8_t half = h[dx < 0 ? -dx : dx];
+    FillColumn(buffer, c, y - half, y + half);
+  }
+}
@@ -0,0 +1,67 @@
+#include <stddef.h>
+#include "parallax.h"
+
+#define UM_PER_MM 1000
+
+// Offsets go either way, so multiplied into Q8 rather than shifted
+void ParallaxInit(struct Parallax *p, const struct ParallaxGeometry *g) {
+  int64_t a = g->lcdCenter[2] - g->eye[2];
+  p->xSign = g->lcdXSign;
+  p->principalXQ4 = g->principalXQ4;
+  p->principalYQ4 = g->principalYQ4;
+  p->cameraEyeZ = g->camera[2] - g->eye[2];
+  p->baseX = (int32_t)(((int64_t)(g->eye[0] - g->lcdCenter[0]) * 256) / g->lcdPitch);
+  p->baseY = (int32_t)(((int64_t)(g->eye[1] - g->lcdCenter[1]) * 256) / g->lcdPitch);
+  p->offsetNumX = (int32_t)((a * (g->camera[0] - g->eye[0]) * 256) / g->lcdPitch);
+  p->offsetNumY = (int32_t)((a * (g->camera[1] - g->eye[1]) * 256) / g->lcdPitch);
+  // A / (f pitch), f in Q4
+  p->slopeInfinity = (int32_t)((a * (1 << (16 + 4))) / ((int64_t)g->focalQ4 * g->lcdPitch));
+  ParallaxSetDistance(p, g->distanceMm);
+}
+
+// Everything that depends on the distance. Two divides.
+static inline void ForDistance(const struct Parallax *p, uint16_t distanceMm, int32_t *offsetX, int32_t *offsetY,
+                               int32_t *slope) {
+  int32_t b = p->cameraEyeZ + (int32_t)distanceMm * UM_PER_MM;
+  if (b < 1) {
+    b = 1; // Source behind the eye, nothing sensible to draw
+  }
+  // 32 bit as long as the camera is within 131 mm of the eye along z
+  int32_t w = (1 << PARALLAX_W_BITS) - (p->cameraEyeZ * (1 << PARALLAX_W_BITS)) / b;
+  *offsetX = p->baseX + p->offsetNumX / b;
+  *offsetY = p->baseY + p->offsetNumY / b;
+  *slope = (p->slopeInfinity * w) >> PARALLAX_W_BITS;
+}
+
+void ParallaxSetDistance(struct Parallax *p, uint16_t distanceMm) {
+  p->distanceMm = distanceMm;
+  ForDistance(p, distanceMm, &p->offsetX, &p->offsetY, &p->slope);
+}
+
+static inline void Project(const struct Parallax *p, int32_t offsetX, int32_t offsetY, int32_t slope, int16_t x,
+                           int16_t y, int32_t *lcdX, int32_t *lcdY) {
+  ParallaxProjectQ8(p, offsetX, offsetY, slope, (int32_t)x * 256, (int32_t)y * 256, lcdX, lcdY);
+}
+
+void ParallaxPoint(const struct Parallax *p, int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY) {
+  Project(p, p->offsetX, p->offsetY, p->slope, x, y, lcdX, lcdY);
+}
+
+void ParallaxProject(const struct Parallax *p, const int16_t *x, const int16_t *y, const uint16_t *distanceMm,
+                     uint8_t count, int32_t *lcdX, int32_t *lcdY) {
+  if (distanceMm == NULL) {
+    for (uint8_t i = 0; i < count; i++) {
+      Project(p, p->offsetX, p->offsetY, p->slope, x[i], y[i], &lcdX[i], &lcdY[i]);
+    }
+    return;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (distanceMm[i] == 0 || distanceMm[i] == p->distanceMm) {
+      Project(p, p->offsetX, p->offsetY, p->slope, x[i], y[i], &lcdX[i], &lcdY[i]);
+      continue;
+    }
+    int32_t offsetX, offsetY, slope;
+    ForDistance(p, distanceMm[i], &offsetX, &offsetY, &slope);
+    Project(p, offsetX, offsetY, slope, x[i], y[i], &lcdX[i], &lcdY[i]);
+  }
+}
@@ -0,0 +1,25 @@
+#include "radial.h"
+
+void RadialToLCD(const struct RadialTransform *t, int16_t x, int16_t y, int32_t *lcdX, int32_t *lcdY) {
+  int32_t dx = x - t->centerX;
+  int32_t dy = y - t->centerY;
+  uint32_t index = (uint32_t)(dx * dx + dy * dy) >> RADIAL_R2_SHIFT;
+  if (index >= RADIAL_TABLE_SIZE) {
+    index = RADIAL_TABLE_SIZE - 1;
+  }
+  int32_t k = t->scale[index];
+  int32_t ux = (dx * k) >> (RADIAL_SCALE_BITS - RADIAL_UNDISTORTED_BITS);
+  int32_t uy = (dy * k) >> (RADIAL_SCALE_BITS - RADIAL_UNDISTORTED_BITS);
+
+  // Q16 LCD px
+  int32_t lx = ((t->h[0] * ux + t->h[1] * uy) >> RADIAL_UNDISTORTED_BITS) + t->h[2];
+  int32_t ly = ((t->h[3] * ux + t->h[4] * uy) >> RADIAL_UNDISTORTED_BITS) + t->h[5];
+  if (!t->projective) {
+    *lcdX = lx >> (16 - DEWARP_FRACTION_BITS);
+    *lcdY = ly >> (16 - DEWARP_FRACTION_BITS);
+    return;
+  }
+  int32_t w = (1 << 16) + ((t->h[6] * ux + t->h[7] * uy) >> (RADIAL_PROJECTIVE_BITS - 16 + RADIAL_UNDISTORTED_BITS));
+  *lcdX = (int32_t)((int64_t)lx * (1 << DEWARP_FRACTION_BITS) / w);
+  *lcdY = (int32_t)((int64_t)ly * (1 << DEWARP_FRACTION_BITS) / w);
+}
@@ -0,0 +1,423 @@
+#include <Arduino.h>
+#include <string.h>
+#include "render.h"
+#include "mask_raster.h"
+#include "gray_raster.h"
+#include "shape_raster.h"
+#ifdef DISPLAY_DMA
+#include "display_dma.h"
+#endif
+
+#if defined(RENDER_GRAY) && !defined(DISPLAY_DMA)
+#error "RENDER_GRAY needs DISPLAY_DMA"
+#endif
+#if defined(RENDER_FRC) && (defined(RENDER_GRAY) || !defined(DISPLAY_DMA))
+#error "RENDER_FRC is for 1-bit frames and needs DISPLAY_DMA to refresh fast enough"
+#endif
+
+#ifdef RENDER_FRC
+// Partly opaque lights get drawn in here first, one opacity level at a time
+static uint8_t ditherLayer[LCD_PAGES * LCD_PAGE_BYTES] __attribute__((aligned(4)));
+// Threshold of each pixel in a 2x2 block. Adding the phase walks every pixel
+// through all four thresholds, and each block always has `level` pixels on.
+static const uint8_t bayer[2][2] = {{0, 2}, {3, 1}};
+#endif
+
+void RenderInit(struct Renderer *r, U8G2 *display) {
+  r->display = display;
+#ifdef DISPLAY_DMA
+  r->panel = static_cast<U8G2_ST7571_128X128_F_DMA *>(display)->panel;
+#else
+  r->panel = 0;
+#endif
+  r->back = 0;
+  r->composed = false;
+  r->dirty = 0;
+  r->numLastLights = 0;
+  r->ditherPhase = 0;
+  r->dithered = false;
+  MaskRasterInit();
+  ShapeRasterInit();
+#ifdef RENDER_GRAY
+  GrayRasterInit();
+  DisplayDmaSetGray(r->panel, true);
+#endif
+  RenderInvalidate(r);
+}
+
+void RenderInvalidate(struct Renderer *r) {
+  r->frontValid = false;
+}
+
+// Field by field, only the ones the shape uses: the rest and the padding
+// are whatever was there before
+static bool SameLight(const struct Light *a, const struct Light *b) {
+  if (a->x1 != b->x1 || a->y1 != b->y1 || a->radius != b->radius || a->brightness != b->brightness ||
+      a->shape != b->shape) {
+    return false;
+  }
+  if (a->shape == LIGHT_ELLIPSE) {
+    return a->minor == b->minor && a->angle == b->angle;
+  }
+  if (a->shape == LIGHT_POLYGON) {
+    if (a->numVertices != b->numVertices) {
+      return false;
+    }
+    for (uint8_t k = 0; k < a->numVertices; k++) {
+      if (a->vx[k] != b->vx[k] || a->vy[k] != b->vy[k]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool SameLights(const struct Renderer *r, const struct Light *lights, uint8_t numLights) {
+  if (numLights != r->numLastLights) {
+    return false;
+  }
+  for (uint8_t i = 0; i < numLights; i++) {
+    if (!SameLight(&lights[i], &r->lastLights[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifndef DISPLAY_DMA
+static void FlushPages(struct Renderer *r, uint8_t *buffer, uint16_t pageMask) {
+  uint8_t *u8g2Buffer = r->display->getBufferPtr();
+  for (uint8_t page = 0; page < LCD_PAGES; page++) {
+    if (pageMask & (1 << page)) {
+      memcpy(&u8g2Buffer[page * LCD_PAGE_BYTES], &buffer[page * LCD_PAGE_BYTES], LCD_PAGE_BYTES);
+      // Tile units: whole width, one page tall
+      r->display->updateDisplayArea(0, page, LCD_PAGE_BYTES / 8, 1);
+    }
+  }
+}
+#endif
+
+// Blocks until the last flush is really on the glass
+static void FlushWait() {
+#ifdef DISPLAY_DMA
+  DisplayDmaWait();
+#endif
+}
+
+#ifdef RENDER_FRC
+// 1 (a quarter of the pixels) .. FRC_LEVELS (solid), brighter blocks more
+static uint8_t DitherLevel(const struct Light *light) {
+  return 1 + (uint16_t)light->brightness * (FRC_LEVELS - 1) / 255;
+}
+
+// Which of a page byte's pixels are on for this level and phase. Rows
+// alternate within the byte, so it's 0x00, 0x55, 0xAA or 0xFF.
+static uint8_t DitherPattern(uint8_t level, uint8_t phase, uint8_t xParity) {
+  uint8_t pattern = 0;
+  if (((bayer[0][xParity] + phase) & 3) < level) {
+    pattern |= 0x55; // Even rows
+  }
+  if (((bayer[1][xParity] + phase) & 3) < level) {
+    pattern |= 0xAA;
+  }
+  return pattern;
+}
+
+static void DrawDithered(struct Renderer *r, uint8_t *buffer) {
+  r->dithered = false;
+  for (uint8_t level = 1; level < FRC_LEVELS; level++) {
+    bool any = false;
+    for (uint8_t i = 0; i < r->numLastLights; i++) {
+      if (DitherLevel(&r->lastLights[i]) != level) {
+        continue;
+      }
+      if (!any) {
+        memset(ditherLayer, 0, sizeof(ditherLayer));
+        any = true;
+      }
+      ShapeDrawLight(ditherLayer, SHAPE_MONO, &r->lastLights[i]);
+    }
+    if (!any) {
+      continue;
+    }
+    r->dithered = true;
+    // Byte index is page * 128 + x, so even bytes are even columns
+    uint8_t even = DitherPattern(level, r->ditherPhase, 0);
+    uint8_t odd = DitherPattern(level, r->ditherPhase, 1);
+    uint32_t pattern = even | (odd << 8) | ((uint32_t)even << 16) | ((uint32_t)odd << 24);
+    uint32_t *to = (uint32_t *)buffer;
+    const uint32_t *from = (const uint32_t *)ditherLayer;
+    for (uint16_t i = 0; i < sizeof(ditherLayer) / 4; i++) {
+      to[i] |= from[i] & pattern;
+    }
+  }
+  for (uint8_t i = 0; i < r->numLastLights; i++) {
+    if (DitherLevel(&r->lastLights[i]) == FRC_LEVELS) {
+      ShapeDrawLight(buffer, SHAPE_MONO, &r->lastLights[i]);
+    }
+  }
+}
+#endif
+
+// Draws lastLights into the back frame and works out which pages changed
+static void ComposeFrame(struct Renderer *r, struct RenderStats *stats, unsigned long start) {
+  // Safe to draw into, the flush that used it finished before the last one was queued
+  uint8_t *buffer = r->frames[r->back];
+  uint8_t *front = r->frames[r->back ^ 1];
+  memset(buffer, 0, sizeof(r->frames[0]));
+#ifdef RENDER_FRC
+  DrawDithered(r, buffer);
+#else
+  for (uint8_t i = 0; i < r->numLastLights; i++) {
+    ShapeDrawLight(buffer, RENDER_SHAPE_LAYOUT, &r->lastLights[i]);
+  }
+#endif
+
+  for (uint8_t page = 0; page < LCD_PAGES; page++) {
+    if (r->frontValid && memcmp(&buffer[page * RENDER_PAGE_BYTES], &front[page * RENDER_PAGE_BYTES], RENDER_PAGE_BYTES) == 0) {
+      continue;
+    }
+    r->dirty |= 1 << page;
+    stats->pagesSent++;
+  }
+  r->composed = true;
+  stats->drawUs = micros() - start;
+}
+
+static void ClearStats(struct Renderer *r, struct RenderStats *stats) {
+  stats->pagesSent = 0;
+  stats->drawUs = 0;
+  stats->flushUs = 0;
+  r->composed = false;
+  r->dirty = 0;
+}
+
+void RenderCompose(struct Renderer *r, const struct Light *lights, uint8_t numLights, struct RenderStats *stats) {
+  unsigned long start = micros();
+  ClearStats(r, stats);
+  if (numLights > MAX_LIGHTS) {
+    numLights = MAX_LIGHTS;
+  }
+
+  if (r->frontValid && SameLights(r, lights, numLights)) {
+    // Nothing moved, nothing to send. Dithering carries on in RenderDitherStep().
+    return;
+  }
+  memcpy(r->lastLights, lights, sizeof(lights[0]) * numLights);
+  r->numLastLights = numLights;
+  ComposeFrame(r, stats, start);
+}
+
+bool RenderDitherStep(struct Renderer *r, struct RenderStats *stats) {
+  ClearStats(r, stats);
+#ifdef RENDER_FRC
+  unsigned long start = micros();
+  if (!r->dithered || !r->frontValid) {
+    return false;
+  }
+  r->ditherPhase = (r->ditherPhase + 1) % FRC_PHASES;
+  ComposeFrame(r, stats, start);
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint32_t RenderFlush(struct Renderer *const *renderers, uint8_t count) {
+  unsigned long start = micros();
+#ifdef DISPLAY_DMA
+  uint8_t panels[DISPLAY_MAX_PANELS];
+  const uint8_t *buffers[DISPLAY_MAX_PANELS];
+  uint16_t masks[DISPLAY_MAX_PANELS];
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < count && n < DISPLAY_MAX_PANELS; i++) {
+    if (renderers[i]->composed && renderers[i]->dirty != 0) {
+      panels[n] = renderers[i]->panel;
+      buffers[n] = renderers[i]->frames[renderers[i]->back];
+      masks[n] = renderers[i]->dirty;
+      n++;
+    }
+  }
+  if (n > 0) {
+    DisplayDmaFlushPanels(panels, buffers, masks, n);
+  }
+#else
+  for (uint8_t i = 0; i < count; i++) {
+    if (renderers[i]->composed && renderers[i]->dirty != 0) {
+      FlushPages(renderers[i], renderers[i]->frames[renderers[i]->back], renderers[i]->dirty);
+    }
+  }
+#endif
+  for (uint8_t i = 0; i < count; i++) {
+    struct Renderer *r = renderers[i];
+    if (r->composed) {
+      r->back ^= 1;
+      r->frontValid = true;
+      r->composed = false;
+    }
+  }
+  return micros() - start;
+}
+
+void RenderLights(struct Renderer *r, const struct Light *lights, uint8_t numLights, struct RenderStats *stats) {
+  RenderCompose(r, lights, numLights, stats);
+  stats->flushUs = RenderFlush(&r, 1);
+}
+
+void RenderBenchmark(struct Renderer *r) {
+  static const uint8_t counts[] = {1, 4, 15};
+  static const uint8_t updates = 50;
+  struct Light lights[15];
+  struct RenderStats stats;
+
+  for (uint8_t c = 0; c < sizeof(counts); c++) {
+    uint8_t n = counts[c];
+    uint32_t dirtyUs = 0;
+    uint32_t pages = 0;
+    for (uint8_t i = 0; i < n; i++) {
+      lights[i].x1 = 8 + (i * 29) % 112;
+      lights[i].y1 = 8 + (i * 47) % 112;
+      lights[i].radius = 4;
+      lights[i].brightness = 255;
+      lights[i].shape = LIGHT_DISC;
+    }
+
+    RenderInvalidate(r);
+    RenderLights(r, lights, n, &stats);
+    for (uint8_t u = 0; u < updates; u++) {
+      for (uint8_t i = 0; i < n; i++) {
+        // Drift diagonally a pixel per update
+        lights[i].x1 = 8 + (lights[i].x1 - 8 + 1) % 112;
+        lights[i].y1 = 8 + (lights[i].y1 - 8 + 1) % 112;
+      }
+      unsigned long start = micros();
+      RenderLights(r, lights, n, &stats);
+      FlushWait();
+      dirtyUs += micros() - start;
+      pages += stats.pagesSent;
+    }
+
+    uint32_t fullUs = 0;
+    for (uint8_t u = 0; u < updates; u++) {
+      RenderInvalidate(r);
+      unsigned long start = micros();
+      RenderLights(r, lights, n, &stats);
+      FlushWait();
+      fullUs += micros() - start;
+    }
+
+    unsigned long start = micros();
+    RenderLights(r, lights, n, &stats);
+    uint32_t stillUs = micros() - start;
+
+    Serial.printf("Render %2d lights: dirty %6lu us/update (%lu pages), full %6lu us/update, not moving %lu us\n",
+                  n, (unsigned long)(dirtyUs / updates), (unsigned long)(pages / updates),
+                  (unsigned long)(fullUs / updates), (unsigned long)stillUs);
+  }
+
+  // Just the rasterizers, against u8g2's drawDisc
+  static const uint8_t radii[] = {4, 12, 24};
+  static const uint16_t discs = 1000;
+  for (uint8_t k = 0; k < sizeof(radii); k++) {
+    r->display->clearBuffer();
+    unsigned long start = micros();
+    for (uint16_t i = 0; i < discs; i++) {
+      MaskDrawDisc(r->display->getBufferPtr(), (i * 29) % 128, (i * 47) % 128, radii[k]);
+    }
+    uint32_t maskUs = micros() - start + 1;
+    r->display->clearBuffer();
+    start = micros();
+    for (uint16_t i = 0; i < discs; i++) {
+      r->display->drawDisc((i * 29) % 128, (i * 47) % 128, radii[k]);
+    }
+    uint32_t u8g2Us = micros() - start + 1;
+#ifdef RENDER_GRAY
+    memset(r->frames[r->back], 0, sizeof(r->frames[0]));
+    start = micros();
+    for (uint16_t i = 0; i < discs; i++) {
+      GrayDrawLight(r->frames[r->back], (i * 29) % 128, (i * 47) % 128, radii[k]);
+    }
+    uint32_t grayUs = micros() - start + 1;
+    Serial.printf("Discs r=%2d: %lu/ms, u8g2 drawDisc %lu/ms, gray %lu/ms\n", radii[k],
+                  (unsigned long)(discs * 1000UL / maskUs), (unsigned long)(discs * 1000UL / u8g2Us),
+                  (unsigned long)(discs * 1000UL / grayUs));
+#else
+    Serial.printf("Discs r=%2d: %lu/ms, u8g2 drawDisc %lu/ms\n", radii[k],
+                  (unsigned long)(discs * 1000UL / maskUs), (unsigned long)(discs * 1000UL / u8g2Us));
+#endif
+  }
+  r->display->clearBuffer();
+
+  // Streaks, against the disc that would have to cover them
+  static const uint8_t minors[] = {12, 6, 3};
+  for (uint8_t k = 0; k < sizeof(minors); k++) {
+    r->display->clearBuffer();
+    unsigned long start = micros();
+    for (uint16_t i = 0; i < discs; i++) {
+      ShapeDrawEllipse(r->display->getBufferPtr(), SHAPE_MONO, (i * 29) % 128, (i * 47) % 128, 12, minors[k], i);
+    }
+    uint32_t ellipseUs = micros() - start + 1;
+    Serial.printf("Ellipses 12x%d: %lu/ms\n", minors[k], (unsigned long)(discs * 1000UL / ellipseUs));
+  }
+  r->display->clearBuffer();
+
+#ifdef RENDER_FRC
+  // How fast the dither pattern can move with the lights standing still,
+  // everything but the solid ones changes every step
+  for (uint8_t c = 0; c < sizeof(counts); c++) {
+    uint8_t n = counts[c];
+    for (uint8_t i = 0; i < n; i++) {
+      lights[i].x1 = 8 + (i * 29) % 112;
+      lights[i].y1 = 8 + (i * 47) % 112;
+      lights[i].radius = 12;
+      lights[i].brightness = 128; // Three quarters
+      lights[i].shape = LIGHT_DISC;
+    }
+    RenderInvalidate(r);
+    RenderLights(r, lights, n, &stats);
+    uint32_t stepUs = 0;
+    uint32_t pages = 0;
+    for (uint8_t u = 0; u < updates; u++) {
+      unsigned long start = micros();
+      RenderDitherStep(r, &stats);
+      RenderFlush(&r, 1);
+      FlushWait();
+      stepUs += micros() - start;
+      pages += stats.pagesSent;
+    }
+    stepUs = stepUs / updates + 1;
+    Serial.printf("Dither %2d lights r=12: %lu us/refresh (%lu pages), %lu Hz one panel, %lu Hz both\n", n,
+                  (unsigned long)stepUs, (unsigned long)(pages / updates), (unsigned long)(1000000UL / stepUs),
+                  (unsigned long)(1000000UL / (2 * stepUs)));
+  }
+  RenderInvalidate(r);
+#endif
+
+  // Just pushing a whole frame, the part DISPLAY_DMA is about. Build with and
+  // without it to compare against bit-banged SPI.
+  uint8_t *buffer = r->frames[r->back ^ 1];
+  uint32_t cpuUs = 0;
+  uint32_t totalUs = 0;
+  for (uint8_t u = 0; u < updates; u++) {
+    unsigned long start = micros();
+#ifdef DISPLAY_DMA
+    DisplayDmaFlushPages(r->panel, buffer, 0xFFFF);
+#else
+    FlushPages(r, buffer, 0xFFFF);
+#endif
+    cpuUs += micros() - start;
+    FlushWait();
+    totalUs += micros() - start;
+  }
+#if defined(RENDER_GRAY)
+  Serial.printf("Flush full frame (2bpp, HW SPI DMA @ %lu Hz): %lu us, CPU busy %lu us\n", (unsigned long)DISPLAY_SPI_HZ,
+                (unsigned long)(totalUs / updates), (unsigned long)(cpuUs / updates));
+#elif defined(DISPLAY_DMA)
+  Serial.printf("Flush full frame (HW SPI DMA @ %lu Hz): %lu us, CPU busy %lu us\n", (unsigned long)DISPLAY_SPI_HZ,
+                (unsigned long)(totalUs / updates), (unsigned long)(cpuUs / updates));
+#else
+  Serial.printf("Flush full frame (SW SPI): %lu us, CPU busy %lu us\n",
+                (unsigned long)(totalUs / updates), (unsigned long)(cpuUs / updates));
+#endif
+  RenderInvalidate(r);
+}
@@ -0,0 +1,235 @@
+#include <math.h>
+#include "shape_raster.h"
+#include "mask_raster.h"
+#include "gray_raster.h"
+
+#define ONE (1 << SHAPE_SUBPIXEL_SHIFT)
+#define ANGLE_STEPS 512 // A full turn, light angles only go half way round
+#define TRIG_ONE 16384 // Q14
+
+static int16_t cosTable[ANGLE_STEPS];
+// Vertices of the 16-gon around the unit circle, Q14
+static int16_t unitX[SHAPE_ELLIPSE_VERTICES];
+static int16_t unitY[SHAPE_ELLIPSE_VERTICES];
+
+void ShapeRasterInit() {
+  for (uint16_t i = 0; i < ANGLE_STEPS; i++) {
+    cosTable[i] = (int16_t)lroundf(cosf(i * (float)(2 * M_PI / ANGLE_STEPS)) * TRIG_ONE);
+  }
+  // Pushed out so the edges (not the corners) touch the circle
+  float grow = 1.0f / cosf((float)(M_PI / SHAPE_ELLIPSE_VERTICES));
+  for (uint8_t k = 0; k < SHAPE_ELLIPSE_VERTICES; k++) {
+    float a = k * (float)(2 * M_PI / SHAPE_ELLIPSE_VERTICES);
+    unitX[k] = (int16_t)lroundf(cosf(a) * grow * TRIG_ONE);
+    unitY[k] = (int16_t)lroundf(sinf(a) * grow * TRIG_ONE);
+  }
+}
+
+static inline int32_t Cos(uint16_t a) {
+  return cosTable[a & (ANGLE_STEPS - 1)];
+}
+
+static inline int32_t Sin(uint16_t a) {
+  return cosTable[(a - ANGLE_STEPS / 4) & (ANGLE_STEPS - 1)];
+}
+
+// b > 0, rounds towards -infinity for negative a too
+static inline int32_t FloorDiv(int32_t a, int32_t b) {
+  int32_t q = a / b;
+  return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+static inline int32_t CeilDiv(int32_t a, int32_t b) {
+  return -FloorDiv(-a, b);
+}
+
+static void FillSpan(uint8_t *buffer, uint8_t layout, int16_t c, int16_t y0, int16_t y1) {
+  if (y0 < 0) {
+    y0 = 0;
+  }
+  if (y1 >= SHAPE_PAGES * 8) {
+    y1 = SHAPE_PAGES * 8 - 1;
+  }
+  if (y0 > y1) {
+    return;
+  }
+  bool gray = layout == SHAPE_GRAY;
+  uint8_t *column = gray ? &buffer[c * 2] : &buffer[c];
+  uint16_t stride = gray ? GRAY_PAGE_BYTES : MASK_WIDTH;
+  int16_t p0 = y0 >> 3;
+  int16_t p1 = y1 >> 3;
+  for (int16_t p = p0; p <= p1; p++) {
+    uint8_t bits = 0xFF;
+    if (p == p0) {
+      bits &= 0xFF << (y0 & 7);
+    }
+    if (p == p1) {
+      bits &= 0xFF >> (7 - (y1 & 7));
+    }
+    uint8_t *b = &column[p * stride];
+    if (gray) {
+      // Core level is both planes set, darkest wins anyway
+      b[GRAY_PLANE_LSB] |= bits;
+      b[GRAY_PLANE_MSB] |= bits;
+    } else {
+      b[0] |= bits;
+    }
+  }
+}
+
+// Vertices in 1/16 pixels, within a panel or two of the screen so nothing
+// below overflows. Fills every pixel whose center is inside or on an edge.
+static void FillPolygon(uint8_t *buffer, uint8_t layout, const int32_t *px, const int32_t *py, uint8_t n) {
+  int16_t top[SHAPE_WIDTH];
+  int16_t bottom[SHAPE_WIDTH];
+  int32_t minX = px[0];
+  int32_t maxX = px[0];
+  for (uint8_t i = 1; i < n; i++) {
+    minX = px[i] < minX ? px[i] : minX;
+    maxX = px[i] > maxX ? px[i] : maxX;
+  }
+  int32_t c0 = CeilDiv(minX, ONE);
+  int32_t c1 = FloorDiv(maxX, ONE);
+  c0 = c0 < 0 ? 0 : c0;
+  c1 = c1 >= SHAPE_WIDTH ? SHAPE_WIDTH - 1 : c1;
+  if (c0 > c1) {
+    return;
+  }
+  for (int32_t c = c0; c <= c1; c++) {
+    top[c] = INT16_MAX;
+    bottom[c] = INT16_MIN;
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    uint8_t j = i + 1 == n ? 0 : i + 1;
+    int32_t ax = px[i], ay = py[i], bx = px[j], by = py[j];
+    if (ax > bx) {
+      ax = px[j], ay = py[j], bx = px[i], by = py[i];
+    }
+    if (ax == bx) {
+      // Vertical, only counts if it's right on a column
+      int32_t c = FloorDiv(ax, ONE);
+      if (c * ONE != ax || c < c0 || c > c1) {
+        continue;
+      }
+      int16_t up = CeilDiv(ay < by ? ay : by, ONE);
+      int16_t down = FloorDiv(ay > by ? ay : by, ONE);
+      top[c] = up < top[c] ? up : top[c];
+      bottom[c] = down > bottom[c] ? down : bottom[c];
+      continue;
+    }
+    int32_t cStart = CeilDiv(ax, ONE);
+    int32_t cEnd = FloorDiv(bx, ONE);
+    cStart = cStart < c0 ? c0 : cStart;
+    cEnd = cEnd > c1 ? c1 : cEnd;
+    if (cStart > cEnd) {
+      continue;
+    }
+    // Edge's y in pixels at column c is num / d, walked along as quotient +
+    // remainder so it's exact and there's no divide in the loop
+    int32_t dx = bx - ax;
+    int32_t dy = by - ay;
+    int32_t d = dx * ONE;
+    int32_t num = ay * dx + (cStart * ONE - ax) * dy;
+    int32_t q = FloorDiv(num, d);
+    int32_t r = num - q * d;
+    int32_t stepQ = FloorDiv(dy * ONE, d);
+    int32_t stepR = dy * ONE - stepQ * d;
+    for (int32_t c = cStart; c <= cEnd; c++) {
+      int16_t up = q + (r != 0);
+      if (up < top[c]) {
+        top[c] = up;
+      }
+      if (q > bottom[c]) {
+        bottom[c] = q;
+      }
+      q += stepQ;
+      r += stepR;
+      if (r >= d) {
+        r -= d;
+        q++;
+      }
+    }
+  }
+
+  for (int32_t c = c0; c <= c1; c++) {
+    if (top[c] <= bottom[c]) {
+      FillSpan(buffer, layout, c, top[c], bottom[c]);
+    }
+  }
+}
+
+static bool OffPanel(int16_t x, int16_t y, int16_t reach) {
+  return x + reach < 0 || x - reach >= SHAPE_WIDTH || y + reach < 0 || y - reach >= SHAPE_PAGES * 8;
+}
+
+void ShapeDrawEllipse(uint8_t *buffer, uint8_t layout, int16_t x, int16_t y, uint8_t major, uint8_t minor,
+                      uint8_t angle) {
+  int32_t px[SHAPE_ELLIPSE_VERTICES];
+  int32_t py[SHAPE_ELLIPSE_VERTICES];
+  if (OffPanel(x, y, major + 1)) {
+    return;
+  }
+  int32_t c = Cos(angle);
+  int32_t s = Sin(angle);
+  for (uint8_t k = 0; k < SHAPE_ELLIPSE_VERTICES; k++) {
+    // Along the axes in 1/64 pixels, then rotated (Q14) down to 1/16. The
+    // axes get an extra 1/16 pixel so rounding can't pull an edge inside.
+    int32_t ex = (((int32_t)major * 64 + 4) * unitX[k]) >> 14;
+    int32_t ey = (((int32_t)minor * 64 + 4) * unitY[k]) >> 14;
+    px[k] = x * ONE + ((ex * c - ey * s + (1 << 15)) >> 16);
+    py[k] = y * ONE + ((ex * s + ey * c + (1 << 15)) >> 16);
+  }
+  FillPolygon(buffer, layout, px, py, SHAPE_ELLIPSE_VERTICES);
+}
+
+void ShapeDrawPolygon(uint8_t *buffer, uint8_t layout, int16_t x, int16_t y, const int8_t *vx, const int8_t *vy,
+                      uint8_t numVertices) {
+  int32_t px[SHAPE_MAX_VERTICES];
+  int32_t py[SHAPE_MAX_VERTICES];
+  if (numVertices == 0 || OffPanel(x, y, 128)) {
+    return;
+  }
+  if (numVertices > SHAPE_MAX_VERTICES) {
+    numVertices = SHAPE_MAX_VERTICES;
+  }
+  for (uint8_t k = 0; k < numVertices; k++) {
+    px[k] = (x + vx[k]) * ONE;
+    py[k] = (y + vy[k]) * ONE;
+  }
+  FillPolygon(buffer, layout, px, py, numVertices);
+}
+
+void ShapeDrawLight(uint8_t *buffer, uint8_t layout, const struct Light *light) {
+  int16_t x = (int16_t)light->x1;
+  int16_t y = (int16_t)light->y1;
+  switch (light->shape) {
+    case LIGHT_ELLIPSE:
+      ShapeDrawEllipse(buffer, layout, x, y, light->radius, light->minor, light->angle);
+      break;
+    case LIGHT_POLYGON:
+      ShapeDrawPolygon(buffer, layout, x, y, light->vx, light->vy, light->numVertices);
+      break;
+    default:
+      if (layout == SHAPE_GRAY) {
+        GrayDrawLight(buffer, x, y, light->radius);
+      } else {
+        MaskDrawDisc(buffer, x, y, light->radius);
+      }
+      break;
+  }
+}
+
+uint8_t ShapeCoverRadius(const struct Light *light) {
+  uint16_t farthest = 0;
+  for (uint8_t k = 0; k < light->numVertices && k < LIGHT_POLYGON_MAX_VERTICES; k++) {
+    uint16_t d = light->vx[k] * light->vx[k] + light->vy[k] * light->vy[k];
+    farthest = d > farthest ? d : farthest;
+  }
+  // Once per received light, a plain walk up is fine
+  uint16_t r = 0;
+  while ((uint32_t)r * r < farthest) {
+    r++;
+  }
+  return r > 255 ? 255 : r;
+}
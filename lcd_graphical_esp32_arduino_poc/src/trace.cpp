@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include "trace.h"
+
+#ifdef TRACE_ENABLED
+
+static struct TraceEvent events[TRACE_EVENTS];
+static uint32_t head = 0; // Writes claimed so far
+static uint32_t tail = 0; // Next to send
+static uint32_t lost = 0; // Not reported yet
+
+void TraceWrite(uint16_t id, int32_t a, int32_t b) {
+  uint32_t seq = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  struct TraceEvent *e = &events[seq & (TRACE_EVENTS - 1)];
+  __atomic_store_n(&e->stamp, 0, __ATOMIC_RELEASE);
+  e->us = micros();
+  e->id = id;
+  e->a = a;
+  e->b = b;
+  // Last, so a reader that sees the stamp sees the rest of the event
+  __atomic_store_n(&e->stamp, seq + 1, __ATOMIC_RELEASE);
+}
+
+static void Send(const struct TraceEvent *e) {
+  Serial.printf("~%08lx%04x%08lx%08lx\n", (unsigned long)e->us, e->id, (unsigned long)(uint32_t)e->a,
+                (unsigned long)(uint32_t)e->b);
+}
+
+uint16_t TraceDrain(uint16_t maxEvents) {
+  uint32_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+  uint16_t sent = 0;
+
+  if (end - tail > TRACE_EVENTS) {
+    // Lapped, the oldest ones are gone
+    lost += end - tail - TRACE_EVENTS;
+    tail = end - TRACE_EVENTS;
+  }
+  if (lost > 0 && maxEvents > 0) {
+    struct TraceEvent e = {0, (uint32_t)micros(), TRACE_LOST, (int32_t)lost, 0};
+    Send(&e);
+    lost = 0;
+    sent++;
+  }
+  while (tail != end && sent < maxEvents) {
+    struct TraceEvent *slot = &events[tail & (TRACE_EVENTS - 1)];
+    if (__atomic_load_n(&slot->stamp, __ATOMIC_ACQUIRE) != tail + 1) {
+      // Not finished yet (an interrupted write), try again next time
+      break;
+    }
+    struct TraceEvent e = *slot;
+    if (__atomic_load_n(&slot->stamp, __ATOMIC_ACQUIRE) != tail + 1) {
+      // Overwritten while we copied it
+      lost++;
+    } else {
+      Send(&e);
+      sent++;
+    }
+    tail++;
+  }
+  return sent;
+}
+
+void TraceDump() {
+  while (TraceDrain(TRACE_EVENTS) > 0) {
+  }
+}
+
+void TracePoll() {
+  // A line is 30 bytes, only send what fits without blocking
+  uint16_t room = Serial.availableForWrite() / 30;
+  TraceDrain(room < TRACE_DRAIN_PER_POLL ? room : TRACE_DRAIN_PER_POLL);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+// Lights one backplane x segment crossing of the 4x4 test panel at a time:
+// charge through the backplane with everything else held equal, let it sit,
+// same through the segment, then the whole thing again inverted so it adds
+// up to 0 DC. The rest of its backplane's row and its segment's column see
+// half as much, the others nothing. One table per crossing, all checked at
+// compile time, main.cpp picks which from millis().
+
+#include "waveform_table.h"
+
+#define SEGMENT_TEST_BACKPLANES 4
+#define SEGMENT_TEST_SEGMENTS 4
+#define SEGMENT_TEST_ALL 0x0F
+#define LCD_CHARGE_TIME_US 6000
+#define LCD_DISCHARGE_TIME_US 6000
+#define SEGMENT_TEST_PHASES 8
+#define SEGMENT_TEST_PERIOD_US (4 * (LCD_CHARGE_TIME_US + LCD_DISCHARGE_TIME_US))
+
+// {backplanes, segments, us, floating}
+#define SEGMENT_TEST(b, s)                                                     \
+  {                                                                            \
+    {SEGMENT_TEST_ALL & ~(1 << (b)), SEGMENT_TEST_ALL, LCD_CHARGE_TIME_US, 0}, \
+    {SEGMENT_TEST_ALL, SEGMENT_TEST_ALL, LCD_DISCHARGE_TIME_US, 0},            \
+    {SEGMENT_TEST_ALL, SEGMENT_TEST_ALL & ~(1 << (s)), LCD_CHARGE_TIME_US, 0}, \
+    {SEGMENT_TEST_ALL, SEGMENT_TEST_ALL, LCD_DISCHARGE_TIME_US, 0},            \
+    {1 << (b), 0, LCD_CHARGE_TIME_US, 0},                                      \
+    {0, 0, LCD_DISCHARGE_TIME_US, 0},                                          \
+    {0, 1 << (s), LCD_CHARGE_TIME_US, 0},                                      \
+    {0, 0, LCD_DISCHARGE_TIME_US, 0},                                          \
+  }
+
+static constexpr struct WavePhase segmentTests[SEGMENT_TEST_BACKPLANES][SEGMENT_TEST_SEGMENTS][SEGMENT_TEST_PHASES] = {
+  {SEGMENT_TEST(0, 0), SEGMENT_TEST(0, 1), SEGMENT_TEST(0, 2), SEGMENT_TEST(0, 3)},
+  {SEGMENT_TEST(1, 0), SEGMENT_TEST(1, 1), SEGMENT_TEST(1, 2), SEGMENT_TEST(1, 3)},
+  {SEGMENT_TEST(2, 0), SEGMENT_TEST(2, 1), SEGMENT_TEST(2, 2), SEGMENT_TEST(2, 3)},
+  {SEGMENT_TEST(3, 0), SEGMENT_TEST(3, 1), SEGMENT_TEST(3, 2), SEGMENT_TEST(3, 3)},
+};
+
+// WAVE_CHECK() for each of them, a constexpr loop
+static constexpr bool SegmentTestsOk(uint8_t n) {
+  return n == 0 ||
+         (WaveBalanced(segmentTests[(n - 1) / SEGMENT_TEST_SEGMENTS][(n - 1) % SEGMENT_TEST_SEGMENTS],
+                       SEGMENT_TEST_PHASES, SEGMENT_TEST_BACKPLANES, SEGMENT_TEST_SEGMENTS) &&
+          WavePeriodUs(segmentTests[(n - 1) / SEGMENT_TEST_SEGMENTS][(n - 1) % SEGMENT_TEST_SEGMENTS],
+                       SEGMENT_TEST_PHASES) == SEGMENT_TEST_PERIOD_US &&
+          SegmentTestsOk(n - 1));
+}
+static_assert(SegmentTestsOk(SEGMENT_TEST_BACKPLANES * SEGMENT_TEST_SEGMENTS), "a segment test has DC or is off period");
@@ -24,26 +24,49 @@
   https://www.arduino.cc/en/Tutorial/BuiltInExamples/Blink
 */
 #include <Arduino.h>
-const int NUM_BACKPLANES = 4;
-const int backplanes[NUM_BACKPLANES] = {D0, D1, D2, D3};
+#include "waveform.h"
+#include "segment_tests.h"
+#include "multiplex.h"
+const int NUM_BACKPLANES = SEGMENT_TEST_BACKPLANES;
+static constexpr uint8_t backplanes[NUM_BACKPLANES] = {D0, D1, D2, D3};
 int backplane_active = 0;
-const int NUM_SEGMENTS = 4;
-const int segments[NUM_SEGMENTS] = {D5, D6, D7, D8};
+const int NUM_SEGMENTS = SEGMENT_TEST_SEGMENTS;
+static constexpr uint8_t segments[NUM_SEGMENTS] = {D5, D6, D7, D8};
 int segment_active = 0;
-
-const int LCD_CHARGE_TIME_US = 6000;
-const int LCD_DISCHARGE_TIME_US = 6000;
-
+// Masks for all of them at once, see pin_group.h
+static constexpr struct PinGroup backplane_lines = PIN_GROUP(backplanes);
+static constexpr struct PinGroup segment_lines = PIN_GROUP(segments);
+
+// 0 lights one crossing at a time (segment_tests.h). 1 or 2 multiplexes the
+// framebuffer with that many row groups (multiplex.h), which needs the
+// half-supply dividers on the backplane pins. Two treats the glass as two
+// 2x2 panels, backplanes D0-D1 on segments D5-D6 and D2-D3 on D7-D8. This
+// glass is one 4x4 though, so the crossings between the groups get the
+// other group's segments while their own backplane is selected, up to the
+// full on level, and ghost dark. Only 2 on glass made of separate panels.
+#define MULTIPLEX_GROUPS 0
+const struct MultiplexLayout layout = {NUM_BACKPLANES, NUM_SEGMENTS, MULTIPLEX_GROUPS, LCD_CHARGE_TIME_US};
+uint8_t framebuffer[NUM_BACKPLANES];
 
 // the setup function runs once when you press reset or power the board
 void setup() {
-  for (int i = 0; i < NUM_BACKPLANES; i++) {
-    pinMode(backplanes[i], OUTPUT);
+  WaveBegin(&backplane_lines, &segment_lines);
+  Serial.begin(921600);
+  if (MULTIPLEX_GROUPS > 0) {
+    Serial.printf("Multiplexed, %d groups: %u Hz\n", MULTIPLEX_GROUPS, MultiplexFrameHz(&layout));
   }
-  for (int i = 0; i < NUM_SEGMENTS; i++) {
-    pinMode(segments[i], OUTPUT);
+}
+
+// A diagonal, stepping round every second. Split in two groups, pixels
+// that land between them can't be set: those crossings get driven by the
+// other group's data instead (see MULTIPLEX_GROUPS).
+void Multiplex() {
+  for (int b = 0; b < NUM_BACKPLANES; b++) {
+    framebuffer[b] = 1 << ((b + millis() / 1024) % NUM_SEGMENTS);
   }
-  Serial.begin(921600);
+  struct WavePhase phases[WAVE_MAX_PHASES];
+  uint8_t n = MultiplexPhases(&layout, framebuffer, phases);
+  WavePlay(phases, n);
 }
 
 // the loop function runs over and over again forever
@@ -51,43 +74,16 @@ void setup() {
 uint32_t lcd_on_time_us = 0;
 uint32_t lcd_on_time_us_increment = 500;
 void loop() {
-
-  for (int i = 0; i < NUM_BACKPLANES; i++) {
-    digitalWrite(backplanes[i], HIGH);
-  }  
-  for (int i = 0; i < NUM_SEGMENTS; i++) {
-    digitalWrite(segments[i], HIGH);
+  if (MULTIPLEX_GROUPS > 0) {
+    Multiplex();
+    delay(1);
+    return;
   }
-  //delayMicroseconds(LCD_DISCHARGE_TIME_US);
-
-
-  digitalWrite(backplanes[backplane_active], LOW);
-  delayMicroseconds(LCD_CHARGE_TIME_US);
-  digitalWrite(backplanes[backplane_active], HIGH);
-  delayMicroseconds(LCD_DISCHARGE_TIME_US);
-  digitalWrite(segments[segment_active], LOW);
-  delayMicroseconds(LCD_CHARGE_TIME_US);
-  digitalWrite(segments[segment_active], HIGH);
-  delayMicroseconds(LCD_DISCHARGE_TIME_US);  
-
-  for (int i = 0; i < NUM_BACKPLANES; i++) {
-    digitalWrite(backplanes[i], LOW);
-  }  
-  for (int i = 0; i < NUM_SEGMENTS; i++) {
-    digitalWrite(segments[i], LOW);
-  }
-  //delayMicroseconds(LCD_DISCHARGE_TIME_US);
-
-  digitalWrite(backplanes[backplane_active], HIGH);
-  delayMicroseconds(LCD_CHARGE_TIME_US);
-  digitalWrite(backplanes[backplane_active], LOW);
-  delayMicroseconds(LCD_DISCHARGE_TIME_US);
-  digitalWrite(segments[segment_active], HIGH);
-  delayMicroseconds(LCD_CHARGE_TIME_US);
-  digitalWrite(segments[segment_active], LOW);
-  delayMicroseconds(LCD_DISCHARGE_TIME_US);  
-
-  
+  // Table for the crossing being tested, see segment_tests.h. Takes over
+  // once the one playing comes round.
+  WavePlay(segmentTests[backplane_active][segment_active], SEGMENT_TEST_PHASES);
+  delay(1);
+
   backplane_active = (millis() / 256) % NUM_SEGMENTS;
   segment_active = (millis() / 1024) % NUM_SEGMENTS;
 
@@ -0,0 +1,189 @@
+#include "flicker_lock.h"
+#include "waveform.h" // WAVE_MIN_PHASE_US
+
+#define MIN_PERIOD_US (1000000UL / FLICKER_MAX_HZ)
+#define MAX_PERIOD_US (1000000UL / FLICKER_MIN_HZ)
+
+void FlickerPllInit(struct FlickerPll *pll) {
+  pll->haveSample = false;
+  pll->on = false;
+  pll->haveRise = false;
+  pll->agreeing = 0;
+  pll->locked = false;
+  pll->onUs = 0;
+  pll->misses = 0;
+  pll->errorUs = 0;
+}
+
+// Start of period n counted from from (negative is before it), Q8 rounded
+static uint32_t PeriodsOn(const struct FlickerPll *pll, uint32_t from, int64_t n) {
+  return from + (uint32_t)((n * pll->periodQ8 + 128) >> 8);
+}
+
+static void Acquire(struct FlickerPll *pll, uint32_t us, uint32_t interval) {
+  if (interval < MIN_PERIOD_US || interval > MAX_PERIOD_US) {
+    pll->agreeing = 0;
+    return;
+  }
+  uint32_t diff = interval > pll->candidateUs ? interval - pll->candidateUs : pll->candidateUs - interval;
+  if (pll->agreeing > 0 && diff < pll->candidateUs / 16) {
+    pll->agreeing++;
+    pll->candidateUs = (3 * pll->candidateUs + interval) / 4;
+  } else {
+    pll->candidateUs = interval;
+    pll->agreeing = 1;
+  }
+  if (pll->agreeing >= FLICKER_LOCK_EDGES) {
+    pll->locked = true;
+    pll->edgeUs = us;
+    pll->periodQ8 = pll->candidateUs << 8;
+    pll->misses = 0;
+    pll->errorUs = 0;
+  }
+}
+
+static void Track(struct FlickerPll *pll, uint32_t us) {
+  // Nearest period to where it's meant to be
+  int64_t since = (int64_t)(int32_t)(us - pll->edgeUs) * 256;
+  int64_t half = pll->periodQ8 / 2;
+  int64_t n = (since + (since >= 0 ? half : -half)) / pll->periodQ8;
+  if (n < 1) {
+    // The one it's counting from again, bounce
+    return;
+  }
+  uint32_t predicted = PeriodsOn(pll, pll->edgeUs, n);
+  int32_t error = (int32_t)(us - predicted);
+  uint32_t off = error < 0 ? -error : error;
+  if (off > FlickerPeriodUs(pll) / 8) {
+    if (++pll->misses >= FLICKER_UNLOCK_MISSES) {
+      pll->locked = false;
+      pll->agreeing = 0;
+    }
+    return;
+  }
+  pll->misses = 0;
+  pll->errorUs = error;
+  pll->edgeUs = predicted + error / (1 << FLICKER_PHASE_SHIFT);
+  int64_t periodQ8 = pll->periodQ8 + (int64_t)error * 256 / (n * (1 << FLICKER_PERIOD_SHIFT));
+  if (periodQ8 < (int64_t)MIN_PERIOD_US << 8) {
+    periodQ8 = (int64_t)MIN_PERIOD_US << 8;
+  } else if (periodQ8 > (int64_t)MAX_PERIOD_US << 8) {
+    periodQ8 = (int64_t)MAX_PERIOD_US << 8;
+  }
+  pll->periodQ8 = (uint32_t)periodQ8;
+}
+
+static void Rise(struct FlickerPll *pll, uint32_t us) {
+  if (pll->locked) {
+    Track(pll, us);
+  } else if (pll->haveRise) {
+    Acquire(pll, us, us - pll->riseUs);
+  }
+  pll->riseUs = us;
+  pll->haveRise = true;
+}
+
+static void Fall(struct FlickerPll *pll, uint32_t us) {
+  if (!pll->haveRise) {
+    return;
+  }
+  uint32_t on = us - pll->riseUs;
+  if (on > MAX_PERIOD_US) {
+    return;
+  }
+  pll->onUs = pll->onUs == 0 ? on : pll->onUs + ((int32_t)(on - pll->onUs)) / 8;
+}
+
+void FlickerPllSample(struct FlickerPll *pll, uint32_t us, int32_t level) {
+  int32_t x = level * 256;
+  if (!pll->haveSample) {
+    pll->high = x;
+    pll->low = x;
+    pll->lastUs = us;
+    pll->lastLevel = x;
+    pll->crossUs = us;
+    pll->haveSample = true;
+    return;
+  }
+  int32_t gap = pll->high - pll->low;
+  pll->high = x > pll->high ? x : pll->high - (gap >> FLICKER_DECAY_SHIFT);
+  pll->low = x < pll->low ? x : pll->low + (gap >> FLICKER_DECAY_SHIFT);
+  gap = pll->high - pll->low;
+  int32_t mid = pll->low + gap / 2;
+
+  // Last time it went through the middle, that's the edge once it's
+  // gone far enough past to count
+  if ((pll->lastLevel < mid) != (x < mid) && x != pll->lastLevel) {
+    pll->crossUs =
+        pll->lastUs + (uint32_t)((int64_t)(mid - pll->lastLevel) * (int32_t)(us - pll->lastUs) / (x - pll->lastLevel));
+  }
+  if (gap >= FLICKER_MIN_SWING << 8) {
+    int32_t hysteresis = gap / 8;
+    if (!pll->on && x > mid + hysteresis) {
+      pll->on = true;
+      Rise(pll, pll->crossUs);
+    } else if (pll->on && x < mid - hysteresis) {
+      pll->on = false;
+      Fall(pll, pll->crossUs);
+    }
+  }
+  pll->lastUs = us;
+  pll->lastLevel = x;
+}
+
+uint32_t FlickerWindowUs(const struct FlickerPll *pll, uint32_t us) {
+  uint32_t first = pll->edgeUs - FLICKER_LEAD_US;
+  int64_t since = (int64_t)(int32_t)(us - first) * 256;
+  // Round up, either side of first
+  int64_t n = since <= 0 ? -(-since / pll->periodQ8) : (since + pll->periodQ8 - 1) / pll->periodQ8;
+  return PeriodsOn(pll, first, n);
+}
+
+uint32_t FlickerDarkUs(const struct FlickerPll *pll) {
+  uint32_t period = FlickerPeriodUs(pll);
+  uint32_t dark = pll->onUs + FLICKER_LEAD_US + FLICKER_TAIL_US;
+  return dark + FLICKER_MIN_CLEAR_US > period ? period : dark;
+}
+
+uint8_t FlickerPhases(const struct FlickerPll *pll, uint32_t startUs, struct WavePhase *phases) {
+  uint32_t period = FlickerPeriodUs(pll);
+  uint32_t dark = FlickerDarkUs(pll);
+  if (dark >= period) {
+    // fullBlock at the source's rate, nothing to line up
+    phases[0] = {0, 1, period, 0};
+    phases[1] = {1, 0, period, 0};
+    return 2;
+  }
+  uint32_t clear = period - dark;
+  // Two periods of dark, clear, inverted dark, clear from a window start,
+  // cut to start at startUs and wrapped round. How far into a period that
+  // is, snapped to the nearest phase edge if it'd leave a sliver.
+  uint32_t into = period - (FlickerWindowUs(pll, startUs) - startUs);
+  into = into >= period ? into - period : into;
+  if (into < WAVE_MIN_PHASE_US) {
+    into = 0;
+  } else if (into < dark && dark - into < WAVE_MIN_PHASE_US) {
+    into = dark;
+  } else if (into > dark && into - dark < WAVE_MIN_PHASE_US) {
+    into = dark;
+  } else if (into > period - WAVE_MIN_PHASE_US) {
+    into = 0;
+  }
+  const struct WavePhase base[] = {{0, 1, dark, 0}, {1, 1, clear, 0}, {1, 0, dark, 0}, {0, 0, clear, 0}};
+  const uint8_t count = WAVE_COUNT(base);
+  uint8_t first = into < dark ? 0 : 1;
+  uint32_t skip = into < dark ? into : into - dark;
+  uint8_t n = 0;
+  for (uint8_t i = 0; i <= count; i++) {
+    struct WavePhase p = base[(first + i) % count];
+    if (i == 0) {
+      p.us -= skip;
+    } else if (i == count) {
+      p.us = skip;
+    }
+    if (p.us > 0) {
+      phases[n++] = p;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Locks onto a flickering light (a PWM taillight, an AC street lamp) and
+// builds tables for waveform.h that only go dark while it's on, so the rest
+// of the time the glass stays clear. sixtyHertz and ledBadgeBlink did this
+// for two sources with the timing written in by hand, and only lined up by
+// luck.
+//
+// In: timestamped brightness samples, from a photodiode on the ADC or
+// anything else that says when it was looking (camera rows stamped with
+// their exposure time work the same, gaps are fine). The level between the
+// slowly decaying highs and lows, with some hysteresis, turns them into on
+// and off edges, timed by interpolating between the samples either side.
+//
+// Acquire: FLICKER_LOCK_EDGES on-edge intervals in a row agreeing, in
+// FLICKER_MIN_HZ..FLICKER_MAX_HZ. Then a software PLL: each on edge is
+// compared to where the last estimate says it should be, and the phase and
+// period pulled towards it (proportional and integral). Edges too far off
+// don't count, FLICKER_UNLOCK_MISSES of them in a row and it starts over.
+//
+// Out: two source periods per table, dark for the on time plus
+// FLICKER_LEAD_US before (the LCD takes a while to go dark) and
+// FLICKER_TAIL_US after, the second inverted for 0 DC. Each table is cut to
+// start wherever it's going to, the end of the one playing, so it lines up
+// with the source from its first phase whatever came before. That's the
+// actual phase lock. Played over and over it stays lined up as well as the
+// period in whole us does.
+//
+// Times in micros(), only ever subtracted, so wraparound is ok. Period is
+// Q8 so a few ppm of mismatch don't pile up. See host_tools/flicker_lock_sim.
+
+#include <stdint.h>
+#include "waveform_table.h"
+
+#define FLICKER_MIN_HZ 50
+#define FLICKER_MAX_HZ 1000
+#define FLICKER_LOCK_EDGES 4
+#define FLICKER_UNLOCK_MISSES 8
+#define FLICKER_PHASE_SHIFT 2 // Edge error to phase, 1/4
+#define FLICKER_PERIOD_SHIFT 4 // Edge error to period, 1/16 per period it's been
+#define FLICKER_DECAY_SHIFT 10 // Highs and lows close in 1/1024 of the gap a sample
+#define FLICKER_MIN_SWING 24 // Sample units, less and it's not flickering
+#define FLICKER_LEAD_US 300
+#define FLICKER_TAIL_US 200
+#define FLICKER_MIN_CLEAR_US 500 // Less than this between windows and it's dark throughout
+#define FLICKER_PHASES 5 // Most in a table: dark, clear, dark, clear, one of them cut in two
+
+struct FlickerPll {
+  // Edge detector, levels << 8
+  int32_t high;
+  int32_t low;
+  bool on;
+  bool haveSample;
+  uint32_t lastUs;
+  int32_t lastLevel;
+  uint32_t crossUs; // Last time through the middle
+  uint32_t riseUs; // Last on edge seen
+  bool haveRise;
+
+  // Acquiring
+  uint32_t candidateUs; // Interval between on edges
+  uint8_t agreeing;
+
+  // Locked
+  bool locked;
+  uint32_t edgeUs; // An on edge, where the loop thinks it is
+  uint32_t periodQ8;
+  uint32_t onUs; // Averaged on time
+  uint8_t misses;
+  int32_t errorUs; // Last on edge against the estimate
+};
+
+void FlickerPllInit(struct FlickerPll *pll);
+// level is whatever the sensor gives, brighter is bigger
+void FlickerPllSample(struct FlickerPll *pll, uint32_t us, int32_t level);
+
+static inline uint32_t FlickerPeriodUs(const struct FlickerPll *pll) {
+  return (pll->periodQ8 + 128) >> 8;
+}
+
+// Start of the first dark window at or after us
+uint32_t FlickerWindowUs(const struct FlickerPll *pll, uint32_t us);
+// How long each window is, the whole period if the clear bit between would
+// be too short to bother with
+uint32_t FlickerDarkUs(const struct FlickerPll *pll);
+// Table to start at startUs, one backplane and one segment line, up to
+// FLICKER_PHASES of them. Only while locked.
+uint8_t FlickerPhases(const struct FlickerPll *pll, uint32_t startUs, struct WavePhase *phases);
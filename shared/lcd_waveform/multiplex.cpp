@@ -0,0 +1,36 @@
+#include "multiplex.h"
+
+uint8_t MultiplexPhases(const struct MultiplexLayout *layout, const uint8_t *framebuffer, struct WavePhase *phases) {
+  uint8_t groups = layout->groups;
+  if (groups == 0 || layout->numBackplanes > WAVE_MAX_LINES || layout->numSegments > WAVE_MAX_LINES ||
+      layout->numBackplanes % groups != 0 || layout->numSegments % groups != 0) {
+    return 0;
+  }
+  uint8_t rows = layout->numBackplanes / groups;
+  uint8_t columns = layout->numSegments / groups;
+  if (rows == 0 || rows > MULTIPLEX_MAX_ROWS) {
+    return 0;
+  }
+  uint8_t allBackplanes = (uint8_t)((1 << layout->numBackplanes) - 1);
+  uint8_t n = 0;
+  for (uint8_t inverted = 0; inverted < 2; inverted++) {
+    for (uint8_t slot = 0; slot < rows; slot++) {
+      // Selected rows low and segments high where it's on, then the other
+      // way around the second frame
+      uint8_t selected = 0;
+      uint8_t on = 0;
+      for (uint8_t g = 0; g < groups; g++) {
+        uint8_t row = g * rows + slot;
+        uint8_t groupSegments = (uint8_t)(((1 << columns) - 1) << (g * columns));
+        selected |= 1 << row;
+        on |= framebuffer[row] & groupSegments;
+      }
+      struct WavePhase *p = &phases[n++];
+      p->backplanes = inverted ? selected : 0;
+      p->segments = inverted ? (uint8_t)(~on & ((1 << layout->numSegments) - 1)) : on;
+      p->floating = allBackplanes & ~selected;
+      p->us = layout->slotUs;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Multiplexed drive from a framebuffer, as phases for waveform.h. One
+// backplane per row group is selected at a time, with the segments set for
+// its row. The others are let go and sit at half supply on a resistor
+// divider, so every pixel not on the selected row sees +-half supply whatever
+// it's showing (1/2 bias, the usual way to multiplex off plain GPIOs). That
+// needs two equal resistors on every backplane pin, one to the supply and
+// one to ground, around 100k.
+//
+// Row groups: the backplanes are split into groups, each with its own
+// segment lines, and the groups all scan at once. Rows per group is the
+// multiplex ratio, which is what sets the contrast, and the frame takes
+// rows per group slots instead of all of them. Groups have to be separate
+// on the glass: where a group's backplane crosses another group's segment
+// lines, that crossing sees the other group's data and can go dark. See
+// host_tools/passive_matrix_sim for bigger panels.
+//
+// A superframe is two frames, the second one inverted, so every crossing
+// adds up to 0 DC (WaveBalanced()) whatever's in the framebuffer.
+//
+// Selected row, segment on: full supply across it. Off: 0. Everyone else:
+// half. For a multiplex ratio of n that's
+//   on  = sqrt((1 + (n - 1) / 4) / n), off = sqrt(((n - 1) / 4) / n)
+// of the supply: 1.53x contrast at 4, 2.24x at 2.
+
+#include <stdint.h>
+#include "waveform_table.h"
+
+#define MULTIPLEX_MAX_ROWS (WAVE_MAX_PHASES / 2) // Per group, two frames of them in a table
+
+struct MultiplexLayout {
+  uint8_t numBackplanes; // Rows, WAVE_MAX_LINES at most
+  uint8_t numSegments; // Columns over all groups
+  uint8_t groups; // Group g is backplanes and segments [g * n / groups, (g + 1) * n / groups)
+  uint32_t slotUs; // Each row selected this long, each frame
+};
+
+// Backplane b, segment s on (dark) if bit s of framebuffer[b] is set. Bits
+// for segments in another group than b are ignored, they're not b's to
+// drive. Number of phases, 0 if the layout doesn't split evenly or doesn't
+// fit.
+uint8_t MultiplexPhases(const struct MultiplexLayout *layout, const uint8_t *framebuffer, struct WavePhase *phases);
+
+// Whole frames a second, each showing the whole framebuffer
+static inline uint32_t MultiplexFrameHz(const struct MultiplexLayout *layout) {
+  return 1000000UL * layout->groups / ((uint32_t)layout->numBackplanes * layout->slotUs);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// A group of drive lines (the backplanes, or the segments) on ESP8266 GPIOs,
+// with the GPOS / GPOC masks for any combination of them worked out at
+// compile time from the pin array. Line bits go in, a mask comes out from two
+// nibble lookups, so setting every line in the group is one GPOS and one
+// GPOC write instead of a digitalWrite() per pin, each of which skews that
+// pin's edge by the ones before it.
+//
+// GPIO16 isn't in GPOS / GPOC (it's GP16O), so it's left out of the masks
+// and its line bit kept on the side.
+//
+//   static constexpr uint8_t segmentPins[] = {D5, D6, D7, D8};
+//   static constexpr struct PinGroup segments = PIN_GROUP(segmentPins);
+
+#include <stdint.h>
+
+#define PIN_GROUP_MAX_LINES 8
+#define PIN_GROUP_GPIO16 16
+
+struct PinGroup {
+  uint32_t nibbles[2][16]; // GPIO mask for every value of line bits 0-3, then 4-7
+  uint32_t all; // Every line but GPIO16
+  uint8_t bit16; // Line bit that's GPIO16, 0 if none
+  uint8_t count;
+};
+
+// GPIO mask of the lines set in lines
+static constexpr uint32_t PinLinesMask(const uint8_t *pins, uint8_t count, uint32_t lines) {
+  return count == 0 ? 0
+                    : (((lines >> (count - 1)) & 1) && pins[count - 1] != PIN_GROUP_GPIO16 ? 1UL << pins[count - 1]
+                                                                                           : 0) |
+                          PinLinesMask(pins, count - 1, lines);
+}
+
+static constexpr uint8_t PinLine16(const uint8_t *pins, uint8_t count) {
+  return count == 0 ? 0
+                    : (pins[count - 1] == PIN_GROUP_GPIO16 ? 1 << (count - 1) : 0) | PinLine16(pins, count - 1);
+}
+
+// GPIO mask for a set of line bits, GPIO16 not included
+static inline uint32_t PinGroupMask(const struct PinGroup *g, uint8_t lines) {
+  return g->nibbles[0][lines & 0xF] | g->nibbles[1][lines >> 4];
+}
+
+#define PIN_GROUP_COUNT(pins) ((uint8_t)(sizeof(pins) / sizeof((pins)[0])))
+#define PIN_NIBBLE_(pins, v, shift) PinLinesMask(pins, PIN_GROUP_COUNT(pins), (uint32_t)(v) << (shift))
+#define PIN_NIBBLE(pins, shift)                                                                          \
+  {                                                                                                      \
+    PIN_NIBBLE_(pins, 0x0, shift), PIN_NIBBLE_(pins, 0x1, shift), PIN_NIBBLE_(pins, 0x2, shift),         \
+        PIN_NIBBLE_(pins, 0x3, shift), PIN_NIBBLE_(pins, 0x4, shift), PIN_NIBBLE_(pins, 0x5, shift),     \
+        PIN_NIBBLE_(pins, 0x6, shift), PIN_NIBBLE_(pins, 0x7, shift), PIN_NIBBLE_(pins, 0x8, shift),     \
+        PIN_NIBBLE_(pins, 0x9, shift), PIN_NIBBLE_(pins, 0xA, shift), PIN_NIBBLE_(pins, 0xB, shift),     \
+        PIN_NIBBLE_(pins, 0xC, shift), PIN_NIBBLE_(pins, 0xD, shift), PIN_NIBBLE_(pins, 0xE, shift),     \
+        PIN_NIBBLE_(pins, 0xF, shift)                                                                    \
+  }
+// pins has to be constexpr, PIN_GROUP_MAX_LINES of them at most
+#define PIN_GROUP(pins)                                                                                   \
+  {                                                                                                       \
+    {PIN_NIBBLE(pins, 0), PIN_NIBBLE(pins, 4)}, PinLinesMask(pins, PIN_GROUP_COUNT(pins), 0xFF),          \
+        PinLine16(pins, PIN_GROUP_COUNT(pins)), PIN_GROUP_COUNT(pins)                                     \
+  }
@@ -0,0 +1,291 @@
+#include <Arduino.h>
+#include "waveform.h"
+
+#define TICKS_PER_US 5 // Timer1 at TIM_DIV16 off the 80 MHz APB clock
+#define MIN_TICKS 10 // Interrupt can't come any sooner than about this
+#define MAX_PERIOD_ERROR 65535 // Cycles, so the square stays 32 bit in the interrupt
+
+// A phase as the interrupt wants it: what to write, and for how long
+struct Edge {
+  uint32_t set;
+  uint32_t clear;
+  uint32_t cycles;
+  uint32_t drive; // GPES, output enabled
+  uint32_t release; // GPEC, floating backplanes
+  uint32_t gpio16; // GP16O, it's not in GPOS / GPOC
+  uint32_t gpio16Drive; // GP16E
+};
+
+// Played one, and the next one waiting for it to come round to the start
+static struct Edge tables[2][WAVE_MAX_PHASES];
+static uint8_t counts[2];
+static volatile uint8_t active = 0;
+static volatile bool pending = false;
+static volatile bool playing = false;
+static uint8_t phase = 0;
+static uint32_t nextEdge = 0; // Cycle count
+static uint32_t cycleStart = 0; // Cycle count the table playing last came round to phase 0
+
+static const struct PinGroup *backplanes = NULL;
+static const struct PinGroup *segments = NULL;
+static uint32_t allMask = 0;
+static bool useGpio16 = false;
+static uint32_t cyclesPerTick = 0;
+static uint32_t leadCycles = 0;
+static uint32_t spinCycles = 0;
+
+// What WavePlay() was last handed, to skip the same again
+static struct WavePhase last[WAVE_MAX_PHASES];
+static uint8_t lastCount = 0;
+
+// Sums in cycles, turned into WaveStats when taken
+struct Sums {
+  uint32_t edges;
+  uint64_t late;
+  uint32_t maxLate;
+  uint32_t periods;
+  uint64_t periodSquared;
+  uint32_t periodMax;
+  uint32_t overruns;
+  uint32_t prevLate;
+  bool havePrev; // Not after a start or an overrun, the last edge wasn't on schedule
+};
+static struct Sums sums;
+
+static inline void IRAM_ATTR Record(struct Sums *s, uint32_t late) {
+  s->edges++;
+  s->late += late;
+  if (late > s->maxLate) {
+    s->maxLate = late;
+  }
+  if (s->havePrev) {
+    uint32_t error = late > s->prevLate ? late - s->prevLate : s->prevLate - late;
+    if (error > MAX_PERIOD_ERROR) {
+      error = MAX_PERIOD_ERROR;
+    }
+    s->periods++;
+    s->periodSquared += error * error;
+    if (error > s->periodMax) {
+      s->periodMax = error;
+    }
+  }
+  s->prevLate = late;
+  s->havePrev = true;
+}
+
+static void IRAM_ATTR WaveIsr() {
+  for (uint8_t spins = 1;; spins++) {
+    // Came in early on purpose, wait out the rest
+    uint32_t now;
+    do {
+      now = ESP.getCycleCount();
+    } while ((int32_t)(nextEdge - now) > 0);
+    const struct Edge *e = &tables[active][phase];
+    GPOS = e->set;
+    GPOC = e->clear;
+    GPES = e->drive;
+    GPEC = e->release;
+    if (useGpio16) {
+      GP16O = e->gpio16;
+      GP16E = e->gpio16Drive;
+    }
+    Record(&sums, now - nextEdge);
+    if (phase == 0) {
+      cycleStart = nextEdge;
+    }
+
+    nextEdge += e->cycles;
+    if (++phase >= counts[active]) {
+      phase = 0;
+      if (pending) {
+        active ^= 1;
+        pending = false;
+      }
+    }
+    int32_t wait = (int32_t)(nextEdge - ESP.getCycleCount());
+    if (wait < 0) {
+      // Something held interrupts off for a whole phase, start over from here
+      sums.overruns++;
+      sums.havePrev = false;
+      wait = leadCycles + MIN_TICKS * cyclesPerTick;
+      nextEdge = ESP.getCycleCount() + wait;
+    }
+    if ((uint32_t)wait > spinCycles || spins >= WAVE_MAX_SPIN_EDGES) {
+      uint32_t ticks = (uint32_t)wait > leadCycles ? ((uint32_t)wait - leadCycles) / cyclesPerTick : 0;
+      timer1_write(ticks < MIN_TICKS ? MIN_TICKS : ticks);
+      return;
+    }
+  }
+}
+
+static void Outputs(const struct PinGroup *g) {
+  for (uint8_t pin = 0; pin < PIN_GROUP_GPIO16; pin++) {
+    if (g->all & (1UL << pin)) {
+      pinMode(pin, OUTPUT);
+    }
+  }
+  if (g->bit16) {
+    pinMode(PIN_GROUP_GPIO16, OUTPUT);
+    useGpio16 = true;
+  }
+}
+
+void WaveBegin(const struct PinGroup *backplaneLines, const struct PinGroup *segmentLines) {
+  backplanes = backplaneLines;
+  segments = segmentLines;
+  Outputs(backplanes);
+  Outputs(segments);
+  allMask = backplanes->all | segments->all;
+  GPOC = allMask;
+  if (useGpio16) {
+    GP16O = 0;
+  }
+  cyclesPerTick = clockCyclesPerMicrosecond() / TICKS_PER_US;
+  leadCycles = microsecondsToClockCycles(WAVE_LEAD_US);
+  spinCycles = microsecondsToClockCycles(WAVE_SPIN_US);
+  timer1_isr_init();
+  memset(&sums, 0, sizeof(sums));
+}
+
+static void Fill(struct Edge *edges, const struct WavePhase *phases, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t set = PinGroupMask(backplanes, phases[i].backplanes) | PinGroupMask(segments, phases[i].segments);
+    uint32_t release = PinGroupMask(backplanes, phases[i].floating);
+    edges[i].set = set;
+    edges[i].clear = allMask & ~set;
+    edges[i].drive = allMask & ~release;
+    edges[i].release = release;
+    edges[i].gpio16 = (phases[i].backplanes & backplanes->bit16) || (phases[i].segments & segments->bit16);
+    edges[i].gpio16Drive = !(phases[i].floating & backplanes->bit16);
+    edges[i].cycles = microsecondsToClockCycles(phases[i].us < WAVE_MIN_PHASE_US ? WAVE_MIN_PHASE_US : phases[i].us);
+  }
+}
+
+// Field by field, the padding in tables built on the stack is whatever
+static bool Same(const struct WavePhase *phases, uint8_t count) {
+  if (count != lastCount) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (phases[i].backplanes != last[i].backplanes || phases[i].segments != last[i].segments ||
+        phases[i].us != last[i].us || phases[i].floating != last[i].floating) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WavePlay(const struct WavePhase *phases, uint8_t count) {
+  if (count == 0 || count > WAVE_MAX_PHASES) {
+    return false;
+  }
+  if (playing && Same(phases, count)) {
+    return true;
+  }
+  if (backplanes == NULL || !WaveBalanced(phases, count, backplanes->count, segments->count)) {
+    return false;
+  }
+  if (!playing) {
+    Fill(tables[active], phases, count);
+    counts[active] = count;
+    phase = 0;
+    sums.havePrev = false;
+    playing = true;
+    // Everything the interrupt reads is set before it can fire
+    nextEdge = ESP.getCycleCount() + leadCycles + MIN_TICKS * cyclesPerTick;
+    cycleStart = nextEdge;
+    __asm__ __volatile__("" ::: "memory");
+    timer1_attachInterrupt(WaveIsr);
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+    timer1_write(MIN_TICKS);
+  } else {
+    // The interrupt only swaps once pending is set, so the spare table and
+    // active are ours until then
+    if (pending) {
+      return false;
+    }
+    uint8_t spare = active ^ 1;
+    Fill(tables[spare], phases, count);
+    counts[spare] = count;
+    __asm__ __volatile__("" ::: "memory");
+    pending = true;
+  }
+  memcpy(last, phases, count * sizeof(phases[0]));
+  lastCount = count;
+  return true;
+}
+
+void WaveStop() {
+  if (playing) {
+    timer1_disable();
+    timer1_detachInterrupt();
+    playing = false;
+    pending = false;
+    lastCount = 0;
+  }
+  GPOC = allMask;
+  GPES = allMask;
+  if (useGpio16) {
+    GP16O = 0;
+    GP16E = 1;
+  }
+}
+
+bool WavePlaying() {
+  return playing;
+}
+
+bool WaveCycleStartUs(uint32_t *us) {
+  noInterrupts();
+  bool ok = playing && !pending;
+  uint32_t start = cycleStart;
+  uint32_t nowCycles = ESP.getCycleCount();
+  uint32_t nowUs = micros();
+  interrupts();
+  // Can be a bit ahead, just after WavePlay() started it
+  *us = nowUs - (int32_t)(nowCycles - start) / (int32_t)clockCyclesPerMicrosecond();
+  return ok;
+}
+
+static void ToStats(const struct Sums *s, struct WaveStats *stats) {
+  uint32_t cyclesPerUs = clockCyclesPerMicrosecond();
+  stats->edges = s->edges;
+  stats->meanLateNs = s->edges ? (uint32_t)(s->late * 1000 / s->edges / cyclesPerUs) : 0;
+  stats->maxLateNs = (uint32_t)((uint64_t)s->maxLate * 1000 / cyclesPerUs);
+  stats->periodRmsNs = s->periods ? (uint32_t)(sqrt((double)s->periodSquared / s->periods) * 1000 / cyclesPerUs) : 0;
+  stats->periodMaxNs = s->periodMax * 1000 / cyclesPerUs;
+  stats->overruns = s->overruns;
+}
+
+void WaveTakeStats(struct WaveStats *stats) {
+  noInterrupts();
+  struct Sums s = sums;
+  memset(&sums, 0, sizeof(sums));
+  sums.prevLate = s.prevLate;
+  sums.havePrev = s.havePrev;
+  interrupts();
+  ToStats(&s, stats);
+}
+
+void WaveBusyWaitStats(uint8_t backplanePin, uint8_t segmentPin, uint32_t halfPeriodUs, uint32_t count,
+                       struct WaveStats *stats) {
+  // Same as FullBlock() was, lateness against a schedule started at the
+  // first edge, so drift shows up there and wobble in the period error
+  struct Sums s;
+  memset(&s, 0, sizeof(s));
+  uint32_t halfCycles = microsecondsToClockCycles(halfPeriodUs);
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    digitalWrite(backplanePin, i & 1 ? HIGH : LOW);
+    digitalWrite(segmentPin, i & 1 ? LOW : HIGH);
+    uint32_t now = ESP.getCycleCount();
+    if (i == 0) {
+      start = now;
+    }
+    Record(&s, now - start - i * halfCycles);
+    delayMicroseconds(halfPeriodUs);
+  }
+  digitalWrite(backplanePin, LOW);
+  digitalWrite(segmentPin, LOW);
+  ToStats(&s, stats);
+}
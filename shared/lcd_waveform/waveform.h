@@ -0,0 +1,63 @@
+#pragma once
+
+// Plays the backplane / segment waveform from timer1 instead of
+// digitalWrite + delayMicroseconds in loop(). A waveform is a table of
+// phases (see waveform_table.h) played over and over, so loop() only has to
+// hand over a new table when something changes and can sit in delay() the
+// rest of the time. ESP8266 only.
+//
+// Timer1 ticks are 0.2 us, but interrupt entry wobbles by a few us, so it
+// fires WAVE_LEAD_US early and spins on the cycle counter to the exact edge.
+// Edges are scheduled off the previous edge's ideal time, not when the
+// interrupt got to it, so nothing drifts. Phases shorter than WAVE_SPIN_US
+// are played inside the one interrupt. All the lines change together, one
+// GPOS and one GPOC write (plus GP16O if GPIO16 is one of them), and
+// floating backplanes get their output turned off through GPEC.
+//
+// Takes timer1 for itself, which is also what the core's analogWrite(),
+// tone() and Servo use on the ESP8266.
+
+#include <stdint.h>
+#include "waveform_table.h"
+#include "pin_group.h"
+
+#define WAVE_MIN_PHASE_US 2
+#define WAVE_LEAD_US 5 // Interrupt this early, then spin
+#define WAVE_SPIN_US 12 // Next edge this close, stay in the interrupt for it
+#define WAVE_MAX_SPIN_EDGES 8 // Give the rest of the chip a look in at least this often
+
+// How close to schedule the edges landed, see WaveTakeStats()
+struct WaveStats {
+  uint32_t edges;
+  uint32_t meanLateNs; // Pin write after the ideal edge time
+  uint32_t maxLateNs;
+  uint32_t periodRmsNs; // Each edge to the next vs what the table says, same as WaveBusyWaitStats()
+  uint32_t periodMaxNs;
+  uint32_t overruns; // Fell a whole phase behind and started over from now
+};
+
+// Bit n of a phase's backplanes is the group's nth pin (see pin_group.h).
+// Up to WAVE_MAX_LINES of each, kept, so they have to stay around.
+void WaveBegin(const struct PinGroup *backplaneLines, const struct PinGroup *segmentLines);
+// Starts playing this right away if stopped, else from the end of the table
+// playing now so a period never gets cut short. Copied, so phases can be
+// reused straight away. False if the last one handed over hasn't started
+// yet, try again next loop(). Same table as last time is a no-op. Won't
+// take one with DC on any crossing (WaveBalanced()), false for good then.
+bool WavePlay(const struct WavePhase *phases, uint8_t count);
+// Both pins low, timer off
+void WaveStop();
+bool WavePlaying();
+// micros() at the first edge of the table playing, the last time it came
+// round. So a table handed over now starts at this plus its period, unless
+// it comes round again before WavePlay() gets in. False if stopped, or if
+// one handed over is still waiting and the table playing isn't the last one
+// given.
+bool WaveCycleStartUs(uint32_t *us);
+// Since the last call
+void WaveTakeStats(struct WaveStats *stats);
+
+// For comparison: the old busy wait (digitalWrite + delayMicroseconds),
+// square wave of halfPeriodUs for count edges, timed the same way
+void WaveBusyWaitStats(uint8_t backplanePin, uint8_t segmentPin, uint32_t halfPeriodUs, uint32_t count,
+                       struct WaveStats *stats);
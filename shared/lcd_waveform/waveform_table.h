@@ -0,0 +1,79 @@
+#pragma once
+
+// LCD drive waveforms as tables of phases: which backplane and segment lines
+// are high, for how long. Played over and over by waveform.h, which doesn't
+// care what's in them.
+//
+// A pixel is a backplane x segment crossing, and sees segment - backplane.
+// Any DC left over in that over a period plates the liquid crystal and ghosts
+// (the "write inverted to add up to 0 DC" the sketches used to do by hand), so
+// it has to come to exactly zero for every crossing. That and the period are
+// worked out at compile time by WAVE_CHECK() for tables that are constexpr,
+// and the same functions run on tables built at run time (WavePlay() won't
+// take one that isn't balanced).
+//
+// Lines are high or low, and backplanes can also be let go (floating), for
+// multiplexing: a resistor divider on the pin holds it at half supply then
+// (1/2 bias, see multiplex.h). So levels are in half supplies, times in us,
+// DC is in half-supply-us and the balance check is exact.
+// host_tools/waveform_rms turns them into volts.
+//
+// C++11 constexpr, so it's all one-return recursion.
+
+#include <stdint.h>
+
+#define WAVE_MAX_LINES 8 // Of each, a bit per line
+#define WAVE_MAX_PHASES 40 // In a table
+
+struct WavePhase {
+  uint8_t backplanes; // Bit per backplane line, high. Anything not set is low.
+  uint8_t segments; // Same for the segment lines
+  uint32_t us;
+  uint8_t floating; // Backplane lines let go instead, at half supply. 0 for none.
+};
+
+// Half supplies across one crossing, -2..2
+static constexpr int32_t WaveLevel(const struct WavePhase &p, uint8_t backplane, uint8_t segment) {
+  return 2 * (int32_t)((p.segments >> segment) & 1) -
+         (((p.floating >> backplane) & 1) ? 1 : 2 * (int32_t)((p.backplanes >> backplane) & 1));
+}
+
+// Net half-supply-us across one crossing over the whole table, 0 is balanced
+static constexpr int64_t WaveDc(const struct WavePhase *phases, uint8_t count, uint8_t backplane, uint8_t segment) {
+  return count == 0 ? 0
+                    : (int64_t)WaveLevel(phases[count - 1], backplane, segment) * phases[count - 1].us +
+                          WaveDc(phases, count - 1, backplane, segment);
+}
+
+// Same squared, for RMS
+static constexpr int64_t WaveSquared(const struct WavePhase *phases, uint8_t count, uint8_t backplane,
+                                     uint8_t segment) {
+  return count == 0 ? 0
+                    : (int64_t)WaveLevel(phases[count - 1], backplane, segment) *
+                              WaveLevel(phases[count - 1], backplane, segment) * phases[count - 1].us +
+                          WaveSquared(phases, count - 1, backplane, segment);
+}
+
+static constexpr uint32_t WavePeriodUs(const struct WavePhase *phases, uint8_t count) {
+  return count == 0 ? 0 : phases[count - 1].us + WavePeriodUs(phases, count - 1);
+}
+
+static constexpr bool WaveSegmentsBalanced(const struct WavePhase *phases, uint8_t count, uint8_t backplane,
+                                           uint8_t numSegments) {
+  return numSegments == 0 || (WaveDc(phases, count, backplane, numSegments - 1) == 0 &&
+                              WaveSegmentsBalanced(phases, count, backplane, numSegments - 1));
+}
+
+// Every crossing of the first numBackplanes x numSegments lines
+static constexpr bool WaveBalanced(const struct WavePhase *phases, uint8_t count, uint8_t numBackplanes,
+                                   uint8_t numSegments) {
+  return numBackplanes == 0 || (WaveSegmentsBalanced(phases, count, numBackplanes - 1, numSegments) &&
+                                WaveBalanced(phases, count, numBackplanes - 1, numSegments));
+}
+
+#define WAVE_COUNT(table) ((uint8_t)(sizeof(table) / sizeof((table)[0])))
+
+// At namespace scope, after a constexpr table
+#define WAVE_CHECK(table, numBackplanes, numSegments, periodUs)                                       \
+  static_assert(WaveBalanced(table, WAVE_COUNT(table), numBackplanes, numSegments), #table " has DC"); \
+  static_assert(WavePeriodUs(table, WAVE_COUNT(table)) == (periodUs), #table " period is off")
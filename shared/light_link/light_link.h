@@ -0,0 +1,304 @@
+#pragma once
+
+// Camera -> LCD serial link. Shared by both boards (and host tools) so the
+// sender and receiver can't drift apart.
+//
+// Plain ASCII so it's still readable in a serial monitor:
+//   "010 020 \n"  = light at camera pixel x=10, y=20
+//   "010 020 003 250 \n" = same, with radius 3 and brightness 250 (0-255)
+//   "010 020 009 250 003 032 \n" = ellipse, semi-axes 9 and 3, major axis
+//                                  32/256 of a half turn from +x towards +y
+//   "010 020 010 250 496 500 508 497 505 508 \n" = convex polygon, vertex
+//                                  offsets from x, y + 500 (here (-4,0) (8,-3) (5,8))
+//   "\n"          = end of frame (all lights for this camera frame were sent)
+//   "@0001e240\n" = end of frame, captured at camera micros() 0x1e240
+// Clock sync, see time_sync.h (LCD asks, camera answers, times in hex micros):
+//   "?t1\n"       = LCD -> camera request
+//   "!t1t2t3\n"   = camera -> LCD reply
+// Anything else is garbage (boot messages, line noise) and gets dropped at
+// the next newline.
+
+#include <stdint.h>
+
+#define LIGHT_LINK_BAUD 921600
+// "000 000 " + '\n'
+#define LIGHT_LINK_LINE_CHARS 8
+#define LIGHT_LINK_LINE_BYTES (LIGHT_LINK_LINE_CHARS + 1)
+// "000 000 000 000 " + '\n'
+#define LIGHT_LINK_FULL_LINE_CHARS 16
+#define LIGHT_LINK_FULL_LINE_BYTES (LIGHT_LINK_FULL_LINE_CHARS + 1)
+// Full line + "000 000 "
+#define LIGHT_LINK_ELLIPSE_LINE_CHARS 24
+#define LIGHT_LINK_ELLIPSE_LINE_BYTES (LIGHT_LINK_ELLIPSE_LINE_CHARS + 1)
+// Full line + "000 000 " per vertex
+#define LIGHT_LINK_MIN_VERTICES 3
+#define LIGHT_LINK_MAX_VERTICES 6
+#define LIGHT_LINK_VERTEX_BIAS 500
+#define LIGHT_LINK_POLYGON_LINE_CHARS(n) (LIGHT_LINK_FULL_LINE_CHARS + 8 * (n))
+#define LIGHT_LINK_HEX_CHARS 8
+#define LIGHT_LINK_SYNC_REPLY_CHARS (1 + 3 * LIGHT_LINK_HEX_CHARS)
+#define LIGHT_LINK_SYNC_REPLY_BYTES (LIGHT_LINK_SYNC_REPLY_CHARS + 1)
+// Longest line is the biggest polygon
+#define LIGHT_LINK_MAX_LINE_CHARS LIGHT_LINK_POLYGON_LINE_CHARS(LIGHT_LINK_MAX_VERTICES)
+#define LIGHT_LINK_MAX_LINE_BYTES (LIGHT_LINK_MAX_LINE_CHARS + 1)
+
+#define LIGHT_LINK_DISC 0
+#define LIGHT_LINK_ELLIPSE 1
+#define LIGHT_LINK_POLYGON 2
+
+enum LightLinkEvent {
+  LINK_NONE = 0,     // Still in the middle of a line
+  LINK_LIGHT,        // x, y filled in, radius/brightness too if sent (else 0), shape if sent
+  LINK_FRAME_END,    // Empty or timestamped line, t[0] = capture time if hasTime
+  LINK_SYNC_REQUEST, // t[0] = t1
+  LINK_SYNC_REPLY,   // t[0..2] = t1, t2, t3
+  LINK_BAD_LINE,     // Line didn't match, thrown away
+};
+
+struct LightLinkMessage {
+  uint16_t x;
+  uint16_t y;
+  uint16_t radius;
+  uint16_t brightness;
+  uint8_t shape;        // LIGHT_LINK_DISC if it didn't say
+  uint16_t minor;       // LIGHT_LINK_ELLIPSE, radius is the semi-major axis
+  uint16_t angle;
+  uint8_t numVertices;  // LIGHT_LINK_POLYGON
+  int16_t vx[LIGHT_LINK_MAX_VERTICES];
+  int16_t vy[LIGHT_LINK_MAX_VERTICES];
+  bool hasTime;
+  uint32_t t[3];
+};
+
+struct LightLinkParser {
+  char line[LIGHT_LINK_MAX_LINE_CHARS];
+  uint8_t index;
+  bool overflow; // Line got too long, ignore until the next newline
+  uint32_t goodLines;
+  uint32_t badLines;
+};
+
+static inline void LightLinkReset(LightLinkParser *p) {
+  p->index = 0;
+  p->overflow = false;
+}
+
+static inline void LightLinkInit(LightLinkParser *p) {
+  LightLinkReset(p);
+  p->goodLines = 0;
+  p->badLines = 0;
+}
+
+// Time for a line to go over the wire (8N1), for stamping sync messages
+static inline uint32_t LightLinkWireUs(uint16_t bytes) {
+  return ((uint32_t)bytes * 10 * 1000000 + LIGHT_LINK_BAUD / 2) / LIGHT_LINK_BAUD;
+}
+
+static inline void LightLinkFormatHex(char *buf, uint32_t v) {
+  static const char digits[] = "0123456789abcdef";
+  for (int8_t i = LIGHT_LINK_HEX_CHARS - 1; i >= 0; i--) {
+    buf[i] = digits[v & 0xF];
+    v >>= 4;
+  }
+}
+
+static inline bool LightLinkParseHex(const char *buf, uint32_t *v) {
+  uint32_t r = 0;
+  for (uint8_t i = 0; i < LIGHT_LINK_HEX_CHARS; i++) {
+    char c = buf[i];
+    r <<= 4;
+    if (c >= '0' && c <= '9') {
+      r |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      r |= c - 'a' + 10;
+    } else {
+      return false;
+    }
+  }
+  *v = r;
+  return true;
+}
+
+// "000 ". Values above 999 are clamped, the format only has room for 3 digits.
+static inline void LightLinkFormatField(char *buf, uint16_t v) {
+  if (v > 999) v = 999;
+  buf[0] = '0' + v / 100;
+  buf[1] = '0' + (v / 10) % 10;
+  buf[2] = '0' + v % 10;
+  buf[3] = ' ';
+}
+
+// Returns the number of bytes written to buf (always LIGHT_LINK_LINE_BYTES).
+static inline uint8_t LightLinkFormatLight(char *buf, uint16_t x, uint16_t y) {
+  LightLinkFormatField(&buf[0], x);
+  LightLinkFormatField(&buf[4], y);
+  buf[8] = '\n';
+  return LIGHT_LINK_LINE_BYTES;
+}
+
+// Returns the number of bytes written to buf (always LIGHT_LINK_FULL_LINE_BYTES).
+static inline uint8_t LightLinkFormatFullLight(char *buf, uint16_t x, uint16_t y, uint16_t radius, uint16_t brightness) {
+  LightLinkFormatField(&buf[0], x);
+  LightLinkFormatField(&buf[4], y);
+  LightLinkFormatField(&buf[8], radius);
+  LightLinkFormatField(&buf[12], brightness);
+  buf[16] = '\n';
+  return LIGHT_LINK_FULL_LINE_BYTES;
+}
+
+// angle is 0-255 for a half turn. Returns LIGHT_LINK_ELLIPSE_LINE_BYTES.
+static inline uint8_t LightLinkFormatEllipse(char *buf, uint16_t x, uint16_t y, uint16_t major, uint16_t minor,
+                                             uint16_t angle, uint16_t brightness) {
+  LightLinkFormatFullLight(buf, x, y, major, brightness);
+  LightLinkFormatField(&buf[16], minor);
+  LightLinkFormatField(&buf[20], angle);
+  buf[24] = '\n';
+  return LIGHT_LINK_ELLIPSE_LINE_BYTES;
+}
+
+// Vertex offsets from (x, y), -500..499. radius should cover them all.
+// Returns the number of bytes written to buf.
+static inline uint8_t LightLinkFormatPolygon(char *buf, uint16_t x, uint16_t y, uint16_t radius, uint16_t brightness,
+                                             const int16_t *vx, const int16_t *vy, uint8_t numVertices) {
+  LightLinkFormatFullLight(buf, x, y, radius, brightness);
+  for (uint8_t i = 0; i < numVertices; i++) {
+    LightLinkFormatField(&buf[16 + i * 8], (uint16_t)(vx[i] + LIGHT_LINK_VERTEX_BIAS));
+    LightLinkFormatField(&buf[20 + i * 8], (uint16_t)(vy[i] + LIGHT_LINK_VERTEX_BIAS));
+  }
+  buf[LIGHT_LINK_POLYGON_LINE_CHARS(numVertices)] = '\n';
+  return LIGHT_LINK_POLYGON_LINE_CHARS(numVertices) + 1;
+}
+
+static inline uint8_t LightLinkFormatFrameEnd(char *buf) {
+  buf[0] = '\n';
+  return 1;
+}
+
+static inline uint8_t LightLinkFormatTimedFrameEnd(char *buf, uint32_t captureUs) {
+  buf[0] = '@';
+  LightLinkFormatHex(&buf[1], captureUs);
+  buf[1 + LIGHT_LINK_HEX_CHARS] = '\n';
+  return 2 + LIGHT_LINK_HEX_CHARS;
+}
+
+static inline uint8_t LightLinkFormatSyncRequest(char *buf, uint32_t t1) {
+  buf[0] = '?';
+  LightLinkFormatHex(&buf[1], t1);
+  buf[1 + LIGHT_LINK_HEX_CHARS] = '\n';
+  return 2 + LIGHT_LINK_HEX_CHARS;
+}
+
+static inline uint8_t LightLinkFormatSyncReply(char *buf, uint32_t t1, uint32_t t2, uint32_t t3) {
+  buf[0] = '!';
+  LightLinkFormatHex(&buf[1], t1);
+  LightLinkFormatHex(&buf[1 + LIGHT_LINK_HEX_CHARS], t2);
+  LightLinkFormatHex(&buf[1 + 2 * LIGHT_LINK_HEX_CHARS], t3);
+  buf[1 + 3 * LIGHT_LINK_HEX_CHARS] = '\n';
+  return LIGHT_LINK_SYNC_REPLY_BYTES;
+}
+
+static inline bool LightLinkParseField(const char *s, uint16_t *v) {
+  if (s[3] != ' ') {
+    return false;
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    if (s[i] < '0' || s[i] > '9') {
+      return false;
+    }
+  }
+  *v = (s[0] - '0') * 100 + (s[1] - '0') * 10 + (s[2] - '0');
+  return true;
+}
+
+static inline bool LightLinkParseLight(const char *s, uint8_t length, LightLinkMessage *m) {
+  m->radius = 0;
+  m->brightness = 0;
+  m->shape = LIGHT_LINK_DISC;
+  m->numVertices = 0;
+  if (length == LIGHT_LINK_LINE_CHARS) {
+    return LightLinkParseField(&s[0], &m->x) && LightLinkParseField(&s[4], &m->y);
+  }
+  if (length < LIGHT_LINK_FULL_LINE_CHARS || (length - LIGHT_LINK_FULL_LINE_CHARS) % 8 != 0 ||
+      !LightLinkParseField(&s[0], &m->x) || !LightLinkParseField(&s[4], &m->y) ||
+      !LightLinkParseField(&s[8], &m->radius) || !LightLinkParseField(&s[12], &m->brightness)) {
+    return false;
+  }
+  if (length == LIGHT_LINK_FULL_LINE_CHARS) {
+    return true;
+  }
+  if (length == LIGHT_LINK_ELLIPSE_LINE_CHARS) {
+    m->shape = LIGHT_LINK_ELLIPSE;
+    return LightLinkParseField(&s[16], &m->minor) && LightLinkParseField(&s[20], &m->angle);
+  }
+  uint8_t n = (length - LIGHT_LINK_FULL_LINE_CHARS) / 8;
+  if (n < LIGHT_LINK_MIN_VERTICES || n > LIGHT_LINK_MAX_VERTICES) {
+    return false;
+  }
+  m->shape = LIGHT_LINK_POLYGON;
+  for (uint8_t i = 0; i < n; i++) {
+    uint16_t vx, vy;
+    if (!LightLinkParseField(&s[16 + i * 8], &vx) || !LightLinkParseField(&s[20 + i * 8], &vy)) {
+      return false;
+    }
+    m->vx[i] = (int16_t)vx - LIGHT_LINK_VERTEX_BIAS;
+    m->vy[i] = (int16_t)vy - LIGHT_LINK_VERTEX_BIAS;
+  }
+  m->numVertices = n;
+  return true;
+}
+
+// Tagged line: one tag char followed by numTimes hex timestamps
+static inline bool LightLinkParseTimes(const char *s, uint8_t length, uint8_t numTimes, LightLinkMessage *m) {
+  if (length != 1 + numTimes * LIGHT_LINK_HEX_CHARS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < numTimes; i++) {
+    if (!LightLinkParseHex(&s[1 + i * LIGHT_LINK_HEX_CHARS], &m->t[i])) {
+      return false;
+    }
+  }
+  m->hasTime = true;
+  return true;
+}
+
+// Feed one received byte. Doesn't block and doesn't need to see the whole
+// line at once, so it works with whatever Serial.available() hands us.
+static inline LightLinkEvent LightLinkFeed(LightLinkParser *p, char c, LightLinkMessage *m) {
+  if (c != '\n') {
+    if (p->index >= LIGHT_LINK_MAX_LINE_CHARS) {
+      // Probably garbage when first plugging in
+      p->overflow = true;
+    } else {
+      p->line[p->index++] = c;
+    }
+    return LINK_NONE;
+  }
+
+  const char *s = p->line;
+  uint8_t length = p->index;
+  bool overflow = p->overflow;
+  LightLinkEvent e = LINK_BAD_LINE;
+  LightLinkReset(p);
+  m->hasTime = false;
+
+  if (overflow) {
+    e = LINK_BAD_LINE;
+  } else if (length == 0) {
+    e = LINK_FRAME_END;
+  } else if (s[0] == '@') {
+    e = LightLinkParseTimes(s, length, 1, m) ? LINK_FRAME_END : LINK_BAD_LINE;
+  } else if (s[0] == '?') {
+    e = LightLinkParseTimes(s, length, 1, m) ? LINK_SYNC_REQUEST : LINK_BAD_LINE;
+  } else if (s[0] == '!') {
+    e = LightLinkParseTimes(s, length, 3, m) ? LINK_SYNC_REPLY : LINK_BAD_LINE;
+  } else {
+    e = LightLinkParseLight(s, length, m) ? LINK_LIGHT : LINK_BAD_LINE;
+  }
+
+  if (e == LINK_BAD_LINE) {
+    p->badLines++;
+  } else if (e != LINK_FRAME_END || length != 0) {
+    p->goodLines++;
+  }
+  return e;
+}
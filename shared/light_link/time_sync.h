@@ -0,0 +1,174 @@
+#pragma once
+
+// NTP-style clock sync between the camera and LCD boards over the light link.
+//
+// The LCD sends "?t1", the camera stamps t2 when it sees the request and t3
+// when it answers, the LCD stamps t4 when the answer comes back:
+//   offset = ((t2 - t1) + (t3 - t4)) / 2   (camera clock - LCD clock)
+//   rtt    = (t4 - t1) - (t3 - t2)
+// Either loop can be late reading the UART (the LCD is blind while drawing),
+// which only ever makes rtt bigger and skews the offset by up to rtt/2. So
+// like NTP's clock filter, only the smallest-rtt sample out of each window is
+// kept.
+//
+// Crystals drift apart by tens of ppm (a few us per 100ms), which is about
+// the same size as the per-sample noise over a second or two. So drift comes
+// from a line fit through the last TIME_SYNC_HISTORY filtered samples
+// (~30 s), weighted towards small rtt. Only runs once per window, so the
+// double math doesn't matter.
+//
+// All times are 32-bit micros() and only ever subtracted, so wraparound is ok.
+
+#include <stdint.h>
+#include <math.h>
+
+#define TIME_SYNC_WINDOW 8
+#define TIME_SYNC_HISTORY 16
+// Don't let a near-zero rtt sample take all the weight
+#define TIME_SYNC_MIN_RTT_US 20
+
+struct TimeSyncSample {
+  uint32_t localUs;
+  int32_t offsetUs;
+  uint32_t rttUs;
+};
+
+struct TimeSync {
+  TimeSyncSample window[TIME_SYNC_WINDOW];
+  uint8_t windowCount;
+  TimeSyncSample history[TIME_SYNC_HISTORY];
+  uint8_t historyCount;
+  uint8_t historyNext;
+
+  bool valid;
+  uint32_t baseLocalUs; // Offset is extrapolated from here
+  int32_t baseOffsetUs;
+  int32_t driftPpb;     // How much faster the remote clock runs, parts per billion
+  uint32_t errorUs;     // Fit residual and rtt/2 together (rms), or rtt/2 before there is a fit
+};
+
+static inline void TimeSyncInit(TimeSync *ts) {
+  ts->windowCount = 0;
+  ts->historyCount = 0;
+  ts->historyNext = 0;
+  ts->valid = false;
+  ts->driftPpb = 0;
+  ts->errorUs = 0;
+}
+
+// Remote - local offset, extrapolated to localUs
+static inline int32_t TimeSyncOffsetAt(const TimeSync *ts, uint32_t localUs) {
+  int32_t elapsed = (int32_t)(localUs - ts->baseLocalUs);
+  return ts->baseOffsetUs + (int32_t)((int64_t)ts->driftPpb * elapsed / 1000000000);
+}
+
+static inline void TimeSyncFit(TimeSync *ts) {
+  const TimeSyncSample *newest = &ts->history[(ts->historyNext + TIME_SYNC_HISTORY - 1) % TIME_SYNC_HISTORY];
+  double sw = 0, st = 0, so = 0;
+  for (uint8_t i = 0; i < ts->historyCount; i++) {
+    const TimeSyncSample *s = &ts->history[i];
+    double rtt = s->rttUs < TIME_SYNC_MIN_RTT_US ? TIME_SYNC_MIN_RTT_US : s->rttUs;
+    double w = 1.0 / (rtt * rtt);
+    sw += w;
+    st += w * (int32_t)(s->localUs - newest->localUs);
+    so += w * (s->offsetUs - newest->offsetUs);
+  }
+  double meanT = st / sw;
+  double meanO = so / sw;
+  double stt = 0, sto = 0;
+  for (uint8_t i = 0; i < ts->historyCount; i++) {
+    const TimeSyncSample *s = &ts->history[i];
+    double rtt = s->rttUs < TIME_SYNC_MIN_RTT_US ? TIME_SYNC_MIN_RTT_US : s->rttUs;
+    double w = 1.0 / (rtt * rtt);
+    double dt = (int32_t)(s->localUs - newest->localUs) - meanT;
+    double dofs = (s->offsetUs - newest->offsetUs) - meanO;
+    stt += w * dt * dt;
+    sto += w * dt * dofs;
+  }
+  double slope = (ts->historyCount >= 3 && stt > 0) ? sto / stt : 0;
+
+  // Line through the weighted mean, evaluated at the newest sample
+  ts->baseLocalUs = newest->localUs;
+  ts->baseOffsetUs = newest->offsetUs + (int32_t)(meanO - slope * meanT);
+  ts->driftPpb = (int32_t)(slope * 1e9);
+
+  if (ts->historyCount >= 3) {
+    // Scatter about the line, plus what the fit can't see: every sample's
+    // offset can be off by up to rtt/2 the same way (one side slower than the
+    // other), so that's there on top however well the line fits
+    double sr = 0, sh = 0;
+    for (uint8_t i = 0; i < ts->historyCount; i++) {
+      const TimeSyncSample *s = &ts->history[i];
+      double rtt = s->rttUs < TIME_SYNC_MIN_RTT_US ? TIME_SYNC_MIN_RTT_US : s->rttUs;
+      double w = 1.0 / (rtt * rtt);
+      double r = s->offsetUs - TimeSyncOffsetAt(ts, s->localUs);
+      sr += w * r * r;
+      sh += w * rtt / 2;
+    }
+    double half = sh / sw;
+    ts->errorUs = (uint32_t)sqrt(sr / sw + half * half);
+  } else {
+    ts->errorUs = newest->rttUs / 2;
+  }
+}
+
+// t1, t4 = local (requester) clock, t2, t3 = remote clock.
+// Returns true when the estimate was updated.
+static inline bool TimeSyncAddSample(TimeSync *ts, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) {
+  int32_t there = (int32_t)(t2 - t1);
+  int32_t back = (int32_t)(t3 - t4);
+  int32_t rtt = (int32_t)(t4 - t1) - (int32_t)(t3 - t2);
+  if (rtt < 0) {
+    // Stale or mangled reply
+    return false;
+  }
+
+  TimeSyncSample s;
+  s.localUs = t4;
+  s.offsetUs = (int32_t)(((int64_t)there + back) / 2);
+  s.rttUs = (uint32_t)rtt;
+
+  if (!ts->valid) {
+    // Something rough to go on until the first window fills up
+    ts->valid = true;
+    ts->baseLocalUs = s.localUs;
+    ts->baseOffsetUs = s.offsetUs;
+    ts->errorUs = s.rttUs / 2;
+  }
+
+  ts->window[ts->windowCount++] = s;
+  if (ts->windowCount < TIME_SYNC_WINDOW) {
+    return false;
+  }
+  ts->windowCount = 0;
+
+  const TimeSyncSample *best = &ts->window[0];
+  for (uint8_t i = 1; i < TIME_SYNC_WINDOW; i++) {
+    if (ts->window[i].rttUs < best->rttUs) {
+      best = &ts->window[i];
+    }
+  }
+  ts->history[ts->historyNext] = *best;
+  ts->historyNext = (ts->historyNext + 1) % TIME_SYNC_HISTORY;
+  if (ts->historyCount < TIME_SYNC_HISTORY) {
+    ts->historyCount++;
+  }
+
+  TimeSyncFit(ts);
+  return true;
+}
+
+// Converts a remote timestamp (e.g. camera capture time) to local micros()
+static inline uint32_t TimeSyncRemoteToLocal(const TimeSync *ts, uint32_t remoteUs) {
+  // First guess ignoring drift, then use the offset at that time
+  uint32_t localUs = remoteUs - (uint32_t)ts->baseOffsetUs;
+  return remoteUs - (uint32_t)TimeSyncOffsetAt(ts, localUs);
+}
+
+static inline uint32_t TimeSyncLocalToRemote(const TimeSync *ts, uint32_t localUs) {
+  return localUs + (uint32_t)TimeSyncOffsetAt(ts, localUs);
+}
+
+static inline uint32_t TimeSyncErrorUs(const TimeSync *ts) {
+  return ts->errorUs;
+}